@@ -473,7 +473,7 @@ void Cheats::AutoStrafe(int slot, void *player, CUserCmd *cmd) {
 
 	if (cmd->forwardmove == 0 && cmd->sidemove == 0) return;
 
-	auto m_MoveType = SE(player)->field<char>("m_MoveType");
+	auto m_MoveType = SE(player)->field<char>(ENT_FIELD("m_MoveType"));
 
 	if (m_MoveType == MOVETYPE_NOCLIP) return;
 
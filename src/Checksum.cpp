@@ -1,10 +1,15 @@
 #include "Checksum.hpp"
 
 #include "Utils.hpp"
+#include "Command.hpp"
 #include "Event.hpp"
+#include "Modules/Console.hpp"
 #include "Modules/Engine.hpp"
 #include "Modules/FileSystem.hpp"
+#include "Utils/CpuFeatures.hpp"
 #include "Utils/ed25519/ed25519.h"
+#include "Utils/ed25519/sha512.h"
+#include "Variable.hpp"
 #include "Version.hpp"
 
 #include <cstdint>
@@ -12,11 +17,28 @@
 #include <cstdlib>
 #include <cstring>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
 #include <string>
 #include <thread>
 #include <map>
 #include <filesystem>
 #include <mutex>
+#include <random>
+#include <sys/stat.h>
+#include <vector>
+#include <emmintrin.h>
+#include <wmmintrin.h>
+
+#ifdef _WIN32
+#	define PCLMUL_TARGET
+#else
+#	define PCLMUL_TARGET __attribute__((target("sse2,pclmul")))
+#endif
+
+// Files are read in chunks of this size rather than all at once
+#define CHECKSUM_BUF_SIZE (64 * 1024)
 
 #define WRITE_LE32(x)          \
 	(uint8_t)(x & 0xFF),          \
@@ -96,51 +118,143 @@ static const uint32_t crcTable[256] = {
 };
 // clang-format on
 
-static uint32_t crc32(const char *buf, size_t len) {
-	uint32_t sum = 0xFFFFFFFF;
-
-	// Unrolled loop
+// CRC32 backends {{{
 
-	size_t i;
+// Each backend takes and returns the raw (non-inverted) register, and all
+// of them produce identical results; they only differ in speed.
 
-	for (i = 0; i + 10 < len; i += 10) {
-		uint8_t lookupIdx0 = (sum ^ buf[i+0]) & 0xFF;
-		sum = (sum >> 8) ^ crcTable[lookupIdx0];
+static uint32_t crc32Bytewise(uint32_t sum, const uint8_t *buf, size_t len) {
+	for (size_t i = 0; i < len; ++i) {
+		sum = (sum >> 8) ^ crcTable[(sum ^ buf[i]) & 0xFF];
+	}
+	return sum;
+}
 
-		uint8_t lookupIdx1 = (sum ^ buf[i+1]) & 0xFF;
-		sum = (sum >> 8) ^ crcTable[lookupIdx1];
+// crcSliceTable[k][b] is the CRC of byte b followed by k zero bytes, so
+// eight table lookups advance the register by eight bytes at once
+static uint32_t crcSliceTable[8][256];
 
-		uint8_t lookupIdx2 = (sum ^ buf[i+2]) & 0xFF;
-		sum = (sum >> 8) ^ crcTable[lookupIdx2];
+static void initCrcSliceTable() {
+	for (int i = 0; i < 256; ++i) {
+		crcSliceTable[0][i] = crcTable[i];
+	}
+	for (int k = 1; k < 8; ++k) {
+		for (int i = 0; i < 256; ++i) {
+			uint32_t prev = crcSliceTable[k - 1][i];
+			crcSliceTable[k][i] = (prev >> 8) ^ crcTable[prev & 0xFF];
+		}
+	}
+}
 
-		uint8_t lookupIdx3 = (sum ^ buf[i+3]) & 0xFF;
-		sum = (sum >> 8) ^ crcTable[lookupIdx3];
+static uint32_t crc32Slice8(uint32_t sum, const uint8_t *buf, size_t len) {
+	for (; len >= 8; buf += 8, len -= 8) {
+		uint32_t lo = READ_LE32(buf, 0) ^ sum;
+		uint32_t hi = READ_LE32(buf, 4);
+		sum = crcSliceTable[7][lo & 0xFF] ^
+			crcSliceTable[6][(lo >> 8) & 0xFF] ^
+			crcSliceTable[5][(lo >> 16) & 0xFF] ^
+			crcSliceTable[4][lo >> 24] ^
+			crcSliceTable[3][hi & 0xFF] ^
+			crcSliceTable[2][(hi >> 8) & 0xFF] ^
+			crcSliceTable[1][(hi >> 16) & 0xFF] ^
+			crcSliceTable[0][hi >> 24];
+	}
+	return crc32Bytewise(sum, buf, len);
+}
 
-		uint8_t lookupIdx4 = (sum ^ buf[i+4]) & 0xFF;
-		sum = (sum >> 8) ^ crcTable[lookupIdx4];
+// Carry-less multiply folding, following Intel's "Fast CRC Computation
+// for Generic Polynomials Using PCLMULQDQ Instruction". The constants are
+// the bit-reflected fold and Barrett constants for the CRC32 polynomial.
+PCLMUL_TARGET static uint32_t crc32Pclmul(uint32_t sum, const uint8_t *buf, size_t len) {
+	if (len < 64) return crc32Slice8(sum, buf, len);
+
+	alignas(16) static const uint64_t k1k2[] = {0x0154442bd4, 0x01c6e41596};
+	alignas(16) static const uint64_t k3k4[] = {0x01751997d0, 0x00ccaa009e};
+	alignas(16) static const uint64_t k5k0[] = {0x0163cd6124, 0x0000000000};
+	alignas(16) static const uint64_t poly[] = {0x01db710641, 0x01f7011641};
+
+	size_t tail = len & 15;
+	len -= tail;
+
+	__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+	x1 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+	x2 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+	x3 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+	x4 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(sum));
+	x0 = _mm_load_si128((const __m128i *)k1k2);
+	buf += 64;
+	len -= 64;
+
+	// Fold four 128-bit lanes in parallel
+	for (; len >= 64; buf += 64, len -= 64) {
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i *)(buf + 0x00)));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i *)(buf + 0x10)));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i *)(buf + 0x20)));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i *)(buf + 0x30)));
+	}
 
-		uint8_t lookupIdx5 = (sum ^ buf[i+5]) & 0xFF;
-		sum = (sum >> 8) ^ crcTable[lookupIdx5];
+	// Fold the lanes into one
+	x0 = _mm_load_si128((const __m128i *)k3k4);
+	__m128i lanes[] = {x2, x3, x4};
+	for (auto lane : lanes) {
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, lane), x5);
+	}
 
-		uint8_t lookupIdx6 = (sum ^ buf[i+6]) & 0xFF;
-		sum = (sum >> 8) ^ crcTable[lookupIdx6];
+	// Fold in any remaining 16-byte blocks
+	for (; len >= 16; buf += 16, len -= 16) {
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i *)buf)), x5);
+	}
 
-		uint8_t lookupIdx7 = (sum ^ buf[i+7]) & 0xFF;
-		sum = (sum >> 8) ^ crcTable[lookupIdx7];
+	// Reduce 128 bits to 64
+	x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+	x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+	x0 = _mm_loadl_epi64((const __m128i *)k5k0);
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, x3);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	// Barrett reduction to 32 bits
+	x0 = _mm_load_si128((const __m128i *)poly);
+	x2 = _mm_and_si128(x1, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+	x2 = _mm_and_si128(x2, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	sum = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+	return crc32Slice8(sum, buf, tail);
+}
 
-		uint8_t lookupIdx8 = (sum ^ buf[i+8]) & 0xFF;
-		sum = (sum >> 8) ^ crcTable[lookupIdx8];
+static uint32_t (*selectCrc32Backend())(uint32_t, const uint8_t *, size_t) {
+	initCrcSliceTable();
+	auto &cpu = GetCpuFeatures();
+	return cpu.pclmul && cpu.sse2 ? crc32Pclmul : crc32Slice8;
+}
 
-		uint8_t lookupIdx9 = (sum ^ buf[i+9]) & 0xFF;
-		sum = (sum >> 8) ^ crcTable[lookupIdx9];
-	}
+// Picked during static initialization, before any checksums are taken
+static uint32_t (*g_crc32Backend)(uint32_t, const uint8_t *, size_t) = selectCrc32Backend();
 
-	for (; i < len; ++i) {
-		uint8_t lookupIdx = (sum ^ buf[i]) & 0xFF;
-		sum = (sum >> 8) ^ crcTable[lookupIdx];
-	}
+// }}}
 
-	return ~sum;
+// Continues the checksum crc over buf; pass 0 to start a new one
+static uint32_t crc32(uint32_t crc, const char *buf, size_t len) {
+	return ~g_crc32Backend(~crc, (const uint8_t *)buf, len);
 }
 
 static bool fileChecksum(FILE *fp, size_t ignoreEnd, uint32_t *crcOut) {
@@ -151,17 +265,17 @@ static bool fileChecksum(FILE *fp, size_t ignoreEnd, uint32_t *crcOut) {
 
 	if (fseek(fp, 0, SEEK_SET)) return false;
 
-	char *buf = (char *)malloc(size);
+	char buf[CHECKSUM_BUF_SIZE];
+	uint32_t crc = 0;
 
-	fread(buf, 1, size, fp);
-	if (ferror(fp)) {
-		free(buf);
-		return false;
+	while (size > 0) {
+		size_t chunk = std::min((size_t)size, sizeof buf);
+		if (fread(buf, 1, chunk, fp) != chunk) return false;
+		crc = crc32(crc, buf, chunk);
+		size -= chunk;
 	}
 
-	*crcOut = crc32(buf, size);
-
-	free(buf);
+	*crcOut = crc;
 	return true;
 }
 
@@ -230,35 +344,160 @@ bool AddDemoChecksum(const char *filename) {
 	return true;
 }
 
-#define NUM_FILE_SUM_THREADS 1
+// Checksums are cached across launches keyed by path, so only new or
+// changed files get read. These sums go into demos as integrity data, so a
+// hit has to survive someone editing a file and restoring its mtime, or
+// editing the cache itself:
+//  - size, mtime, ctime and inode must all match; touch -r can't restore
+//    the ctime, and replacing the file changes the inode
+//  - a checksum of the first and last CHECKSUM_PROBE_SIZE bytes is taken
+//    again and compared. Files no bigger than the probe are simply hashed
+//    in full and never cached
+//  - the cache file is MACed with the demo signing key, which anyone able
+//    to forge this could already sign demos with
+#define CHECKSUM_CACHE_FILE "sar_checksums.txt"
+#define CHECKSUM_CACHE_HEADER "sar_checksums 2"
+#define CHECKSUM_PROBE_SIZE (64 * 1024)
+
+static Variable sar_checksum_threads("sar_checksum_threads", "0", 0, 32, "How many threads to checksum game files on; 0 = one per CPU core. Takes effect the next time checksums are calculated\n");
+
+struct FileSumCacheEntry {
+	uint64_t size;
+	int64_t mtime;
+	int64_t ctime;
+	uint64_t inode;
+	uint32_t probe;
+	uint32_t sum;
+};
+
+struct FileSumStats {
+	int files;
+	int hits;
+	int hashed;
+	int stale;
+	int removed;
+	int threads;
+	bool rejected;  // the cache file failed its MAC
+	int64_t walkUs;
+	int64_t hashUs;
+};
 
-static std::thread g_sumthreads[NUM_FILE_SUM_THREADS];
-static std::map<std::string, uint32_t> g_filesums[NUM_FILE_SUM_THREADS];
+static std::thread g_sumthread;
+static std::map<std::string, uint32_t> g_filesums;
+static FileSumStats g_sumStats;
+static std::atomic<bool> g_sumsReady;
 
 ON_EVENT(SAR_UNLOAD) {
-	for (size_t i = 0; i < NUM_FILE_SUM_THREADS; ++i) {
-		if (g_sumthreads[i].joinable()) g_sumthreads[i].detach();
+	if (g_sumthread.joinable()) g_sumthread.detach();
+}
+
+// HMAC-SHA512 of the cache contents
+static std::string fileSumCacheMac(const std::string &data) {
+	unsigned char key[64] = SAR_DEMO_SIGN_PRIVKEY;
+	unsigned char ipad[128], opad[128];
+	for (size_t i = 0; i < sizeof ipad; ++i) {
+		unsigned char k = i < sizeof key ? key[i] : 0;
+		ipad[i] = k ^ 0x36;
+		opad[i] = k ^ 0x5C;
 	}
+
+	unsigned char inner[64], mac[64];
+	sha512_context ctx;
+	sha512_init(&ctx);
+	sha512_update(&ctx, ipad, sizeof ipad);
+	sha512_update(&ctx, (const unsigned char *)data.data(), data.size());
+	sha512_final(&ctx, inner);
+	sha512_init(&ctx);
+	sha512_update(&ctx, opad, sizeof opad);
+	sha512_update(&ctx, inner, sizeof inner);
+	sha512_final(&ctx, mac);
+
+	std::string hex;
+	for (auto b : mac) hex += Utils::ssprintf("%02x", b);
+	return hex;
+}
+
+// Checksum of the first and last CHECKSUM_PROBE_SIZE bytes of a file that's
+// bigger than both together
+static bool probeChecksum(const char *path, uint64_t size, uint32_t *out) {
+	FILE *fp = fopen(path, "rb");
+	if (!fp) return false;
+
+	char buf[CHECKSUM_PROBE_SIZE];
+	uint32_t crc = 0;
+	bool ok = fread(buf, 1, sizeof buf, fp) == sizeof buf;
+	if (ok) crc = crc32(crc, buf, sizeof buf);
+	ok = ok && !fseek(fp, (long)(size - sizeof buf), SEEK_SET) && fread(buf, 1, sizeof buf, fp) == sizeof buf;
+	if (ok) crc = crc32(crc, buf, sizeof buf);
+	fclose(fp);
+
+	*out = crc;
+	return ok;
 }
 
-static void calcFileSums(std::map<std::string, uint32_t> *out, std::vector<std::string> paths) {
-	for (auto &path : paths) {
-		uint32_t sum = 0; // if error, just use 0
+static std::map<std::string, FileSumCacheEntry> loadFileSumCache(bool *rejected) {
+	std::map<std::string, FileSumCacheEntry> cache;
+	*rejected = false;
+
+	std::ifstream file(CHECKSUM_CACHE_FILE, std::ios::binary);
+	if (!file.good()) return cache;
+	std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+	// The last line is mac<TAB>hex, over everything before it
+	auto macLine = data.rfind("\nmac\t");
+	if (data.compare(0, strlen(CHECKSUM_CACHE_HEADER "\n"), CHECKSUM_CACHE_HEADER "\n") || macLine == std::string::npos) {
+		*rejected = true;
+		return cache;
+	}
+	std::string body = data.substr(0, macLine + 1);
+	std::string mac = data.substr(macLine + 5);
+	while (!mac.empty() && (mac.back() == '\n' || mac.back() == '\r')) mac.pop_back();
+	if (mac != fileSumCacheMac(body)) {
+		*rejected = true;
+		return cache;
+	}
 
-		FILE *fp = fopen(path.c_str(), "rb");  // Open for binary reading
-		if (fp) {
-			fileChecksum(fp, 0, &sum);
-			fclose(fp);
+	// path<TAB>size<TAB>mtime<TAB>ctime<TAB>inode<TAB>probe<TAB>sum
+	size_t pos = strlen(CHECKSUM_CACHE_HEADER "\n");
+	while (pos < body.size()) {
+		auto end = body.find('\n', pos);
+		std::string line = body.substr(pos, end - pos);
+		pos = end + 1;
+
+		size_t tabs[6];
+		size_t t = 0;
+		for (int i = 0; i < 6 && t != std::string::npos; ++i) {
+			t = line.find('\t', i ? tabs[i - 1] + 1 : 0);
+			tabs[i] = t;
 		}
+		if (t == std::string::npos) continue;
+
+		auto &entry = cache[line.substr(0, tabs[0])];
+		entry.size = std::strtoull(line.c_str() + tabs[0] + 1, nullptr, 10);
+		entry.mtime = std::strtoll(line.c_str() + tabs[1] + 1, nullptr, 10);
+		entry.ctime = std::strtoll(line.c_str() + tabs[2] + 1, nullptr, 10);
+		entry.inode = std::strtoull(line.c_str() + tabs[3] + 1, nullptr, 10);
+		entry.probe = std::strtoul(line.c_str() + tabs[4] + 1, nullptr, 16);
+		entry.sum = std::strtoul(line.c_str() + tabs[5] + 1, nullptr, 16);
+	}
+
+	return cache;
+}
 
-		(*out)[path] = sum;
+static void saveFileSumCache(const std::map<std::string, FileSumCacheEntry> &cache) {
+	std::string body = CHECKSUM_CACHE_HEADER "\n";
+	for (auto &[path, entry] : cache) {
+		body += Utils::ssprintf("%s\t%llu\t%lld\t%lld\t%llu\t%08X\t%08X\n", path.c_str(), (unsigned long long)entry.size, (long long)entry.mtime, (long long)entry.ctime, (unsigned long long)entry.inode, entry.probe, entry.sum);
 	}
+
+	std::ofstream file(CHECKSUM_CACHE_FILE, std::ios::out | std::ios::trunc | std::ios::binary);
+	if (!file.good()) return;
+	file << body << "mac\t" << fileSumCacheMac(body) << '\n';
 }
 
-static void initFileSums() {
+static std::vector<std::string> findSummedFiles(const std::vector<std::string> &searchpaths) {
 	std::vector<std::string> paths;
 	try {
-		auto searchpaths = fileSystem->GetSearchPaths();
 		for (auto searchpath : searchpaths) {
 			auto iterator = std::filesystem::recursive_directory_iterator(searchpath, std::filesystem::directory_options::follow_directory_symlink);
 			for (auto &ent : iterator) {
@@ -290,13 +529,111 @@ static void initFileSums() {
 		}
 	} catch (...) {
 	}
+	return paths;
+}
+
+// Runs on g_sumthread; the search paths are fetched on the main thread
+// since the filesystem interface isn't ours to call from here
+static void calcFileSums(std::vector<std::string> searchpaths, bool useCache, int numThreads) {
+	FileSumStats stats{};
+
+	auto start = NOW_STEADY();
+	auto paths = findSummedFiles(searchpaths);
+	stats.walkUs = std::chrono::duration_cast<std::chrono::microseconds>(NOW_STEADY() - start).count();
+	stats.files = paths.size();
+
+	auto oldCache = useCache ? loadFileSumCache(&stats.rejected) : std::map<std::string, FileSumCacheEntry>{};
+	std::map<std::string, FileSumCacheEntry> newCache;
+
+	// Split everything into cache hits and files that need reading
+	std::vector<FileSumCacheEntry> entries(paths.size());
+	std::vector<bool> valid(paths.size(), false);
+	std::vector<size_t> toHash;
+	for (size_t i = 0; i < paths.size(); ++i) {
+		struct stat st;
+		if (stat(paths[i].c_str(), &st)) {
+			entries[i] = {};  // if error, just use 0
+			continue;
+		}
+		entries[i] = {(uint64_t)st.st_size, (int64_t)st.st_mtime, (int64_t)st.st_ctime, (uint64_t)st.st_ino, 0, 0};
+
+		// small files are cheaper to hash than to check
+		bool big = entries[i].size > 2 * CHECKSUM_PROBE_SIZE;
+		auto cached = big ? oldCache.find(paths[i]) : oldCache.end();
+		if (cached != oldCache.end()) {
+			auto &c = cached->second;
+			if (c.size == entries[i].size && c.mtime == entries[i].mtime && c.ctime == entries[i].ctime && c.inode == entries[i].inode && probeChecksum(paths[i].c_str(), entries[i].size, &entries[i].probe) && c.probe == entries[i].probe) {
+				entries[i].sum = c.sum;
+				valid[i] = true;
+				++stats.hits;
+				continue;
+			}
+			++stats.stale;
+		}
+		toHash.push_back(i);
+	}
+
+	start = NOW_STEADY();
+
+	if (numThreads <= 0) numThreads = std::thread::hardware_concurrency();
+	if (numThreads <= 0) numThreads = 1;
+	if ((size_t)numThreads > toHash.size()) numThreads = std::max<size_t>(toHash.size(), 1);
+	stats.threads = numThreads;
+
+	// valid is a vector<bool>, whose packed bits can't be written from
+	// several threads at once, so workers report into ok instead
+	std::vector<char> ok(paths.size());
+	std::atomic<size_t> next(0);
+	auto hashFiles = [&]() {
+		for (size_t n; (n = next++) < toHash.size();) {
+			size_t i = toHash[n];
+			FILE *fp = fopen(paths[i].c_str(), "rb");  // Open for binary reading
+			if (fp) {
+				ok[i] = fileChecksum(fp, 0, &entries[i].sum);
+				fclose(fp);
+			}
+			if (ok[i] && entries[i].size > 2 * CHECKSUM_PROBE_SIZE) {
+				ok[i] = probeChecksum(paths[i].c_str(), entries[i].size, &entries[i].probe);
+			}
+		}
+	};
+
+	std::vector<std::thread> pool;
+	for (int t = 1; t < numThreads; ++t) pool.emplace_back(hashFiles);
+	hashFiles();
+	for (auto &thrd : pool) thrd.join();
 
-	size_t idx = 0;
-	for (size_t i = 0; i < NUM_FILE_SUM_THREADS; ++i) {
-		size_t end = paths.size() * (i+1) / NUM_FILE_SUM_THREADS;
-		g_sumthreads[i] = std::thread(calcFileSums, &g_filesums[i], std::vector<std::string>(paths.begin() + idx, paths.begin() + end));
-		idx = end;
+	for (size_t i : toHash) {
+		if (ok[i]) valid[i] = true;
+		else entries[i].sum = 0;  // if error, just use 0
 	}
+
+	stats.hashed = toHash.size();
+	stats.hashUs = std::chrono::duration_cast<std::chrono::microseconds>(NOW_STEADY() - start).count();
+
+	std::map<std::string, uint32_t> sums;
+	for (size_t i = 0; i < paths.size(); ++i) {
+		sums[paths[i]] = entries[i].sum;
+		if (valid[i] && entries[i].size > 2 * CHECKSUM_PROBE_SIZE) newCache[paths[i]] = entries[i];
+	}
+
+	for (auto &[path, entry] : oldCache) {
+		if (!newCache.count(path)) ++stats.removed;
+	}
+
+	if (stats.stale > 0 || stats.removed > 0 || newCache.size() != (size_t)stats.hits || !useCache) {
+		saveFileSumCache(newCache);
+	}
+
+	g_filesums = std::move(sums);
+	g_sumStats = stats;
+	g_sumsReady.store(true);
+}
+
+static void initFileSums(bool useCache = true) {
+	if (g_sumthread.joinable()) g_sumthread.join();
+	g_sumsReady.store(false);
+	g_sumthread = std::thread(calcFileSums, fileSystem->GetSearchPaths(), useCache, sar_checksum_threads.GetInt());
 }
 
 static void addFileChecksum(const char *path, uint32_t sum) {
@@ -313,14 +650,10 @@ static void addFileChecksum(const char *path, uint32_t sum) {
 
 void AddDemoFileChecksums() {
 	// make sure all file sums are fully calculated first
-	for (auto &thrd : g_sumthreads) {
-		if (thrd.joinable()) thrd.join();
-	}
+	if (g_sumthread.joinable()) g_sumthread.join();
 
-	for (auto &sums : g_filesums) {
-		for (auto [path, sum] : sums) {
-			addFileChecksum(path.c_str(), sum);
-		}
+	for (auto [path, sum] : g_filesums) {
+		addFileChecksum(path.c_str(), sum);
 	}
 }
 
@@ -336,3 +669,81 @@ ON_INIT {
 
 	fclose(fp);
 }
+
+CON_COMMAND(sar_checksum_cache_stats, "sar_checksum_cache_stats - prints statistics about the game file checksum cache\n") {
+	if (!g_sumsReady.load()) {
+		return console->Print("File checksums are still being calculated\n");
+	}
+
+	auto &stats = g_sumStats;
+	console->Print("Cache file: %s%s\n", CHECKSUM_CACHE_FILE, stats.rejected ? " (failed verification, discarded)" : "");
+	console->Print("Files: %d\n", stats.files);
+	console->Print("Cache hits: %d\n", stats.hits);
+	console->Print("Hashed: %d (%d changed since cached)\n", stats.hashed, stats.stale);
+	console->Print("Removed from cache: %d\n", stats.removed);
+	console->Print("Threads: %d\n", stats.threads);
+	console->Print("Directory walk: %.2fms\n", stats.walkUs / 1000.0f);
+	console->Print("Hashing: %.2fms\n", stats.hashUs / 1000.0f);
+}
+
+CON_COMMAND(sar_checksum_cache_invalidate, "sar_checksum_cache_invalidate - discards the game file checksum cache and recalculates every checksum\n") {
+	if (engine->demorecorder->isRecordingDemo) {
+		return console->Print("Cannot recalculate checksums while recording a demo\n");
+	}
+
+	std::error_code ec;
+	std::filesystem::remove(CHECKSUM_CACHE_FILE, ec);
+	initFileSums(false);
+	console->Print("Recalculating file checksums\n");
+}
+
+CON_COMMAND(sar_checksum_selftest, "sar_checksum_selftest [megabytes] - checks every CRC32 backend against the bytewise one over random buffers and reports their throughput\n") {
+	if (args.ArgC() > 2) return console->Print(sar_checksum_selftest.ThisPtr()->m_pszHelpString);
+
+	int mb = args.ArgC() == 2 ? std::atoi(args[1]) : 64;
+	if (mb <= 0) return console->Print(sar_checksum_selftest.ThisPtr()->m_pszHelpString);
+
+	struct Backend {
+		const char *name;
+		uint32_t (*fn)(uint32_t, const uint8_t *, size_t);
+	};
+	std::vector<Backend> backends = {{"bytewise", crc32Bytewise}, {"slice-by-8", crc32Slice8}};
+	auto &cpu = GetCpuFeatures();
+	if (cpu.pclmul && cpu.sse2) {
+		backends.push_back({"pclmul", crc32Pclmul});
+	} else {
+		console->Print("pclmul: not supported on this CPU, skipped\n");
+	}
+
+	std::mt19937 rng(1234);
+	std::vector<uint8_t> buf((size_t)mb * 1024 * 1024 + 64);
+	for (auto &b : buf) b = (uint8_t)rng();
+
+	// around every block boundary the backends switch paths at, and at
+	// every alignment a 16-byte load can see
+	static const size_t lengths[] = {0, 1, 7, 8, 9, 15, 16, 17, 31, 63, 64, 65, 79, 127, 128, 129, 255, 1000, 4096, 4099, CHECKSUM_BUF_SIZE + 13};
+	int mismatches = 0, cases = 0;
+	for (size_t len : lengths) {
+		for (size_t align = 0; align < 16; ++align) {
+			size_t off = align + (rng() % (buf.size() - len - 16) & ~(size_t)15);
+			uint32_t seed = rng();
+			uint32_t expect = crc32Bytewise(seed, buf.data() + off, len);
+			for (auto &b : backends) {
+				if (b.fn(seed, buf.data() + off, len) != expect) {
+					if (mismatches++ < 10) console->Print("%s: mismatch at length %u, alignment %u\n", b.name, (unsigned)len, (unsigned)align);
+				}
+			}
+			++cases;
+		}
+	}
+	console->Print("%d buffers checked, %d mismatches\n", cases, mismatches);
+
+	for (auto &b : backends) {
+		auto start = std::chrono::steady_clock::now();
+		uint32_t sum = b.fn(~0u, buf.data() + 1, buf.size() - 64);
+		float secs = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+		console->Print("%s: %.0f MiB/s (%08X)\n", b.name, mb / std::max(secs, 1e-6f), ~sum);
+	}
+
+	console->Print("%s\n", mismatches ? "CRC32 self test FAILED" : "CRC32 self test passed");
+}
@@ -1,6 +1,16 @@
 #include "Entity.hpp"
+#include "Command.hpp"
+#include "Event.hpp"
+#include "Features/EntityList.hpp"
+#include "Features/Session.hpp"
 #include "Utils/Memory.hpp"
 #include "Modules/Console.hpp"
+#include "Modules/Server.hpp"
+#include "Offsets.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <vector>
 
 static inline EntField::Type translateSendType(SendPropType t) {
 #define C(a, b) case DPT_##a: return EntField::Type::b;
@@ -150,6 +160,50 @@ const std::pair<size_t, EntField::Type> &EntField::getClientOffset(void *ent, co
 	return g_client_offsets[class_name][std::string(field)];
 }
 
+unsigned EntField::g_handleGeneration = 1;
+unsigned EntField::g_handleCount = 0;
+
+// Per-class tables keyed by vtable, each indexed by handle id; an entry with
+// no vtable hasn't been resolved yet
+static std::unordered_map<void *, std::vector<EntField::Handle::Entry>> g_server_classes;
+static std::unordered_map<void *, std::vector<EntField::Handle::Entry>> g_client_classes;
+
+ON_EVENT(SESSION_START) {
+	++EntField::g_handleGeneration;
+	g_server_classes.clear();
+	g_client_classes.clear();
+}
+
+static const EntField::Handle::Entry &resolveHandle(void *ent, EntField::Handle &h, std::unordered_map<void *, std::vector<EntField::Handle::Entry>> &classes, const std::pair<size_t, EntField::Type> &(*getOffset)(void *, const char *)) {
+	void *vtable = *(void **)ent;
+
+	auto &table = classes[vtable];
+	if (table.size() <= h.id) table.resize(EntField::g_handleCount);
+	auto &entry = table[h.id];
+	if (!entry.vtable) {
+		auto &val = getOffset(ent, h.name.c_str());
+		entry = {vtable, val.first, val.second};
+	}
+
+	if (h.generation != EntField::g_handleGeneration) {
+		for (auto &e : h.cache) e.vtable = nullptr;
+		h.generation = EntField::g_handleGeneration;
+	}
+
+	auto &slot = h.cache[h.next];
+	h.next = (h.next + 1) % (sizeof h.cache / sizeof h.cache[0]);
+	slot = entry;
+	return slot;
+}
+
+const EntField::Handle::Entry &EntField::resolveServer(void *ent, EntField::Handle &h) {
+	return resolveHandle(ent, h, g_server_classes, &EntField::getServerOffset);
+}
+
+const EntField::Handle::Entry &EntField::resolveClient(void *ent, EntField::Handle &h) {
+	return resolveHandle(ent, h, g_client_classes, &EntField::getClientOffset);
+}
+
 static const char *g_type_names[] = {
 	"void",
 	"bool",
@@ -176,3 +230,88 @@ void EntField::warnBadFieldType(void *ent, const char *field, const char *expect
 		console->Print("ERROR: fetched %s field %s with incorrect type %s, should be %s!\n", server ? "server" : "client", field, expect_type, g_type_names[(int)actual_type]);
 	}
 }
+
+// Field access benchmark {{{
+
+// Not every class has all of these; a missing field resolves to the same
+// empty entry through both paths, so it still compares equal
+static const char *g_benchFields[] = {
+	"m_vecAbsOrigin",
+	"m_fFlags",
+	"m_iEFlags",
+	"m_iName",
+	"m_hGroundEntity",
+	"m_Collision",
+};
+static constexpr size_t NUM_BENCH_FIELDS = sizeof g_benchFields / sizeof g_benchFields[0];
+
+// Times `reads` reads spread over `ents`, moving to the next entity after
+// every field, through the name lookup every read used to do and through
+// handles. Returns nanoseconds per read for each
+static std::pair<double, double> benchFieldReads(const std::vector<ServerEnt *> &ents, std::vector<EntField::Handle> &handles, int reads) {
+	using clock = std::chrono::steady_clock;
+	volatile uintptr_t sink = 0;
+
+	auto start = clock::now();
+	for (int i = 0; i < reads; ++i) {
+		auto ent = ents[(i / NUM_BENCH_FIELDS) % ents.size()];
+		sink = sink + (uintptr_t)ent + EntField::getServerOffset(ent, g_benchFields[i % NUM_BENCH_FIELDS]).first;
+	}
+	auto mid = clock::now();
+	for (int i = 0; i < reads; ++i) {
+		auto ent = ents[(i / NUM_BENCH_FIELDS) % ents.size()];
+		sink = sink + (uintptr_t)&ent->fieldOff<char>(handles[i % NUM_BENCH_FIELDS], 0);
+	}
+	auto end = clock::now();
+
+	return {
+		std::chrono::duration<double, std::nano>(mid - start).count() / reads,
+		std::chrono::duration<double, std::nano>(end - mid).count() / reads,
+	};
+}
+
+CON_COMMAND(sar_entfield_bench, "sar_entfield_bench [reads] - times server entity field reads by name against reads through cached field handles\n") {
+	if (args.ArgC() > 2) return console->Print(sar_entfield_bench.ThisPtr()->m_pszHelpString);
+	int reads = args.ArgC() == 2 ? atoi(args[1]) : 1000000;
+	if (reads <= 0) return console->Print(sar_entfield_bench.ThisPtr()->m_pszHelpString);
+	if (!session->isRunning || !server->m_EntPtrArray) return console->Print("No entities to read!\n");
+
+	std::vector<ServerEnt *> ents;
+	for (int index = 0; index < Offsets::NUM_ENT_ENTRIES; ++index) {
+		auto info = entityList->GetEntityInfoByIndex(index);
+		if (info->m_pEntity) ents.push_back((ServerEnt *)info->m_pEntity);
+	}
+	auto player = server->GetPlayer(1);
+	if (!player || ents.empty()) return console->Print("No entities to read!\n");
+
+	// Interned once, like the static handles behind ENT_FIELD, so repeated
+	// runs don't keep growing the per-class tables
+	static std::vector<EntField::Handle> handles;
+	if (handles.empty()) {
+		for (auto name : g_benchFields) handles.emplace_back(name);
+	}
+
+	int mismatches = 0;
+	std::unordered_map<void *, bool> classes;
+	for (auto ent : ents) {
+		classes[*(void **)ent] = true;
+		for (size_t f = 0; f < NUM_BENCH_FIELDS; ++f) {
+			size_t byName = EntField::getServerOffset(ent, g_benchFields[f]).first;
+			size_t byHandle = (uintptr_t)&ent->fieldOff<char>(handles[f], 0) - (uintptr_t)ent;
+			if (byName != byHandle) {
+				if (++mismatches <= 10) console->Print("Mismatch: %s on %s: name %u, handle %u\n", g_benchFields[f], server->GetEntityClassName(ent), (unsigned)byName, (unsigned)byHandle);
+			}
+		}
+	}
+
+	console->Print("Checked %d fields on %d entities of %d classes: %d mismatches\n", (int)(ents.size() * NUM_BENCH_FIELDS), (int)ents.size(), (int)classes.size(), mismatches);
+
+	auto one = benchFieldReads({player}, handles, reads);
+	console->Print("player only: by name %.1f ns/read, handle %.1f ns/read (%.1fx)\n", one.first, one.second, one.first / one.second);
+	auto all = benchFieldReads(ents, handles, reads);
+	console->Print("all entities: by name %.1f ns/read, handle %.1f ns/read (%.1fx)\n", all.first, all.second, all.first / all.second);
+
+	console->Print(mismatches ? "Field handle self test FAILED\n" : "Field handle self test passed\n");
+}
+
+// }}}
@@ -56,6 +56,46 @@ namespace EntField {
 	const std::pair<size_t, Type> &getServerOffset(void *ent, const char *field);
 	const std::pair<size_t, Type> &getClientOffset(void *ent, const char *field);
 
+	// Bumped on map change to invalidate every handle
+	extern unsigned g_handleGeneration;
+
+	extern unsigned g_handleCount;
+
+	// A field name plus the offsets it resolved to for the last few entity
+	// classes it was read from. Classes are identified by their vtable, so a
+	// read through a handle that has seen the class is a few compares and a
+	// pointer add. Classes that fall out of the handle are found again in a
+	// per-class table indexed by the handle's id, so each (class, field) pair
+	// is only ever resolved by name once.
+	struct Handle {
+		struct Entry {
+			void *vtable;
+			size_t offset;
+			Type type;
+		};
+
+		std::string name;
+		unsigned id;
+		unsigned generation = 0;
+		unsigned next = 0;  // cache slot to replace on a miss
+		Entry cache[4] = {};
+
+		Handle(const char *name)
+			: name(name)
+			, id(g_handleCount++) {}
+		inline const Entry *Find(void *ent) const {
+			if (generation != g_handleGeneration) return nullptr;
+			void *vtable = *(void **)ent;
+			for (auto &e : cache) {
+				if (e.vtable == vtable) return &e;
+			}
+			return nullptr;
+		}
+	};
+
+	const Handle::Entry &resolveServer(void *ent, Handle &h);
+	const Handle::Entry &resolveClient(void *ent, Handle &h);
+
 	void warnBadFieldType(void *ent, const char *field, const char *expect_type, Type actual_type, bool server);
 
 	template <typename T>
@@ -72,22 +112,28 @@ namespace EntField {
 #define SE(e) (EntField::assertVoidEnt(e), (ServerEnt *)(e))
 #define CE(e) (EntField::assertVoidEnt(e), (ClientEnt *)(e))
 
+// A handle interned once at the call site, for reading a field by its name:
+//   ent->field<int>(ENT_FIELD("m_fFlags"))
+#define ENT_FIELD(name) ([]() -> EntField::Handle & { static EntField::Handle h(name); return h; }())
+
 // Helper macro for defining specific accessors for common fields
-#define FIELD(name, type, internal) type &name() { return this->field<type>(internal); }
+#define FIELD(name, type, internal) type &name() { return this->field<type>(ENT_FIELD(internal)); }
 
 struct ServerEnt {
 	// Ensure type is opaque
 	ServerEnt(const ServerEnt &) = delete;
 
-	template <typename T> T &field(const char *field) {
-		auto val = EntField::getServerOffset(this, field);
-		if (!EntField::matchFieldType<T>(val.second)) EntField::warnBadFieldType(this, field, typeid(T).name(), val.second, true);
-		return *(T *)((uintptr_t)this + val.first);
+	template <typename T> T &field(EntField::Handle &h) {
+		auto e = h.Find(this);
+		if (!e) e = &EntField::resolveServer(this, h);
+		if (!EntField::matchFieldType<T>(e->type)) EntField::warnBadFieldType(this, h.name.c_str(), typeid(T).name(), e->type, true);
+		return *(T *)((uintptr_t)this + e->offset);
 	}
 
-	template <typename T> T &fieldOff(const char *field, int off) {
-		auto val = EntField::getServerOffset(this, field);
-		return *(T *)((uintptr_t)this + val.first + off);
+	template <typename T> T &fieldOff(EntField::Handle &h, int off) {
+		auto e = h.Find(this);
+		if (!e) e = &EntField::resolveServer(this, h);
+		return *(T *)((uintptr_t)this + e->offset + off);
 	}
 
 	FIELD(portals_placed, int, "iNumPortalsPlaced")
@@ -114,15 +160,17 @@ struct ClientEnt {
 	// Ensure type is opaque
 	ClientEnt(const ClientEnt &) = delete;
 
-	template <typename T> T &field(const char *field) {
-		auto val = EntField::getClientOffset(this, field);
-		if (!EntField::matchFieldType<T>(val.second)) EntField::warnBadFieldType(this, field, typeid(T).name(), val.second, false);
-		return *(T *)((uintptr_t)this + val.first);
+	template <typename T> T &field(EntField::Handle &h) {
+		auto e = h.Find(this);
+		if (!e) e = &EntField::resolveClient(this, h);
+		if (!EntField::matchFieldType<T>(e->type)) EntField::warnBadFieldType(this, h.name.c_str(), typeid(T).name(), e->type, false);
+		return *(T *)((uintptr_t)this + e->offset);
 	}
 
-	template <typename T> T &fieldOff(const char *field, int off) {
-		auto val = EntField::getClientOffset(this, field);
-		return *(T *)((uintptr_t)this + val.first + off);
+	template <typename T> T &fieldOff(EntField::Handle &h, int off) {
+		auto e = h.Find(this);
+		if (!e) e = &EntField::resolveClient(this, h);
+		return *(T *)((uintptr_t)this + e->offset + off);
 	}
 
 	FIELD(abs_origin, Vector, "m_vecAbsOrigin")
@@ -1,5 +1,13 @@
 #include "Event.hpp"
 
+#include "Command.hpp"
+#include "Modules/Console.hpp"
+#include "Variable.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
 #include <map>
 
 SarInitHandler::SarInitHandler(std::function<void()> cb)
@@ -18,3 +26,228 @@ std::vector<SarInitHandler *> &SarInitHandler::GetHandlers() {
 	static std::vector<SarInitHandler *> handlers;
 	return handlers;
 }
+
+std::vector<void (*)()> &Event::_Finalizers() {
+	static std::vector<void (*)()> finalizers;
+	return finalizers;
+}
+
+void Event::Finalize() {
+	for (auto fn : Event::_Finalizers()) {
+		fn();
+	}
+}
+
+// Event profiler {{{
+
+static const char *g_eventNames[] = {
+	"SESSION_START",
+	"SESSION_END",
+	"SAR_UNLOAD",
+	"DEMO_START",
+	"DEMO_STOP",
+	"PRE_TICK",
+	"POST_TICK",
+	"CM_FLAGS",
+	"PROCESS_MOVEMENT",
+	"COOP_RESET_DONE",
+	"COOP_RESET_REMOTE",
+	"FRAME",
+	"ORANGE_READY",
+	"CONFIG_EXEC",
+	"RENDER",
+	"TAS_START",
+	"TAS_END",
+	"MAYBE_AUTOSUBMIT",
+	"CFG_MESSAGE",
+	"SPEEDRUN_FINISH",
+	"RENDERER_START",
+	"RENDERER_FINISH",
+	"STUCK",
+	"BENCH",
+};
+static_assert(sizeof g_eventNames / sizeof g_eventNames[0] == Event::BENCH + 1, "g_eventNames is missing events");
+
+// Bucket 0 is under 1us, bucket n is [2^(n-1), 2^n) us, and the last one
+// is everything slower
+#define EVENT_PROFILE_BUCKETS 16
+
+struct EventProfile {
+	Event::EventType type;
+	const char *file;
+	int line;
+	uint64_t calls;
+	uint64_t total_ns;
+	uint64_t max_ns;
+	uint64_t hist[EVENT_PROFILE_BUCKETS];
+};
+
+static std::vector<EventProfile> &profiles() {
+	static std::vector<EventProfile> profiles;
+	return profiles;
+}
+
+bool Event::_g_profiling = false;
+
+Variable sar_event_profile("sar_event_profile", "0", "Record how long every event callback takes. See sar_event_profile_dump.\n", FCVAR_DONTRECORD, [](void *, const char *, float) {
+	Event::_g_profiling = sar_event_profile.GetBool();
+});
+
+size_t Event::_ProfileRegister(EventType type, const char *file, int line) {
+	EventProfile p{};
+	p.type = type;
+	p.file = file ? file : "?";
+	p.line = line;
+	profiles().push_back(p);
+	return profiles().size() - 1;
+}
+
+void Event::_ProfileRecord(size_t id, std::chrono::steady_clock::duration time) {
+	auto &p = profiles()[id];
+	uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(time).count();
+
+	p.calls += 1;
+	p.total_ns += ns;
+	if (ns > p.max_ns) p.max_ns = ns;
+
+	int bucket = 0;
+	for (uint64_t us = ns / 1000; us > 0 && bucket < EVENT_PROFILE_BUCKETS - 1; us >>= 1) ++bucket;
+	p.hist[bucket] += 1;
+}
+
+// Upper bound of the bucket containing the given fraction of calls
+static float profilePercentile(const EventProfile &p, float frac) {
+	uint64_t target = (uint64_t)ceilf(p.calls * frac);
+	uint64_t seen = 0;
+	for (int i = 0; i < EVENT_PROFILE_BUCKETS - 1; ++i) {
+		seen += p.hist[i];
+		if (seen >= target) return (float)(1 << i);
+	}
+	return p.max_ns / 1000.0f;
+}
+
+static const char *shortPath(const char *path) {
+	const char *src = strstr(path, "src/");
+	if (!src) src = strstr(path, "src\\");
+	return src ? src + 4 : path;
+}
+
+CON_COMMAND(sar_event_profile_dump, "sar_event_profile_dump [count] - print the event callbacks which took the most time while sar_event_profile was enabled\n") {
+	if (args.ArgC() > 2) {
+		return console->Print(sar_event_profile_dump.ThisPtr()->m_pszHelpString);
+	}
+
+	size_t count = args.ArgC() == 2 ? std::atoi(args[1]) : 20;
+
+	std::vector<const EventProfile *> sorted;
+	for (auto &p : profiles()) {
+		if (p.calls > 0) sorted.push_back(&p);
+	}
+
+	if (sorted.empty()) {
+		return console->Print("No event callbacks profiled. Set sar_event_profile 1 to start.\n");
+	}
+
+	std::sort(sorted.begin(), sorted.end(), [](const EventProfile *a, const EventProfile *b) {
+		return a->total_ns > b->total_ns;
+	});
+	if (count > 0 && sorted.size() > count) sorted.resize(count);
+
+	console->Print("%-18s %-40s %10s %10s %9s %9s %9s %9s\n", "event", "source", "calls", "total ms", "avg us", "max us", "p50 us", "p99 us");
+	for (auto p : sorted) {
+		char source[256];
+		snprintf(source, sizeof source, "%s:%d", shortPath(p->file), p->line);
+		console->Print("%-18s %-40s %10llu %10.2f %9.1f %9.1f %9.0f %9.0f\n",
+			g_eventNames[p->type],
+			source,
+			(unsigned long long)p->calls,
+			p->total_ns / 1e6,
+			p->total_ns / 1e3 / p->calls,
+			p->max_ns / 1e3,
+			profilePercentile(*p, 0.5f),
+			profilePercentile(*p, 0.99f));
+	}
+}
+
+CON_COMMAND(sar_event_profile_reset, "sar_event_profile_reset - clear the recorded event callback timings\n") {
+	for (auto &p : profiles()) {
+		p.calls = 0;
+		p.total_ns = 0;
+		p.max_ns = 0;
+		memset(p.hist, 0, sizeof p.hist);
+	}
+}
+
+// }}}
+
+// Trigger benchmark {{{
+
+static uint64_t g_benchCalls;
+
+static void benchHandler(Event::EventData<Event::BENCH>) {
+	++g_benchCalls;
+}
+
+CON_COMMAND(sar_event_bench, "sar_event_bench [triggers] - times triggering an event with 10, 50 and 200 dummy handlers\n") {
+	if (args.ArgC() > 2) {
+		return console->Print(sar_event_bench.ThisPtr()->m_pszHelpString);
+	}
+
+	int triggers = args.ArgC() == 2 ? std::atoi(args[1]) : 100000;
+	if (triggers <= 0) {
+		return console->Print(sar_event_bench.ThisPtr()->m_pszHelpString);
+	}
+
+	// Handlers share one profiler entry, which shows up in
+	// sar_event_profile_dump as BENCH
+	static size_t profileId = Event::_ProfileRegister(Event::BENCH, __FILE__, __LINE__);
+	auto &table = Event::_g_eventTable<Event::BENCH>;
+	bool profiling = Event::_g_profiling;
+	bool ok = true;
+
+	struct Mode {
+		const char *name;
+		bool callback;  // registered as a std::function rather than ON_EVENT's plain function
+		bool profiled;
+	};
+	static const Mode modes[] = {
+		{"function", false, false},
+		{"std::function", true, false},
+		{"function, profiled", false, true},
+	};
+
+	for (int handlers : {10, 50, 200}) {
+		for (auto &mode : modes) {
+			table.regs.clear();
+			for (int i = 0; i < handlers; ++i) {
+				if (mode.callback) {
+					table.regs.push_back({nullptr, [](Event::EventData<Event::BENCH>) { ++g_benchCalls; }, 0, nullptr, profileId});
+				} else {
+					table.regs.push_back({&benchHandler, nullptr, 0, nullptr, profileId});
+				}
+			}
+			table.dirty = true;
+
+			Event::_g_profiling = mode.profiled;
+			g_benchCalls = 0;
+			Event::Trigger<Event::BENCH>({});  // rebuilds the table outside the timing
+
+			auto start = std::chrono::steady_clock::now();
+			for (int i = 0; i < triggers; ++i) {
+				Event::Trigger<Event::BENCH>({});
+			}
+			float ns = std::chrono::duration<float, std::nano>(std::chrono::steady_clock::now() - start).count() / triggers;
+
+			ok &= g_benchCalls == (uint64_t)handlers * (triggers + 1);
+			console->Print("%3d handlers, %-20s %9.1f ns/trigger %6.2f ns/handler\n", handlers, mode.name, ns, ns / handlers);
+		}
+	}
+
+	Event::_g_profiling = profiling;
+	table.regs.clear();
+	table.dirty = true;
+
+	if (!ok) console->Print("Some handlers weren't called the expected number of times\n");
+}
+
+// }}}
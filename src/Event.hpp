@@ -1,8 +1,11 @@
 #pragma once
 
 #include "Utils.hpp"  // technically only Utils/SDK/GameMovement.hpp needed
+#include "Variable.hpp"
 
+#include <chrono>
 #include <functional>
+#include <list>
 #include <string>
 
 #define _ON_INIT1(x)                                    \
@@ -12,13 +15,15 @@
 #define _ON_INIT(x) _ON_INIT1(x)
 #define ON_INIT _ON_INIT(__COUNTER__)
 
-#define _ON_EVENT1(ev, x, pri)                                            \
-	static void _sar_event_fn_##x(Event::EventData<Event::ev> event);        \
-	ON_INIT { Event::RegisterCallback<Event::ev>(&_sar_event_fn_##x, pri); } \
+#define _ON_EVENT1(ev, x, pri, gate)                                                                \
+	static void _sar_event_fn_##x(Event::EventData<Event::ev> event);                                  \
+	ON_INIT { Event::RegisterHandler<Event::ev>(&_sar_event_fn_##x, pri, gate, __FILE__, __LINE__); } \
 	static void _sar_event_fn_##x(Event::EventData<Event::ev> event)
-#define _ON_EVENT(ev, x, pri) _ON_EVENT1(ev, x, pri)
-#define ON_EVENT(ev) _ON_EVENT(ev, __COUNTER__, 0)
-#define ON_EVENT_P(ev, pri) _ON_EVENT(ev, __COUNTER__, pri)
+#define _ON_EVENT(ev, x, pri, gate) _ON_EVENT1(ev, x, pri, gate)
+#define ON_EVENT(ev) _ON_EVENT(ev, __COUNTER__, 0, nullptr)
+#define ON_EVENT_P(ev, pri) _ON_EVENT(ev, __COUNTER__, pri, nullptr)
+// Only called while the given cvar is enabled
+#define ON_EVENT_IF(ev, cvar) _ON_EVENT(ev, __COUNTER__, 0, &cvar)
 
 class SarInitHandler {
 public:
@@ -30,6 +35,7 @@ public:
 };
 
 namespace Event {
+	// Keep g_eventNames in Event.cpp in sync with this
 	enum EventType {
 		SESSION_START,
 		SESSION_END,
@@ -54,6 +60,9 @@ namespace Event {
 		RENDERER_START,
 		RENDERER_FINISH,
 		STUCK,
+		// Never triggered by the game; only sar_event_bench's dummy handlers
+		// are registered on it
+		BENCH,
 	};
 
 	template <EventType E>
@@ -105,34 +114,128 @@ namespace Event {
 		std::string message;
 	};
 
+	// Per-callback timings, enabled by sar_event_profile
+	extern bool _g_profiling;
+	size_t _ProfileRegister(EventType type, const char *file, int line);
+	void _ProfileRecord(size_t id, std::chrono::steady_clock::duration time);
+
 	template <EventType E>
 	struct _EventReg {
-		std::function<void(EventData<E>)> cb;
+		void (*fn)(EventData<E>);                // set for ON_EVENT handlers
+		std::function<void(EventData<E>)> cb;    // set otherwise
 		int32_t priority;
+		Variable *gate;
+		size_t profileId;
+	};
+
+	// What Trigger actually walks: a flat array built from the registrations
+	// once they're all in. ON_EVENT handlers are called straight through fn;
+	// only std::function registrations go through the thunk.
+	template <EventType E>
+	struct _EventHandler {
+		void (*fn)(EventData<E>);
+		void (*thunk)(void *user, const EventData<E> &data);
+		void *user;
+		Variable *gate;
+		size_t profileId;
+	};
+
+	template <EventType E>
+	struct _EventTable {
+		std::list<_EventReg<E>> regs; // in priority order; a list so handlers can point at cb
+		std::vector<_EventHandler<E>> handlers;
+		bool dirty = false;
+		int depth = 0; // nested Triggers in progress; handlers isn't rebuilt while nonzero
 	};
 
 	template <EventType E>
-	std::vector<_EventReg<E>> _g_eventCallbacks;
+	_EventTable<E> _g_eventTable;
+
+	std::vector<void (*)()> &_Finalizers();
+
+	template <EventType E>
+	void _Finalize() {
+		auto &table = _g_eventTable<E>;
+		if (table.depth > 0) return; // stays dirty; the outermost Trigger rebuilds
+		table.handlers.clear();
+		for (auto &reg : table.regs) {
+			_EventHandler<E> h{reg.fn, nullptr, nullptr, reg.gate, reg.profileId};
+			if (!reg.fn) {
+				h.thunk = [](void *user, const EventData<E> &data) { (*(std::function<void(EventData<E>)> *)user)(data); };
+				h.user = &reg.cb;
+			}
+			table.handlers.push_back(h);
+		}
+		table.dirty = false;
+	}
+
+	// Builds the dispatch tables for every event; anything registered
+	// after this gets its table rebuilt on the next trigger
+	void Finalize();
+
+	template <EventType E>
+	inline void _Call(const _EventHandler<E> &h, const EventData<E> &data) {
+		if (h.fn) {
+			h.fn(data);
+		} else {
+			h.thunk(h.user, data);
+		}
+	}
 
 	template <EventType E>
 	void Trigger(EventData<E> data) {
-		for (auto &cb : _g_eventCallbacks<E>) {
-			cb.cb(data);
+		auto &table = _g_eventTable<E>;
+		if (table.dirty) _Finalize<E>();
+
+		// Handlers registered from inside a handler only take effect once
+		// the outermost dispatch has returned, so handlers stays put here
+		++table.depth;
+		const _EventHandler<E> *handlers = table.handlers.data();
+		size_t count = table.handlers.size();
+
+		if (_g_profiling) {
+			for (size_t i = 0; i < count; ++i) {
+				auto &h = handlers[i];
+				if (h.gate && !h.gate->GetBool()) continue;
+				auto start = std::chrono::steady_clock::now();
+				_Call(h, data);
+				_ProfileRecord(h.profileId, std::chrono::steady_clock::now() - start);
+			}
+		} else {
+			for (size_t i = 0; i < count; ++i) {
+				auto &h = handlers[i];
+				if (h.gate && !h.gate->GetBool()) continue;
+				_Call(h, data);
+			}
 		}
+
+		--table.depth;
 	}
 
 	template <EventType E>
-	void RegisterCallback(std::function<void(EventData<E>)> cb, int32_t priority = 0) {
-		_EventReg<E> reg{cb, priority};
+	void _Register(_EventReg<E> reg) {
+		auto &table = _g_eventTable<E>;
+		if (table.regs.empty()) _Finalizers().push_back(&_Finalize<E>);
 
-		auto &vec = _g_eventCallbacks<E>;
+		auto &vec = table.regs;
 
 		auto vit = vec.begin();
 		while (vit != vec.end()) {
-			if (vit->priority <= priority) break;
+			if (vit->priority <= reg.priority) break;
 			++vit;
 		}
 
 		vec.insert(vit, reg);
+		table.dirty = true;
+	}
+
+	template <EventType E>
+	void RegisterCallback(std::function<void(EventData<E>)> cb, int32_t priority = 0, const char *file = nullptr, int line = 0) {
+		_Register<E>({nullptr, cb, priority, nullptr, _ProfileRegister(E, file, line)});
+	}
+
+	template <EventType E>
+	void RegisterHandler(void (*fn)(EventData<E>), int32_t priority = 0, Variable *gate = nullptr, const char *file = nullptr, int line = 0) {
+		_Register<E>({fn, nullptr, priority, gate, _ProfileRegister(E, file, line)});
 	}
 }  // namespace Event
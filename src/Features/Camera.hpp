@@ -92,7 +92,7 @@ public:
 		Ent *player = serverside ? (Ent *)server->GetPlayer(slot + 1) : (Ent *)client->GetPlayer(slot + 1);
 		if (!player) return;
 
-		CBaseHandle portal_handle = player->template field<CBaseHandle>("m_hPortalEnvironment");
+		CBaseHandle portal_handle = player->template field<CBaseHandle>(ENT_FIELD("m_hPortalEnvironment"));
 		Ent *portal_ent = serverside ? (Ent *)entityList->LookupEntity(portal_handle) : (Ent *)client->GetPlayer(portal_handle.GetEntryIndex());
 
 		if (portal_ent) {
@@ -105,7 +105,7 @@ public:
 
 			if (portal_norm.Dot(eye_to_portal_center) > 0.0f) {
 				// eyes behind portal - translate position
-				VMatrix portal_matrix = portal_ent->template field<VMatrix>("m_matrixThisToLinked");
+				VMatrix portal_matrix = portal_ent->template field<VMatrix>(ENT_FIELD("m_matrixThisToLinked"));
 				eyePos = portal_matrix.PointTransform(eyePos);
 				// translate angles
 				Vector forward, up;
@@ -7,19 +7,168 @@
 #include "Modules/Server.hpp"
 #include "Utils.hpp"
 
+#include <chrono>
 #include <cstdlib>
 #include <cstring>
+#include <list>
 #include <map>
 #include <queue>
 #include <stack>
+#include <string_view>
 #include <vector>
+#include <unordered_map>
 #include <unordered_set>
 #include <fstream>
 
 #define PERSISTENT_SVAR_FILENAME "svars_persist"
 #define CFG_MESSAGE_TYPE "cfgmessage"
 
-static std::map<std::string, std::string> g_svars;
+// Svar store {{{
+
+// svars live in an open-addressed table keyed by name. Each entry caches
+// its numeric value next to the text so the arithmetic commands don't
+// parse and reformat a string on every call; the text is only produced
+// again once somebody reads it.
+struct Svar {
+	enum {
+		HAS_STR = 1 << 0,
+		HAS_INT = 1 << 1,
+		HAS_FLOAT = 1 << 2,
+	};
+
+	std::string name;
+	uint32_t hash;
+	std::string str;
+	int ival;
+	double fval;
+	uint8_t flags;
+	bool persistent;
+
+	const std::string &Str() {
+		if (!(flags & HAS_STR)) {
+			// the same formats the arithmetic commands always used
+			char buf[32];
+			if (flags & HAS_INT) {
+				snprintf(buf, sizeof buf, "%d", ival);
+			} else {
+				snprintf(buf, sizeof buf, "%.17g", fval);
+			}
+			str.assign(buf);
+			flags |= HAS_STR;
+		}
+		return str;
+	}
+
+	int Int() {
+		if (!(flags & HAS_INT)) {
+			ival = atoi(Str().c_str());
+			flags |= HAS_INT;
+		}
+		return ival;
+	}
+
+	double Float() {
+		if (!(flags & HAS_FLOAT)) {
+			fval = atof(Str().c_str());
+			flags |= HAS_FLOAT;
+		}
+		return fval;
+	}
+
+	void SetStr(std::string val) {
+		str = std::move(val);
+		flags = HAS_STR;
+	}
+
+	// "%d" and "%.17g" both read back exactly, so the cached numbers stay
+	// in agreement with atoi/atof of the text they stand in for
+	void SetInt(int val) {
+		ival = val;
+		fval = val;
+		flags = HAS_INT | HAS_FLOAT;
+	}
+
+	void SetFloat(double val) {
+		fval = val;
+		flags = HAS_FLOAT;
+	}
+};
+
+class SvarTable {
+public:
+	Svar *Find(std::string_view name) {
+		if (this->slots.empty()) return nullptr;
+		uint32_t slot = this->slots[this->Probe(name, Hash(name))];
+		return slot ? &this->entries[slot - 1] : nullptr;
+	}
+
+	// Returns the named svar, creating it empty if it doesn't exist.
+	// The reference is invalidated by the next insertion.
+	Svar &Get(std::string_view name) {
+		uint32_t hash = Hash(name);
+		if (!this->slots.empty()) {
+			uint32_t slot = this->slots[this->Probe(name, hash)];
+			if (slot) return this->entries[slot - 1];
+		}
+
+		// keep the load factor at or below 1/2
+		if ((this->entries.size() + 1) * 2 > this->slots.size()) this->Grow();
+
+		this->entries.push_back({std::string(name), hash, "", 0, 0.0, Svar::HAS_STR | Svar::HAS_INT | Svar::HAS_FLOAT, false});
+		this->slots[this->Probe(name, hash)] = this->entries.size();
+		return this->entries.back();
+	}
+
+	size_t Size() const {
+		return this->entries.size();
+	}
+
+	// In insertion order
+	std::vector<Svar> &Entries() {
+		return this->entries;
+	}
+
+private:
+	std::vector<Svar> entries;
+	std::vector<uint32_t> slots; // 0 if empty, otherwise entry index + 1
+
+	static uint32_t Hash(std::string_view name) {
+		// FNV-1a
+		uint32_t h = 2166136261u;
+		for (char c : name) {
+			h ^= (uint8_t)c;
+			h *= 16777619u;
+		}
+		return h;
+	}
+
+	// Index of the slot holding name, or of the empty slot it would go in
+	size_t Probe(std::string_view name, uint32_t hash) const {
+		size_t mask = this->slots.size() - 1;
+		size_t i = hash & mask;
+		while (this->slots[i]) {
+			const Svar &e = this->entries[this->slots[i] - 1];
+			if (e.hash == hash && e.name == name) break;
+			i = (i + 1) & mask;
+		}
+		return i;
+	}
+
+	void Grow() {
+		size_t size = this->slots.empty() ? 64 : this->slots.size() * 2;
+		this->slots.assign(size, 0);
+		for (size_t i = 0; i < this->entries.size(); ++i) {
+			size_t j = this->entries[i].hash & (size - 1);
+			while (this->slots[j]) j = (j + 1) & (size - 1);
+			this->slots[j] = i + 1;
+		}
+	}
+};
+
+static SvarTable g_svars;
+
+// }}}
+
 static std::unordered_set<std::string> g_persistentSvars;
 static std::string g_persistentSvarsFile;
 
@@ -36,7 +185,7 @@ ON_INIT {
 		if (oldline == "") continue; // skip empty lines
 		if (!file) break;
 
-		g_svars[oldline] = line;
+		g_svars.Get(oldline).SetStr(line);
 
 		// get the next line so we don't re-use the value line
 		std::getline(file, line);
@@ -47,22 +196,44 @@ static void SavePersistentSvars() {
 	FILE *fp = fopen(g_persistentSvarsFile.c_str(), "w");
 	if (fp) {
 		for (auto &name : g_persistentSvars) {
-			auto val = g_svars[name];
-			fprintf(fp, "%s\n%s\n", name.c_str(), val.c_str());
+			fprintf(fp, "%s\n%s\n", name.c_str(), g_svars.Get(name).Str().c_str());
 		}
 		fclose(fp);
 	}
 }
 
-static void SetSvar(std::string name, std::string val) {
-	g_svars[name] = val;
-	if (g_persistentSvars.count(name) != 0) SavePersistentSvars();
+static void SetSvar(std::string_view name, std::string val) {
+	Svar &svar = g_svars.Get(name);
+	svar.SetStr(std::move(val));
+	if (svar.persistent) SavePersistentSvars();
+}
+
+static void SetSvarInt(std::string_view name, int val) {
+	Svar &svar = g_svars.Get(name);
+	svar.SetInt(val);
+	if (svar.persistent) SavePersistentSvars();
+}
+
+static void SetSvarFloat(std::string_view name, double val) {
+	Svar &svar = g_svars.Get(name);
+	svar.SetFloat(val);
+	if (svar.persistent) SavePersistentSvars();
 }
 
-static std::string GetSvar(std::string name) {
-	auto it = g_svars.find(name);
-	if (it == g_svars.end()) return "";
-	return it->second;
+static std::string GetSvar(std::string_view name) {
+	Svar *svar = g_svars.Find(name);
+	if (!svar) return "";
+	return svar->Str();
+}
+
+static int GetSvarInt(std::string_view name) {
+	Svar *svar = g_svars.Find(name);
+	return svar ? svar->Int() : 0;
+}
+
+static double GetSvarFloat(std::string_view name) {
+	Svar *svar = g_svars.Find(name);
+	return svar ? svar->Float() : 0;
 }
 
 static std::string GetCvar(std::string name) {
@@ -107,17 +278,23 @@ static int CompleteSvars(const char *partial, char commands[COMMAND_COMPLETION_M
 	std::vector<std::string> items;
 
 	// completed_args == 1
-	for (auto svar : g_svars) {
-		if (Utils::StartsWith(svar.first.c_str(), "__")) continue;
+	// the table is unordered; sort the names so completion is stable
+	std::vector<const std::string *> names;
+	names.reserve(g_svars.Size());
+	for (auto &svar : g_svars.Entries()) names.push_back(&svar.name);
+	std::sort(names.begin(), names.end(), [](const std::string *a, const std::string *b) { return *a < *b; });
+
+	for (auto name : names) {
+		if (Utils::StartsWith(name->c_str(), "__")) continue;
 
 		std::string qname =
-			svar.first.find(" ") == std::string::npos
-			? svar.first
-			: Utils::ssprintf("\"%s\"", svar.first.c_str());
+			name->find(" ") == std::string::npos
+			? *name
+			: Utils::ssprintf("\"%s\"", name->c_str());
 
-		if (svar.first == cur) {
+		if (*name == cur) {
 			items.insert(items.begin(), part + qname);
-		} else if (svar.first.find(cur) != std::string::npos) {
+		} else if (name->find(cur) != std::string::npos) {
 			items.push_back(part + qname);
 		}
 
@@ -189,7 +366,7 @@ CON_COMMAND_F(svar_count, "svar_count - prints a count of all the defined svars\
 		return console->Print(svar_count.ThisPtr()->m_pszHelpString);
 	}
 
-	int size = g_svars.size();
+	int size = g_svars.Size();
 
 	console->Print("%d svars defined\n", size);
 }
@@ -200,6 +377,7 @@ CON_COMMAND_F_COMPLETION(svar_persist, "svar_persist <variable> - mark an svar a
 	}
 
 	g_persistentSvars.insert({args[1]});
+	g_svars.Get(args[1]).persistent = true;
 	SavePersistentSvars();
 }
 
@@ -209,6 +387,7 @@ CON_COMMAND_F_COMPLETION(svar_no_persist, "svar_no_persist <variable> - unmark a
 	}
 
 	g_persistentSvars.erase({args[1]});
+	if (Svar *svar = g_svars.Find(args[1])) svar->persistent = false;
 	SavePersistentSvars();
 }
 
@@ -273,38 +452,24 @@ CON_COMMAND_F_COMPLETION(svar_from_cvar, "svar_from_cvar <variable> <cvar> - cap
 		if (args.ArgC() != 3) {                                          \
 			return console->Print(svar_##name.ThisPtr()->m_pszHelpString);  \
 		}                                                                \
-		int cur;                                                         \
-		{                                                                \
-			auto it = g_svars.find({args[1]});                              \
-			cur = (it == g_svars.end()) ? 0 : atoi(it->second.c_str());     \
-		}                                                                \
+		int cur = GetSvarInt(args[1]);                                   \
 		char *end;                                                       \
 		int other = strtol(args[2], &end, 10);                           \
-		if (end == args[2] || *end) {                                    \
-			auto it = g_svars.find({args[2]});                              \
-			other = (it == g_svars.end()) ? 0 : atoi(it->second.c_str());   \
-		}                                                                \
+		if (end == args[2] || *end) other = GetSvarInt(args[2]);         \
 		int val = (disallowSecondZero && other == 0) ? 0 : op;           \
-		SetSvar({args[1]}, Utils::ssprintf("%d", val));                  \
+		SetSvarInt(args[1], val);                                        \
 	}                                                                 \
 	                                                                  \
 	CON_COMMAND_F_COMPLETION(svar_f##name, "svar_f" #name " <variable> <variable|value> - perform the given operation on an svar\n", FCVAR_DONTRECORD, AUTOCOMPLETION_FUNCTION(svar_get)) { \
 		if (args.ArgC() != 3) {                                          \
 			return console->Print(svar_f##name.ThisPtr()->m_pszHelpString); \
 		}                                                                \
-		double cur;                                                      \
-		{                                                                \
-			auto it = g_svars.find({args[1]});                              \
-			cur = (it == g_svars.end()) ? 0 : atof(it->second.c_str());     \
-		}                                                                \
+		double cur = GetSvarFloat(args[1]);                              \
 		char *end;                                                       \
 		double other = strtod(args[2], &end);                            \
-		if (end == args[2] || *end) {                                    \
-			auto it = g_svars.find({args[2]});                              \
-			other = (it == g_svars.end()) ? 0 : atof(it->second.c_str());   \
-		}                                                                \
+		if (end == args[2] || *end) other = GetSvarFloat(args[2]);       \
 		double val = (disallowSecondZero && other == 0) ? 0 : op;        \
-		SetSvar({args[1]}, Utils::ssprintf("%.17g", val));                  \
+		SetSvarFloat(args[1], val);                                      \
 	}
 
 SVAR_OP(add, cur + other, false)
@@ -319,10 +484,8 @@ SVAR_OP(mod, fmod(cur, other), true) // fmod seems to work fine for integers
 			return console->Print(svar_##name.ThisPtr()->m_pszHelpString);    \
 		}                                                                  \
                                                                      \
-		auto it = g_svars.find({args[1]});                                 \
-		double cur = (it == g_svars.end()) ? 0 : atof(it->second.c_str()); \
-                                                                     \
-		SetSvar({args[1]}, Utils::ssprintf("%.17g", op));                     \
+		double cur = GetSvarFloat(args[1]);                                \
+		SetSvarFloat(args[1], op);                                         \
 	}
 
 SVAR_SINGLE_OP(round, round(cur))
@@ -330,6 +493,140 @@ SVAR_SINGLE_OP(floor, floor(cur))
 SVAR_SINGLE_OP(ceil, ceil(cur))
 SVAR_SINGLE_OP(abs, fabs(cur))
 
+CON_COMMAND_F(sar_svar_selftest, "sar_svar_selftest [operations] - runs random svar arithmetic through the svar table and through plain strings, checks they read back the same and times both\n", FCVAR_DONTRECORD) {
+	if (args.ArgC() > 2) {
+		return console->Print(sar_svar_selftest.ThisPtr()->m_pszHelpString);
+	}
+
+	int count = args.ArgC() == 2 ? atoi(args[1]) : 1000000;
+	if (count <= 0) {
+		return console->Print(sar_svar_selftest.ThisPtr()->m_pszHelpString);
+	}
+
+	enum { INT_ADD, INT_MUL, FLOAT_ADD, FLOAT_MUL, SET, READ };
+	struct Op {
+		int kind;
+		int var, other;  // other is an svar operand if >= 0
+		int ival;
+		double fval;
+		const char *str;
+	};
+	static const char *strs[] = {"0", "12", "-3", "1.5", "abc", "", "1e3", " 7", "0x10", "2147483647"};
+
+	std::vector<std::string> names;
+	for (int i = 0; i < 1000; ++i) names.push_back(Utils::ssprintf("v%d", i));
+
+	uint32_t seed = 1;
+	auto rand = [&](uint32_t n) {
+		seed = seed * 1664525 + 1013904223;
+		return (int)((seed >> 8) % n);
+	};
+	std::vector<Op> ops(count);
+	for (auto &op : ops) {
+		op.kind = rand(6);
+		op.var = rand(names.size());
+		op.other = rand(4) ? -1 : rand(names.size());
+		op.ival = rand(2001) - 1000;
+		op.fval = (rand(4001) - 2000) / 1000.0;
+		op.str = strs[rand(sizeof strs / sizeof strs[0])];
+	}
+
+	// Ints wrap rather than overflow, the same way on both sides
+	auto intOp = [](int kind, int cur, int other) {
+		return (int)(kind == INT_ADD ? (unsigned)cur + (unsigned)other : (unsigned)cur * (unsigned)other);
+	};
+
+	// The svar commands' path, against a scratch table so the user's svars
+	// are untouched
+	SvarTable saved = std::move(g_svars);
+	g_svars = SvarTable();
+	std::vector<std::string> tableReads;
+	auto start = std::chrono::steady_clock::now();
+	for (auto &op : ops) {
+		auto &name = names[op.var];
+		switch (op.kind) {
+		case INT_ADD:
+		case INT_MUL: {
+			int other = op.other >= 0 ? GetSvarInt(names[op.other]) : op.ival;
+			SetSvarInt(name, intOp(op.kind, GetSvarInt(name), other));
+			break;
+		}
+		case FLOAT_ADD:
+		case FLOAT_MUL: {
+			double other = op.other >= 0 ? GetSvarFloat(names[op.other]) : op.fval;
+			double cur = GetSvarFloat(name);
+			SetSvarFloat(name, op.kind == FLOAT_ADD ? cur + other : cur * other);
+			break;
+		}
+		case SET:
+			SetSvar(name, op.str);
+			break;
+		case READ:
+			tableReads.push_back(GetSvar(name));
+			break;
+		}
+	}
+	float tableMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	// What they did before svars cached their numbers: parse the text,
+	// then format the result back into it
+	std::map<std::string, std::string> ref;
+	std::vector<std::string> refReads;
+	auto refInt = [&](const std::string &name) {
+		auto it = ref.find(name);
+		return it == ref.end() ? 0 : atoi(it->second.c_str());
+	};
+	auto refFloat = [&](const std::string &name) {
+		auto it = ref.find(name);
+		return it == ref.end() ? 0.0 : atof(it->second.c_str());
+	};
+	start = std::chrono::steady_clock::now();
+	for (auto &op : ops) {
+		auto &name = names[op.var];
+		switch (op.kind) {
+		case INT_ADD:
+		case INT_MUL: {
+			int other = op.other >= 0 ? refInt(names[op.other]) : op.ival;
+			ref[name] = Utils::ssprintf("%d", intOp(op.kind, refInt(name), other));
+			break;
+		}
+		case FLOAT_ADD:
+		case FLOAT_MUL: {
+			double other = op.other >= 0 ? refFloat(names[op.other]) : op.fval;
+			double cur = refFloat(name);
+			ref[name] = Utils::ssprintf("%.17g", op.kind == FLOAT_ADD ? cur + other : cur * other);
+			break;
+		}
+		case SET:
+			ref[name] = op.str;
+			break;
+		case READ: {
+			auto it = ref.find(name);
+			refReads.push_back(it == ref.end() ? "" : it->second);
+			break;
+		}
+		}
+	}
+	float refMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	int mismatches = tableReads == refReads ? 0 : 1;
+	if (g_svars.Size() != ref.size()) ++mismatches;
+	for (auto &kv : ref) {
+		Svar *svar = g_svars.Find(kv.first);
+		if (!svar || svar->Str() != kv.second) {
+			if (mismatches < 10) console->Print("%s is \"%s\", expected \"%s\"\n", kv.first.c_str(), svar ? svar->Str().c_str() : "", kv.second.c_str());
+			++mismatches;
+		}
+	}
+
+	g_svars = std::move(saved);
+
+	console->Print("%d operations on %d svars, %d reads, %d mismatches\n", count, (int)ref.size(), (int)refReads.size(), mismatches);
+	console->Print("Svar table: %.2fms\n", tableMs);
+	console->Print("String round trip: %.2fms\n", refMs);
+	console->Print("%s\n", mismatches ? "Svar self test FAILED" : "Svar self test passed");
+}
+
 struct Condition {
 	enum {
 		ORANGE,
@@ -351,6 +648,14 @@ struct Condition {
 		STEAMID
 	} type;
 
+	// What val holds for conditions which compare against a value; svars
+	// and cvars are looked up when the condition is evaluated
+	enum {
+		VAL_STRING,
+		VAL_SVAR,
+		VAL_CVAR,
+	} val_kind;
+
 	union {
 		struct {
 			char *var, *val;
@@ -406,7 +711,123 @@ static const char *gameName() {
 	}
 }
 
-static bool EvalCondition(Condition *c) {
+// Compiled conditions {{{
+
+// A condition tree flattened in pre-order, so evaluating it needs no
+// allocation. Each op records where its subtree ends, letting AND and OR
+// find their right operand and short-circuit past it.
+struct CondOp {
+	int type;
+	int val_kind;
+	size_t next;
+	std::string var, val;
+};
+
+typedef std::vector<CondOp> CompiledCondition;
+
+static void CompileCondition(const Condition *c, CompiledCondition &out) {
+	size_t idx = out.size();
+	out.push_back({c->type, Condition::VAL_STRING, 0, "", ""});
+
+	switch (c->type) {
+	case Condition::MAP:
+	case Condition::PREV_MAP:
+	case Condition::STEAMID:
+	case Condition::GAME:
+		out[idx].val_kind = c->val_kind;
+		out[idx].val = c->val;
+		break;
+	case Condition::SVAR:
+	case Condition::CVAR:
+	case Condition::STRING:
+		out[idx].val_kind = c->val_kind;
+		out[idx].var = c->var;
+		out[idx].val = c->val;
+		break;
+	case Condition::NOT:
+		CompileCondition(c->unop_cond, out);
+		break;
+	case Condition::AND:
+	case Condition::OR:
+		CompileCondition(c->binop_l, out);
+		CompileCondition(c->binop_r, out);
+		break;
+	default:
+		break;
+	}
+
+	out[idx].next = out.size();
+}
+
+static const char *SvarValue(const std::string &name) {
+	Svar *svar = g_svars.Find(name);
+	return svar ? svar->Str().c_str() : "";
+}
+
+// Like GetCvar, but formats into buf rather than allocating
+static const char *CvarValue(const std::string &name, char *buf, size_t size) {
+	Variable cvar(name.c_str());
+	if (!cvar.ThisPtr() || cvar.ThisPtr()->IsCommand()) return "";
+	if (cvar.GetFlags() & FCVAR_NEVER_AS_STRING) {
+		snprintf(buf, size, "%f", cvar.GetFloat());
+		return buf;
+	}
+	return cvar.GetString();
+}
+
+static const char *OpValue(const CondOp &op, const std::string &str, char *buf, size_t size) {
+	switch (op.val_kind) {
+	case Condition::VAL_SVAR: return SvarValue(str);
+	case Condition::VAL_CVAR: return CvarValue(str, buf, size);
+	default: return str.c_str();
+	}
+}
+
+static bool EvalCondition(const CompiledCondition &ops, size_t i = 0) {
+	const CondOp &op = ops[i];
+	char buf[64];
+
+	switch (op.type) {
+	case Condition::ORANGE: return engine->IsOrange();
+	case Condition::COOP: return engine->IsCoop();
+	case Condition::CM: return client->GetChallengeStatus() == CMStatus::CHALLENGE;
+	case Condition::SAME_MAP: return session->previousMap == engine->GetCurrentMapName();
+	case Condition::WORKSHOP: return !strncmp("workshop/", engine->GetCurrentMapName().c_str(), 9);
+	case Condition::MENU: return engine->GetCurrentMapName().size() == 0;
+	case Condition::MAP: return !strcasecmp(OpValue(op, op.val, buf, sizeof buf), engine->GetCurrentMapName().c_str());
+	case Condition::PREV_MAP: return !strcasecmp(OpValue(op, op.val, buf, sizeof buf), session->previousMap.c_str());
+	case Condition::STEAMID: return (engine->IsCoop() && !engine->IsSplitscreen()) ? !strcmp(OpValue(op, op.val, buf, sizeof buf), engine->GetPartnerSteamID32().c_str()) : false;
+	case Condition::GAME: return !strcmp(OpValue(op, op.val, buf, sizeof buf), gameName());
+	case Condition::NOT: return !EvalCondition(ops, i + 1);
+	case Condition::AND: return EvalCondition(ops, i + 1) && EvalCondition(ops, ops[i + 1].next);
+	case Condition::OR: return EvalCondition(ops, i + 1) || EvalCondition(ops, ops[i + 1].next);
+	case Condition::SVAR: return !strcmp(SvarValue(op.var), OpValue(op, op.val, buf, sizeof buf));
+	case Condition::CVAR: {
+		char var_buf[64];
+		return !strcmp(CvarValue(op.var, var_buf, sizeof var_buf), OpValue(op, op.val, buf, sizeof buf));
+	}
+	case Condition::STRING: return !strcmp(op.var.c_str(), OpValue(op, op.val, buf, sizeof buf));
+	case Condition::LINUX:
+		#ifdef _WIN32
+			return false;
+		#else
+			return true;
+		#endif
+	}
+	return false;
+}
+
+// The tree walk conditions were evaluated with before they were compiled,
+// kept as a reference for sar_cond_selftest
+static std::string TreeValue(const Condition *c) {
+	switch (c->val_kind) {
+	case Condition::VAL_SVAR: return GetSvar({c->val});
+	case Condition::VAL_CVAR: return GetCvar({c->val});
+	default: return c->val;
+	}
+}
+
+static bool EvalConditionTree(const Condition *c) {
 	switch (c->type) {
 	case Condition::ORANGE: return engine->IsOrange();
 	case Condition::COOP: return engine->IsCoop();
@@ -414,16 +835,16 @@ static bool EvalCondition(Condition *c) {
 	case Condition::SAME_MAP: return session->previousMap == engine->GetCurrentMapName();
 	case Condition::WORKSHOP: return !strncmp("workshop/", engine->GetCurrentMapName().c_str(), 9);
 	case Condition::MENU: return engine->GetCurrentMapName().size() == 0;
-	case Condition::MAP: return !strcasecmp(c->val, engine->GetCurrentMapName().c_str());
-	case Condition::PREV_MAP: return !strcasecmp(c->val, session->previousMap.c_str());
-	case Condition::STEAMID: return (engine->IsCoop() && !engine->IsSplitscreen()) ? !strcmp(c->val, engine->GetPartnerSteamID32().c_str()) : false;
-	case Condition::GAME: return !strcmp(c->val, gameName());
-	case Condition::NOT: return !EvalCondition(c->unop_cond);
-	case Condition::AND: return EvalCondition(c->binop_l) && EvalCondition(c->binop_r);
-	case Condition::OR: return EvalCondition(c->binop_l) || EvalCondition(c->binop_r);
-	case Condition::SVAR: return GetSvar({c->var}) == c->val;
-	case Condition::CVAR: return GetCvar({c->var}) == c->val;
-	case Condition::STRING: return !strcmp(c->var, c->val);
+	case Condition::MAP: return !strcasecmp(TreeValue(c).c_str(), engine->GetCurrentMapName().c_str());
+	case Condition::PREV_MAP: return !strcasecmp(TreeValue(c).c_str(), session->previousMap.c_str());
+	case Condition::STEAMID: return (engine->IsCoop() && !engine->IsSplitscreen()) ? !strcmp(TreeValue(c).c_str(), engine->GetPartnerSteamID32().c_str()) : false;
+	case Condition::GAME: return !strcmp(TreeValue(c).c_str(), gameName());
+	case Condition::NOT: return !EvalConditionTree(c->unop_cond);
+	case Condition::AND: return EvalConditionTree(c->binop_l) && EvalConditionTree(c->binop_r);
+	case Condition::OR: return EvalConditionTree(c->binop_l) || EvalConditionTree(c->binop_r);
+	case Condition::SVAR: return GetSvar({c->var}) == TreeValue(c);
+	case Condition::CVAR: return GetCvar({c->var}) == TreeValue(c);
+	case Condition::STRING: return !strcmp(c->var, TreeValue(c).c_str());
 	case Condition::LINUX:
 		#ifdef _WIN32
 			return false;
@@ -434,6 +855,8 @@ static bool EvalCondition(Condition *c) {
 	return false;
 }
 
+// }}}
+
 // Condition Parsing {{{
 
 enum TokenType {
@@ -563,6 +986,7 @@ static Condition *ParseCondition(std::queue<Token> toks) {
 		// TOK_STR {{{
 		case TOK_STR: {
 			Condition *c = (Condition *)malloc(sizeof *c);
+			c->val_kind = Condition::VAL_STRING;
 
 			if (!strncmp(t.str, "orange", t.len)) {
 				c->type = Condition::ORANGE;
@@ -629,12 +1053,12 @@ static Condition *ParseCondition(std::queue<Token> toks) {
 
 				if (val_tok.len > 4 && !strncmp(val_tok.str, "var:", 4) || val_tok.len > 1 && val_tok.str[0] == '?') {
 					int i = val_tok.str[0] == 'v' ? 4 : 1;
-					auto val = GetSvar(std::string(val_tok.str + i, val_tok.len - i));
-					c->val = strdup(val.c_str());
+					c->val_kind = Condition::VAL_SVAR;
+					c->val = strdup(std::string(val_tok.str + i, val_tok.len - i).c_str());
 				} else if (val_tok.len > 5 && !strncmp(val_tok.str, "cvar:", 5) || val_tok.len > 1 && val_tok.str[0] == '#') {
 					int i = val_tok.str[0] == 'c' ? 5 : 1;
-					auto val = GetCvar(std::string(val_tok.str + i, val_tok.len - i));
-					c->val = strdup(val.c_str());
+					c->val_kind = Condition::VAL_CVAR;
+					c->val = strdup(std::string(val_tok.str + i, val_tok.len - i).c_str());
 				} else {
 					c->val = (char *)malloc(val_tok.len + 1);
 					strncpy(c->val, val_tok.str, val_tok.len);
@@ -725,6 +1149,50 @@ static Condition *ParseCondition(std::queue<Token> toks) {
 
 // }}}
 
+// Condition cache {{{
+
+Variable sar_cond_cache_size("sar_cond_cache_size", "256", 0, "How many compiled conditions cond and conds keep around for reuse. 0 = parse them every time.\n");
+
+// Least recently used at the back
+static std::list<std::pair<std::string, CompiledCondition>> g_condCache;
+static std::unordered_map<std::string_view, decltype(g_condCache)::iterator> g_condCacheIndex;
+
+static const CompiledCondition *GetCondition(const char *str) {
+	size_t capacity = sar_cond_cache_size.GetInt();
+
+	auto it = g_condCacheIndex.find(std::string_view(str));
+	if (it != g_condCacheIndex.end()) {
+		g_condCache.splice(g_condCache.begin(), g_condCache, it->second);
+		return &it->second->second;
+	}
+
+	Condition *cond = ParseCondition(LexCondition(str, strlen(str)));
+	if (!cond) return nullptr;
+
+	CompiledCondition compiled;
+	CompileCondition(cond, compiled);
+	FreeCondition(cond);
+
+	if (capacity == 0) {
+		static CompiledCondition uncached;
+		g_condCache.clear();
+		g_condCacheIndex.clear();
+		uncached = std::move(compiled);
+		return &uncached;
+	}
+
+	while (g_condCache.size() >= capacity) {
+		g_condCacheIndex.erase(g_condCache.back().first);
+		g_condCache.pop_back();
+	}
+
+	g_condCache.emplace_front(str, std::move(compiled));
+	g_condCacheIndex[g_condCache.front().first] = g_condCache.begin();
+	return &g_condCache.front().second;
+}
+
+// }}}
+
 CON_COMMAND_F(sar_get_partner_id, "sar_get_partner_id - Prints your coop partner's steam id\n", FCVAR_DONTRECORD) {
 	if (!engine->IsCoop() || engine->IsSplitscreen() || !strcmp("0", engine->GetPartnerSteamID32().c_str())) {
 		console->Print("This command only works in online co-op.\n");
@@ -766,15 +1234,14 @@ CON_COMMAND_F(cond, "cond <condition> <command> [args]... - runs a command only
 
 	const char *cond_str = args[1];
 
-	Condition *cond = ParseCondition(LexCondition(cond_str, strlen(cond_str)));
+	const CompiledCondition *cond = GetCondition(cond_str);
 
 	if (!cond) {
 		console->Print("Condition parsing of \"%s\" failed\n", cond_str);
 		return;
 	}
 
-	bool should_run = EvalCondition(cond);
-	FreeCondition(cond);
+	bool should_run = EvalCondition(*cond);
 
 	if (!should_run) return;
 
@@ -797,14 +1264,13 @@ CON_COMMAND_F(conds, "conds [<condition> <command>]... [else] - runs the first c
 		}
 
 		const char *cond_str = args[i];
-		Condition *cond = ParseCondition(LexCondition(cond_str, strlen(cond_str)));
+		const CompiledCondition *cond = GetCondition(cond_str);
 		if (!cond) {
 			console->Print("Condition parsing of \"%s\" failed\n", cond_str);
 			return;
 		}
 
-		bool should_run = EvalCondition(cond);
-		FreeCondition(cond);
+		bool should_run = EvalCondition(*cond);
 
 		if (should_run) {
 			engine->ExecuteCommand(args[i + 1], true);
@@ -814,6 +1280,118 @@ CON_COMMAND_F(conds, "conds [<condition> <command>]... [else] - runs the first c
 	}
 }
 
+CON_COMMAND_F(sar_cond_selftest, "sar_cond_selftest [evaluations] - checks compiled conditions against the old tree evaluator and times them with and without the condition cache\n", FCVAR_DONTRECORD) {
+	if (args.ArgC() > 2) {
+		return console->Print(sar_cond_selftest.ThisPtr()->m_pszHelpString);
+	}
+
+	int evals = args.ArgC() == 2 ? atoi(args[1]) : 1000000;
+	if (evals <= 0) {
+		return console->Print(sar_cond_selftest.ThisPtr()->m_pszHelpString);
+	}
+
+	static const char *conds[] = {
+		"orange",
+		"coop & !orange",
+		"cm | menu",
+		"!same_map & !workshop",
+		"linux",
+		"map=sp_a1_intro1",
+		"prev_map=sp_a1_intro1 | map=sp_a2_laser_intro",
+		"game=portal2 | game=srm",
+		"steamid=0",
+		"var:a=1",
+		"?a=1 & ?b=two",
+		"var:a=?b",
+		"?c=?d",
+		"?missing=0",
+		"#sv_cheats=1",
+		"cvar:host_timescale=#sv_cheats",
+		"%foo=foo",
+		"%1=?a",
+		"!(?a=1 | ?b=1) & (#sv_cheats=0 | !coop)",
+		"((?a=2))",
+		"?a=0 | ?a=1 | ?a=2 | ?b=0 | ?b=1 | ?b=two | ?c=0.5",
+	};
+	const size_t count = sizeof conds / sizeof conds[0];
+
+	// Run against a scratch svar table so the user's svars are untouched
+	SvarTable saved = std::move(g_svars);
+	g_svars = SvarTable();
+
+	std::vector<Condition *> trees;
+	for (auto str : conds) trees.push_back(ParseCondition(LexCondition(str, strlen(str))));
+
+	int mismatches = 0;
+	for (int round = 0; round < 64; ++round) {
+		// Mix values set as text and as numbers, whose text is only
+		// formatted when a condition reads it
+		g_svars.Get("a").SetInt(round % 3);
+		if (round & 1) {
+			g_svars.Get("b").SetStr(round & 2 ? "two" : "1");
+		} else {
+			g_svars.Get("b").SetInt(round & 2 ? 1 : 0);
+		}
+		g_svars.Get("c").SetFloat(round % 4 * 0.25);
+		g_svars.Get("d").SetStr(round % 5 ? "0.5" : "0.25");
+
+		for (size_t i = 0; i < count; ++i) {
+			const CompiledCondition *compiled = GetCondition(conds[i]);
+			if (!trees[i] || !compiled) {
+				if (round == 0) console->Print("Condition parsing of \"%s\" failed\n", conds[i]);
+				++mismatches;
+				continue;
+			}
+			if (EvalCondition(*compiled) != EvalConditionTree(trees[i])) {
+				if (mismatches < 10) console->Print("Mismatch on \"%s\" in round %d\n", conds[i], round);
+				++mismatches;
+			}
+		}
+	}
+
+	for (auto tree : trees) {
+		if (tree) FreeCondition(tree);
+	}
+
+	auto time = [&](auto eval) {
+		int hits = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < evals; ++i) hits += eval(conds[i % count]);
+		float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+		return std::make_pair(ms, hits);
+	};
+
+	auto cached = time([](const char *str) {
+		auto compiled = GetCondition(str);
+		return compiled && EvalCondition(*compiled);
+	});
+	auto uncached = time([](const char *str) {
+		Condition *c = ParseCondition(LexCondition(str, strlen(str)));
+		if (!c) return false;
+		CompiledCondition compiled;
+		CompileCondition(c, compiled);
+		FreeCondition(c);
+		return EvalCondition(compiled);
+	});
+	auto tree = time([](const char *str) {
+		Condition *c = ParseCondition(LexCondition(str, strlen(str)));
+		if (!c) return false;
+		bool result = EvalConditionTree(c);
+		FreeCondition(c);
+		return result;
+	});
+	if (cached.second != uncached.second || cached.second != tree.second) ++mismatches;
+
+	g_svars = std::move(saved);
+
+	console->Print("%d conditions, %d mismatches\n", (int)count, mismatches);
+	console->Print("%d evaluations:\n", evals);
+	console->Print("    compiled, cached: %.2fms\n", cached.first);
+	console->Print("    compiled, uncached: %.2fms\n", uncached.first);
+	console->Print("    parsed, tree walk: %.2fms\n", tree.first);
+	console->Print("%s\n", mismatches ? "Condition self test FAILED" : "Condition self test passed");
+}
+
 #define MK_SAR_ON(name, when, immediately)                                                                                                \
 	static std::vector<std::string> _g_execs_##name;                                                                                         \
 	CON_COMMAND_F(sar_on_##name, "sar_on_" #name " <command> [args]... - registers a command to be run " when "\n", FCVAR_DONTRECORD) {      \
@@ -7,25 +7,33 @@
 #include "Modules/Console.hpp"
 #include "Modules/Engine.hpp"
 #include "Modules/FileSystem.hpp"
+#include "Utils/MappedFile.hpp"
 #include "Variable.hpp"
 
-#include <fstream>
-#include <sstream>
+#include <atomic>
+#include <chrono>
+#include <cstring>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 
 Variable sar_time_demo_dev("sar_time_demo_dev", "0", 0,
                            "Printing mode when using sar_time_demo.\n"
                            "0 = Default,\n"
                            "1 = Console commands,\n"
                            "2 = Console commands & packets.\n");
+static Variable sar_time_demos_threads("sar_time_demos_threads", "0", 0, "How many threads sar_time_demos parses demos on. 0 = one per CPU core, 1 = one demo at a time\n");
+static Variable sar_time_demos_bench("sar_time_demos_bench", "0", 0, "Whether sar_time_demos parses the demos both one at a time and on its threads, checks both agree and prints how fast each was\n");
 
 DemoParser::DemoParser()
 	: headerOnly(false)
 	, outputMode()
+	, quiet(false)
 	, hasAlignmentByte(true)
 	, maxSplitScreenClients(2) {
 }
-std::string DemoParser::DecodeCustomData(char *data) {
+std::string DemoParser::DecodeCustomData(const char *data) {
 	if (data[0] == 0x03 || data[0] == 0x04) {  // Entity input data
 		std::optional<int> slot;
 		if (data[0] == 0x04) {
@@ -33,13 +41,13 @@ std::string DemoParser::DecodeCustomData(char *data) {
 			++data;
 		}
 
-		char *targetname = data + 1;
+		const char *targetname = data + 1;
 		size_t targetnameLen = strlen(targetname);
-		char *classname = data + 2 + targetnameLen;
+		const char *classname = data + 2 + targetnameLen;
 		size_t classnameLen = strlen(classname);
-		char *inputname = data + 3 + targetnameLen + classnameLen;
+		const char *inputname = data + 3 + targetnameLen + classnameLen;
 		size_t inputnameLen = strlen(inputname);
-		char *parameter = data + 4 + targetnameLen + classnameLen + inputnameLen;
+		const char *parameter = data + 4 + targetnameLen + classnameLen + inputnameLen;
 
 		//console->Print("%s %s %s %s\n", targetname, classname, inputname, parameter);
 
@@ -77,31 +85,81 @@ void DemoParser::Adjust(Demo *demo) {
 	demo->playbackTicks = demo->LastTick();
 	demo->playbackTime = ipt * demo->playbackTicks;
 }
+// Walks a mapped demo in place. Running off the end marks the cursor as
+// exhausted rather than failing, the same as hitting EOF on a stream.
+struct DemoCursor {
+	const uint8_t *pos;
+	const uint8_t *end;
+	bool ok = true;
+
+	const uint8_t *Take(size_t n) {
+		if (!this->ok || (size_t)(this->end - this->pos) < n) {
+			this->ok = false;
+			this->pos = this->end;
+			return nullptr;
+		}
+		auto p = this->pos;
+		this->pos += n;
+		return p;
+	}
+	void Copy(void *dst, size_t n) {
+		if (auto p = this->Take(n)) memcpy(dst, p, n);
+	}
+	void Skip(size_t n) {
+		this->Take(n);
+	}
+	template <typename T>
+	T Read() {
+		T val{};
+		this->Copy(&val, sizeof val);
+		return val;
+	}
+};
+
+struct DemoCmdInfo {
+	int32_t flags;
+	float viewOrigin[3];
+	float viewAngles[3];
+	float localViewAngles[3];
+	float viewOrigin2[3];
+	float viewAngles2[3];
+	float localViewAngles2[3];
+};
+static_assert(sizeof(DemoCmdInfo) == 76, "DemoCmdInfo must match the on-disk layout");
+
 bool DemoParser::Parse(std::string filePath, Demo *demo, bool ghostRequest, std::map<int, DataGhost> *data, CustomData *customData) {
+	if (!Utils::EndsWith(filePath, ".dem")) filePath += ".dem";
+	auto path = fileSystem->FindFileSomewhere(filePath).value_or(filePath);
+	if (std::filesystem::exists(filePath)) path = filePath;
+
+	console->DevMsg("Trying to parse \"%s\"...\n", filePath.c_str());
+
+	return this->ParseFile(path, demo, ghostRequest, data, customData);
+}
+bool DemoParser::ParseFile(const std::string &path, Demo *demo, bool ghostRequest, std::map<int, DataGhost> *data, CustomData *customData) {
 	bool gotFirstPositivePacket = false;
 	bool gotSync = false;
 	try {
-		if (!Utils::EndsWith(filePath, ".dem")) filePath += ".dem";
-		auto path = fileSystem->FindFileSomewhere(filePath).value_or(filePath);
-		if (std::filesystem::exists(filePath)) path = filePath;
-
-		console->DevMsg("Trying to parse \"%s\"...\n", filePath.c_str());
-
-		std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
-		if (!file.good())
+		MappedFile file;
+		if (!file.Open(path))
 			return false;
 
-		file.read(demo->demoFileStamp, sizeof(demo->demoFileStamp));
-		file.read((char *)&demo->demoProtocol, sizeof(demo->demoProtocol));
-		file.read((char *)&demo->networkProtocol, sizeof(demo->networkProtocol));
-		file.read(demo->serverName, sizeof(demo->serverName));
-		file.read(demo->clientName, sizeof(demo->clientName));
-		file.read(demo->mapName, sizeof(demo->mapName));
-		file.read(demo->gameDirectory, sizeof(demo->gameDirectory));
-		file.read((char *)&demo->playbackTime, sizeof(demo->playbackTime));
-		file.read((char *)&demo->playbackTicks, sizeof(demo->playbackTicks));
-		file.read((char *)&demo->playbackFrames, sizeof(demo->playbackFrames));
-		file.read((char *)&demo->signOnLength, sizeof(demo->signOnLength));
+		DemoCursor cur{file.Data(), file.Data() + file.Size()};
+
+		cur.Copy(demo->demoFileStamp, sizeof(demo->demoFileStamp));
+		demo->demoProtocol = cur.Read<int32_t>();
+		demo->networkProtocol = cur.Read<int32_t>();
+		cur.Copy(demo->serverName, sizeof(demo->serverName));
+		cur.Copy(demo->clientName, sizeof(demo->clientName));
+		cur.Copy(demo->mapName, sizeof(demo->mapName));
+		cur.Copy(demo->gameDirectory, sizeof(demo->gameDirectory));
+		demo->playbackTime = cur.Read<float>();
+		demo->playbackTicks = cur.Read<int32_t>();
+		demo->playbackFrames = cur.Read<int32_t>();
+		demo->signOnLength = cur.Read<int32_t>();
+
+		if (!cur.ok)
+			return false;
 
 		demo->segmentTicks = -1;
 
@@ -115,22 +173,21 @@ bool DemoParser::Parse(std::string filePath, Demo *demo, bool ghostRequest, std:
 				this->maxSplitScreenClients = 1;
 			}
 
-			while (!file.eof() && !file.bad()) {
-				unsigned char cmd;
-				int32_t tick;
-
-				file.read((char *)&cmd, sizeof(cmd));
+			while (cur.ok && cur.pos < cur.end) {
+				auto cmd = cur.Read<unsigned char>();
 				if (cmd == 0x07)  // Stop
 					break;
 
-				file.read((char *)&tick, sizeof(tick));
+				auto tick = cur.Read<int32_t>();
+				if (!cur.ok)
+					break;
 
 				// Save positive ticks to keep adjustments simple
 				if (tick >= 0)
 					demo->messageTicks.push_back(tick);
 
 				if (this->hasAlignmentByte)
-					file.ignore(1);
+					cur.Skip(1);
 
 				switch (cmd) {
 				case 0x01:  // SignOn
@@ -144,35 +201,13 @@ bool DemoParser::Parse(std::string filePath, Demo *demo, bool ghostRequest, std:
 					if (outputMode == 2 || ghostRequest == true) {
 						for (auto i = 0; i < this->maxSplitScreenClients; ++i) {
 							if (i >= 1) {
-								file.ignore(76);
+								cur.Skip(sizeof(DemoCmdInfo));
 								continue;
 							}
-							int32_t flags;
-							float vo_x, vo_y, vo_z;
-							float va_x, va_y, va_z;
-							float lva_x, lva_y, lva_z;
-							float vo2_x, vo2_y, vo2_z;
-							float va2_x, va2_y, va2_z;
-							float lva2_x, lva2_y, lva2_z;
-							file.read((char *)&flags, sizeof(flags));
-							file.read((char *)&vo_x, sizeof(vo_x));
-							file.read((char *)&vo_y, sizeof(vo_y));
-							file.read((char *)&vo_z, sizeof(vo_z));
-							file.read((char *)&va_x, sizeof(va_x));
-							file.read((char *)&va_y, sizeof(va_y));
-							file.read((char *)&va_z, sizeof(va_z));
-							file.read((char *)&lva_x, sizeof(lva_x));
-							file.read((char *)&lva_y, sizeof(lva_y));
-							file.read((char *)&lva_z, sizeof(lva_z));
-							file.read((char *)&vo2_x, sizeof(vo2_x));
-							file.read((char *)&vo2_y, sizeof(vo2_y));
-							file.read((char *)&vo2_z, sizeof(vo2_z));
-							file.read((char *)&va2_x, sizeof(va2_x));
-							file.read((char *)&va2_y, sizeof(va2_y));
-							file.read((char *)&va2_z, sizeof(va2_z));
-							file.read((char *)&lva2_x, sizeof(lva2_x));
-							file.read((char *)&lva2_y, sizeof(lva2_y));
-							file.read((char *)&lva2_z, sizeof(lva2_z));
+							auto info = cur.Read<DemoCmdInfo>();
+							auto &vo = info.viewOrigin;
+							auto &va = info.viewAngles;
+							auto &lva = info.localViewAngles;
 
 							if (ghostRequest) {
 								if (tick == 0) {
@@ -181,37 +216,33 @@ bool DemoParser::Parse(std::string filePath, Demo *demo, bool ghostRequest, std:
 
 								if (tick > 0 && waitForNext && lastTick != tick) {
 									lastTick = tick;
-									(*data)[tick] = DataGhost{{vo_x, vo_y, vo_z}, {va_x, va_y, va_z}, 64, true}; // TODO: is there a way to get this data that's not just a guess?
+									(*data)[tick] = DataGhost{{vo[0], vo[1], vo[2]}, {va[0], va[1], va[2]}, 64, true}; // TODO: is there a way to get this data that's not just a guess?
 								}
-							} else {
+							} else if (!this->quiet) {
 								console->Msg(
 									"[%i] flags: %i | "
 									"view origin: %.3f/%.3f/%.3f | "
 									"view angles: %.3f/%.3f/%.3f | "
 									"local view angles: %.3f/%.3f/%.3f\n",
 									tick,
-									flags,
-									vo_x,
-									vo_y,
-									vo_z,
-									va_x,
-									va_y,
-									va_z,
-									lva_x,
-									lva_y,
-									lva_z);
+									info.flags,
+									vo[0],
+									vo[1],
+									vo[2],
+									va[0],
+									va[1],
+									va[2],
+									lva[0],
+									lva[1],
+									lva[2]);
 							}
 						}
-						int32_t in_seq, out_seq;
-						file.read((char *)&in_seq, sizeof(in_seq));
-						file.read((char *)&out_seq, sizeof(out_seq));
+						cur.Skip(4 + 4);  // in_seq, out_seq
 					} else {
-						file.ignore((this->maxSplitScreenClients * 76) + 4 + 4);
+						cur.Skip((this->maxSplitScreenClients * sizeof(DemoCmdInfo)) + 4 + 4);
 					}
 
-					int32_t length;
-					file.read((char *)&length, sizeof(length));
-					file.ignore(length);
+					cur.Skip(cur.Read<int32_t>());
 					break;
 				}
 				case 0x03:  // SyncTick
@@ -219,61 +250,52 @@ bool DemoParser::Parse(std::string filePath, Demo *demo, bool ghostRequest, std:
 					continue;
 				case 0x04:  // ConsoleCmd
 				{
-					int32_t length;
-					file.read((char *)&length, sizeof(length));
-					std::string cmd(length, ' ');
-					file.read(&cmd[0], length);
-					if (!ghostRequest && outputMode >= 1) {
-						console->Msg("[%i] %s\n", tick, cmd.c_str());
+					auto length = cur.Read<int32_t>();
+					auto cmd = (const char *)cur.Take(length);
+					if (!cmd)
+						break;
+					// The command is NUL terminated inside its length
+					auto cmdLen = (int)strnlen(cmd, length);
+					if (!ghostRequest && outputMode >= 1 && !this->quiet) {
+						console->Msg("[%i] %.*s\n", tick, cmdLen, cmd);
 					}
 
-					if (cmd.find("__END__") != std::string::npos) {
-						console->ColorMsg(Color(0, 255, 0, 255), "Segment length -> %d ticks: %.3fs\n", tick, tick * engine->GetIPT());
+					if (std::string_view(cmd, cmdLen).find("__END__") != std::string_view::npos) {
+						if (!this->quiet) {
+							console->ColorMsg(Color(0, 255, 0, 255), "Segment length -> %d ticks: %.3fs\n", tick, tick * engine->GetIPT());
+						}
 						demo->segmentTicks = tick;
 					}
 					break;
 				}
 				case 0x05:  // UserCmd
 				{
-					int32_t cmd;
-					int32_t length;
-					file.read((char *)&cmd, sizeof(cmd));
-					file.read((char *)&length, sizeof(length));
-					file.ignore(length);
+					cur.Skip(4);  // cmd
+					cur.Skip(cur.Read<int32_t>());
 					break;
 				}
 				case 0x06:  // DataTables
 				{
-					int32_t length;
-					file.read((char *)&length, sizeof(length));
-					file.ignore(length);
+					cur.Skip(cur.Read<int32_t>());
 					break;
 				}
 				case 0x08:  // CustomData or StringTables
 				{
 					if (demo->demoProtocol == 4) {
-						int32_t unk;
-						int32_t length;
-						file.read((char *)&unk, sizeof(unk));
-						file.read((char *)&length, sizeof(length));
-
-						if (ghostRequest) {
-							char *data = new char[length];
-							file.read(data, length);
-							
-							if (customData) {
-								std::string str = this->DecodeCustomData(data + 8);
-								if (!str.empty()) {
-									(*customData)[str] = std::make_tuple(tick, false);
-								}
+						cur.Skip(4);  // unk
+						auto length = cur.Read<int32_t>();
+
+						// Decoded straight out of the mapping; nothing to
+						// copy or free
+						auto payload = (const char *)cur.Take(length);
+						if (ghostRequest && customData && payload && length > 8) {
+							std::string str = this->DecodeCustomData(payload + 8);
+							if (!str.empty()) {
+								(*customData)[str] = std::make_tuple(tick, false);
 							}
-						} else {
-							file.ignore(length);
 						}
 					} else {
-						int32_t length;
-						file.read((char *)&length, sizeof(length));
-						file.ignore(length);
+						cur.Skip(cur.Read<int32_t>());
 					}
 					break;
 				}
@@ -281,9 +303,7 @@ bool DemoParser::Parse(std::string filePath, Demo *demo, bool ghostRequest, std:
 				{
 					if (demo->demoProtocol != 4)
 						return false;
-					int32_t length;
-					file.read((char *)&length, sizeof(length));
-					file.ignore(length);
+					cur.Skip(cur.Read<int32_t>());
 					break;
 				}
 				default:
@@ -291,13 +311,17 @@ bool DemoParser::Parse(std::string filePath, Demo *demo, bool ghostRequest, std:
 				}
 			}
 		}
-		file.close();
 	} catch (const std::exception &ex) {
-		console->Warning(
-			"SAR: Error occurred when trying to parse the demo file.\n"
-			"If you think this is an issue, report it at: https://github.com/p2sr/SourceAutoRecord/issues\n"
-			"%s\n",
-			ex.what());
+		if (this->quiet) {
+			std::string what = ex.what();
+			THREAD_PRINT("Error occurred when trying to parse \"%s\": %s\n", path.c_str(), what.c_str());
+		} else {
+			console->Warning(
+				"SAR: Error occurred when trying to parse the demo file.\n"
+				"If you think this is an issue, report it at: https://github.com/p2sr/SourceAutoRecord/issues\n"
+				"%s\n",
+				ex.what());
+		}
 		return false;
 	}
 	return true;
@@ -346,33 +370,132 @@ CON_COMMAND_F_COMPLETION(sar_time_demos, "sar_time_demos <demo_name> [demo_name2
 		return console->Print(sar_time_demos.ThisPtr()->m_pszHelpString);
 	}
 
+	struct TimedDemo {
+		std::string name;
+		std::string path;
+		Demo demo;
+		bool ok;
+	};
+
+	// Resolve paths up front; the filesystem lookups aren't safe off the
+	// main thread
+	std::vector<TimedDemo> demos(args.ArgC() - 1);
+	for (size_t i = 0; i < demos.size(); ++i) {
+		auto &d = demos[i];
+		d.name = std::string(args[i + 1]);
+		if (!Utils::EndsWith(d.name, ".dem")) d.name += ".dem";
+		d.path = fileSystem->FindFileSomewhere(d.name).value_or(d.name);
+		d.ok = false;
+	}
+
+	// The dev output modes print while parsing, so they stay serial, unless
+	// benchmarking, where nothing prints while parsing
+	bool bench = sar_time_demos_bench.GetBool();
+	size_t threads = sar_time_demos_threads.GetInt();
+	if (threads == 0) threads = std::thread::hardware_concurrency();
+	if ((!bench && sar_time_demo_dev.GetInt() != 0) || threads == 0) threads = 1;
+	if (threads > demos.size()) threads = demos.size();
+
 	auto totalTicks = 0;
 	auto totalTime = 0.f;
 	auto printTotal = false;
 
-	DemoParser parser;
-	parser.outputMode = sar_time_demo_dev.GetInt();
-
-	for (auto i = 1; i < args.ArgC(); ++i) {
-		auto name = std::string(args[i]);
-
-		Demo demo;
-		if (!Utils::EndsWith(name, ".dem")) name += ".dem";
-		auto filepath = fileSystem->FindFileSomewhere(name).value_or(name);
-		if (parser.Parse(filepath, &demo)) {
-			parser.Adjust(&demo);
-			console->Print("Demo:     %s\n", name.c_str());
-			console->Print("Client:   %s\n", demo.clientName);
-			console->Print("Map:      %s\n", demo.mapName);
-			console->Print("Ticks:    %i\n", demo.playbackTicks);
-			console->Print("Time:     %.3f\n", demo.playbackTime);
-			console->Print("Tickrate: %.3f\n", demo.Tickrate());
+	auto printDemo = [&](TimedDemo &d, bool printSegment) {
+		if (d.ok) {
+			if (printSegment && d.demo.segmentTicks != -1) {
+				console->ColorMsg(Color(0, 255, 0, 255), "Segment length -> %d ticks: %.3fs\n", d.demo.segmentTicks, d.demo.segmentTicks * engine->GetIPT());
+			}
+			console->Print("Demo:     %s\n", d.name.c_str());
+			console->Print("Client:   %s\n", d.demo.clientName);
+			console->Print("Map:      %s\n", d.demo.mapName);
+			console->Print("Ticks:    %i\n", d.demo.playbackTicks);
+			console->Print("Time:     %.3f\n", d.demo.playbackTime);
+			console->Print("Tickrate: %.3f\n", d.demo.Tickrate());
 			console->Print("---------------\n");
-			totalTicks += demo.playbackTicks;
-			totalTime += demo.playbackTime;
+			totalTicks += d.demo.playbackTicks;
+			totalTime += d.demo.playbackTime;
 			printTotal = true;
 		} else {
-			console->Print("Could not parse \"%s\"!\n", name.c_str());
+			console->Print("Could not parse \"%s\"!\n", d.name.c_str());
+		}
+	};
+
+	// Parses the batch without printing anything, on `count` threads or on
+	// this one if that's 1
+	auto parseQuiet = [](std::vector<TimedDemo> &batch, size_t count) {
+		std::atomic<size_t> next(0);
+		auto work = [&]() {
+			for (size_t i; (i = next++) < batch.size();) {
+				DemoParser parser;
+				parser.quiet = true;
+				batch[i].ok = parser.ParseFile(batch[i].path, &batch[i].demo);
+				if (batch[i].ok) parser.Adjust(&batch[i].demo);
+			}
+		};
+		if (count <= 1) return work();
+		std::vector<std::thread> pool;
+		for (size_t t = 0; t < count; ++t) pool.emplace_back(work);
+		for (auto &t : pool) t.join();
+	};
+
+	if (bench) {
+		// Touch every page first so neither pass pays for reading the demos
+		// off disk
+		size_t bytes = 0;
+		volatile uint8_t sink = 0;
+		for (auto &d : demos) {
+			MappedFile file;
+			if (!file.Open(d.path)) continue;
+			for (size_t off = 0; off < file.Size(); off += 4096) sink = sink + file.Data()[off];
+			bytes += file.Size();
+		}
+
+		using clock = std::chrono::steady_clock;
+		std::vector<TimedDemo> serial = demos;
+		auto start = clock::now();
+		parseQuiet(serial, 1);
+		auto mid = clock::now();
+		parseQuiet(demos, threads);
+		auto end = clock::now();
+
+		int mismatches = 0;
+		for (size_t i = 0; i < demos.size(); ++i) {
+			auto &a = serial[i];
+			auto &b = demos[i];
+			if (a.ok != b.ok || (a.ok && (a.demo.playbackTicks != b.demo.playbackTicks || a.demo.playbackTime != b.demo.playbackTime || a.demo.segmentTicks != b.demo.segmentTicks || strcmp(a.demo.mapName, b.demo.mapName)))) {
+				console->Print("\"%s\" parsed differently on one thread and on %d!\n", b.name.c_str(), (int)threads);
+				++mismatches;
+			}
+		}
+
+		for (auto &d : demos) {
+			printDemo(d, true);
+		}
+
+		auto report = [&](const char *label, clock::duration took) {
+			double secs = std::chrono::duration<double>(took).count();
+			console->Print("%s %.1f ms, %.1f demos/s, %.1f MB/s\n", label, secs * 1000.0, demos.size() / secs, bytes / secs / 1000000.0);
+		};
+		report("1 thread: ", mid - start);
+		report(Utils::ssprintf("%d threads:", (int)threads).c_str(), end - mid);
+		console->Print("Speedup:   %.2fx\n", std::chrono::duration<double>(mid - start).count() / std::chrono::duration<double>(end - mid).count());
+		if (mismatches) console->Print("%d of %d demos differ between the serial and threaded paths\n", mismatches, (int)demos.size());
+	} else if (threads <= 1) {
+		DemoParser parser;
+		parser.outputMode = sar_time_demo_dev.GetInt();
+
+		for (auto &d : demos) {
+			d.ok = parser.ParseFile(d.path, &d.demo);
+			if (d.ok) parser.Adjust(&d.demo);
+			printDemo(d, false);
+		}
+	} else {
+		parseQuiet(demos, threads);
+
+		// Print in the order the demos were given, regardless of which
+		// finished first
+		for (auto &d : demos) {
+			printDemo(d, true);
 		}
 	}
 
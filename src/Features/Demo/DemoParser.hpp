@@ -12,14 +12,17 @@ class DemoParser {
 public:
 	bool headerOnly;
 	int outputMode;
+	bool quiet;  // Don't print anything, so ParseFile can run off the main thread
 	bool hasAlignmentByte;
 	int maxSplitScreenClients;
 
 public:
 	DemoParser();
-	static std::string DecodeCustomData(char *data);
+	static std::string DecodeCustomData(const char *data);
 	void Adjust(Demo *demo);
 	bool Parse(std::string filePath, Demo *demo, bool ghostRequest = false, std::map<int, DataGhost> *data = nullptr, CustomData *customData = nullptr);
+	// Like Parse, but takes a path that has already been resolved
+	bool ParseFile(const std::string &path, Demo *demo, bool ghostRequest = false, std::map<int, DataGhost> *data = nullptr, CustomData *customData = nullptr);
 };
 
 extern Variable sar_time_demo_dev;
@@ -1,5 +1,7 @@
 #include "GhostBendyModel.hpp"
 
+#include <vector>
+
 // Bendy model data
 // 2D (Y,Z) coordinates of vertices.
 const float BENDY_VERTS[] = {-13, 16, 13, 16, -13, 40, 13, 40, -12.55, 42.69, 12.55, 42.69, -11.26, 45.2, 11.26, 45.2, -9.19, 47.35, 9.19, 47.35, -6.5, 49.01, 6.5, 49.01, -3.36, 50.04, 3.36, 50.04, 0, 50.4, 11, 61, 10.63, 63.85, 9.53, 66.5, 7.78, 68.78, 5.5, 70.53, 2.85, 71.63, 0, 72, -2.85, 71.63, -5.5, 70.53, -7.78, 68.78, -9.53, 66.5, -10.63, 63.85, -11, 61, -10.63, 58.15, -9.53, 55.5, -7.78, 53.22, -5.5, 51.47, -2.85, 50.37, 0, 50, 2.85, 50.37, 5.5, 51.47, 7.78, 53.22, 9.53, 55.5, 10.63, 58.15, 9, 16, 1, 16, 1, 0, 9, 0, -1, 16, -9, 16, -9, 0, -1, 0, 9, 44, 3, 44, 3, 20, 9, 20, -3, 44, -9, 44, -9, 20, -3, 20, -13, 19, -13, 22, -13, 25, -13, 28, -13, 31, -13, 34, -13, 37, 13, 19, 13, 22, 13, 25, 13, 28, 13, 31, 13, 34, 13, 37};
@@ -43,3 +45,21 @@ bool GhostBendyModel::TryGetTriangleIndices(int triangleIndex, short *i1, short
 	*i3 = BENDY_INDICES[triangleIndex * 3 + 2];
 	return true;
 }
+
+const GhostBendyModel::VertexInfo *GhostBendyModel::GetBindPose() {
+	static std::vector<VertexInfo> pose;
+	if (pose.empty()) {
+		for (int i = 0; i < GetVerticesCount(); ++i) {
+			pose.push_back(GetVertexInfo(i));
+		}
+	}
+	return pose.data();
+}
+
+const short *GhostBendyModel::GetTriangleIndices() {
+	return BENDY_INDICES;
+}
+
+int GhostBendyModel::GetTrianglesCount() {
+	return BENDY_TRIANGLE_COUNT;
+}
@@ -24,4 +24,10 @@ namespace GhostBendyModel {
 	Group GetVertexGroup(int index);
 	VertexInfo GetVertexInfo(int index);
 	bool TryGetTriangleIndices(int triangleIndex, short *i1, short *i2, short *i3);
+
+	// The whole model at once, for drawing many ghosts without going
+	// through the per-vertex getters
+	const VertexInfo *GetBindPose();
+	const short *GetTriangleIndices();
+	int GetTrianglesCount();
 };
@@ -33,6 +33,8 @@ Variable ghost_show_names("ghost_show_names", "1", "Whether to show names above
 Variable ghost_name_font_size("ghost_name_font_size", "5.0", 0.1f, "The size to render ghost names at.\n");
 Variable ghost_spec_thirdperson("ghost_spec_thirdperson", "0", "Whether to spectate ghost from a third-person perspective.\n");
 Variable ghost_spec_thirdperson_dist("ghost_spec_thirdperson_dist", "300", 50, "The maximum distance from which to spectate in third-person.\n");
+Variable ghost_lod_distance("ghost_lod_distance", "0", 0, "Distance beyond which bendy ghosts are drawn using the simpler ghost_lod_type. 0 = never.\n");
+Variable ghost_lod_type("ghost_lod_type", "1", 0, 1, "Ghost type to draw distant bendy ghosts as. 0 = circle, 1 = pyramid.\n");
 Variable ghost_draw_through_walls("ghost_draw_through_walls", "0", 0, 2, "Whether to draw ghosts through walls. 0 = none, 1 = names, 2 = names and ghosts.\n");
 
 GhostEntity::GhostEntity(unsigned int &ID, std::string &name, DataGhost &data, std::string &current_map, bool network)
@@ -137,6 +139,12 @@ void GhostEntity::Display() {
 		return;
 	}
 
+	// Before anything reads the color, and before the ghost can be culled
+	// or swapped for a LOD model
+	if (GhostEntity::ghost_type == GhostType::BENDY) {
+		renderer.SetGhost(this);
+		renderer.UpdateColor();
+	}
 
 	Color col = GetColor();
 	int opacity = ghost_opacity.GetInt();
@@ -155,77 +163,100 @@ void GhostEntity::Display() {
 		solid = RenderCallback::shade(this->data.position + Vector{0,0,10}, solid);
 	}
 
-	MeshId mesh = OverlayRender::createMesh(solid, RenderCallback::none);
+	// Where it's seen from, for the LOD distance and to face circle ghosts
+	// towards; falls back to the player's eyes before anything is drawn
+	Vector pos;
+	if (!OverlayRender::nearestViewOrigin(this->data.position, &pos)) {
+		auto player = client->GetPlayer(GET_SLOT() + 1);
+		pos = player ? client->GetAbsOrigin(player) + client->GetViewOffset(player) : Vector{0, 0, 0};
+	}
+
+	GhostType type = GhostEntity::ghost_type;
+	float lod_dist = ghost_lod_distance.GetFloat();
+	if (type == GhostType::BENDY && lod_dist > 0 && (this->data.position - pos).SquaredLength() > lod_dist * lod_dist) {
+		type = ghost_lod_type.GetInt() == 0 ? GhostType::CIRCLE : GhostType::PYRAMID;
+	}
+
+	// Nothing to build if the ghost can't be on screen; the bendy model
+	// is 72 units tall, the others are ghost_height
+	float radius = fmaxf(fabsf(ghost_height.GetFloat()), 72.0f);
+	bool on_screen = OverlayRender::getCullCone().sphereVisible(this->data.position, radius);
+	if (GhostEntity::ghost_type == GhostType::BENDY && (!on_screen || type != GhostType::BENDY)) {
+		// keep its animations going for when it's drawn fully again
+		renderer.SetGhost(this);
+		renderer.UpdateWithoutDrawing();
+	}
+
+	if (on_screen) {
+		MeshId mesh = OverlayRender::createMesh(solid, RenderCallback::none);
 
 #define TRIANGLE(p1, p2, p3) OverlayRender::addTriangle(mesh, p1, p2, p3)
-	switch (GhostEntity::ghost_type) {
-	case GhostType::CIRCLE: {
-		float rad = ghost_height.GetFloat() / 2;
-		Vector origin = this->data.position + Vector(0, 0, rad);
+		switch (type) {
+		case GhostType::CIRCLE: {
+			float rad = ghost_height.GetFloat() / 2;
+			Vector origin = this->data.position + Vector(0, 0, rad);
 
-		const int tris = 30;
+			const int tris = 30;
 
-		auto player = client->GetPlayer(GET_SLOT() + 1);
-		Vector pos = player ? client->GetAbsOrigin(player) + client->GetViewOffset(player) : Vector{0, 0, 0};
+			float dx = origin.x - pos.x;
+			float dy = origin.y - pos.y;
+			float hdist = sqrt(dx * dx + dy * dy);
 
-		float dx = origin.x - pos.x;
-		float dy = origin.y - pos.y;
-		float hdist = sqrt(dx * dx + dy * dy);
+			double yaw =
+				origin.x == pos.x && origin.y == pos.y ? M_PI / 2 : atan2(origin.y - pos.y, origin.x - pos.x) + M_PI;
 
-		double yaw =
-			origin.x == pos.x && origin.y == pos.y ? M_PI / 2 : atan2(origin.y - pos.y, origin.x - pos.x) + M_PI;
+			double pitch =
+				hdist == 0 && origin.z == pos.z ? M_PI / 2 : atan2(origin.z - pos.z, hdist);
 
-		double pitch =
-			hdist == 0 && origin.z == pos.z ? M_PI / 2 : atan2(origin.z - pos.z, hdist);
+			auto rot = Math::AngleMatrix({(float)pitch, (float)yaw, 0});
 
-		auto rot = Math::AngleMatrix({(float)pitch, (float)yaw, 0});
+			for (int i = 0; i < tris; ++i) {
+				double lang = M_PI * 2 * i / tris;
+				double rang = M_PI * 2 * (i + 1) / tris;
 
-		for (int i = 0; i < tris; ++i) {
-			double lang = M_PI * 2 * i / tris;
-			double rang = M_PI * 2 * (i + 1) / tris;
+				Vector dl(0, (float)(cos(lang) * rad), (float)(sin(lang) * rad));
+				Vector dr(0, (float)(cos(rang) * rad), (float)(sin(rang) * rad));
 
-			Vector dl(0, (float)(cos(lang) * rad), (float)(sin(lang) * rad));
-			Vector dr(0, (float)(cos(rang) * rad), (float)(sin(rang) * rad));
+				Vector l = origin + rot * dl;
+				Vector r = origin + rot * dr;
 
-			Vector l = origin + rot * dl;
-			Vector r = origin + rot * dr;
+				TRIANGLE(r, l, origin);
+			}
 
-			TRIANGLE(r, l, origin);
+			break;
 		}
 
-		break;
-	}
-
-	case GhostType::PYRAMID:
-	case GhostType::PYRAMID_PGUN: {
-		Vector top = this->data.position + Vector{0, 0, ghost_height.GetFloat()};
+		case GhostType::PYRAMID:
+		case GhostType::PYRAMID_PGUN: {
+			Vector top = this->data.position + Vector{0, 0, ghost_height.GetFloat()};
 
-		Vector a = this->data.position + Vector{5, 5, 0};
-		Vector b = this->data.position + Vector{5, -5, 0};
-		Vector c = this->data.position + Vector{-5, -5, 0};
-		Vector d = this->data.position + Vector{-5, 5, 0};
+			Vector a = this->data.position + Vector{5, 5, 0};
+			Vector b = this->data.position + Vector{5, -5, 0};
+			Vector c = this->data.position + Vector{-5, -5, 0};
+			Vector d = this->data.position + Vector{-5, 5, 0};
 
-		TRIANGLE(a, b, top);
-		TRIANGLE(b, c, top);
-		TRIANGLE(c, d, top);
-		TRIANGLE(d, a, top);
-		TRIANGLE(b, a, c);
-		TRIANGLE(c, a, d);
+			TRIANGLE(a, b, top);
+			TRIANGLE(b, c, top);
+			TRIANGLE(c, d, top);
+			TRIANGLE(d, a, top);
+			TRIANGLE(b, a, c);
+			TRIANGLE(c, a, d);
 
-		break;
-	}
-	case GhostType::BENDY: {
-		// idk, some weird shit was happening when I was setting it in a constructor
-		// so I'm just leaving that here
-		renderer.SetGhost(this);
-		renderer.Draw(mesh);
-		break;
-	}
+			break;
+		}
+		case GhostType::BENDY: {
+			// idk, some weird shit was happening when I was setting it in a constructor
+			// so I'm just leaving that here
+			renderer.SetGhost(this);
+			renderer.Draw(mesh);
+			break;
+		}
 
-	default:
-		break;
-	}
+		default:
+			break;
+		}
 #undef TRIANGLE
+	}
 
 	if (this->prop_entity) {
 		if (GhostEntity::ghost_type == GhostType::MODEL) {
@@ -466,9 +497,9 @@ void GhostEntity::StopFollowing() {
 	crosshairVariable.SetValue(crosshair_value);
 	void *player = server->GetPlayer(GET_SLOT() + 1);
 	if (player) {
-		SE(player)->field<int>("m_fFlags") &= ~FL_GODMODE;
-		SE(player)->field<int>("m_fFlags") &= ~FL_NOTARGET;
-		SE(player)->field<float>("m_flGravity") = 1.0f;
+		SE(player)->field<int>(ENT_FIELD("m_fFlags")) &= ~FL_GODMODE;
+		SE(player)->field<int>(ENT_FIELD("m_fFlags")) &= ~FL_NOTARGET;
+		SE(player)->field<float>(ENT_FIELD("m_flGravity")) = 1.0f;
 	}
 }
 
@@ -699,7 +730,7 @@ ON_EVENT(PRE_TICK) {
 	engine->ExecuteCommand(cmd.c_str());
 
 	// Make sure we have godmode so we can't die while spectating someone
-	SE(player)->field<int>("m_fFlags") |= FL_GODMODE;
-	SE(player)->field<int>("m_fFlags") |= FL_NOTARGET;
-	SE(player)->field<float>("m_flGravity") = FLT_MIN;
+	SE(player)->field<int>(ENT_FIELD("m_fFlags")) |= FL_GODMODE;
+	SE(player)->field<int>(ENT_FIELD("m_fFlags")) |= FL_NOTARGET;
+	SE(player)->field<float>(ENT_FIELD("m_flGravity")) = FLT_MIN;
 }
@@ -39,35 +39,32 @@ void GhostRenderer::UpdateAnimationStates(float deltaTime) {
 }
 
 void GhostRenderer::UpdateAnimatedVertices(float deltaTime) {
-	for (int vertexIndex = 0; vertexIndex < GhostBendyModel::GetVerticesCount(); vertexIndex++) {
-		auto vertexInfo = GhostBendyModel::GetVertexInfo(vertexIndex);
+	const auto *bindPose = GhostBendyModel::GetBindPose();
+	int vertexCount = GhostBendyModel::GetVerticesCount();
 
-		Vector animatedPos = vertexInfo.position;
+	// local to world space transform, same for every vertex
+	float yawCos = cosf(DEG2RAD(ghost->data.view_angle.y));
+	float yawSin = sinf(DEG2RAD(ghost->data.view_angle.y));
+	Vector origin = ghost->data.position;
+
+	for (int vertexIndex = 0; vertexIndex < vertexCount; vertexIndex++) {
+		const auto &vertexInfo = bindPose[vertexIndex];
+
+		Vector v = vertexInfo.position;
 
 		for (const auto &animation : animations) {
-			animation.UpdateVertex(vertexInfo, animatedPos);
+			animation.UpdateVertex(vertexInfo, v);
 		}
 
-		TransformVertexFromLocalToWorldSpace(animatedPos);
-
-		animatedVerts[vertexIndex] = animatedPos;
+		animatedVerts[vertexIndex] = origin + Vector{
+			v.x * yawCos - v.y * yawSin,
+			v.x * yawSin + v.y * yawCos,
+			v.z
+		};
 	}
 }
 
-void GhostRenderer::TransformVertexFromLocalToWorldSpace(Vector &vertex) {
-	float yawCos = cosf(DEG2RAD(ghost->data.view_angle.y));
-	float yawSin = sinf(DEG2RAD(ghost->data.view_angle.y));
-
-	vertex = {
-		vertex.x * yawCos - vertex.y * yawSin,
-		vertex.x * yawSin + vertex.y * yawCos,
-		vertex.z
-	};
-
-	vertex += ghost->data.position;
-}
-
-void GhostRenderer::Draw(MeshId &mesh) {
+void GhostRenderer::UpdateColor() {
 	if (ghost == nullptr) return;
 
 	if (ghost->name == "jeb_" || ghost->name == "AMJ") {
@@ -76,21 +73,25 @@ void GhostRenderer::Draw(MeshId &mesh) {
 		int hue = (server / 4) % 360;
 		ghost->color = Utils::HSVToRGB(hue, 100, 100);
 	}
+}
+
+void GhostRenderer::Draw(MeshId &mesh) {
+	if (ghost == nullptr) return;
 
 	//update verts before drawing
 	UpdateAnimation();
-	
-	// draw each triangle
-	int triangleIndex = 0;
-	short i1, i2, i3;
-	while(GhostBendyModel::TryGetTriangleIndices(triangleIndex, &i1, &i2, &i3)) {
-		Vector p1 = animatedVerts[i1];
-		Vector p2 = animatedVerts[i2];
-		Vector p3 = animatedVerts[i3];
-
-		OverlayRender::addTriangle(mesh, p1, p2, p3);
-		triangleIndex++;
-	}
+
+	OverlayRender::addTriangles(mesh, animatedVerts.data(), GhostBendyModel::GetTriangleIndices(), GhostBendyModel::GetTrianglesCount());
+}
+
+void GhostRenderer::UpdateWithoutDrawing() {
+	if (ghost == nullptr) return;
+
+	float time = engine->GetHostTime();
+	float dt = fminf(fmaxf(time - lastUpdateCall, 0.0f), 0.1f);
+	lastUpdateCall = time;
+
+	UpdateAnimationStates(dt);
 }
 
 void GhostRenderer::SetGhost(GhostEntity* ghost) {
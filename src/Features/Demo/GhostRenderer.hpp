@@ -47,11 +47,15 @@ private:
 	void UpdateAnimation();
 	void UpdateAnimationStates(float deltaTime);
 	void UpdateAnimatedVertices(float deltaTime);
-	void TransformVertexFromLocalToWorldSpace(Vector &vertex);
 public:
 	GhostRenderer();
 	void SetGhost(GhostEntity *ghost);
+	// Cycles the rainbow color of jeb_ and AMJ; called every frame, whether
+	// or not the ghost ends up drawn with the full model
+	void UpdateColor();
 	void Draw(MeshId &mesh);
+	// Keeps animations running for a ghost which isn't drawn this frame
+	void UpdateWithoutDrawing();
 	void StartAnimation(const GhostAnimationDefinition &animation);
 	float GetHeight();
 };
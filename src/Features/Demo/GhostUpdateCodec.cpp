@@ -0,0 +1,246 @@
+#include "GhostUpdateCodec.hpp"
+
+#include <cmath>
+#include <cstring>
+
+// Quantization {{{
+
+static int32_t quantizePos(float x) {
+	return (int32_t)lroundf(x * 32.0f);
+}
+
+static float dequantizePos(int32_t x) {
+	return x / 32.0f;
+}
+
+static uint16_t quantizeAngle(float a) {
+	return (uint16_t)(lroundf(a * (65536.0f / 360.0f)) & 0xFFFF);
+}
+
+static float dequantizeAngle(uint16_t a) {
+	return (int16_t)a * (360.0f / 65536.0f);
+}
+
+QuantizedGhost QuantizedGhost::From(const DataGhost &data) {
+	QuantizedGhost q{};
+	q.valid = data.IsValid();
+	if (!q.valid) return q;
+
+	q.pos[0] = quantizePos(data.position.x);
+	q.pos[1] = quantizePos(data.position.y);
+	q.pos[2] = quantizePos(data.position.z);
+	q.ang[0] = quantizeAngle(data.view_angle.x);
+	q.ang[1] = quantizeAngle(data.view_angle.y);
+	q.ang[2] = quantizeAngle(data.view_angle.z);
+	// Same packing as the protocol 1 DataGhost; the view offset should
+	// never exceed 64
+	q.misc = ((int)data.view_offset & 0x7F) | (data.grounded ? 0x80 : 0x00);
+	return q;
+}
+
+DataGhost QuantizedGhost::ToData() const {
+	if (!this->valid) return DataGhost::Invalid();
+
+	return DataGhost{
+		{dequantizePos(this->pos[0]), dequantizePos(this->pos[1]), dequantizePos(this->pos[2])},
+		{dequantizeAngle(this->ang[0]), dequantizeAngle(this->ang[1]), dequantizeAngle(this->ang[2])},
+		(float)(this->misc & 0x7F),
+		(this->misc & 0x80) != 0,
+	};
+}
+
+bool QuantizedGhost::operator==(const QuantizedGhost &other) const {
+	if (this->valid != other.valid) return false;
+	if (!this->valid) return true;
+	return !memcmp(this->pos, other.pos, sizeof this->pos) && !memcmp(this->ang, other.ang, sizeof this->ang) && this->misc == other.misc;
+}
+
+// }}}
+
+// Byte helpers {{{
+
+static void put8(std::vector<uint8_t> &out, uint8_t x) {
+	out.push_back(x);
+}
+
+static void put16(std::vector<uint8_t> &out, uint16_t x) {
+	out.push_back(x & 0xFF);
+	out.push_back(x >> 8);
+}
+
+static void put32(std::vector<uint8_t> &out, uint32_t x) {
+	put16(out, x & 0xFFFF);
+	put16(out, x >> 16);
+}
+
+struct ByteReader {
+	const uint8_t *pos;
+	const uint8_t *end;
+	bool ok = true;
+
+	uint8_t Get8() {
+		if (this->pos + 1 > this->end) {
+			this->ok = false;
+			return 0;
+		}
+		return *this->pos++;
+	}
+	uint16_t Get16() {
+		uint16_t lo = this->Get8();
+		return lo | (uint16_t)(this->Get8() << 8);
+	}
+	uint32_t Get32() {
+		uint32_t lo = this->Get16();
+		return lo | ((uint32_t)this->Get16() << 16);
+	}
+};
+
+// }}}
+
+// Encoder {{{
+
+GhostUpdateEncoder::GhostUpdateEncoder() {
+	this->Reset();
+}
+
+void GhostUpdateEncoder::Reset() {
+	for (auto &entry : this->history) entry.used = false;
+	this->nextSeq = 0;
+	this->hasAnchor = false;
+	this->anchorSeq = 0;
+	this->sinceKeyframe = 0;
+}
+
+void GhostUpdateEncoder::Ack(uint16_t seq) {
+	// The ack is just the newest update the server has, so a keyframe only
+	// becomes the anchor when it's acknowledged itself. Acks can arrive out
+	// of order over UDP; only move forwards
+	auto &entry = this->history[seq % GHOST_UPDATE_HISTORY];
+	if (!entry.used || entry.seq != seq || !entry.keyframe) return;
+	if (this->hasAnchor && (int16_t)(seq - this->anchorSeq) <= 0) return;
+	this->hasAnchor = true;
+	this->anchorSeq = seq;
+}
+
+std::vector<uint8_t> GhostUpdateEncoder::Encode(const DataGhost &data) {
+	auto state = QuantizedGhost::From(data);
+	uint16_t seq = this->nextSeq++;
+
+	// Delta against the anchor while we still remember it, unless it's
+	// time for a keyframe. Until a new keyframe is acknowledged, the old
+	// anchor keeps being used
+	const QuantizedGhost *base = nullptr;
+	uint16_t age = seq - this->anchorSeq;
+	if (this->hasAnchor && age > 0 && age < GHOST_UPDATE_HISTORY && this->sinceKeyframe < GHOST_UPDATE_KEYFRAME_INTERVAL) {
+		auto &entry = this->history[this->anchorSeq % GHOST_UPDATE_HISTORY];
+		if (entry.used && entry.seq == this->anchorSeq && entry.state.valid && state.valid) base = &entry.state;
+	}
+
+	std::vector<uint8_t> out;
+	out.reserve(32);
+	put16(out, seq);
+	put8(out, base ? (uint8_t)age : GHOST_UPDATE_KEYFRAME_AGE);
+
+	uint8_t flags = 0;
+	if (!state.valid) {
+		flags = GHOST_UPDATE_INVALID;
+	} else if (!base) {
+		flags = GHOST_UPDATE_POS_ABS | GHOST_UPDATE_ANG_ABS | GHOST_UPDATE_MISC;
+	} else {
+		bool posChanged = false, posSmall = true;
+		bool angChanged = false, angSmall = true;
+		for (int i = 0; i < 3; ++i) {
+			int64_t dp = (int64_t)state.pos[i] - base->pos[i];
+			int16_t da = (int16_t)(state.ang[i] - base->ang[i]);
+			posChanged |= dp != 0;
+			posSmall &= dp >= INT16_MIN && dp <= INT16_MAX;
+			angChanged |= da != 0;
+			angSmall &= da >= INT8_MIN && da <= INT8_MAX;
+		}
+		if (posChanged) flags |= posSmall ? GHOST_UPDATE_POS_DELTA : GHOST_UPDATE_POS_ABS;
+		if (angChanged) flags |= angSmall ? GHOST_UPDATE_ANG_DELTA : GHOST_UPDATE_ANG_ABS;
+		if (state.misc != base->misc) flags |= GHOST_UPDATE_MISC;
+	}
+	put8(out, flags);
+
+	for (int i = 0; i < 3; ++i) {
+		if (flags & GHOST_UPDATE_POS_DELTA) put16(out, (uint16_t)(state.pos[i] - base->pos[i]));
+		if (flags & GHOST_UPDATE_POS_ABS) put32(out, (uint32_t)state.pos[i]);
+	}
+	for (int i = 0; i < 3; ++i) {
+		if (flags & GHOST_UPDATE_ANG_DELTA) put8(out, (uint8_t)(state.ang[i] - base->ang[i]));
+		if (flags & GHOST_UPDATE_ANG_ABS) put16(out, state.ang[i]);
+	}
+	if (flags & GHOST_UPDATE_MISC) put8(out, state.misc);
+
+	if (base) {
+		++this->sinceKeyframe;
+	} else {
+		this->sinceKeyframe = 0;
+	}
+
+	auto &entry = this->history[seq % GHOST_UPDATE_HISTORY];
+	entry.seq = seq;
+	entry.used = true;
+	entry.keyframe = !base;
+	entry.state = state;
+
+	return out;
+}
+
+// }}}
+
+// Decoder {{{
+
+GhostUpdateDecoder::GhostUpdateDecoder()
+	: hasLatest(false)
+	, latestSeq(0) {
+	for (auto &entry : this->history) entry.used = false;
+}
+
+bool GhostUpdateDecoder::Decode(const uint8_t *buf, size_t len, DataGhost &out) {
+	ByteReader r{buf, buf + len};
+	uint16_t seq = r.Get16();
+	uint8_t age = r.Get8();
+	uint8_t flags = r.Get8();
+	if (!r.ok || age >= GHOST_UPDATE_HISTORY) return false;
+
+	QuantizedGhost state{};
+	if (age != GHOST_UPDATE_KEYFRAME_AGE) {
+		uint16_t baseSeq = seq - age;
+		auto &entry = this->history[baseSeq % GHOST_UPDATE_HISTORY];
+		if (!entry.used || entry.seq != baseSeq) return false;  // Missed the base; wait for a keyframe
+		state = entry.state;
+	}
+
+	if (flags & GHOST_UPDATE_INVALID) {
+		state = QuantizedGhost{};
+	} else {
+		state.valid = true;
+		for (int i = 0; i < 3; ++i) {
+			if (flags & GHOST_UPDATE_POS_DELTA) state.pos[i] += (int16_t)r.Get16();
+			if (flags & GHOST_UPDATE_POS_ABS) state.pos[i] = (int32_t)r.Get32();
+		}
+		for (int i = 0; i < 3; ++i) {
+			if (flags & GHOST_UPDATE_ANG_DELTA) state.ang[i] += (int8_t)r.Get8();
+			if (flags & GHOST_UPDATE_ANG_ABS) state.ang[i] = r.Get16();
+		}
+		if (flags & GHOST_UPDATE_MISC) state.misc = r.Get8();
+	}
+	if (!r.ok) return false;
+
+	auto &entry = this->history[seq % GHOST_UPDATE_HISTORY];
+	entry.seq = seq;
+	entry.used = true;
+	entry.state = state;
+
+	// Late packets still serve as bases, but never move the ghost back
+	if (this->hasLatest && (int16_t)(seq - this->latestSeq) <= 0) return false;
+	this->hasLatest = true;
+	this->latestSeq = seq;
+
+	out = state.ToData();
+	return true;
+}
+
+// }}}
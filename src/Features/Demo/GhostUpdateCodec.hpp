@@ -0,0 +1,96 @@
+#pragma once
+#include "Features/Demo/GhostEntity.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// Wire format for protocol 2 UPDATE payloads. Each update is quantized
+// and delta coded against an earlier keyframe from the same sender:
+//
+//   uint16 seq
+//   uint8  base age (seq - base seq; 0 means a keyframe, coded absolutely)
+//   uint8  flags (GHOST_UPDATE_*), then the fields they announce in order
+//
+// All multi-byte fields are little endian. The server relays payloads
+// verbatim, so every receiver decodes against its own copy of the
+// sender's history. Only the server acknowledges updates, not the other
+// receivers, so deltas are never chained: they all refer to the newest
+// keyframe the server is known to have. A receiver that lost an update
+// only misses that one, and one that lost the keyframe skips deltas until
+// the next.
+
+#define GHOST_PROTOCOL_VERSION 2
+
+#define GHOST_UPDATE_BASE_AGE_OFFSET 2  // Byte offset of the base age in a payload
+#define GHOST_UPDATE_KEYFRAME_AGE 0     // Base age of a keyframe
+#define GHOST_UPDATE_MAX_PAYLOAD 255    // Payloads are relayed with a uint8 length
+#define GHOST_UPDATE_NO_ACK 0xFFFFFFFF  // Relayed ack before any of our updates arrived
+
+#define GHOST_UPDATE_HISTORY 32           // Updates remembered per sender; also the furthest back a delta can reach
+#define GHOST_UPDATE_KEYFRAME_INTERVAL 20  // Updates between forced keyframes
+
+#define GHOST_UPDATE_POS_DELTA (1 << 0)  // 3 x int16 delta
+#define GHOST_UPDATE_POS_ABS (1 << 1)    // 3 x int32
+#define GHOST_UPDATE_ANG_DELTA (1 << 2)  // 3 x int8 delta
+#define GHOST_UPDATE_ANG_ABS (1 << 3)    // 3 x uint16
+#define GHOST_UPDATE_MISC (1 << 4)       // uint8 view offset (7 bits) and grounded (top bit)
+#define GHOST_UPDATE_INVALID (1 << 5)    // DataGhost::Invalid(), no fields follow
+
+// Position is in 1/32 units, angles in 1/65536 turns
+struct QuantizedGhost {
+	int32_t pos[3];
+	uint16_t ang[3];
+	uint8_t misc;
+	bool valid;
+
+	static QuantizedGhost From(const DataGhost &data);
+	DataGhost ToData() const;
+	bool operator==(const QuantizedGhost &other) const;
+};
+
+class GhostUpdateEncoder {
+private:
+	struct Entry {
+		uint16_t seq;
+		bool used;
+		bool keyframe;
+		QuantizedGhost state;
+	};
+
+	Entry history[GHOST_UPDATE_HISTORY];
+	uint16_t nextSeq;
+	// The newest keyframe the server has acknowledged
+	bool hasAnchor;
+	uint16_t anchorSeq;
+	int sinceKeyframe;
+
+public:
+	GhostUpdateEncoder();
+	void Reset();
+	// The server reports the newest of our updates it has received
+	void Ack(uint16_t seq);
+	std::vector<uint8_t> Encode(const DataGhost &data);
+
+	static bool IsKeyframe(const std::vector<uint8_t> &payload) {
+		return payload.size() > GHOST_UPDATE_BASE_AGE_OFFSET && payload[GHOST_UPDATE_BASE_AGE_OFFSET] == GHOST_UPDATE_KEYFRAME_AGE;
+	}
+};
+
+class GhostUpdateDecoder {
+private:
+	struct Entry {
+		uint16_t seq;
+		bool used;
+		QuantizedGhost state;
+	};
+
+	Entry history[GHOST_UPDATE_HISTORY];
+	bool hasLatest;
+	uint16_t latestSeq;
+
+public:
+	GhostUpdateDecoder();
+	// Returns false if the update should be skipped: it's malformed, its
+	// base was never received, or it's older than one already applied
+	bool Decode(const uint8_t *buf, size_t len, DataGhost &out);
+};
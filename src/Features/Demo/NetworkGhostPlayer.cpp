@@ -17,6 +17,7 @@
 #include "Modules/Surface.hpp"
 #include "Scheduler.hpp"
 
+#include <algorithm>
 #include <chrono>
 #include <functional>
 #include <queue>
@@ -304,6 +305,75 @@ sf::Packet &operator<<(sf::Packet &packet, const Color &col) {
 	return packet << col.r << col.g << col.b;
 }
 
+// Protocol 2 {{{
+
+// These are shared by NetworkManager and the loopback server stand-in
+// below, so the stand-in exercises exactly what goes over the wire
+
+// Both ends put their protocol version last in the CONNECT handshake: the
+// client after its own info, the server after the ghost list. Older ones
+// stop reading before it, and don't send one
+static sf::Packet connectPacket(unsigned short port, const std::string &name, const std::string &modelName, const std::string &map, bool tcpOnly, Color color, bool spectator) {
+	sf::Packet packet;
+	packet << HEADER::CONNECT << port << name.c_str() << DataGhost{{0, 0, 0}, {0, 0, 0}, 0, false} << modelName.c_str() << map.c_str() << tcpOnly << color << spectator << (uint8_t)GHOST_PROTOCOL_VERSION;
+	return packet;
+}
+
+static int readProtocolVersion(sf::Packet &packet) {
+	uint8_t version;
+	if (!(packet >> version)) return 1;
+	return std::clamp<int>(version, 1, GHOST_PROTOCOL_VERSION);
+}
+
+// Returns whether a keyframe was sent
+static bool writeUpdate(sf::Packet &packet, int protocolVersion, GhostUpdateEncoder &encoder, const DataGhost &data) {
+	if (protocolVersion < 2) {
+		packet << data;
+		return false;
+	}
+	auto payload = encoder.Encode(data);
+	packet.append(payload.data(), payload.size());
+	return GhostUpdateEncoder::IsKeyframe(payload);
+}
+
+// The server relays each sender's payload untouched, with its length,
+// after acknowledging the newest of ours it has seen:
+//   uint32 ack (GHOST_UPDATE_NO_ACK if none), uint32 count,
+//   count x { uint32 sender ID, uint8 length, payload }
+static void writeRelayedUpdates(sf::Packet &packet, uint32_t ack, const std::vector<std::pair<uint32_t, std::vector<uint8_t>>> &updates) {
+	packet << ack << (uint32_t)updates.size();
+	for (auto &[id, payload] : updates) {
+		packet << id << (uint8_t)payload.size();
+		packet.append(payload.data(), payload.size());
+	}
+}
+
+template <typename F>
+static void readRelayedUpdates(sf::Packet &packet, uint32_t selfID, GhostUpdateEncoder &encoder, std::unordered_map<uint32_t, GhostUpdateDecoder> &decoders, F apply) {
+	uint32_t ack;
+	uint32_t nupdates;
+	packet >> ack >> nupdates;
+	if (!packet) return;
+	if (ack != GHOST_UPDATE_NO_ACK) encoder.Ack((uint16_t)ack);
+	for (size_t i = 0; i < nupdates; ++i) {
+		uint32_t ghost_id;
+		uint8_t len;
+		packet >> ghost_id >> len;
+		// A truncated or corrupt packet; nothing after this can be trusted
+		if (!packet || len > packet.getDataSize() - packet.getReadPosition()) return;
+
+		uint8_t payload[GHOST_UPDATE_MAX_PAYLOAD];
+		for (uint8_t j = 0; j < len; ++j) packet >> payload[j];
+
+		if (ghost_id == selfID) continue;
+		DataGhost data;
+		if (!decoders[ghost_id].Decode(payload, len, data)) continue;
+		apply(ghost_id, data);
+	}
+}
+
+// }}}
+
 Variable ghost_TCP_only("ghost_TCP_only", "0", "Uses only TCP for ghost servers. For people with unreliable internet.\n");
 Variable ghost_update_rate("ghost_update_rate", "50", 1, "Milliseconds between ghost updates. For people with slow/metered internet.\n");
 Variable ghost_net_dump("ghost_net_dump", "0", "Dump all ghost network activity to a file for debugging.\n");
@@ -368,8 +438,7 @@ void NetworkManager::Connect(sf::IpAddress ip, unsigned short int port, bool spe
 
 		this->spectator = spectator;
 
-		sf::Packet connection_packet;
-		connection_packet << HEADER::CONNECT << this->udpSocket.getLocalPort() << this->name.c_str() << DataGhost{{0, 0, 0}, {0, 0, 0}, 0, false} << this->modelName.c_str() << engine->GetCurrentMapName().c_str() << ghost_TCP_only.GetBool() << GhostEntity::set_color << spectator;
+		auto connection_packet = connectPacket(this->udpSocket.getLocalPort(), this->name, this->modelName, engine->GetCurrentMapName(), ghost_TCP_only.GetBool(), GhostEntity::set_color, spectator);
 		this->tcpSocket.send(connection_packet);
 
 		{
@@ -421,6 +490,13 @@ void NetworkManager::Connect(sf::IpAddress ip, unsigned short int port, bool spe
 					++nb_players;
 			}
 
+			this->protocolVersion = readProtocolVersion(confirm_connection);
+			this->updateEncoder.Reset();
+			this->updateDecoders.clear();
+			this->updatesSent = 0;
+			this->keyframesSent = 0;
+			this->updateBytesSent = 0;
+
 			this->UpdateGhostsSameMap();
 			if (engine->isRunning()) {
 				this->SpawnAllGhosts();
@@ -548,14 +624,18 @@ void NetworkManager::SendPlayerData() {
 	{
 		sf::Packet packet;
 		packet << HEADER::UPDATE << this->ID;
+		DataGhost data = DataGhost::Invalid();
 		auto player = client->GetPlayer(GET_SLOT() + 1);
 		if (player) {
 			bool grounded = player->ground_entity();
-			packet << DataGhost{client->GetAbsOrigin(player), engine->GetAngles(engine->IsOrange() ? 0 : GET_SLOT()), client->GetViewOffset(player).z, grounded};
-		} else {
-			packet << DataGhost::Invalid();
+			data = DataGhost{client->GetAbsOrigin(player), engine->GetAngles(engine->IsOrange() ? 0 : GET_SLOT()), client->GetViewOffset(player).z, grounded};
 		}
 
+		if (writeUpdate(packet, this->protocolVersion, this->updateEncoder, data)) ++this->keyframesSent;
+
+		++this->updatesSent;
+		this->updateBytesSent += packet.getDataSize();
+
 		if (!ghost_TCP_only.GetBool()) {
 			this->udpSocket.send(packet, this->serverIP, this->serverPort);
 		} else {
@@ -814,6 +894,8 @@ void NetworkManager::Treat(sf::Packet &packet, bool udp) {
 	case HEADER::DISCONNECT: {
 		addToNetDump("recv-disconnect", Utils::ssprintf("%d", ID).c_str());
 
+		this->updateDecoders.erase(ID);
+
 		this->voiceStreamsLock.lock();
 		auto streamIt = voiceStreams.find(ID);
 		if (streamIt != voiceStreams.end()) {
@@ -1005,7 +1087,15 @@ void NetworkManager::Treat(sf::Packet &packet, bool udp) {
 		break;
 	}
 	case HEADER::UPDATE: {
-		if (ID == 0) {
+		if (ID == 0 && this->protocolVersion >= 2) {
+			readRelayedUpdates(packet, this->ID, this->updateEncoder, this->updateDecoders, [&](uint32_t ghost_id, const DataGhost &data) {
+				if (!data.IsValid()) return;
+				auto ghost = this->GetGhostByID(ghost_id);
+				if (!ghost) return;
+
+				ghost->SetData(data, true);
+			});
+		} else if (ID == 0) {
 			// This packet contains updates for multiple ghosts
 			uint32_t nupdates;
 			packet >> nupdates;
@@ -1487,6 +1577,254 @@ CON_COMMAND(ghost_debug, "ghost_debug - output a fuckton of debug info about net
 	networkManager.ghostPoolLock.unlock();
 }
 
+CON_COMMAND(ghost_update_stats, "ghost_update_stats - print how much data ghost position updates have sent this connection\n") {
+	if (!networkManager.isConnected) {
+		return console->Print("Not connected to a server\n");
+	}
+
+	uint32_t updates = networkManager.updatesSent;
+	uint64_t bytes = networkManager.updateBytesSent;
+	// HEADER + ID + full DataGhost
+	uint64_t legacyBytes = (uint64_t)updates * (1 + 4 + 12 + 12 + 1);
+
+	console->Print("Protocol version: %d\n", networkManager.protocolVersion);
+	console->Print("Updates sent: %u (%u keyframes)\n", updates, (uint32_t)networkManager.keyframesSent);
+	console->Print("Bytes sent: %llu (%.1f per update)\n", (unsigned long long)bytes, updates ? (float)bytes / updates : 0.0f);
+	if (legacyBytes) {
+		console->Print("Size compared to protocol 1: %.1f%%\n", bytes * 100.0f / legacyBytes);
+	}
+}
+
+// Loopback server {{{
+
+// An in-process stand-in for the server side of protocol 2, to check the
+// client against until a real server speaks it. It does only what the
+// server has to: answer the version in CONNECT, keep the newest update
+// from each client, and fan them out with each recipient's ack
+class GhostLoopbackServer {
+private:
+	struct Client {
+		uint32_t id;
+		int protocolVersion;
+		bool hasLatest;
+		uint16_t latestSeq;
+		std::vector<uint8_t> latest;
+	};
+
+	int version;
+	uint32_t nextID = 1;
+	std::vector<Client> clients;
+
+	Client *GetClient(uint32_t id) {
+		for (auto &c : this->clients) {
+			if (c.id == id) return &c;
+		}
+		return nullptr;
+	}
+
+public:
+	GhostLoopbackServer(int version)
+		: version(version) {
+	}
+
+	sf::Packet Connect(sf::Packet &packet) {
+		HEADER header;
+		unsigned short port;
+		std::string name, modelName, map;
+		DataGhost data;
+		bool tcpOnly, spectator;
+		Color color;
+		packet >> header >> port >> name >> data >> modelName >> map >> tcpOnly >> color >> spectator;
+
+		Client c{this->nextID++, 1, false, 0, {}};
+		if (this->version >= 2) c.protocolVersion = std::min(readProtocolVersion(packet), this->version);
+		this->clients.push_back(c);
+
+		// Nobody else is in the ghost list; the relay below is where they
+		// show up
+		sf::Packet reply;
+		reply << c.id << (uint32_t)0;
+		if (this->version >= 2) reply << (uint8_t)this->version;
+		return reply;
+	}
+
+	void Receive(sf::Packet &packet) {
+		HEADER header;
+		uint32_t id;
+		packet >> header >> id;
+		auto c = this->GetClient(id);
+		if (!packet || header != HEADER::UPDATE || !c || c->protocolVersion < 2) return;
+
+		size_t start = packet.getReadPosition();
+		size_t len = packet.getDataSize() - start;
+		if (len < sizeof(uint16_t) || len > GHOST_UPDATE_MAX_PAYLOAD) return;
+		auto payload = (const uint8_t *)packet.getData() + start;
+
+		uint16_t seq = payload[0] | (payload[1] << 8);
+		if (c->hasLatest && (int16_t)(seq - c->latestSeq) <= 0) return;
+		c->hasLatest = true;
+		c->latestSeq = seq;
+		c->latest.assign(payload, payload + len);
+	}
+
+	// The newest update from id, which the next relay will carry
+	std::optional<uint16_t> LatestSeq(uint32_t id) {
+		auto c = this->GetClient(id);
+		if (!c || !c->hasLatest) return {};
+		return c->latestSeq;
+	}
+
+	sf::Packet Relay(uint32_t to) {
+		auto recipient = this->GetClient(to);
+		std::vector<std::pair<uint32_t, std::vector<uint8_t>>> updates;
+		for (auto &c : this->clients) {
+			if (c.id != to && c.hasLatest) updates.push_back({c.id, c.latest});
+		}
+
+		sf::Packet packet;
+		packet << HEADER::UPDATE << (uint32_t)0;
+		writeRelayedUpdates(packet, recipient && recipient->hasLatest ? recipient->latestSeq : GHOST_UPDATE_NO_ACK, updates);
+		return packet;
+	}
+};
+
+CON_COMMAND(ghost_loopback_test, "ghost_loopback_test [ticks] [loss] - run two simulated clients through an in-process protocol 2 server, losing the given percentage of packets each way\n") {
+	int ticks = args.ArgC() >= 2 ? std::atoi(args[1]) : 5000;
+	int loss = args.ArgC() >= 3 ? std::atoi(args[2]) : 10;
+	if (ticks <= 0 || loss < 0 || loss >= 100) {
+		return console->Print(ghost_loopback_test.ThisPtr()->m_pszHelpString);
+	}
+
+	uint32_t rng = 0x9E3779B9;
+	auto random = [&](int n) {
+		rng ^= rng << 13;
+		rng ^= rng >> 17;
+		rng ^= rng << 5;
+		return (int)(rng % n);
+	};
+
+	bool ok = true;
+
+	// Handshake, against an old server and a new one
+	for (int serverVersion = 1; serverVersion <= GHOST_PROTOCOL_VERSION; ++serverVersion) {
+		GhostLoopbackServer server(serverVersion);
+		auto connect = connectPacket(0, "loopback", "", "", false, {255, 255, 255}, false);
+		auto reply = server.Connect(connect);
+		uint32_t id, nb_ghosts;
+		reply >> id >> nb_ghosts;
+		int negotiated = readProtocolVersion(reply);
+		console->Print("Protocol %d server: negotiated protocol %d\n", serverVersion, negotiated);
+		ok &= negotiated == serverVersion;
+	}
+
+	struct SimClient {
+		uint32_t id;
+		int protocolVersion;
+		GhostUpdateEncoder encoder;
+		std::unordered_map<uint32_t, GhostUpdateDecoder> decoders;
+		DataGhost data;
+		QuantizedGhost sent[65536];  // By seq
+	};
+
+	GhostLoopbackServer server(GHOST_PROTOCOL_VERSION);
+	auto clients = std::make_unique<SimClient[]>(2);
+	for (int i = 0; i < 2; ++i) {
+		auto &c = clients[i];
+		auto connect = connectPacket(0, Utils::ssprintf("loopback%d", i), "", "", false, {255, 255, 255}, false);
+		auto reply = server.Connect(connect);
+		uint32_t nb_ghosts;
+		reply >> c.id >> nb_ghosts;
+		c.protocolVersion = readProtocolVersion(reply);
+		c.data = DataGhost{{(float)i * 100, 0, 0}, {0, 0, 0}, 64, true};
+	}
+
+	uint32_t updates = 0, keyframes = 0, applied = 0, skipped = 0, mismatches = 0;
+	uint64_t bytes = 0;
+	for (int tick = 0; tick < ticks; ++tick) {
+		for (int i = 0; i < 2; ++i) {
+			auto &c = clients[i];
+			uint16_t seq = (uint16_t)tick;
+
+			// Mostly small movement, with the odd portal and invalid update
+			if (random(100) == 0) {
+				c.data = DataGhost::Invalid();
+			} else {
+				if (!c.data.IsValid()) c.data = DataGhost{{0, 0, 0}, {0, 0, 0}, 64, true};
+				if (random(50) == 0) {
+					c.data.position = {(float)(random(32768) - 16384), (float)(random(32768) - 16384), (float)(random(8192) - 4096)};
+					c.data.view_angle.y = (float)(random(360) - 180);
+				} else {
+					c.data.position += {(random(4000) - 2000) / 100.0f, (random(4000) - 2000) / 100.0f, (random(1000) - 500) / 100.0f};
+					c.data.view_angle.x = std::clamp(c.data.view_angle.x + (random(200) - 100) / 100.0f, -89.0f, 89.0f);
+					c.data.view_angle.y += (random(400) - 200) / 100.0f;
+					if (c.data.view_angle.y > 180) c.data.view_angle.y -= 360;
+					if (c.data.view_angle.y < -180) c.data.view_angle.y += 360;
+				}
+				if (random(20) == 0) c.data.grounded = !c.data.grounded;
+				c.data.view_offset = random(10) == 0 ? 36.0f : 64.0f;
+			}
+
+			sf::Packet packet;
+			packet << HEADER::UPDATE << c.id;
+			if (writeUpdate(packet, c.protocolVersion, c.encoder, c.data)) ++keyframes;
+			c.sent[seq] = QuantizedGhost::From(c.data);
+			++updates;
+			bytes += packet.getDataSize();
+
+			if (random(100) >= loss) server.Receive(packet);
+		}
+
+		for (int i = 0; i < 2; ++i) {
+			auto &c = clients[i];
+			auto &other = clients[1 - i];
+			auto relayed = server.LatestSeq(other.id);
+			auto packet = server.Relay(c.id);
+			if (random(100) < loss) continue;
+
+			HEADER header;
+			uint32_t id;
+			packet >> header >> id;
+			bool decoded = false;
+			readRelayedUpdates(packet, c.id, c.encoder, c.decoders, [&](uint32_t ghost_id, const DataGhost &data) {
+				decoded = true;
+				++applied;
+				if (ghost_id != other.id || !relayed || !(QuantizedGhost::From(data) == other.sent[*relayed])) ++mismatches;
+			});
+			if (relayed && !decoded) ++skipped;
+		}
+	}
+
+	// The length of a relayed payload has to be checked against what's
+	// actually left in the packet
+	{
+		sf::Packet packet;
+		packet << (uint32_t)GHOST_UPDATE_NO_ACK << (uint32_t)1 << (uint32_t)1 << (uint8_t)20;
+		uint8_t partial[5] = {0, 0, GHOST_UPDATE_KEYFRAME_AGE, GHOST_UPDATE_MISC, 64};
+		packet.append(partial, sizeof partial);
+
+		GhostUpdateEncoder encoder;
+		std::unordered_map<uint32_t, GhostUpdateDecoder> decoders;
+		bool truncatedApplied = false;
+		readRelayedUpdates(packet, 0, encoder, decoders, [&](uint32_t, const DataGhost &) {
+			truncatedApplied = true;
+		});
+		console->Print("Truncated relay: %s\n", truncatedApplied ? "applied" : "rejected");
+		ok &= !truncatedApplied;
+	}
+
+	// HEADER + ID + full DataGhost
+	uint64_t legacyBytes = (uint64_t)updates * (1 + 4 + 12 + 12 + 1);
+
+	console->Print("Updates sent: %u (%u keyframes), %.1f bytes each, %.1f%% of protocol 1\n", updates, keyframes, (float)bytes / updates, bytes * 100.0f / legacyBytes);
+	console->Print("Relayed updates applied: %u, skipped waiting for a keyframe or as stale: %u\n", applied, skipped);
+	console->Print("Mismatched states: %u\n", mismatches);
+	ok &= mismatches == 0 && applied > 0;
+
+	console->Print("%s\n", ok ? "Loopback test passed" : "Loopback test FAILED");
+}
+
+// }}}
+
 CON_COMMAND(ghost_list, "ghost_list - list all players in the current ghost server\n") {
 	if (!networkManager.isConnected) {
 		return console->Print("Not connected to a server\n");
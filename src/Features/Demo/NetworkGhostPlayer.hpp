@@ -1,6 +1,7 @@
 #pragma once
 #include "Command.hpp"
 #include "Features/Demo/GhostEntity.hpp"
+#include "Features/Demo/GhostUpdateCodec.hpp"
 #include "Features/Hud/Hud.hpp"
 #include "SFML/Audio.hpp"
 #include "SFML/Network.hpp"
@@ -139,7 +140,18 @@ public:
 
 	std::chrono::time_point<std::chrono::steady_clock> lastUpdateTime;
 
+	// Protocol 2 update coding; both are only touched on the network
+	// thread once connected
+	GhostUpdateEncoder updateEncoder;
+	std::unordered_map<uint32_t, GhostUpdateDecoder> updateDecoders;
+
 public:
+	int protocolVersion = 1;  // Negotiated with the server on connect
+
+	std::atomic<uint32_t> updatesSent;
+	std::atomic<uint32_t> keyframesSent;
+	std::atomic<uint64_t> updateBytesSent;
+
 	std::atomic<bool> isConnected;
 	std::atomic<bool> runThread;
 	std::string name;
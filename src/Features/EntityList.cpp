@@ -22,49 +22,258 @@ CEntInfo *EntityList::GetEntityInfoByIndex(int index) {
 	return reinterpret_cast<CEntInfo *>((uintptr_t)server->m_EntPtrArray + sizeof(CEntInfo) * index);
 }
 CEntInfo *EntityList::GetEntityInfoByName(const char *name) {
-	for (auto index = 0; index < Offsets::NUM_ENT_ENTRIES; ++index) {
-		auto info = this->GetEntityInfoByIndex(index);
-		if (info->m_pEntity == nullptr) {
-			continue;
+	auto &indices = this->GetEntityIndicesByName(name);
+	return indices.empty() ? nullptr : this->GetEntityInfoByIndex(indices[0]);
+}
+CEntInfo *EntityList::GetEntityInfoByClassName(const char *name) {
+	auto &indices = this->GetEntityIndicesByClassName(name);
+	return indices.empty() ? nullptr : this->GetEntityInfoByIndex(indices[0]);
+}
+int EntityList::GetEntityInfoIndexByHandle(void *entity) {
+	if (entity == nullptr) return -1;
+	if (!server->gEntList) {
+		for (auto index = 0; index < Offsets::NUM_ENT_ENTRIES; ++index) {
+			if (this->GetEntityInfoByIndex(index)->m_pEntity == entity) return index;
 		}
+		return -1;
+	}
+	this->UpdateIndex();
+	auto it = this->byEntity.find(entity);
+	return it != this->byEntity.end() ? it->second : -1;
+}
+const std::vector<int> &EntityList::GetEntityIndicesByName(const char *name) {
+	return this->Lookup(this->byName, name, false);
+}
+const std::vector<int> &EntityList::GetEntityIndicesByClassName(const char *name) {
+	return this->Lookup(this->byClassName, name, true);
+}
 
-		auto match = server->GetEntityName(info->m_pEntity);
-		if (!match || std::strcmp(match, name) != 0) {
-			continue;
-		}
+static const std::vector<int> g_noEntities;
 
-		return info;
+const std::vector<int> &EntityList::Lookup(std::unordered_map<std::string, std::vector<int>> &map, const char *key, bool classname) {
+	// without the entity list hooks nothing keeps an index current, and
+	// rebuilding one per lookup would cost more than the scan it replaces
+	if (!server->gEntList) return this->Scan(key, classname);
+
+	this->UpdateIndex(true);
+
+	auto it = map.find(key);
+	if (it == map.end()) return g_noEntities;
+
+	// renamed since this tick's rekey; fix those slots up and look again
+	bool stale = false;
+	for (int index : it->second) {
+		auto &slot = this->slots[index];
+		const char *cur = classname ? server->GetEntityClassName(slot.entity) : server->GetEntityName(slot.entity);
+		if (cur != (classname ? slot.classname : slot.name)) stale = true;
 	}
+	if (!stale) return it->second;
 
-	return nullptr;
+	auto hits = it->second;
+	for (int index : hits) this->RekeySlot(index);
+	it = map.find(key);
+	return it != map.end() ? it->second : g_noEntities;
 }
-CEntInfo *EntityList::GetEntityInfoByClassName(const char *name) {
+const std::vector<int> &EntityList::Scan(const char *key, bool classname) {
+	this->scanResult.clear();
+	for (auto index = 0; index < Offsets::NUM_ENT_ENTRIES; ++index) {
+		void *ent = this->GetEntityInfoByIndex(index)->m_pEntity;
+		if (!ent) continue;
+		const char *cur = classname ? server->GetEntityClassName(ent) : server->GetEntityName(ent);
+		if (cur && !strcmp(cur, key)) this->scanResult.push_back(index);
+	}
+	return this->scanResult;
+}
+
+static void insertSorted(std::vector<int> &vec, int index) {
+	vec.insert(std::lower_bound(vec.begin(), vec.end(), index), index);
+}
+static void eraseSorted(std::unordered_map<std::string, std::vector<int>> &map, const std::string &key, int index) {
+	auto it = map.find(key);
+	if (it == map.end()) return;
+	auto &vec = it->second;
+	auto pos = std::lower_bound(vec.begin(), vec.end(), index);
+	if (pos != vec.end() && *pos == index) vec.erase(pos);
+	if (vec.empty()) map.erase(it);
+}
+
+void EntityList::UnkeySlot(int index) {
+	auto &slot = this->slots[index];
+	if (!slot.nameKey.empty()) eraseSorted(this->byName, slot.nameKey, index);
+	if (!slot.classKey.empty()) eraseSorted(this->byClassName, slot.classKey, index);
+	slot.name = nullptr;
+	slot.classname = nullptr;
+	slot.nameKey.clear();
+	slot.classKey.clear();
+}
+void EntityList::RekeySlot(int index) {
+	auto &slot = this->slots[index];
+	const char *name = server->GetEntityName(slot.entity);
+	const char *classname = server->GetEntityClassName(slot.entity);
+	if (!slot.dirty && name == slot.name && classname == slot.classname) return;
+
+	this->UnkeySlot(index);
+	slot.name = name;
+	slot.classname = classname;
+	slot.dirty = false;
+	if (name && *name) {
+		slot.nameKey = name;
+		insertSorted(this->byName[slot.nameKey], index);
+	}
+	if (classname && *classname) {
+		slot.classKey = classname;
+		insertSorted(this->byClassName[slot.classKey], index);
+	}
+}
+void EntityList::RebuildIndex() {
+	this->slots.assign(Offsets::NUM_ENT_ENTRIES, EntityIndexSlot());
+	this->byName.clear();
+	this->byClassName.clear();
+	this->byEntity.clear();
+	this->live.clear();
+	this->dirtySlots.clear();
+
 	for (auto index = 0; index < Offsets::NUM_ENT_ENTRIES; ++index) {
 		auto info = this->GetEntityInfoByIndex(index);
 		if (info->m_pEntity == nullptr) {
 			continue;
 		}
+		this->slots[index].entity = info->m_pEntity;
+		this->slots[index].dirty = true;
+		this->byEntity[info->m_pEntity] = index;
+		this->AddLive(index);
+		this->RekeySlot(index);
+	}
 
-		auto match = server->GetEntityClassName(info->m_pEntity);
-		if (!match || std::strcmp(match, name) != 0) {
-			continue;
-		}
+	this->indexBuilt = true;
+}
+void EntityList::AddLive(int index) {
+	this->slots[index].livePos = this->live.size();
+	this->live.push_back(index);
+}
+void EntityList::RemoveLive(int index) {
+	int pos = this->slots[index].livePos;
+	if (pos < 0) return;
+	int last = this->live.back();
+	this->live[pos] = last;
+	this->slots[last].livePos = pos;
+	this->live.pop_back();
+	this->slots[index].livePos = -1;
+}
+// Pass names to also pick up renames; the pointer lookup doesn't need them.
+// Only called with the entity list hooks in place
+void EntityList::UpdateIndex(bool names) {
+	int tick = server->gpGlobals ? server->gpGlobals->tickcount : 0;
+
+	if (!this->indexBuilt) {
+		this->RebuildIndex();
+		this->rekeyTick = tick;
+		return;
+	}
 
-		return info;
+	for (int index : this->dirtySlots) {
+		if (this->slots[index].entity) this->RekeySlot(index);
 	}
+	this->dirtySlots.clear();
 
-	return nullptr;
+	if (names && tick != this->rekeyTick) {
+		for (int index : this->live) {
+			this->RekeySlot(index);
+		}
+		this->rekeyTick = tick;
+	}
 }
-int EntityList::GetEntityInfoIndexByHandle(void *entity) {
-	if (entity == nullptr) return -1;
+void EntityList::InvalidateIndex() {
+	this->indexBuilt = false;
+}
+void EntityList::OnEntityAdded(int index) {
+	if (!this->indexBuilt || index < 0 || index >= (int)this->slots.size()) return;
+	if (this->slots[index].entity) this->OnEntityRemoved(index);
+
+	auto &slot = this->slots[index];
+	slot.entity = this->GetEntityInfoByIndex(index)->m_pEntity;
+	if (!slot.entity) return;
+	// names aren't assigned yet while the entity is being constructed
+	slot.dirty = true;
+	this->byEntity[slot.entity] = index;
+	this->AddLive(index);
+	this->dirtySlots.push_back(index);
+}
+void EntityList::OnEntityRemoved(int index) {
+	if (!this->indexBuilt || index < 0 || index >= (int)this->slots.size()) return;
+	this->UnkeySlot(index);
+	this->RemoveLive(index);
+	this->byEntity.erase(this->slots[index].entity);
+	this->slots[index] = EntityIndexSlot();
+}
+// Compares the index against a full scan of the entity list, returning the
+// number of mismatches
+int EntityList::CheckIndex() {
+	if (!server->gEntList) {
+		console->Print("The entity list hooks aren't available; lookups scan the entity list\n");
+		return 0;
+	}
+	this->rekeyTick = -1;
+	this->UpdateIndex(true);
+
+	int errors = 0;
+	auto contains = [](std::unordered_map<std::string, std::vector<int>> &map, const char *key, int index) {
+		auto it = map.find(key);
+		return it != map.end() && std::binary_search(it->second.begin(), it->second.end(), index);
+	};
+
 	for (auto index = 0; index < Offsets::NUM_ENT_ENTRIES; ++index) {
-		auto info = this->GetEntityInfoByIndex(index);
-		if (info->m_pEntity != entity) {
+		void *ent = this->GetEntityInfoByIndex(index)->m_pEntity;
+		if (this->slots[index].entity != ent) {
+			console->Print("[%i] slot holds %p, entity list has %p\n", index, this->slots[index].entity, ent);
+			++errors;
 			continue;
 		}
-		return index;
+		if (!ent) continue;
+
+		auto it = this->byEntity.find(ent);
+		if (it == this->byEntity.end() || it->second != index) {
+			console->Print("[%i] missing from handle lookup\n", index);
+			++errors;
+		}
+		auto name = server->GetEntityName(ent);
+		if (name && *name && !contains(this->byName, name, index)) {
+			console->Print("[%i] not indexed under targetname %s\n", index, name);
+			++errors;
+		}
+		auto classname = server->GetEntityClassName(ent);
+		if (classname && *classname && !contains(this->byClassName, classname, index)) {
+			console->Print("[%i] not indexed under classname %s\n", index, classname);
+			++errors;
+		}
+	}
+
+	for (auto &kv : this->byName) {
+		for (int index : kv.second) {
+			auto ent = this->GetEntityInfoByIndex(index)->m_pEntity;
+			auto name = ent ? server->GetEntityName(ent) : nullptr;
+			if (!name || kv.first != name) {
+				console->Print("[%i] stale targetname %s\n", index, kv.first.c_str());
+				++errors;
+			}
+		}
+	}
+	for (auto &kv : this->byClassName) {
+		for (int index : kv.second) {
+			auto ent = this->GetEntityInfoByIndex(index)->m_pEntity;
+			auto classname = ent ? server->GetEntityClassName(ent) : nullptr;
+			if (!classname || kv.first != classname) {
+				console->Print("[%i] stale classname %s\n", index, kv.first.c_str());
+				++errors;
+			}
+		}
+	}
+	if (this->byEntity.size() != (size_t)std::count_if(this->slots.begin(), this->slots.end(), [](const EntityIndexSlot &s) { return s.entity != nullptr; })) {
+		console->Print("Handle lookup has %u entries for a different number of slots\n", (unsigned)this->byEntity.size());
+		++errors;
 	}
-	return -1;
+
+	return errors;
 }
 
 bool EntityList::IsPortalGun(const CBaseHandle &handle) {
@@ -127,23 +336,23 @@ CEntInfo *EntityList::QuerySelector(const char *selector) {
 
 	// TODO: maybe implement an * wildcard support here as well?
 
-	for (auto i = 0; i < Offsets::NUM_ENT_ENTRIES; ++i) {
-
-		auto info = entityList->GetEntityInfoByIndex(i);
-		if (info->m_pEntity == nullptr) {
-			continue;
-		}
-
-		auto tname = server->GetEntityName(info->m_pEntity);
-		if (!tname || std::strcmp(tname, selectorStr.c_str()) != 0) {
-			auto cname = server->GetEntityClassName(info->m_pEntity);
-			if (!cname || std::strcmp(cname, selectorStr.c_str()) != 0) {
-				continue;
-			}
+	// walk targetname and classname matches together in slot order
+	auto byName = this->GetEntityIndicesByName(selectorStr.c_str());
+	auto byClass = this->GetEntityIndicesByClassName(selectorStr.c_str());
+	size_t n = 0, c = 0;
+	while (n < byName.size() || c < byClass.size()) {
+		int index;
+		if (c == byClass.size() || (n < byName.size() && byName[n] < byClass[c])) {
+			index = byName[n++];
+		} else if (n == byName.size() || byClass[c] < byName[n]) {
+			index = byClass[c++];
+		} else {
+			index = byName[n++];
+			++c;
 		}
 
 		if (entId == 0) {
-			return info;
+			return this->GetEntityInfoByIndex(index);
 		} else {
 			entId--;
 		}
@@ -294,6 +503,18 @@ CON_COMMAND(sar_find_ents, "sar_find_ents <selector> - finds entities in the ent
 	}
 }
 
+CON_COMMAND(sar_ent_index_check, "sar_ent_index_check - compares the entity lookup index against a full scan of the entity list\n") {
+	if (!session->isRunning) return console->Print("No entities to check!\n");
+
+	int errors = entityList->CheckIndex();
+	if (errors) {
+		console->Print("Found %d mismatches; rebuilding index\n", errors);
+		entityList->InvalidateIndex();
+	} else {
+		console->Print("Entity index matches the entity list\n");
+	}
+}
+
 std::deque<EntitySlotSerial> g_ent_slot_serial;
 CON_COMMAND(sar_ent_slot_serial, "sar_ent_slot_serial <id> [value] - prints entity slot serial number, or sets it if additional parameter is specified.\nBanned in most categories, check with the rules before use!\n") {
 	if (client->GetChallengeStatus() == CMStatus::CHALLENGE && !sv_cheats.GetBool()) return console->Print("This is cheating! If you really want to do it, set sv_cheats 1\n");
@@ -3,17 +3,71 @@
 #include "Feature.hpp"
 #include "Utils.hpp"
 #include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
+struct EntityIndexSlot {
+	void *entity = nullptr;
+	// the strings this slot is currently keyed under; only compared, never read
+	const char *name = nullptr;
+	const char *classname = nullptr;
+	std::string nameKey;
+	std::string classKey;
+	bool dirty = false;
+	int livePos = -1;  // position in EntityList::live
+};
+
+// Main thread only: the index is updated by the entity list hooks and by
+// lookups themselves, with no locking.
 class EntityList : public Feature {
+private:
+	// Index of server entities by targetname, classname and pointer. Slots
+	// are added and removed through the entity list hooks. Names are assigned
+	// after an entity is added and can change at any time, so the first name
+	// lookup of each server tick compares every live slot's name and
+	// classname pointers against the ones it's keyed under (the strings are
+	// pooled, so a rename always changes the pointer) and rekeys the ones
+	// that moved. Later lookups in the same tick only re-check their own
+	// hits, so they never return an entity that no longer matches; one
+	// renamed to the key mid-tick shows up from the next tick on.
+	std::vector<EntityIndexSlot> slots;
+	std::unordered_map<std::string, std::vector<int>> byName;
+	std::unordered_map<std::string, std::vector<int>> byClassName;
+	std::unordered_map<void *, int> byEntity;
+	std::vector<int> live;  // indices of occupied slots, unordered
+	std::vector<int> dirtySlots;
+	bool indexBuilt = false;
+	int rekeyTick = -1;  // server tick of the last full rekey
+	std::vector<int> scanResult;  // without the hooks, lookups scan into this
+
 public:
 	EntityList();
 	CEntInfo *GetEntityInfoByIndex(int index);
 	CEntInfo *GetEntityInfoByName(const char *name);
 	CEntInfo *GetEntityInfoByClassName(const char *name);
 	int GetEntityInfoIndexByHandle(void *entity);
+	// Sorted slot indices; don't hold on to the result across entity removals
+	const std::vector<int> &GetEntityIndicesByName(const char *name);
+	const std::vector<int> &GetEntityIndicesByClassName(const char *name);
 	bool IsPortalGun(const CBaseHandle &handle);
 	IHandleEntity *LookupEntity(const CBaseHandle &handle);
 	CEntInfo *QuerySelector(const char *selector);
+
+	void OnEntityAdded(int index);
+	void OnEntityRemoved(int index);
+	void InvalidateIndex();
+	int CheckIndex();
+
+private:
+	void RebuildIndex();
+	void UpdateIndex(bool names = false);
+	void AddLive(int index);
+	void RemoveLive(int index);
+	void RekeySlot(int index);
+	void UnkeySlot(int index);
+	const std::vector<int> &Lookup(std::unordered_map<std::string, std::vector<int>> &map, const char *key, bool classname);
+	const std::vector<int> &Scan(const char *key, bool classname);
 };
 
 struct EntitySlotSerial {
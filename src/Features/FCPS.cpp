@@ -336,7 +336,7 @@ static inline float dotProdAbs(Vector vec, float *vals) {
 }
 
 bool RecordFcps1(void *entity, const Vector &ind_push, int mask) {
-	CBaseHandle move_parent_handle = SE(entity)->field<CBaseHandle>("m_hMoveParent");
+	CBaseHandle move_parent_handle = SE(entity)->field<CBaseHandle>(ENT_FIELD("m_hMoveParent"));
 	if (entityList->LookupEntity(move_parent_handle)) return true;
 
 	ICollideable *coll = &SE(entity)->collision();
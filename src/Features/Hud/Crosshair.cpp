@@ -88,8 +88,8 @@ int Crosshair::GetPortalUpgradeState(int slot) {
 	ClientEnt *gun = getPortalGun(slot);
 
 	if (gun) {
-		bool prim = gun->field<bool>("m_bCanFirePortal1");
-		bool sec = gun->field<bool>("m_bCanFirePortal2");
+		bool prim = gun->field<bool>(ENT_FIELD("m_bCanFirePortal1"));
+		bool sec = gun->field<bool>(ENT_FIELD("m_bCanFirePortal2"));
 		return prim | (sec << 1);
 	}
 
@@ -116,8 +116,8 @@ void Crosshair::GetPortalsStates(int slot, int &portalUpgradeState, bool &isBlue
 		ClientEnt *gun = getPortalGun(slot);
 		if (gun) {
 			// this doesn't actually work "correctly" regarding portals closing, but it mirrors the base game behaviour
-			auto bluePos = gun->field<Vector>("m_vecBluePortalPos");
-			auto orangePos = gun->field<Vector>("m_vecOrangePortalPos");
+			auto bluePos = gun->field<Vector>(ENT_FIELD("m_vecBluePortalPos"));
+			auto orangePos = gun->field<Vector>(ENT_FIELD("m_vecOrangePortalPos"));
 			if (bluePos != Vector{ FLT_MAX, FLT_MAX, FLT_MAX }) isBlueActive = true;
 			if (orangePos != Vector{ FLT_MAX, FLT_MAX, FLT_MAX }) isOrangeActive = true;
 			// with single portal gun, the crosshair is always active
@@ -823,10 +823,10 @@ HUD_ELEMENT_MODE2(duckstate, "0", 0, 2,
 		ctx->DrawElement("duckstate: %s", ducked ? "ducked" : "standing");
 	} else {
 		bool holdingDuck = (inputHud.GetButtonBits(ctx->slot) & IN_DUCK);
-		bool ducking = player->field<bool>("m_bDucking");
-		bool inDuckJump = player->field<bool>("m_bInDuckJump");
-		int duckTimeMsecs = player->field<int>("m_nDuckTimeMsecs");
-		int duckJumpTimeMsecs = player->field<int>("m_nDuckJumpTimeMsecs");
+		bool ducking = player->field<bool>(ENT_FIELD("m_bDucking"));
+		bool inDuckJump = player->field<bool>(ENT_FIELD("m_bInDuckJump"));
+		int duckTimeMsecs = player->field<int>(ENT_FIELD("m_nDuckTimeMsecs"));
+		int duckJumpTimeMsecs = player->field<int>(ENT_FIELD("m_nDuckJumpTimeMsecs"));
 		bool duckedInAir = client->GetPortalLocal(player).m_bDuckedInAir;
 		Vector viewOffset = client->GetViewOffset(player);
 
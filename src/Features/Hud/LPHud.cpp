@@ -50,7 +50,7 @@ static int getStatsCount() {
 	for (int slot = 0; slot < slots; ++slot) {
 		ClientEnt *player = client->GetPlayer(slot + 1);
 		if (!player) continue;
-		total += player->field<int>("iNumPortalsPlaced");
+		total += player->field<int>(ENT_FIELD("iNumPortalsPlaced"));
 	}
 
 	return total;
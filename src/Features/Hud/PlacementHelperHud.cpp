@@ -65,27 +65,22 @@ ON_EVENT(RENDER) {
 	if (!engine->hoststate->m_activeGame) return;
 	if (!sar_placement_helper_hud.GetBool()) return;
 
-	for (auto index = 0; index < Offsets::NUM_ENT_ENTRIES; ++index) {
+	for (int index : entityList->GetEntityIndicesByClassName("info_placement_helper")) {
 		auto info = entityList->GetEntityInfoByIndex(index);
-		if (info->m_pEntity == nullptr) continue;
-
-		auto entityClass = server->GetEntityClassName(info->m_pEntity);
-		if (!entityClass || std::strcmp(entityClass, "info_placement_helper") != 0) continue;
-
 		auto placementHelper = SE(info->m_pEntity);
 
 		auto position = placementHelper->abs_origin();
 #ifdef _WIN32
 		// no idea honestly. it's just there.
-		auto size = placementHelper->fieldOff<float>("m_flRadius", 648);
+		auto size = placementHelper->fieldOff<float>(ENT_FIELD("m_flRadius"), 648);
 #else
-		auto size = placementHelper->fieldOff<float>("m_flRadius", 664);
+		auto size = placementHelper->fieldOff<float>(ENT_FIELD("m_flRadius"), 664);
 #endif
-		auto forcePlacement = placementHelper->field<bool>("m_bForcePlacement");
-		auto snapToHelperAngles = placementHelper->field<bool>("m_bSnapToHelperAngles");
-		auto disabled = placementHelper->field<bool>("m_bDisabled");
-		auto disableTime = placementHelper->field<float>("m_flDisableTime");
-		auto deferringToPortal = placementHelper->field<bool>("m_bDeferringToPortal");
+		auto forcePlacement = placementHelper->field<bool>(ENT_FIELD("m_bForcePlacement"));
+		auto snapToHelperAngles = placementHelper->field<bool>(ENT_FIELD("m_bSnapToHelperAngles"));
+		auto disabled = placementHelper->field<bool>(ENT_FIELD("m_bDisabled"));
+		auto disableTime = placementHelper->field<float>(ENT_FIELD("m_flDisableTime"));
+		auto deferringToPortal = placementHelper->field<bool>(ENT_FIELD("m_bDeferringToPortal"));
 
 		auto currentTime = server->gpGlobals->curtime;
 		auto remainingBlockedTimeTicks = (int)(fmaxf(disableTime - currentTime, 0.0f) * sar.game->Tickrate());
@@ -118,22 +118,22 @@ ON_EVENT(PRE_TICK) {
 		if (!g_hasPortalGun)
 			return;
 
-		uint8_t linkage = SE(portalgun)->field<unsigned char>("m_iPortalLinkageGroupID");
+		uint8_t linkage = SE(portalgun)->field<unsigned char>(ENT_FIELD("m_iPortalLinkageGroupID"));
 
-		auto m_hPrimaryPortal = SE(portalgun)->field<CBaseHandle>("m_hPrimaryPortal");
-		auto m_hSecondaryPortal = SE(portalgun)->field<CBaseHandle>("m_hSecondaryPortal");
+		auto m_hPrimaryPortal = SE(portalgun)->field<CBaseHandle>(ENT_FIELD("m_hPrimaryPortal"));
+		auto m_hSecondaryPortal = SE(portalgun)->field<CBaseHandle>(ENT_FIELD("m_hSecondaryPortal"));
 		auto bluePortal = (uintptr_t)entityList->LookupEntity(m_hPrimaryPortal);
 		auto orangePortal = (uintptr_t)entityList->LookupEntity(m_hSecondaryPortal);
 
 		if (!bluePortal) {
 			// spawn the portal
 			bluePortal = server->FindPortal(linkage, false, true);
-			SE(portalgun)->field<CBaseHandle>("m_hPrimaryPortal") = ((IHandleEntity *)bluePortal)->GetRefEHandle();
+			SE(portalgun)->field<CBaseHandle>(ENT_FIELD("m_hPrimaryPortal")) = ((IHandleEntity *)bluePortal)->GetRefEHandle();
 		}
 		if (!orangePortal) {
 			// spawn the portal
 			orangePortal = server->FindPortal(linkage, true, true);
-			SE(portalgun)->field<CBaseHandle>("m_hSecondaryPortal") = ((IHandleEntity *)orangePortal)->GetRefEHandle();
+			SE(portalgun)->field<CBaseHandle>(ENT_FIELD("m_hSecondaryPortal")) = ((IHandleEntity *)orangePortal)->GetRefEHandle();
 		}
 
 		// Check blue
@@ -51,13 +51,13 @@ void PortalgunHud::Paint(int slot) {
 		return;
 	}
 
-	uint8_t linkage = SE(portalgun)->field<unsigned char>("m_iPortalLinkageGroupID");
+	uint8_t linkage = SE(portalgun)->field<unsigned char>(ENT_FIELD("m_iPortalLinkageGroupID"));
 
 	surface->DrawTxt(font, x, y, Color{255, 255, 255, 255}, "linkage: %d", (int)linkage);
 	y += lineHeight + 10;
 
-	auto m_hPrimaryPortal = SE(portalgun)->field<CBaseHandle>("m_hPrimaryPortal");
-	auto m_hSecondaryPortal = SE(portalgun)->field<CBaseHandle>("m_hSecondaryPortal");
+	auto m_hPrimaryPortal = SE(portalgun)->field<CBaseHandle>(ENT_FIELD("m_hPrimaryPortal"));
+	auto m_hSecondaryPortal = SE(portalgun)->field<CBaseHandle>(ENT_FIELD("m_hSecondaryPortal"));
 
 	auto bluePortal = (uintptr_t)entityList->LookupEntity(m_hPrimaryPortal);
 	auto orangePortal = (uintptr_t)entityList->LookupEntity(m_hSecondaryPortal);
@@ -69,7 +69,7 @@ void PortalgunHud::Paint(int slot) {
 		Color col = Color{255, 150, 150, 255};
 
 		if (portal) {
-			bool active = SE(portal)->field<bool>("m_bActivated");
+			bool active = SE(portal)->field<bool>(ENT_FIELD("m_bActivated"));
 			col = active ? Color{150, 255, 150, 255} : Color{255, 200, 150, 255};
 		}
 
@@ -1,20 +1,35 @@
 #include "OverlayRender.hpp"
+#include "Command.hpp"
 #include "Modules/Client.hpp"
+#include "Modules/Console.hpp"
 #include "Modules/Engine.hpp"
 #include "Modules/MaterialSystem.hpp"
 #include "Modules/Surface.hpp"
 #include "Modules/Scheme.hpp"
 #include "Event.hpp"
+#include "Features/Hud/Hud.hpp"
 #include "Features/Session.hpp"
 #include "Features/Timer/PauseTimer.hpp"
 #include "Utils/FontAtlas.hpp"
 
+#include <algorithm>
 #include <array>
+#include <cfloat>
+#include <chrono>
+#include <cstring>
 #include <set>
 
 #define FONT_HPAD 48
 #define FONT_VPAD 24
 
+// Immediate meshes are split so no single draw gets too big; retained
+// meshes aren't, and get split up when drawn instead
+#define MAX_MESH_PRIMS 8192
+#define MAX_DRAW_VERTS (MAX_MESH_PRIMS * 6)
+
+// Set in the ids of retained meshes
+#define RETAINED_MESH_BIT ((MeshId)1 << (sizeof (MeshId) * 8 - 1))
+
 RenderCallback RenderCallback::none = {
 	[](ViewSetup *vs, Color &col_out, bool &nodepth_out) {
 		col_out = Color{0,0,0,0};
@@ -110,11 +125,122 @@ struct OverlayMesh {
 	int num_points_in_pos;
 	std::vector<Vector> tri_verts;
 	std::vector<Vector> line_verts;
+	bool retained;
+	// Bounds are only tracked for retained meshes
+	Vector mins, maxs;
 };
 
 static std::vector<OverlayMesh> g_meshes;
 static size_t g_num_meshes;
 
+struct RetainedMesh {
+	OverlayMesh mesh;
+	bool alive;
+	bool queued; // drawRetainedMesh was called this frame
+};
+
+static std::vector<RetainedMesh> g_retained;
+static std::vector<size_t> g_retained_free;
+
+// Vertices sent to the GPU, as { immediate, retained }
+static size_t g_verts_drawn[2];
+static size_t g_verts_drawn_last[2];
+
+static OverlayMesh &getMesh(MeshId id) {
+	if (id & RETAINED_MESH_BIT) return g_retained[id & ~RETAINED_MESH_BIT].mesh;
+	return g_meshes[id];
+}
+
+static void clearMesh(OverlayMesh &m) {
+	m.tri_verts.clear();
+	m.line_verts.clear();
+	m.pos = {0,0,0};
+	m.num_points_in_pos = 0;
+	m.mins = {FLT_MAX, FLT_MAX, FLT_MAX};
+	m.maxs = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+}
+
+static void addBounds(OverlayMesh &m, Vector v) {
+	m.mins = {fminf(m.mins.x, v.x), fminf(m.mins.y, v.y), fminf(m.mins.z, v.z)};
+	m.maxs = {fmaxf(m.maxs.x, v.x), fmaxf(m.maxs.y, v.y), fmaxf(m.maxs.z, v.z)};
+}
+
+// The cone from the previous frame's draw is what geometry built this frame
+// gets culled against
+static OverlayCullCone g_cull_cone;
+static OverlayCullCone g_next_cull_cone;
+static int g_views_drawn;
+
+// Origins of the views drawn in the previous frame, and in this one so far
+#define MAX_VIEW_ORIGINS 4
+static Vector g_view_origins[MAX_VIEW_ORIGINS];
+static Vector g_next_view_origins[MAX_VIEW_ORIGINS];
+static int g_num_view_origins;
+
+// Allowance for camera movement between building and drawing geometry
+#define CULL_CONE_MARGIN 15.0f
+// Widest aspect ratio we allow for; Source's fov is horizontal at 4:3
+#define CULL_CONE_MAX_ASPECT (21.0f / 9.0f)
+
+OverlayCullCone OverlayCullCone::fromDir(Vector origin, Vector dir, float half_angle_deg) {
+	OverlayCullCone cone;
+	if (half_angle_deg >= 90.0f) return cone;
+	cone.origin = origin;
+	cone.dir = dir;
+	cone.cos_angle = cosf(DEG2RAD(half_angle_deg));
+	cone.sin_angle = sinf(DEG2RAD(half_angle_deg));
+	cone.enabled = true;
+	return cone;
+}
+
+OverlayCullCone OverlayCullCone::fromView(const ViewSetup *setup, float margin_deg) {
+	if (setup->m_bOrtho) return OverlayCullCone{};
+
+	float tan_v = tanf(DEG2RAD(setup->fov / 2.0f)) * 0.75f;
+	float tan_h = tan_v * CULL_CONE_MAX_ASPECT;
+	float half_angle = RAD2DEG(atanf(sqrtf(tan_h * tan_h + tan_v * tan_v))) + margin_deg;
+
+	Vector forward;
+	Math::AngleVectors(setup->angles, &forward);
+	return fromDir(setup->origin, forward, half_angle);
+}
+
+bool OverlayCullCone::sphereVisible(Vector center, float radius) const {
+	if (!this->enabled) return true;
+
+	Vector v = center - this->origin;
+	float len_sq = v.SquaredLength();
+	if (len_sq <= radius * radius) return true;
+
+	// distance along the axis and from it; the sphere is outside if its
+	// center is further than its radius from the cone's surface
+	float along = v.Dot(this->dir);
+	float perp = sqrtf(fmaxf(len_sq - along * along, 0.0f));
+	return perp * this->cos_angle - along * this->sin_angle <= radius;
+}
+
+bool OverlayCullCone::boxVisible(Vector mins, Vector maxs) const {
+	return sphereVisible((mins + maxs) / 2, (maxs - mins).Length() / 2);
+}
+
+OverlayCullCone OverlayRender::getCullCone() {
+	return g_cull_cone;
+}
+
+bool OverlayRender::nearestViewOrigin(Vector point, Vector *origin) {
+	if (g_num_view_origins == 0) return false;
+
+	float best = FLT_MAX;
+	for (int i = 0; i < g_num_view_origins; ++i) {
+		float dist = (g_view_origins[i] - point).SquaredLength();
+		if (dist < best) {
+			best = dist;
+			*origin = g_view_origins[i];
+		}
+	}
+	return true;
+}
+
 // Dispatched just before RENDER
 ON_EVENT(FRAME) {
 	// Garbage collection - remove any unused slots
@@ -122,16 +248,26 @@ ON_EVENT(FRAME) {
 
 	// Clear the vertex arrays for each mesh that we'll keep around
 	for (size_t i = 0; i < g_num_meshes; ++i) {
-		auto &m = g_meshes[i];
-		m.tri_verts.clear();
-		m.line_verts.clear();
-		m.pos = {0,0,0};
-		m.num_points_in_pos = 0;
+		clearMesh(g_meshes[i]);
 	}
 
 	g_num_meshes = 0;
 
+	for (auto &r : g_retained) r.queued = false;
+
+	g_verts_drawn_last[0] = g_verts_drawn[0];
+	g_verts_drawn_last[1] = g_verts_drawn[1];
+	g_verts_drawn[0] = g_verts_drawn[1] = 0;
+
 	g_text.clear();
+
+	g_cull_cone = g_views_drawn == 1 ? g_next_cull_cone : OverlayCullCone{};
+	// keep the last origins if nothing was drawn, e.g. while paused in a menu
+	if (g_views_drawn > 0) {
+		g_num_view_origins = std::min(g_views_drawn, MAX_VIEW_ORIGINS);
+		std::copy(g_next_view_origins, g_next_view_origins + g_num_view_origins, g_view_origins);
+	}
+	g_views_drawn = 0;
 }
 
 MeshId OverlayRender::createMesh(RenderCallback solid, RenderCallback wireframe) {
@@ -140,28 +276,102 @@ MeshId OverlayRender::createMesh(RenderCallback solid, RenderCallback wireframe)
 	g_num_meshes += 1;
 	g_meshes[id].solid = solid;
 	g_meshes[id].wireframe = wireframe;
+	g_meshes[id].retained = false;
 	return id;
 }
 
+MeshId OverlayRender::createRetainedMesh(RenderCallback solid, RenderCallback wireframe) {
+	size_t idx;
+	if (!g_retained_free.empty()) {
+		idx = g_retained_free.back();
+		g_retained_free.pop_back();
+	} else {
+		idx = g_retained.size();
+		g_retained.push_back({});
+	}
+
+	auto &r = g_retained[idx];
+	clearMesh(r.mesh);
+	r.mesh.solid = solid;
+	r.mesh.wireframe = wireframe;
+	r.mesh.retained = true;
+	r.alive = true;
+	r.queued = false;
+	return idx | RETAINED_MESH_BIT;
+}
+
+void OverlayRender::clearRetainedMesh(MeshId mesh) {
+	clearMesh(getMesh(mesh));
+}
+
+void OverlayRender::drawRetainedMesh(MeshId mesh) {
+	g_retained[mesh & ~RETAINED_MESH_BIT].queued = true;
+}
+
+void OverlayRender::destroyRetainedMesh(MeshId mesh) {
+	size_t idx = mesh & ~RETAINED_MESH_BIT;
+	auto &r = g_retained[idx];
+	if (!r.alive) return;
+	r.alive = false;
+	r.queued = false;
+	// Free the memory too, these can be big
+	r.mesh = {};
+	g_retained_free.push_back(idx);
+}
+
 void OverlayRender::addTriangle(MeshId &mesh, Vector a, Vector b, Vector c, bool cull_back) {
-	if (g_meshes[mesh].num_points_in_pos >= 8192) {
+	if (!(mesh & RETAINED_MESH_BIT) && g_meshes[mesh].num_points_in_pos >= MAX_MESH_PRIMS) {
 		mesh = OverlayRender::createMesh(g_meshes[mesh].solid, g_meshes[mesh].wireframe);
 	}
-	auto &vs = g_meshes[mesh].tri_verts;
+	auto &m = getMesh(mesh);
+	if (m.retained) {
+		addBounds(m, a);
+		addBounds(m, b);
+		addBounds(m, c);
+	}
+	auto &vs = m.tri_verts;
 	vs.insert(vs.end(), { a, b, c });
 	if (!cull_back) vs.insert(vs.end(), { a, c, b });
-	g_meshes[mesh].pos += (a + b + c) / 3.0;
-	g_meshes[mesh].num_points_in_pos += 1;
+	m.pos += (a + b + c) / 3.0;
+	m.num_points_in_pos += 1;
+}
+
+void OverlayRender::addTriangles(MeshId &mesh, const Vector *verts, const short *indices, int ntris, bool cull_back) {
+	if (!(mesh & RETAINED_MESH_BIT) && g_meshes[mesh].num_points_in_pos > 0 && g_meshes[mesh].num_points_in_pos + ntris > MAX_MESH_PRIMS) {
+		mesh = OverlayRender::createMesh(g_meshes[mesh].solid, g_meshes[mesh].wireframe);
+	}
+	auto &m = getMesh(mesh);
+	auto &vs = m.tri_verts;
+	vs.reserve(vs.size() + ntris * (cull_back ? 3 : 6));
+	for (int i = 0; i < ntris; ++i) {
+		Vector a = verts[indices[i * 3]];
+		Vector b = verts[indices[i * 3 + 1]];
+		Vector c = verts[indices[i * 3 + 2]];
+		if (m.retained) {
+			addBounds(m, a);
+			addBounds(m, b);
+			addBounds(m, c);
+		}
+		vs.insert(vs.end(), { a, b, c });
+		if (!cull_back) vs.insert(vs.end(), { a, c, b });
+		m.pos += (a + b + c) / 3.0;
+	}
+	m.num_points_in_pos += ntris;
 }
 
 void OverlayRender::addLine(MeshId &mesh, Vector a, Vector b) {
-	if (g_meshes[mesh].num_points_in_pos >= 8192) {
+	if (!(mesh & RETAINED_MESH_BIT) && g_meshes[mesh].num_points_in_pos >= MAX_MESH_PRIMS) {
 		mesh = OverlayRender::createMesh(g_meshes[mesh].solid, g_meshes[mesh].wireframe);
 	}
-	auto &vs = g_meshes[mesh].line_verts;
+	auto &m = getMesh(mesh);
+	if (m.retained) {
+		addBounds(m, a);
+		addBounds(m, b);
+	}
+	auto &vs = m.line_verts;
 	vs.insert(vs.end(), { a, b });
-	g_meshes[mesh].pos += (a + b) / 2.0;
-	g_meshes[mesh].num_points_in_pos += 1;
+	m.pos += (a + b) / 2.0;
+	m.num_points_in_pos += 1;
 }
 
 void OverlayRender::addQuad(MeshId &mesh, Vector a, Vector b, Vector c, Vector d, bool cull_back) {
@@ -169,7 +379,7 @@ void OverlayRender::addQuad(MeshId &mesh, Vector a, Vector b, Vector c, Vector d
 	OverlayRender::addTriangle(mesh, a, c, d, cull_back);
 }
 
-void OverlayRender::addBoxMesh(Vector origin, Vector mins, Vector maxs, QAngle ang, RenderCallback solid, RenderCallback wireframe) {
+void OverlayRender::addBox(MeshId &solid_mesh, MeshId &wf_mesh, Vector origin, Vector mins, Vector maxs, QAngle ang) {
 	auto rot = Math::AngleMatrix(ang);
 
 	Vector verts[8];
@@ -181,7 +391,6 @@ void OverlayRender::addBoxMesh(Vector origin, Vector mins, Vector maxs, QAngle a
 		verts[i] = origin + rot * v;
 	}
 
-	MeshId solid_mesh = OverlayRender::createMesh(solid, RenderCallback::none);
 	for (auto i : std::array<std::array<int, 4>, 6>{
 		std::array<int, 4>{ 2, 6, 4, 0 },
 		std::array<int, 4>{ 7, 3, 1, 5 },
@@ -193,7 +402,6 @@ void OverlayRender::addBoxMesh(Vector origin, Vector mins, Vector maxs, QAngle a
 		OverlayRender::addQuad(solid_mesh, verts[i[0]], verts[i[1]], verts[i[2]], verts[i[3]], true);
 	}
 
-	MeshId wf_mesh = OverlayRender::createMesh(RenderCallback::none, wireframe);
 	for (auto i : std::array<std::array<int, 2>, 12>{
 		std::array<int, 2>{ 0, 1 },
 		std::array<int, 2>{ 0, 2 },
@@ -212,6 +420,12 @@ void OverlayRender::addBoxMesh(Vector origin, Vector mins, Vector maxs, QAngle a
 	}
 }
 
+void OverlayRender::addBoxMesh(Vector origin, Vector mins, Vector maxs, QAngle ang, RenderCallback solid, RenderCallback wireframe) {
+	MeshId solid_mesh = OverlayRender::createMesh(solid, RenderCallback::none);
+	MeshId wf_mesh = OverlayRender::createMesh(RenderCallback::none, wireframe);
+	OverlayRender::addBox(solid_mesh, wf_mesh, origin, mins, maxs, ang);
+}
+
 void OverlayRender::addText(Vector pos, const std::string &text, float x_height, bool visibility_scale, bool no_depth, OverlayRender::TextAlign align, Color col, Color bg_col) {
 	g_text.push_back({pos, align, text, col, x_height, visibility_scale, no_depth, bg_col});
 }
@@ -313,6 +527,13 @@ ON_EVENT(SAR_UNLOAD) {
 }
 
 static void drawVerts(IMaterial *mat, bool lines, Vector *verts, int nverts, Color col) {
+	// Only retained meshes can be big enough to need several batches
+	while (nverts > MAX_DRAW_VERTS) {
+		drawVerts(mat, lines, verts, MAX_DRAW_VERTS, col);
+		verts += MAX_DRAW_VERTS;
+		nverts -= MAX_DRAW_VERTS;
+	}
+
 	int prims = lines ? nverts / 2 : nverts / 3;
 	MeshBuilder mb(mat, lines ? PrimitiveType::LINES : PrimitiveType::TRIANGLES, prims);
 
@@ -325,6 +546,11 @@ static void drawVerts(IMaterial *mat, bool lines, Vector *verts, int nverts, Col
 	mb.Draw();
 }
 
+static bool retainedVisible(const OverlayCullCone &cone, const RetainedMesh &r) {
+	if (!r.alive || !r.queued || r.mesh.num_points_in_pos == 0) return false;
+	return cone.boxVisible(r.mesh.mins, r.mesh.maxs);
+}
+
 static void drawMesh(ViewSetup *setup, OverlayMesh &m, bool translucent) {
 	Color solid_color, wf_color;
 	bool solid_nodepth, wf_nodepth;
@@ -338,6 +564,7 @@ static void drawMesh(ViewSetup *setup, OverlayMesh &m, bool translucent) {
 
 		// Tris
 		drawVerts(mat, false, m.tri_verts.data(), m.tri_verts.size(), solid_color);
+		g_verts_drawn[m.retained] += m.tri_verts.size();
 	}
 
 	if (wf_color.a != 0 && (translucent ^ (wf_color.a == 255))) {
@@ -350,6 +577,7 @@ static void drawMesh(ViewSetup *setup, OverlayMesh &m, bool translucent) {
 
 		// Tris
 		drawVerts(mat, true, m.tri_verts.data(), m.tri_verts.size(), wf_color);
+		g_verts_drawn[m.retained] += m.line_verts.size() + m.tri_verts.size();
 	}
 }
 
@@ -498,56 +726,187 @@ void OverlayRender::drawOpaques(void *viewrender) {
 	// CRendering3dView inherits CViewSetup! this is handy
 	auto setup = ViewSetupCreate((CViewSetup *)((uintptr_t)viewrender + 8));
 
+	g_next_cull_cone = OverlayCullCone::fromView(setup, CULL_CONE_MARGIN);
+	if (g_views_drawn < MAX_VIEW_ORIGINS) g_next_view_origins[g_views_drawn] = setup->origin;
+	g_views_drawn += 1;
+
 	for (size_t i = 0; i < g_num_meshes; ++i) {
 		drawMesh(setup, g_meshes[i], false);
 	}
+
+	OverlayCullCone cone = OverlayCullCone::fromView(setup, 0.0f);
+	for (auto &r : g_retained) {
+		if (retainedVisible(cone, r)) drawMesh(setup, r.mesh, false);
+	}
+}
+
+// Translucent meshes and text, keyed by distance from the camera
+struct TranslucentItem {
+	uint32_t key;
+	bool text;
+	void *ptr;
+};
+
+static std::vector<TranslucentItem> g_translucents;
+static std::vector<TranslucentItem> g_translucents_scratch;
+
+// Squared distances are never negative, so the bits of the float order
+// the same way as the float itself; flip them to put far things first
+static uint32_t depthKey(Vector pos, Vector origin) {
+	float dist = (pos - origin).SquaredLength();
+	uint32_t bits;
+	memcpy(&bits, &dist, sizeof bits);
+	return ~bits;
+}
+
+// Stable LSD radix sort by key, a byte at a time
+static void sortTranslucents(std::vector<TranslucentItem> &items, std::vector<TranslucentItem> &scratch) {
+	if (items.size() < 2) return;
+	scratch.resize(items.size());
+
+	for (int shift = 0; shift < 32; shift += 8) {
+		size_t offsets[256] = {0};
+		for (auto &it : items) offsets[(it.key >> shift) & 0xFF]++;
+
+		// Skip bytes which are the same for every key; the high ones
+		// usually are, since everything is at a similar distance
+		if (offsets[(items[0].key >> shift) & 0xFF] == items.size()) continue;
+
+		size_t sum = 0;
+		for (auto &off : offsets) {
+			size_t count = off;
+			off = sum;
+			sum += count;
+		}
+
+		for (auto &it : items) scratch[offsets[(it.key >> shift) & 0xFF]++] = it;
+		items.swap(scratch);
+	}
 }
 
 void OverlayRender::drawTranslucents(void *viewrender) {
 	// CRendering3dView inherits CViewSetup! this is handy
 	auto setup = ViewSetupCreate((CViewSetup *)((uintptr_t)viewrender + 8));
 
-	// Order meshes!
-	struct MeshCompare {
-		bool operator()(std::pair<bool, void *> a, std::pair<bool, void *> b) const {
-			float dist_a;
-			if (a.first) {
-				OverlayText *t = (OverlayText *)a.second;
-				dist_a = (t->pos - this->origin).SquaredLength();
-			} else {
-				OverlayMesh *m = (OverlayMesh *)a.second;
-				int npa = m->num_points_in_pos == 0 ? 1 : m->num_points_in_pos;
-				dist_a = (m->pos / npa - this->origin).SquaredLength();
-			}
+	// Order meshes! Ties are drawn in the order they were added
+	auto &items = g_translucents;
+	items.clear();
 
-			float dist_b;
-			if (b.first) {
-				OverlayText *t = (OverlayText *)b.second;
-				dist_b = (t->pos - this->origin).SquaredLength();
-			} else {
-				OverlayMesh *m = (OverlayMesh *)b.second;
-				int npb = m->num_points_in_pos == 0 ? 1 : m->num_points_in_pos;
-				dist_b = (m->pos / npb - this->origin).SquaredLength();
-			}
-
-			if (dist_a == dist_b) return a.second < b.second; // Define *some* kind of ordering for meshes in the same place
-			return dist_a > dist_b;
-		}
-		Vector origin;
+	auto addMesh = [&](OverlayMesh &m) {
+		int np = m.num_points_in_pos == 0 ? 1 : m.num_points_in_pos;
+		items.push_back({ depthKey(m.pos / np, setup->origin), false, &m });
 	};
-	std::set<std::pair<bool, void *>, MeshCompare> meshes(MeshCompare{setup->origin});
+
 	for (size_t i = 0; i < g_num_meshes; ++i) {
-		meshes.insert({ false, &g_meshes[i] });
+		addMesh(g_meshes[i]);
+	}
+	OverlayCullCone cone = OverlayCullCone::fromView(setup, 0.0f);
+	for (auto &r : g_retained) {
+		if (retainedVisible(cone, r)) addMesh(r.mesh);
 	}
 	for (auto &text : g_text) {
-		meshes.insert({ true, &text });
+		items.push_back({ depthKey(text.pos, setup->origin), true, &text });
 	}
 
-	for (auto mesh : meshes) {
-		if (mesh.first) {
-			drawText(setup, *(OverlayText *)mesh.second);
+	sortTranslucents(items, g_translucents_scratch);
+
+	for (auto &item : items) {
+		if (item.text) {
+			drawText(setup, *(OverlayText *)item.ptr);
 		} else {
-			drawMesh(setup, *(OverlayMesh *)mesh.second, true);
+			drawMesh(setup, *(OverlayMesh *)item.ptr, true);
 		}
 	}
 }
+
+// Translucent sort self test {{{
+
+CON_COMMAND(sar_overlay_sort_selftest, "sar_overlay_sort_selftest [items] [rounds] - checks the translucent overlay radix sort against std::stable_sort on random scenes and times both\n") {
+	if (args.ArgC() > 3) return console->Print(sar_overlay_sort_selftest.ThisPtr()->m_pszHelpString);
+	int max_items = args.ArgC() >= 2 ? atoi(args[1]) : 5000;
+	int rounds = args.ArgC() >= 3 ? atoi(args[2]) : 200;
+	if (max_items < 1 || rounds < 1) return console->Print(sar_overlay_sort_selftest.ThisPtr()->m_pszHelpString);
+
+	uint32_t seed = 1;
+	auto rand = [&]() { return (seed = seed * 1664525 + 1013904223) >> 8; };
+	auto randf = [&](float range) { return (rand() / (float)(1 << 24) - 0.5f) * range; };
+
+	using clock = std::chrono::steady_clock;
+	clock::duration radix_time{}, stable_time{}, set_time{};
+	size_t total = 0;
+	int failures = 0;
+
+	std::vector<Vector> positions;
+	std::vector<TranslucentItem> items, expected, scratch;
+	for (int round = 0; round < rounds; ++round) {
+		// A scene of things near each other, things spread across a map,
+		// and things sharing a position, so there are ties to keep in order
+		size_t count = 1 + rand() % max_items;
+		Vector origin{randf(8000), randf(8000), randf(2000)};
+		Vector cluster = origin + Vector{randf(2000), randf(2000), randf(500)};
+		positions.resize(count);
+		for (size_t i = 0; i < count; ++i) {
+			switch (rand() % 4) {
+			case 0: positions[i] = cluster + Vector{randf(8), randf(8), randf(8)}; break;
+			case 1: positions[i] = i > 0 ? positions[rand() % i] : cluster; break;
+			default: positions[i] = Vector{randf(16000), randf(16000), randf(4000)}; break;
+			}
+		}
+
+		// ptr is the position, so ties can be told apart by where they
+		// were added
+		items.clear();
+		for (size_t i = 0; i < count; ++i) items.push_back({depthKey(positions[i], origin), rand() % 4 == 0, &positions[i]});
+		expected = items;
+
+		auto start = clock::now();
+		sortTranslucents(items, scratch);
+		auto mid = clock::now();
+		std::stable_sort(expected.begin(), expected.end(), [](const TranslucentItem &a, const TranslucentItem &b) {
+			return a.key < b.key;
+		});
+		auto end = clock::now();
+
+		// What drawTranslucents used to do: insert into a set whose
+		// comparator works out both distances every time
+		struct DistCompare {
+			Vector origin;
+			bool operator()(const Vector *a, const Vector *b) const {
+				float dist_a = (*a - origin).SquaredLength();
+				float dist_b = (*b - origin).SquaredLength();
+				if (dist_a == dist_b) return a < b;
+				return dist_a > dist_b;
+			}
+		};
+		auto set_start = clock::now();
+		std::set<const Vector *, DistCompare> set(DistCompare{origin});
+		for (auto &p : positions) set.insert(&p);
+		auto set_end = clock::now();
+
+		radix_time += mid - start;
+		stable_time += end - mid;
+		set_time += set_end - set_start;
+		total += count;
+
+		bool ok = true;
+		for (size_t i = 0; i < count && ok; ++i) {
+			ok = items[i].key == expected[i].key && items[i].ptr == expected[i].ptr && items[i].text == expected[i].text;
+			// Stability: equal keys keep the order they were added in
+			if (ok && i > 0 && items[i].key == items[i - 1].key) ok = items[i].ptr > items[i - 1].ptr;
+			// Ordering: far things first
+			if (ok && i > 0) ok = (*(Vector *)items[i - 1].ptr - origin).SquaredLength() >= (*(Vector *)items[i].ptr - origin).SquaredLength();
+		}
+		if (!ok && ++failures <= 10) console->Print("Round %d (%d items) sorted differently\n", round, (int)count);
+	}
+
+	auto ns = [&](clock::duration d) { return std::chrono::duration<double, std::nano>(d).count() / total; };
+	console->Print("%d rounds, %d items: radix %.1f ns/item, std::stable_sort %.1f ns/item, old std::set %.1f ns/item\n", rounds, (int)total, ns(radix_time), ns(stable_time), ns(set_time));
+	console->Print(failures ? "Translucent sort self test FAILED\n" : "Translucent sort self test passed\n");
+}
+
+// }}}
+
+HUD_ELEMENT2(overlay_verts, "0", "Draws the number of overlay vertices drawn last frame, split into retained and immediate geometry.\n", HudType_InGame | HudType_Paused) {
+	size_t immediate = g_verts_drawn_last[0], retained = g_verts_drawn_last[1];
+	ctx->DrawElement("overlay verts: %u (retained: %u, immediate: %u)", (unsigned)(immediate + retained), (unsigned)retained, (unsigned)immediate);
+}
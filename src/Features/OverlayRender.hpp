@@ -27,12 +27,40 @@ struct RenderCallback {
 
 typedef size_t MeshId;
 
+// A cone around the view direction which conservatively contains everything
+// on screen, for skipping geometry which can't be seen. A disabled cone
+// contains everything.
+struct OverlayCullCone {
+	Vector origin;
+	Vector dir;
+	float cos_angle;
+	float sin_angle;
+	bool enabled = false;
+
+	static OverlayCullCone fromView(const ViewSetup *setup, float margin_deg);
+	static OverlayCullCone fromDir(Vector origin, Vector dir, float half_angle_deg);
+
+	bool sphereVisible(Vector center, float radius) const;
+	bool boxVisible(Vector mins, Vector maxs) const;
+};
+
 namespace OverlayRender {
 	// INTERNAL FUNCTIONS - DO NOT USE
 	void drawOpaques(void *viewrender);
 	void drawTranslucents(void *viewrender);
 	void initMaterials();
 
+	// Cull cone for the view overlays were last drawn from, widened to allow
+	// for a frame of camera movement. Disabled if there's no single view to
+	// cull against (nothing drawn yet, splitscreen, orthographic views).
+	OverlayCullCone getCullCone();
+
+	// Origin of whichever view overlays were last drawn from is nearest to
+	// point, i.e. where the camera actually was, whether that's the player,
+	// a demo, a freecam or one of several splitscreen views. False if
+	// nothing has been drawn yet.
+	bool nearestViewOrigin(Vector point, Vector *origin);
+
 	// Every primitive has to be within a mesh
 	MeshId createMesh(RenderCallback solid, RenderCallback wireframe);
 
@@ -40,6 +68,20 @@ namespace OverlayRender {
 	void addTriangle(MeshId &mesh, Vector a, Vector b, Vector c, bool cull_back = false);
 	void addLine(MeshId &mesh, Vector a, Vector b);
 	void addQuad(MeshId &mesh, Vector a, Vector b, Vector c, Vector d, bool cull_back = false);
+	// Many triangles at once, given as triples of indices into verts
+	void addTriangles(MeshId &mesh, const Vector *verts, const short *indices, int ntris, bool cull_back = false);
+	// A box's faces into one mesh and its edges into another
+	void addBox(MeshId &solid, MeshId &wireframe, Vector origin, Vector mins, Vector maxs, QAngle ang);
+
+	// Retained meshes keep their geometry between frames, so things which
+	// don't change every frame only have to be built when they do. Build
+	// them with the primitive functions above, then call drawRetainedMesh
+	// on every frame they should be shown. They're skipped when outside
+	// the view, and live until destroyed.
+	MeshId createRetainedMesh(RenderCallback solid, RenderCallback wireframe);
+	void clearRetainedMesh(MeshId mesh);
+	void drawRetainedMesh(MeshId mesh);
+	void destroyRetainedMesh(MeshId mesh);
 
 	enum class TextAlign {
 		BOTTOM,    // the bottom center of the text block
@@ -167,21 +167,21 @@ static uintptr_t initScan() {
 	uintptr_t portalgun = (uintptr_t)entityList->LookupEntity(SE(player)->active_weapon());
 	if (!portalgun || !entityList->IsPortalGun(SE(player)->active_weapon())) return 0;
 
-	uint8_t linkage = SE(portalgun)->field<unsigned char>("m_iPortalLinkageGroupID");
+	uint8_t linkage = SE(portalgun)->field<unsigned char>(ENT_FIELD("m_iPortalLinkageGroupID"));
 
-	auto m_hPrimaryPortal = SE(portalgun)->field<CBaseHandle>("m_hPrimaryPortal");
-	auto m_hSecondaryPortal = SE(portalgun)->field<CBaseHandle>("m_hSecondaryPortal");
+	auto m_hPrimaryPortal = SE(portalgun)->field<CBaseHandle>(ENT_FIELD("m_hPrimaryPortal"));
+	auto m_hSecondaryPortal = SE(portalgun)->field<CBaseHandle>(ENT_FIELD("m_hSecondaryPortal"));
 	auto bluePortal = (uintptr_t)entityList->LookupEntity(m_hPrimaryPortal);
 	auto orangePortal = (uintptr_t)entityList->LookupEntity(m_hSecondaryPortal);
 
 	if (!bluePortal) {
 		bluePortal = server->FindPortal(linkage, false, true);
-		SE(portalgun)->field<CBaseHandle>("m_hPrimaryPortal") = ((IHandleEntity *)bluePortal)->GetRefEHandle();
+		SE(portalgun)->field<CBaseHandle>(ENT_FIELD("m_hPrimaryPortal")) = ((IHandleEntity *)bluePortal)->GetRefEHandle();
 	}
 
 	if (!orangePortal) {
 		orangePortal = server->FindPortal(linkage, true, true);
-		SE(portalgun)->field<CBaseHandle>("m_hSecondaryPortal") = ((IHandleEntity *)orangePortal)->GetRefEHandle();
+		SE(portalgun)->field<CBaseHandle>(ENT_FIELD("m_hSecondaryPortal")) = ((IHandleEntity *)orangePortal)->GetRefEHandle();
 	}
 
 	return portalgun;
@@ -15,6 +15,9 @@
 #include "Modules/Server.hpp"
 #include "Modules/Surface.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
 #include <vector>
 
 PlayerTrace *playerTrace;
@@ -37,6 +40,8 @@ Variable sar_trace_draw_time("sar_trace_draw_time", "3", 0, 3,
 );
 Variable sar_trace_font_size("sar_trace_font_size", "3.0", 0.1, "The size of text overlaid on recorded traces.\n");
 
+Variable sar_trace_compact("sar_trace_compact", "0", "Store new traces in a compact form which quantizes positions, velocities and angles. Uses several times less memory at a small precision loss.\n");
+
 Variable sar_trace_vphys_record("sar_trace_vphys_record", "1", 0, 1, "Record vphysics locations of dynamic entities for analysis.\n");
 
 Variable sar_trace_reveal("sar_trace_reveal", "0", "Only draw traces until the specified tick. Set to bbox to draw until the bbox tick.\n");
@@ -56,6 +61,219 @@ Vector g_playerTraceTeleportLocation;
 int g_playerTraceTeleportSlot;
 bool g_playerTraceNeedsTeleport = false;
 
+// quantization steps for compact traces
+#define TRACE_COMPACT_POS_SCALE (1.0f / 128.0f)
+#define TRACE_COMPACT_ANG_SCALE (1.0f / 1024.0f)
+
+// Quantized values are kept within 2^28 so prediction residuals always fit
+// in 32 bits after zigzag coding
+#define TRACE_COMPACT_LIMIT (1 << 28)
+
+static inline int32_t quantize(float f, float scale) {
+	float q = f / scale;
+	if (q != q) return 0;
+	if (q > TRACE_COMPACT_LIMIT) return TRACE_COMPACT_LIMIT;
+	if (q < -TRACE_COMPACT_LIMIT) return -TRACE_COMPACT_LIMIT;
+	return (int32_t)lrintf(q);
+}
+
+static inline uint32_t zigzag(int64_t v) {
+	return (uint32_t)((v << 1) ^ (v >> 63));
+}
+
+static inline int64_t unzigzag(uint32_t v) {
+	return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+// Prediction for the k-th value of a chunk: nothing for the first, the
+// previous value for the second, then linear extrapolation
+static inline int64_t predict(size_t k, int32_t prev, int32_t prevprev) {
+	if (k == 0) return 0;
+	if (k == 1) return prev;
+	return 2 * (int64_t)prev - prevprev;
+}
+
+static inline size_t varintSize(uint32_t v) {
+	size_t n = 1;
+	while (v >= 0x80) {
+		v >>= 7;
+		++n;
+	}
+	return n;
+}
+
+void TraceVec3Column::SetCompact(float scale) {
+	if (count) return;
+	this->compact = true;
+	this->scale = scale;
+}
+
+void TraceVec3Column::Encode(const int32_t q[3]) {
+	size_t k = (count - 1) % TRACE_CHUNK_TICKS;  // count already includes the pending tick
+	if (k == 0) chunkOffsets.push_back(bytes.size());
+
+	for (int c = 0; c < 3; ++c) {
+		uint32_t v = zigzag(q[c] - predict(k, encPrev[0][c], encPrev[1][c]));
+		while (v >= 0x80) {
+			bytes.push_back((uint8_t)(v | 0x80));
+			v >>= 7;
+		}
+		bytes.push_back((uint8_t)v);
+
+		encPrev[1][c] = encPrev[0][c];
+		encPrev[0][c] = q[c];
+	}
+}
+
+void TraceVec3Column::Push(float x, float y, float z) {
+	if (!compact) {
+		raw.push_back(x);
+		raw.push_back(y);
+		raw.push_back(z);
+		++count;
+		return;
+	}
+
+	if (count) Encode(pending);
+	pending[0] = quantize(x, scale);
+	pending[1] = quantize(y, scale);
+	pending[2] = quantize(z, scale);
+	++count;
+}
+
+void TraceVec3Column::SetLast(float x, float y, float z) {
+	if (!count) return;
+
+	if (!compact) {
+		raw[(count - 1) * 3 + 0] = x;
+		raw[(count - 1) * 3 + 1] = y;
+		raw[(count - 1) * 3 + 2] = z;
+		return;
+	}
+
+	pending[0] = quantize(x, scale);
+	pending[1] = quantize(y, scale);
+	pending[2] = quantize(z, scale);
+}
+
+void TraceVec3Column::Get(size_t i, float out[3]) const {
+	if (!compact) {
+		out[0] = raw[i * 3 + 0];
+		out[1] = raw[i * 3 + 1];
+		out[2] = raw[i * 3 + 2];
+		return;
+	}
+
+	if (i == count - 1) {
+		for (int c = 0; c < 3; ++c) out[c] = pending[c] * scale;
+		return;
+	}
+
+	size_t chunk = i / TRACE_CHUNK_TICKS;
+	if (cursor.next == 0 || cursor.next > i + 1 || (cursor.next - 1) / TRACE_CHUNK_TICKS != chunk) {
+		// can't continue from the cursor; restart at the chunk
+		cursor.next = chunk * TRACE_CHUNK_TICKS;
+		cursor.pos = chunkOffsets[chunk];
+	}
+
+	while (cursor.next <= i) {
+		size_t k = cursor.next % TRACE_CHUNK_TICKS;
+		for (int c = 0; c < 3; ++c) {
+			uint32_t v = 0;
+			int shift = 0;
+			uint8_t b;
+			do {
+				b = bytes[cursor.pos++];
+				v |= (uint32_t)(b & 0x7F) << shift;
+				shift += 7;
+			} while (b & 0x80);
+
+			int32_t q = (int32_t)(predict(k, cursor.prev[0][c], cursor.prev[1][c]) + unzigzag(v));
+			cursor.prev[1][c] = cursor.prev[0][c];
+			cursor.prev[0][c] = q;
+		}
+		++cursor.next;
+	}
+
+	for (int c = 0; c < 3; ++c) out[c] = cursor.prev[0][c] * scale;
+}
+
+size_t TraceVec3Column::MemoryUsage() const {
+	return raw.capacity() * sizeof(float) + bytes.capacity() + chunkOffsets.capacity() * sizeof(uint32_t);
+}
+
+size_t TraceVec3Column::FullMemoryUsage() const {
+	return count * 3 * sizeof(float);
+}
+
+size_t TraceVec3Column::CompactMemoryUsage(float scale) const {
+	if (compact) return bytes.size() + chunkOffsets.size() * sizeof(uint32_t);
+
+	// Run the encoder over the raw values without storing anything
+	size_t size = (count + TRACE_CHUNK_TICKS - 1) / TRACE_CHUNK_TICKS * sizeof(uint32_t);
+	int32_t prev[2][3] = {};
+	for (size_t i = 0; i < count; ++i) {
+		size_t k = i % TRACE_CHUNK_TICKS;
+		for (int c = 0; c < 3; ++c) {
+			int32_t q = quantize(raw[i * 3 + c], scale);
+			size += varintSize(zigzag(q - predict(k, prev[0][c], prev[1][c])));
+			prev[1][c] = prev[0][c];
+			prev[0][c] = q;
+		}
+	}
+	return size;
+}
+
+uint32_t TraceMeshPool::Intern(const void *collide, const Vector *verts, int count) {
+	// FNV-1a over the vertex data, mixed with the collide identity
+	uint64_t hash = 14695981039346656037ull;
+	auto p = (const uint8_t *)verts;
+	for (size_t i = 0; i < count * sizeof(Vector); ++i) hash = (hash ^ p[i]) * 1099511628211ull;
+	uint64_t key = hash ^ ((uint64_t)(uintptr_t)collide * 0x9E3779B97F4A7C15ull);
+
+	auto &candidates = lookup[key];
+	for (uint32_t idx : candidates) {
+		const Mesh &mesh = meshes[idx];
+		if (mesh.collide != collide || mesh.hash != hash || mesh.verts.size() != (size_t)count) continue;
+		if (!memcmp(mesh.verts.data(), verts, count * sizeof(Vector))) return idx;
+	}
+
+	meshes.push_back({collide, hash, std::vector<Vector>(verts, verts + count)});
+	candidates.push_back(meshes.size() - 1);
+	return meshes.size() - 1;
+}
+
+size_t TraceMeshPool::MemoryUsage() const {
+	size_t size = meshes.capacity() * sizeof(Mesh) + lookup.size() * (sizeof(uint64_t) + sizeof(std::vector<uint32_t>) + sizeof(uint32_t) + 2 * sizeof(void *));
+	for (const auto &mesh : meshes) size += mesh.verts.capacity() * sizeof(Vector);
+	return size;
+}
+
+// Points closer than this to the last one don't start a new line segment
+#define TRACE_MIN_SEGMENT 0.001f
+
+void TraceChunkIndex::Add(size_t tick, Vector pos) {
+	if (tick == 0) this->anchor = pos;
+
+	if (tick % TRACE_INDEX_CHUNK_TICKS == 0) {
+		this->chunks.push_back({this->anchor, this->anchor, this->anchor});
+	}
+
+	auto &chunk = this->chunks.back();
+	chunk.mins = {fminf(chunk.mins.x, pos.x), fminf(chunk.mins.y, pos.y), fminf(chunk.mins.z, pos.z)};
+	chunk.maxs = {fmaxf(chunk.maxs.x, pos.x), fmaxf(chunk.maxs.y, pos.y), fmaxf(chunk.maxs.z, pos.z)};
+
+	if ((this->anchor - pos).Length() > TRACE_MIN_SEGMENT) this->anchor = pos;
+}
+
+const VphysLocationList::Location *VphysLocationList::Find(int index) const {
+	auto it = std::lower_bound(locations.begin(), locations.end(), index, [](const Location &l, int idx) {
+		return l.index < idx;
+	});
+	if (it == locations.end() || it->index != index) return nullptr;
+	return &*it;
+}
+
 static int tickInternalToUser(int tick, const Trace &trace) {
 	if (tick == -1) return -1;
 	switch (sar_trace_draw_time.GetInt()) {
@@ -134,8 +352,17 @@ bool PlayerTrace::IsTraceNameValid(std::string trace_name) {
 
 void PlayerTrace::AddPoint(std::string trace_name, void *player, int slot, bool use_client_offset) {
 	if (traces.count(trace_name) == 0) {
-		traces[trace_name] = Trace();
-		traces[trace_name].startSessionTick = session->GetTick();
+		Trace &trace = traces[trace_name];
+		trace.startSessionTick = session->GetTick();
+		if (sar_trace_compact.GetBool()) {
+			trace.compact = true;
+			for (int i = 0; i < 2; ++i) {
+				trace.positions[i].SetCompact(TRACE_COMPACT_POS_SCALE);
+				trace.eyepos[i].SetCompact(TRACE_COMPACT_POS_SCALE);
+				trace.angles[i].SetCompact(TRACE_COMPACT_ANG_SCALE);
+				trace.velocities[i].SetCompact(TRACE_COMPACT_POS_SCALE);
+			}
+		}
 	}
 
 	Trace &trace = traces[trace_name];
@@ -174,7 +401,7 @@ void PlayerTrace::AddPoint(std::string trace_name, void *player, int slot, bool
 	this->EmitLog("ProcessMovement(%d) slot: %d", session->GetTick(), slot);
 	this->EmitLog("player %d @ (%.6f,%.6f,%.6f)", slot, pos.x, pos.y, pos.z);
 
-	HitboxList hitboxes = ConstructHitboxList(pos);
+	HitboxList hitboxes = ConstructHitboxList(pos, trace.meshes);
 
 	trace.positions[slot].push_back(pos);
 	trace.angles[slot].push_back(angles);
@@ -183,6 +410,9 @@ void PlayerTrace::AddPoint(std::string trace_name, void *player, int slot, bool
 	trace.grounded[slot].push_back(grounded);
 	trace.crouched[slot].push_back(ducked);
 	trace.hitboxes[slot].push_back(hitboxes);
+	// index what's actually stored, which differs from pos in compact traces
+	size_t tick = trace.positions[slot].size() - 1;
+	trace.index[slot].Add(tick, trace.positions[slot][tick]);
 
 	// Only do it for one of the slots since we record all the portals in the map at once
 	if (slot == 0) {
@@ -231,6 +461,17 @@ void PlayerTrace::Clear(std::string trace_name) {
 void PlayerTrace::ClearAll() {
 	traces.clear();
 }
+// Whether any tick in the chunk could be close enough to the crosshair to
+// be hovered
+static bool chunkInPickRange(const TraceChunkIndex::Chunk &chunk, Vector cam_pos, const OverlayCullCone &pick_cone) {
+	Vector nearest{
+		std::clamp(cam_pos.x, chunk.mins.x, chunk.maxs.x),
+		std::clamp(cam_pos.y, chunk.mins.y, chunk.maxs.y),
+		std::clamp(cam_pos.z, chunk.mins.z, chunk.maxs.z),
+	};
+	return (nearest - cam_pos).SquaredLength() < 300*300 && pick_cone.boxVisible(chunk.mins, chunk.maxs);
+}
+
 void PlayerTrace::DrawInWorld() const {
 	bool draw_through_walls = sar_trace_draw_through_walls.GetBool();
 
@@ -254,6 +495,11 @@ void PlayerTrace::DrawInWorld() const {
 		}.Normalize();
 	}
 
+	// Drawing only needs what's in view; hover picking only looks at points
+	// within 300 units in a narrow cone around the crosshair
+	OverlayCullCone draw_cone = OverlayRender::getCullCone();
+	OverlayCullCone pick_cone = OverlayCullCone::fromDir(cam_pos, view_vec, RAD2DEG(acosf(0.9f)));
+
 	for (auto it = playerTrace->traces.begin(); it != playerTrace->traces.end(); ++it) {
 		std::string trace_name = it->first;
 		const Trace &trace = it->second;
@@ -273,10 +519,6 @@ void PlayerTrace::DrawInWorld() const {
 			MeshId mesh_over300   = OverlayRender::createMesh(RenderCallback::none, RenderCallback::constant({ 0,   255, 0   }, draw_through_walls));
 			MeshId mesh_grounded  = OverlayRender::createMesh(RenderCallback::none, RenderCallback::constant({ 255, 0,   0   }, draw_through_walls));
 
-			Vector pos = trace.positions[slot][0];
-			float speed = trace.velocities[slot][0].Length2D();
-			unsigned groundframes = trace.grounded[slot][0];
-
 			size_t end_tick = trace.positions[slot].size() - 1;
 			if (sar_trace_reveal.GetInt() > 0) {
 				end_tick = (std::min)(end_tick, (size_t)tickUserToInternal(sar_trace_reveal.GetInt() + 1, trace));
@@ -284,68 +526,75 @@ void PlayerTrace::DrawInWorld() const {
 				end_tick = (std::min)(end_tick, (size_t)tickUserToInternal(sar_trace_bbox_at.GetInt() + 1, trace));
 			}
 
-			for (size_t i = 0; i < end_tick; i++) {
-				Vector new_pos = trace.positions[slot][i];
-				speed = trace.velocities[slot][i].Length2D();
-				
-				if (trace.grounded[slot][i]) {
-					groundframes++;
-				} else {
-					groundframes = 0;
-				}
-
-				if ((new_pos - cam_pos).SquaredLength() < 300*300) {
-					// It's close enough to test
-					Vector dir = new_pos - cam_pos;
-					float dist = fabsf(1 - dir.Normalize().Dot(view_vec));
-					if (dist < 0.1 && dist < closest_dist) {
-						// Check whether the point is actually visible
-						CGameTrace tr;
-
-						if (!draw_through_walls) {
-							Ray_t ray;
-							ray.m_IsRay = true;
-							ray.m_IsSwept = true;
-							ray.m_Start = VectorAligned(cam_pos.x, cam_pos.y, cam_pos.z);
-							ray.m_Delta = VectorAligned(dir.x, dir.y, dir.z);
-							ray.m_StartOffset = VectorAligned();
-							ray.m_Extents = VectorAligned();
-
-							CTraceFilterSimple filter;
-							filter.SetPassEntity(server->GetPlayer(GET_SLOT()+1));
-
-							engine->TraceRay(engine->engineTrace->ThisPtr(), ray, MASK_VISIBLE, &filter, &tr);
-						}
-
-						if (draw_through_walls || tr.plane.normal.Length() <= 0.9) {
-							// Didn't hit anything; use this point
-							closest_id = i;
-							closest_dist = dist;
-							closest_pos = new_pos;
-							closest_vel = speed;
+			const auto &chunks = trace.index[slot].chunks;
+			for (size_t c = 0; c < chunks.size() && c * TRACE_INDEX_CHUNK_TICKS < end_tick; ++c) {
+				const auto &chunk = chunks[c];
+
+				bool draw_chunk = draw_cone.boxVisible(chunk.mins, chunk.maxs);
+				bool pick_chunk = chunkInPickRange(chunk, cam_pos, pick_cone);
+				if (!draw_chunk && !pick_chunk) continue;
+
+				Vector pos = chunk.anchor;
+				size_t chunk_end = (std::min)(end_tick, (c + 1) * TRACE_INDEX_CHUNK_TICKS);
+
+				for (size_t i = c * TRACE_INDEX_CHUNK_TICKS; i < chunk_end; i++) {
+					Vector new_pos = trace.positions[slot][i];
+					float speed = trace.velocities[slot][i].Length2D();
+
+					if (pick_chunk && (new_pos - cam_pos).SquaredLength() < 300*300) {
+						// It's close enough to test
+						Vector dir = new_pos - cam_pos;
+						float dist = fabsf(1 - dir.Normalize().Dot(view_vec));
+						if (dist < 0.1 && dist < closest_dist) {
+							// Check whether the point is actually visible
+							CGameTrace tr;
+
+							if (!draw_through_walls) {
+								Ray_t ray;
+								ray.m_IsRay = true;
+								ray.m_IsSwept = true;
+								ray.m_Start = VectorAligned(cam_pos.x, cam_pos.y, cam_pos.z);
+								ray.m_Delta = VectorAligned(dir.x, dir.y, dir.z);
+								ray.m_StartOffset = VectorAligned();
+								ray.m_Extents = VectorAligned();
+
+								CTraceFilterSimple filter;
+								filter.SetPassEntity(server->GetPlayer(GET_SLOT()+1));
+
+								engine->TraceRay(engine->engineTrace->ThisPtr(), ray, MASK_VISIBLE, &filter, &tr);
+							}
+
+							if (draw_through_walls || tr.plane.normal.Length() <= 0.9) {
+								// Didn't hit anything; use this point
+								closest_id = i;
+								closest_dist = dist;
+								closest_pos = new_pos;
+								closest_vel = speed;
+							}
 						}
 					}
-				}
 
-				// Don't draw a line when going through a portal or 0 length line
-				float pos_delta = (pos - new_pos).Length();
-				if (pos_delta < 127 && pos_delta > 0.001) {
-					// Colors:
-					// red: grounded
-					// brown: speedlocked
-					// yellow: can't turn further
-					// green: speed>300
-					Vector vel = trace.velocities[slot][i];
-					MeshId &mesh =
-						groundframes > 1 ? mesh_grounded :
-						speed < 300      ? mesh_under300 :
-						fabsf(vel.x) >= 150 && fabsf(vel.y) >= 150 ? mesh_airlocked :
-						fabsf(vel.x) >= 60  && fabsf(vel.y) >= 60  ? mesh_max_turn :
-						mesh_over300;
-
-					OverlayRender::addLine(mesh, pos, new_pos);
+					// Don't draw a line when going through a portal or 0 length line
+					float pos_delta = (pos - new_pos).Length();
+					if (draw_chunk && pos_delta < 127 && pos_delta > TRACE_MIN_SEGMENT) {
+						// Colors:
+						// red: grounded (for at least two ticks, or since the start)
+						// brown: speedlocked
+						// yellow: can't turn further
+						// green: speed>300
+						bool grounded = trace.grounded[slot][i] && (i == 0 || trace.grounded[slot][i - 1]);
+						Vector vel = trace.velocities[slot][i];
+						MeshId &mesh =
+							grounded         ? mesh_grounded :
+							speed < 300      ? mesh_under300 :
+							fabsf(vel.x) >= 150 && fabsf(vel.y) >= 150 ? mesh_airlocked :
+							fabsf(vel.x) >= 60  && fabsf(vel.y) >= 60  ? mesh_max_turn :
+							mesh_over300;
+
+						OverlayRender::addLine(mesh, pos, new_pos);
+					}
+					if (pos_delta > TRACE_MIN_SEGMENT) pos = new_pos;
 				}
-				if (pos_delta > 0.001) pos = new_pos;
 			}
 
 			if (closest_dist < 1.0f) {
@@ -448,10 +697,11 @@ void PlayerTrace::DrawBboxAt(int tick) const {
 						RenderCallback::constant({ 255, 0, 0, 20  }),
 						RenderCallback::constant({ 255, 0, 0, 255 })
 					);
-					for (size_t i = 0; i < vphys.verts.size(); i += 3) {
-						Vector a = vphys.verts[i+0];
-						Vector b = vphys.verts[i+1];
-						Vector c = vphys.verts[i+2];
+					auto &verts = trace.meshes.meshes[vphys.mesh].verts;
+					for (size_t i = 0; i < verts.size(); i += 3) {
+						Vector a = vphys.transform.VectorTransform(verts[i+0]);
+						Vector b = vphys.transform.VectorTransform(verts[i+1]);
+						Vector c = vphys.transform.VectorTransform(verts[i+2]);
 						OverlayRender::addTriangle(mesh, a, b, c, true);
 					}
 				}
@@ -461,10 +711,11 @@ void PlayerTrace::DrawBboxAt(int tick) const {
 						RenderCallback::constant({ 0, 0, 255, 20  }),
 						RenderCallback::constant({ 0, 0, 255, 255 })
 					);
-					for (size_t i = 0; i < bsp.verts.size(); i += 3) {
-						Vector a = bsp.verts[i+0];
-						Vector b = bsp.verts[i+1];
-						Vector c = bsp.verts[i+2];
+					auto &verts = trace.meshes.meshes[bsp.mesh].verts;
+					for (size_t i = 0; i < verts.size(); i += 3) {
+						Vector a = bsp.transform.VectorTransform(verts[i+0]);
+						Vector b = bsp.transform.VectorTransform(verts[i+1]);
+						Vector c = bsp.transform.VectorTransform(verts[i+2]);
 						OverlayRender::addTriangle(mesh, a, b, c, true);
 					}
 				}
@@ -599,7 +850,7 @@ void PlayerTrace::TeleportAt(std::string trace_name, int slot, int tick, bool ey
 	g_playerTraceNeedsTeleport = true;
 }
 
-HitboxList PlayerTrace::ConstructHitboxList(Vector center) const {
+HitboxList PlayerTrace::ConstructHitboxList(Vector center, TraceMeshPool &pool) const {
 	if (!sar_trace_bbox_ent_record.GetBool()) return HitboxList{};
 
 	const float d = sar_trace_bbox_ent_dist.GetFloat();
@@ -650,17 +901,16 @@ HitboxList PlayerTrace::ConstructHitboxList(Vector center) const {
 				Vector *verts;
 				int vert_count = engine->CreateDebugMesh(engine->g_physCollision, phys_coll, &verts);
 
-				matrix3x4_t trans = coll->CollisionToWorldTransform();
-
-				std::vector<Vector> verts_copy(vert_count);
-				for (int i = 0; i < vert_count; ++i) {
-					verts_copy[i] = trans.VectorTransform(verts[i]);
-				}
+				// Keep the geometry in collision space; only the transform is per-tick
+				HitboxList::VphysBox box{
+					pool.Intern(phys_coll, verts, vert_count),
+					coll->CollisionToWorldTransform(),
+				};
 
 				if (coll->GetSolid() == SOLID_VPHYSICS) {
-					list.vphys.push_back(HitboxList::VphysBox{verts_copy});
+					list.vphys.push_back(box);
 				} else {
-					list.bsps.push_back(HitboxList::VphysBox{verts_copy});
+					list.bsps.push_back(box);
 				}
 
 				engine->DestroyDebugMesh(engine->g_physCollision, vert_count, verts);
@@ -685,7 +935,7 @@ VphysLocationList PlayerTrace::ConstructVphysLocationList() const {
 		if (!ent) continue;
 		auto className = server->GetEntityClassName(ent);
 
-		const char *allowedClassNames[] = {
+		static const char *allowedClassNames[] = {
 			"player",
 			"prop_physics",
 			"func_physbox",
@@ -698,23 +948,26 @@ VphysLocationList PlayerTrace::ConstructVphysLocationList() const {
 		};
 
 		int size = sizeof(allowedClassNames) / sizeof(allowedClassNames[0]);
-		bool isAllowedEntity = false;
+		const char *internedName = nullptr;
 
 		for (int i = 0; i < size; i++) {
 			if (strcmp(className, allowedClassNames[i]) == 0) {
-				isAllowedEntity = true;
+				// the table doubles as the intern pool
+				internedName = allowedClassNames[i];
 				break;
 			}
 		}
-		if (!isAllowedEntity) continue;
+		if (!internedName) continue;
 
 		ICollideable *coll = &SE(ent)->collision();
 
-		locationList.locations[i] = {
-			std::string(className),
+		// entities are visited in index order, so this stays sorted
+		locationList.locations.push_back({
+			i,
+			internedName,
 			coll->GetCollisionOrigin(),
 			coll->GetCollisionAngles()
-		};
+		});
 	}
 
 	return locationList;
@@ -730,22 +983,19 @@ PortalLocations PlayerTrace::ConstructPortalLocations() const {
 
 	PortalLocations portals;
 
-	for (int i = 0; i < Offsets::NUM_ENT_ENTRIES; ++i) {
+	for (int i : entityList->GetEntityIndicesByClassName("prop_portal")) {
 		void *ent = server->m_EntPtrArray[i].m_pEntity;
-		if (!ent) continue;
-		if (server->IsPlayer(ent)) continue;
-		if (strcmp(server->GetEntityClassName(ent), "prop_portal")) continue;
-		if (!SE(ent)->field<bool>("m_bActivated")) continue;
+		if (!SE(ent)->field<bool>(ENT_FIELD("m_bActivated"))) continue;
 
 		PortalLocations::PortalLocation portal;
 
 		portal.pos = server->GetAbsOrigin(ent);
 		portal.ang = server->GetAbsAngles(ent);
-		portal.is_primary = !SE(ent)->field<bool>("m_bIsPortal2");
+		portal.is_primary = !SE(ent)->field<bool>(ENT_FIELD("m_bIsPortal2"));
 		portal.is_coop = engine->IsCoop();
 
 		if (portal.is_coop) {
-			CBaseHandle shooter_handle = SE(ent)->field<CBaseHandle>("m_hFiredByPlayer");
+			CBaseHandle shooter_handle = SE(ent)->field<CBaseHandle>(ENT_FIELD("m_hFiredByPlayer"));
 			void *shooter = entityList->LookupEntity(shooter_handle);
 			portal.is_atlas = shooter == server->GetPlayer(1);
 		}
@@ -806,8 +1056,7 @@ void PlayerTrace::TweakLatestEyeOffsetForPortalShot(CMoveData *moveData, int slo
 	} else {
 		camera->GetEyePosFromOrigin<true>(slot, moveData->m_vecAbsOrigin, eyepos, angles);
 	}
-	int lastTick = trace->positions[slot].size() - 1;
-	trace->eyepos[slot][lastTick] = eyepos;
+	trace->eyepos[slot].SetLast(eyepos);
 }
 
 void PlayerTrace::CheckTraceChanged() {
@@ -889,6 +1138,78 @@ int PlayerTrace::GetTasTraceTick() {
 	return max_tas_tick;
 }
 
+static std::string formatTraceBytes(size_t bytes) {
+	if (bytes >= 1024 * 1024) return Utils::ssprintf("%.2f MiB", bytes / (1024.0 * 1024.0));
+	if (bytes >= 1024) return Utils::ssprintf("%.2f KiB", bytes / 1024.0);
+	return Utils::ssprintf("%u B", (unsigned)bytes);
+}
+
+void PlayerTrace::PrintMemoryUsage() {
+	if (traces.size() == 0) {
+		console->Print("No traces recorded.\n");
+		return;
+	}
+
+	size_t total = 0;
+
+	for (const auto &[name, trace] : traces) {
+		size_t ticks = (std::max)(trace.positions[0].size(), trace.positions[1].size());
+
+		size_t cur = 0, full = 0, compact = 0;
+		for (int slot = 0; slot < 2; ++slot) {
+			const TraceVec3Column *posCols[] = {&trace.positions[slot], &trace.eyepos[slot], &trace.velocities[slot]};
+			for (auto col : posCols) {
+				cur += col->MemoryUsage();
+				full += col->FullMemoryUsage();
+				compact += col->CompactMemoryUsage(TRACE_COMPACT_POS_SCALE);
+			}
+			cur += trace.angles[slot].MemoryUsage();
+			full += trace.angles[slot].FullMemoryUsage();
+			compact += trace.angles[slot].CompactMemoryUsage(TRACE_COMPACT_ANG_SCALE);
+
+			size_t flags = (trace.grounded[slot].capacity() + trace.crouched[slot].capacity()) / 8;
+			cur += flags;
+			full += flags;
+			compact += flags;
+		}
+
+		size_t hitboxes = 0;
+		for (int slot = 0; slot < 2; ++slot) {
+			hitboxes += trace.hitboxes[slot].capacity() * sizeof(HitboxList);
+			for (const auto &list : trace.hitboxes[slot]) {
+				hitboxes += (list.vphys.capacity() + list.bsps.capacity()) * sizeof(HitboxList::VphysBox);
+				hitboxes += list.obb.capacity() * sizeof(HitboxList::ObbBox);
+			}
+		}
+		hitboxes += trace.meshes.MemoryUsage();
+
+		size_t vphys = trace.vphysLocations.capacity() * sizeof(VphysLocationList);
+		for (const auto &list : trace.vphysLocations) {
+			vphys += list.locations.capacity() * sizeof(VphysLocationList::Location);
+		}
+
+		size_t portals = trace.portals.capacity() * sizeof(PortalLocations);
+		for (const auto &list : trace.portals) {
+			portals += list.locations.capacity() * sizeof(PortalLocations::PortalLocation);
+		}
+
+		size_t logs = trace.log_lines.capacity() * sizeof(std::string);
+		for (const auto &line : trace.log_lines) logs += line.capacity();
+
+		size_t sum = cur + hitboxes + vphys + portals + logs;
+		total += sum;
+
+		console->Print("trace %s (%u ticks, %s storage): %s\n", name.c_str(), (unsigned)ticks, trace.compact ? "compact" : "full", formatTraceBytes(sum).c_str());
+		console->Print("  player state: %s (full: %s, compact: %s)\n", formatTraceBytes(cur).c_str(), formatTraceBytes(full).c_str(), formatTraceBytes(compact).c_str());
+		console->Print("  hitboxes: %s\n", formatTraceBytes(hitboxes).c_str());
+		console->Print("  vphys locations: %s\n", formatTraceBytes(vphys).c_str());
+		console->Print("  portals: %s\n", formatTraceBytes(portals).c_str());
+		console->Print("  logs: %s\n", formatTraceBytes(logs).c_str());
+	}
+
+	console->Print("total: %s\n", formatTraceBytes(total).c_str());
+}
+
 HUD_ELEMENT2(trace, "0", "Draws info about current trace bbox tick.\n", HudType_InGame | HudType_Paused) {
 	if (!sv_cheats.GetBool()) return;
 	playerTrace->DrawTraceHud(ctx);
@@ -916,6 +1237,154 @@ CON_COMMAND(sar_trace_show, "sar_trace_show [trace name] - show the trace with t
 	}
 }
 
+CON_COMMAND(sar_trace_memory, "sar_trace_memory - prints the memory used by each trace, comparing full and compact storage\n") {
+	playerTrace->PrintMemoryUsage();
+}
+
+// Draw benchmark {{{
+
+struct TraceWalkResult {
+	size_t lines = 0;       // segments handed to the renderer
+	size_t ticks = 0;       // ticks decoded
+	size_t visible = 0;     // drawn segments ending inside the draw cone
+	size_t picked = SIZE_MAX;
+	float picked_dist = 1.0f;
+};
+
+// What DrawInWorld did before the chunk index: decode and test every tick
+// and hand every segment to the renderer. Kept as a reference for
+// sar_trace_bench, which draws through walls so there's no trace ray
+static TraceWalkResult walkTraceLinear(const Trace &trace, Vector cam_pos, Vector view_vec, const OverlayCullCone &draw_cone, bool check) {
+	TraceWalkResult res;
+	size_t end_tick = trace.positions[0].size() - 1;
+	Vector pos = trace.positions[0][0];
+	for (size_t i = 0; i < end_tick; i++) {
+		Vector new_pos = trace.positions[0][i];
+		++res.ticks;
+		if ((new_pos - cam_pos).SquaredLength() < 300*300) {
+			Vector dir = new_pos - cam_pos;
+			float dist = fabsf(1 - dir.Normalize().Dot(view_vec));
+			if (dist < 0.1 && dist < res.picked_dist) {
+				res.picked = i;
+				res.picked_dist = dist;
+			}
+		}
+		float pos_delta = (pos - new_pos).Length();
+		if (pos_delta < 127 && pos_delta > TRACE_MIN_SEGMENT) {
+			++res.lines;
+			if (check && draw_cone.sphereVisible(new_pos, 0)) ++res.visible;
+		}
+		if (pos_delta > TRACE_MIN_SEGMENT) pos = new_pos;
+	}
+	return res;
+}
+
+// The walk DrawInWorld does now, minus the drawing
+static TraceWalkResult walkTraceChunked(const Trace &trace, Vector cam_pos, Vector view_vec, const OverlayCullCone &draw_cone, const OverlayCullCone &pick_cone, bool check) {
+	TraceWalkResult res;
+	size_t end_tick = trace.positions[0].size() - 1;
+	const auto &chunks = trace.index[0].chunks;
+	for (size_t c = 0; c < chunks.size() && c * TRACE_INDEX_CHUNK_TICKS < end_tick; ++c) {
+		const auto &chunk = chunks[c];
+
+		bool draw_chunk = draw_cone.boxVisible(chunk.mins, chunk.maxs);
+		bool pick_chunk = chunkInPickRange(chunk, cam_pos, pick_cone);
+		if (!draw_chunk && !pick_chunk) continue;
+
+		Vector pos = chunk.anchor;
+		size_t chunk_end = (std::min)(end_tick, (c + 1) * TRACE_INDEX_CHUNK_TICKS);
+		for (size_t i = c * TRACE_INDEX_CHUNK_TICKS; i < chunk_end; i++) {
+			Vector new_pos = trace.positions[0][i];
+			++res.ticks;
+			if (pick_chunk && (new_pos - cam_pos).SquaredLength() < 300*300) {
+				Vector dir = new_pos - cam_pos;
+				float dist = fabsf(1 - dir.Normalize().Dot(view_vec));
+				if (dist < 0.1 && dist < res.picked_dist) {
+					res.picked = i;
+					res.picked_dist = dist;
+				}
+			}
+			float pos_delta = (pos - new_pos).Length();
+			if (draw_chunk && pos_delta < 127 && pos_delta > TRACE_MIN_SEGMENT) {
+				++res.lines;
+				if (check && draw_cone.sphereVisible(new_pos, 0)) ++res.visible;
+			}
+			if (pos_delta > TRACE_MIN_SEGMENT) pos = new_pos;
+		}
+	}
+	return res;
+}
+
+CON_COMMAND(sar_trace_bench, "sar_trace_bench [ticks] [views] - times trace draw prep and hover picking on a synthetic trace, with and without the chunk index\n") {
+	if (args.ArgC() > 3) return console->Print(sar_trace_bench.ThisPtr()->m_pszHelpString);
+	int ticks = args.ArgC() >= 2 ? atoi(args[1]) : 1000000;
+	int views = args.ArgC() >= 3 ? atoi(args[2]) : 100;
+	if (ticks < TRACE_INDEX_CHUNK_TICKS || views < 1) return console->Print(sar_trace_bench.ThisPtr()->m_pszHelpString);
+
+	uint32_t seed = 1;
+	auto rand = [&]() { return ((seed = seed * 1664525 + 1013904223) >> 8) / (float)(1 << 24); };
+
+	// Meandering movement at a few hundred units a second with the odd
+	// portal, like a long run. Not added to the feature, so never drawn
+	Trace trace;
+	Vector pos{0, 0, 0};
+	float yaw = 0, speed = 300;
+	for (int i = 0; i < ticks; ++i) {
+		yaw += (rand() - 0.5f) * 0.1f;
+		speed = std::clamp(speed + (rand() - 0.5f) * 20.0f, 0.0f, 800.0f);
+		Vector vel{cosf(yaw) * speed, sinf(yaw) * speed, (rand() - 0.5f) * 100.0f};
+		pos = rand() < 0.001f ? Vector{(rand() - 0.5f) * 8000.0f, (rand() - 0.5f) * 8000.0f, (rand() - 0.5f) * 2000.0f} : pos + vel / 60.0f;
+		trace.positions[0].push_back(pos);
+		trace.index[0].Add(i, pos);
+	}
+
+	using clock = std::chrono::steady_clock;
+	clock::duration linear_time{}, chunked_time{};
+	size_t linear_ticks = 0, chunked_ticks = 0, linear_lines = 0, chunked_lines = 0;
+	int picks = 0, mismatches = 0;
+
+	for (int v = 0; v < views; ++v) {
+		// Stand near some tick and look at a tick shortly after it, so most
+		// views have something to hover
+		size_t at = (size_t)(rand() * (ticks - 64));
+		Vector target = trace.positions[0][at + 1 + (size_t)(rand() * 60)];
+		Vector cam_pos = trace.positions[0][at] + Vector{(rand() - 0.5f) * 100.0f, (rand() - 0.5f) * 100.0f, 64.0f};
+		if ((target - cam_pos).SquaredLength() < 1) continue;
+		Vector view_vec = (target - cam_pos).Normalize();
+
+		OverlayCullCone draw_cone = OverlayCullCone::fromDir(cam_pos, view_vec, 60);
+		OverlayCullCone pick_cone = OverlayCullCone::fromDir(cam_pos, view_vec, RAD2DEG(acosf(0.9f)));
+
+		auto linear = walkTraceLinear(trace, cam_pos, view_vec, draw_cone, true);
+		auto chunked = walkTraceChunked(trace, cam_pos, view_vec, draw_cone, pick_cone, true);
+		if (linear.picked != chunked.picked || linear.visible != chunked.visible) {
+			if (++mismatches <= 10) console->Print("View %d: picked tick %d, chunked %d; %d visible lines, chunked %d\n", v, (int)linear.picked, (int)chunked.picked, (int)linear.visible, (int)chunked.visible);
+		}
+		if (linear.picked != SIZE_MAX) ++picks;
+
+		auto start = clock::now();
+		linear = walkTraceLinear(trace, cam_pos, view_vec, draw_cone, false);
+		auto mid = clock::now();
+		chunked = walkTraceChunked(trace, cam_pos, view_vec, draw_cone, pick_cone, false);
+		auto end = clock::now();
+
+		linear_time += mid - start;
+		chunked_time += end - mid;
+		linear_ticks += linear.ticks;
+		chunked_ticks += chunked.ticks;
+		linear_lines += linear.lines;
+		chunked_lines += chunked.lines;
+	}
+
+	auto ms = [&](clock::duration d) { return std::chrono::duration<double, std::milli>(d).count() / views; };
+	console->Print("%d ticks in %d chunks, %d views, %d with a hovered tick\n", ticks, (int)trace.index[0].chunks.size(), views, picks);
+	console->Print("linear:  %.3f ms/frame, %d ticks and %d lines per frame\n", ms(linear_time), (int)(linear_ticks / views), (int)(linear_lines / views));
+	console->Print("chunked: %.3f ms/frame, %d ticks and %d lines per frame (%.1fx)\n", ms(chunked_time), (int)(chunked_ticks / views), (int)(chunked_lines / views), ms(linear_time) / ms(chunked_time));
+	console->Print(mismatches ? "Trace index self test FAILED\n" : "Trace index self test passed\n");
+}
+
+// }}}
+
 CON_COMMAND(sar_trace_dump, "sar_trace_dump <tick> [player slot] [trace name] - dump the player state from the given trace tick on the given trace ID (defaults to 1) in the given slot (defaults to 0).\n") {
 	if (!sv_cheats.GetBool()) return;
 
@@ -939,8 +1408,7 @@ CON_COMMAND(sar_trace_dump, "sar_trace_dump <tick> [player slot] [trace name] -
 	}
 }
 
-ON_EVENT(RENDER) {
-	if (!sar_trace_draw.GetBool()) return;
+ON_EVENT_IF(RENDER, sar_trace_draw) {
 	if (!sv_cheats.GetBool()) return;
 
 	// overriding the value of sar_trace_bbox_at if hovered position is used
@@ -1147,8 +1615,8 @@ CON_COMMAND(sar_trace_compare, "sar_trace_compare <trace 1> <trace 2> - compares
 		return;
 	}
 
-	auto vphysList1 = trace1->vphysLocations;
-	auto vphysList2 = trace2->vphysLocations;
+	const auto &vphysList1 = trace1->vphysLocations;
+	const auto &vphysList2 = trace2->vphysLocations;
 	if (vphysList1.size() != vphysList2.size()) {
 		console->ColorMsg(badColor, "Mismatch in trace length: %d <-> %d\n", vphysList1.size(), vphysList2.size());
 	}
@@ -1160,20 +1628,20 @@ CON_COMMAND(sar_trace_compare, "sar_trace_compare <trace 1> <trace 2> - compares
 
 		auto userTick = tickInternalToUser(i, *trace1);
 
-		auto locationsList1 = vphysList1[i].locations;
-		auto locationsList2 = vphysList2[i].locations;
+		const auto &locationsList1 = vphysList1[i];
+		const auto &locationsList2 = vphysList2[i];
 
 		for (int ent_index = 0; ent_index < Offsets::NUM_ENT_ENTRIES; ++ent_index) {
-			auto location1Entry = locationsList1.find(ent_index);
-			auto location2Entry = locationsList2.find(ent_index);
+			auto location1Entry = locationsList1.Find(ent_index);
+			auto location2Entry = locationsList2.Find(ent_index);
 
-			auto location1Valid = (location1Entry != locationsList1.end());
-			auto location2Valid = (location2Entry != locationsList2.end());
+			auto location1Valid = (location1Entry != nullptr);
+			auto location2Valid = (location2Entry != nullptr);
 
 			if (!location1Valid && !location2Valid) {
 				continue;
 			} else if (!location1Valid || !location2Valid) {
-				auto entityName = location1Valid ? (*location1Entry).second.className.c_str() : (*location2Entry).second.className.c_str();
+				auto entityName = location1Valid ? location1Entry->className : location2Entry->className;
 				console->ColorMsg(badColor, "Tick %d Slot %d: entity %s exists in trace \"%s\", but not in trace \"%s\"\n",
 					userTick, ent_index, entityName, location1Valid ? trace1Name : trace2Name, location2Valid ? trace1Name : trace2Name);
 				mismatchCount++;
@@ -1182,18 +1650,18 @@ CON_COMMAND(sar_trace_compare, "sar_trace_compare <trace 1> <trace 2> - compares
 
 			bool mismatch = false;
 
-			auto location1 = (*location1Entry).second;
-			auto location2 = (*location2Entry).second;
+			const auto &location1 = *location1Entry;
+			const auto &location2 = *location2Entry;
 
 			if (location1.className != location2.className) {
 				console->ColorMsg(badColor, "Tick %d Slot %d: mismatch in entity types:\n  %s <-> %s\n",
-					userTick, ent_index, location1.className.c_str(), location2.className.c_str());
+					userTick, ent_index, location1.className, location2.className);
 				mismatch = true;
 			}
 
 			if (location1.pos != location2.pos) {
 				console->ColorMsg(badColor, "Tick %d Slot %d: mismatch in position of entity %s:\n  (%.9f %.9f %.9f) <-> (%.9f %.9f %.9f)\n",
-					userTick, ent_index, location1.className.c_str(), 
+					userTick, ent_index, location1.className, 
 					location1.pos.x, location1.pos.y, location1.pos.z, 
 					location2.pos.x, location2.pos.y, location2.pos.z
 				);
@@ -1202,7 +1670,7 @@ CON_COMMAND(sar_trace_compare, "sar_trace_compare <trace 1> <trace 2> - compares
 
 			if (QAngleToVector(location1.ang) != QAngleToVector(location2.ang)) {
 				console->ColorMsg(badColor, "Tick %d Slot %d: mismatch in rotation of entity %s:\n  (%.9f %.9f %.9f) <-> (%.9f %.9f %.9f)\n",
-					userTick, ent_index, location1.className.c_str(), 
+					userTick, ent_index, location1.className, 
 					location1.ang.x, location1.ang.y, location1.ang.z, 
 					location2.ang.x, location2.ang.y, location2.ang.z
 				);
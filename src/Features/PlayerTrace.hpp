@@ -5,10 +5,31 @@
 #include "Utils.hpp"
 
 #include <map>
+#include <unordered_map>
+
+// Collision debug meshes shared between hitbox records, so a prop which
+// stays around for thousands of ticks only stores its geometry once.
+// Meshes are keyed by the collide they came from and a hash of their
+// collision-space vertices.
+struct TraceMeshPool {
+	struct Mesh {
+		const void *collide;
+		uint64_t hash;
+		std::vector<Vector> verts;
+	};
+
+	std::vector<Mesh> meshes;
+	std::unordered_map<uint64_t, std::vector<uint32_t>> lookup;
+
+	// Returns the index of a mesh with exactly these vertices, adding it if needed
+	uint32_t Intern(const void *collide, const Vector *verts, int count);
+	size_t MemoryUsage() const;
+};
 
 struct HitboxList {
 	struct VphysBox {
-		std::vector<Vector> verts;
+		uint32_t mesh;  // index into the trace's mesh pool
+		matrix3x4_t transform;
 	};
 
 	struct ObbBox {
@@ -24,11 +45,16 @@ struct HitboxList {
 
 struct VphysLocationList {
 	struct Location {
-		std::string className;
+		int index;
+		// interned; equal names compare equal by pointer
+		const char *className;
 		Vector pos;
 		QAngle ang;
 	};
-	std::map<int, Location> locations;
+	// sorted by entity index
+	std::vector<Location> locations;
+
+	const Location *Find(int index) const;
 };
 
 struct PortalLocations {
@@ -45,16 +71,96 @@ struct PortalLocations {
 	std::vector<PortalLocation> locations;
 };
 
+#define TRACE_CHUNK_TICKS 32
+
+// Per-tick xyz storage for traces. By default values are kept as raw
+// floats; in compact mode they're quantized to multiples of a fixed scale
+// and delta-coded against a linear prediction in chunks of
+// TRACE_CHUNK_TICKS, so any tick can still be decoded from its chunk start.
+class TraceVec3Column {
+public:
+	// Switches to compact storage; only valid while the column is empty
+	void SetCompact(float scale);
+	inline bool IsCompact() const { return compact; }
+	inline size_t size() const { return count; }
+
+	void Push(float x, float y, float z);
+	void SetLast(float x, float y, float z);
+	void Get(size_t i, float out[3]) const;
+
+	size_t MemoryUsage() const;
+	// What this column would take in either storage mode; the scale is only
+	// used to estimate a column which isn't compact
+	size_t FullMemoryUsage() const;
+	size_t CompactMemoryUsage(float scale) const;
+
+private:
+	void Encode(const int32_t q[3]);
+
+	bool compact = false;
+	size_t count = 0;
+	float scale = 1.0f;
+
+	// full mode
+	std::vector<float> raw;
+
+	// compact mode; the newest tick stays unencoded so SetLast can change it
+	std::vector<uint8_t> bytes;
+	std::vector<uint32_t> chunkOffsets;
+	int32_t pending[3];
+	int32_t encPrev[2][3];
+
+	// sequential reads continue from the last decoded tick
+	struct Cursor {
+		size_t next = 0;
+		size_t pos = 0;
+		int32_t prev[2][3];
+	};
+	mutable Cursor cursor;
+};
+
+template <typename T>
+class TraceColumn : public TraceVec3Column {
+public:
+	inline T operator[](size_t i) const {
+		float v[3];
+		Get(i, v);
+		return T{v[0], v[1], v[2]};
+	}
+	inline void push_back(const T &v) { Push(v.x, v.y, v.z); }
+	inline void SetLast(const T &v) { TraceVec3Column::SetLast(v.x, v.y, v.z); }
+};
+
+#define TRACE_INDEX_CHUNK_TICKS 128
+
+// Bounding boxes over runs of TRACE_INDEX_CHUNK_TICKS ticks, so drawing
+// and hover picking can skip parts of a trace which can't be seen
+struct TraceChunkIndex {
+	struct Chunk {
+		Vector mins, maxs;
+		// where the trace line entering this chunk starts
+		Vector anchor;
+	};
+
+	std::vector<Chunk> chunks;
+	Vector anchor;
+
+	void Add(size_t tick, Vector pos);
+};
+
 struct Trace {
 	int startSessionTick;
 	int startTasTick;
-	std::vector<Vector> positions[2];
-	std::vector<Vector> eyepos[2];
-	std::vector<QAngle> angles[2];
-	std::vector<Vector> velocities[2];
+	bool compact = false;
+	TraceColumn<Vector> positions[2];
+	TraceColumn<Vector> eyepos[2];
+	TraceColumn<QAngle> angles[2];
+	TraceColumn<Vector> velocities[2];
 	std::vector<bool> grounded[2];
 	std::vector<bool> crouched[2];
 	std::vector<HitboxList> hitboxes[2];
+	TraceMeshPool meshes;
+	TraceChunkIndex index[2];
 	// Only have one of those, store all the portals in the map
 	// indiscriminately of player (also ones placed by pedestals etc)
 	std::vector<PortalLocations> portals;
@@ -99,7 +205,7 @@ public:
 	// Teleport to given tick on given trace
 	void TeleportAt(std::string trace_name, int slot, int tick, bool eye);
 	// Construct a list of the hitboxes of all entities near a point
-	HitboxList ConstructHitboxList(Vector center) const;
+	HitboxList ConstructHitboxList(Vector center, TraceMeshPool &pool) const;
 	// Construct a list of locations of all dynamic entities for verification purposes
 	VphysLocationList ConstructVphysLocationList() const;
 	// Construct a list of all portals in the map
@@ -114,6 +220,8 @@ public:
 	void CheckTraceChanged();
 	// Get the current trace bbox tick for TAS stuff, or -1 if there isn't one
 	int GetTasTraceTick();
+	// Print how much memory each trace takes in each storage mode
+	void PrintMemoryUsage();
 
 	// Returns an identifier for the scope which should be passed to ExitLogScope
 	void EnterLogScope(const char *name);
@@ -1,6 +1,7 @@
 #include "RNGManip.hpp"
 
 #include "Event.hpp"
+#include "Features/EntityList.hpp"
 #include "Features/Tas/TasPlayer.hpp"
 #include "Hook.hpp"
 #include "Modules/Console.hpp"
@@ -52,14 +53,9 @@ static bool restoreViewPunches(const json11::Json &data) {
 static json11::Json savePaintSprayers() {
 	std::vector<json11::Json> vals;
 
-	for (int i = 0; i < Offsets::NUM_ENT_ENTRIES; ++i) {
+	for (int i : entityList->GetEntityIndicesByClassName("info_paint_sprayer")) {
 		void *ent = server->m_EntPtrArray[i].m_pEntity;
-		if (!ent) continue;
-
-		auto classname = server->GetEntityClassName(ent);
-		if (!classname || strcmp(classname, "info_paint_sprayer")) continue;
-
-		int seed = SE(ent)->field<int>("m_nBlobRandomSeed");
+		int seed = SE(ent)->field<int>(ENT_FIELD("m_nBlobRandomSeed"));
 		vals.push_back({seed});
 	}
 
@@ -71,19 +67,15 @@ static bool restorePaintSprayers(const json11::Json &data) {
 
 	size_t idx = 0;
 
-	for (int i = 0; i < Offsets::NUM_ENT_ENTRIES; ++i) {
+	for (int i : entityList->GetEntityIndicesByClassName("info_paint_sprayer")) {
 		void *ent = server->m_EntPtrArray[i].m_pEntity;
-		if (!ent) continue;
-
-		auto classname = server->GetEntityClassName(ent);
-		if (!classname || strcmp(classname, "info_paint_sprayer")) continue;
 
 		if (idx == data.array_items().size()) {
 			// bad count
 			return false;
 		}
 
-		SE(ent)->field<int>("m_nBlobRandomSeed") = data[idx].int_value();
+		SE(ent)->field<int>(ENT_FIELD("m_nBlobRandomSeed")) = data[idx].int_value();
 		++idx;
 	}
 	return idx == data.array_items().size();
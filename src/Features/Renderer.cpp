@@ -7,18 +7,32 @@
 #include "Modules/FileSystem.hpp"
 #include "Modules/Server.hpp"
 #include "Features/Session.hpp"
+#include "Utils/CpuFeatures.hpp"
 #include "Utils/SDK.hpp"
 #include "Utils/Math.hpp"
 
+#include <algorithm>
 #include <atomic>
 #include <cinttypes>
 #include <condition_variable>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <deque>
+#include <emmintrin.h>
+#include <immintrin.h>
 #include <mutex>
 #include <string>
 #include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#	define SSE2_TARGET
+#	define AVX2_TARGET
+#else
+#	define SSE2_TARGET __attribute__((target("sse2")))
+#	define AVX2_TARGET __attribute__((target("avx2")))
+#endif
 
 extern "C" {
 #include <libavcodec/avcodec.h>
@@ -69,6 +83,9 @@ static Variable sar_render_autostop("sar_render_autostop", "1", "Whether to auto
 static Variable sar_render_shutter_angle("sar_render_shutter_angle", "360", 30, 360, "The shutter angle to use for rendering in degrees.\n");
 static Variable sar_render_merge("sar_render_merge", "0", "When set, merge all the renders until sar_render_finish is entered\n");
 static Variable sar_render_skip_coop_videos("sar_render_skip_coop_videos", "1", "When set, don't include coop loading time in renders\n");
+static Variable sar_render_buffers("sar_render_buffers", "4", 1, 16, "How many captured frames can be queued for the encoder before the game waits for it\n");
+
+#define MAX_RENDER_BUFFERS 16
 
 // g_videomode VMT wrappers {{{
 
@@ -104,6 +121,27 @@ enum class WorkerMsg {
 	STOP_RENDERING_REQUESTED,
 };
 
+struct WorkerJob {
+	WorkerMsg msg;
+	int slot;  // Ring slot holding the frame data, -1 for stop messages
+};
+
+// Timings are in microseconds. Everything is written under jobsLock,
+// except captureUs which is only touched by the game thread.
+struct RenderStats {
+	int captured;
+	int blended;
+	int encoded;
+	int audioFrames;
+	int stalls;
+	int maxDepth;
+	int64_t stallUs;
+	int64_t captureUs;
+	int64_t blendUs;
+	int64_t convertUs;
+	int64_t encodeUs;
+};
+
 // The global renderer state
 static struct
 {
@@ -118,41 +156,86 @@ static struct
 	AVFormatContext *outCtx;
 	int width, height;
 
+	// Captured data goes through a ring of buffers: the game thread fills
+	// the next free slot and queues it for the worker, so it only has to
+	// wait when every slot is still waiting to be encoded. Slots are
+	// handed back in the order they were queued, so a head index and an
+	// in-use count are enough to track them.
+	int numBufs;
+	uint8_t *imageBufs[MAX_RENDER_BUFFERS];      // Raw pixel data read from the screen
+	int16_t *audioBufs[MAX_RENDER_BUFFERS][8];  // Planar audio info from the game
+	int imageNext, imageInUse;
+	int audioNext, audioInUse;
+
 	// The audio stream's temporary frame needs nb_samples worth of
 	// audio before we resample and submit, so we keep track of how far
 	// in we are with this
-	int16_t *audioBuf[8];  // Temporary buffer - contains the planar audio info from the game
+	int audioSlot;  // Slot currently being filled, -1 if none
 	size_t audioBufSz;
 	size_t audioBufIdx;
 
-	// This buffer stores the image data
-	uint8_t *imageBuf;  // Temporary buffer - contains the raw pixel data read from the screen
-
 	int toBlend;
 	int toBlendStart;       // Inclusive
 	int toBlendEnd;         // Exclusive
 	int nextBlendIdx;       // How many frames in this blend have we seen so far?
 	uint32_t *blendSumBuf;  // Blending buffer - contains the sum of the pixel values during blending (we only divide at the end of the blend to prevent rounding errors). Not allocated if toBlend == 1.
-	uint32_t totalBlendWeight;
+	std::vector<uint16_t> blendWeights;  // Q15 weight of each frame in the blend; these always sum to BLEND_WEIGHT_ONE
 
 	// Synchronisation
 	std::thread worker;
-	std::mutex workerUpdateLock;
-	std::condition_variable workerUpdate;
-	std::atomic<WorkerMsg> workerMsg;
-	std::mutex imageBufLock;
+	std::mutex jobsLock;
+	std::condition_variable jobsReady;  // Worker waits on this for queued jobs
+	std::condition_variable slotFreed;  // Game thread waits on this for a free slot or the worker starting
+	std::deque<WorkerJob> jobs;
+	std::mutex imageBufLock;  // Held while capturing so the buffers can't be freed underneath us
 	std::mutex audioBufLock;
 	std::atomic<bool> workerFailedToStart;
+
+	RenderStats stats;
 } g_render;
 
 ON_EVENT(SAR_UNLOAD) {
 	if (g_render.worker.joinable()) g_render.worker.detach();
 }
 
+static inline int64_t usSince(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration_cast<std::chrono::microseconds>(NOW_STEADY() - start).count();
+}
+
+static void queueJob(WorkerMsg msg, int slot) {
+	std::lock_guard<std::mutex> lock(g_render.jobsLock);
+	g_render.jobs.push_back({msg, slot});
+	if ((int)g_render.jobs.size() > g_render.stats.maxDepth) g_render.stats.maxDepth = g_render.jobs.size();
+	g_render.jobsReady.notify_one();
+}
+
 static inline void msgStopRender(bool error) {
-	std::lock_guard<std::mutex> lock(g_render.workerUpdateLock);
-	g_render.workerMsg.store(error ? WorkerMsg::STOP_RENDERING_ERROR : WorkerMsg::STOP_RENDERING_REQUESTED);
-	g_render.workerUpdate.notify_all();
+	queueJob(error ? WorkerMsg::STOP_RENDERING_ERROR : WorkerMsg::STOP_RENDERING_REQUESTED, -1);
+}
+
+// Claim the next slot of a ring, waiting for the worker to hand one back
+// if they're all in use. Returns -1 if the render stopped meanwhile.
+static int acquireSlot(int &next, int &inUse) {
+	std::unique_lock<std::mutex> lock(g_render.jobsLock);
+	if (inUse == g_render.numBufs && g_render.isRendering.load()) {
+		auto start = NOW_STEADY();
+		g_render.slotFreed.wait(lock, [&]() {
+			return inUse < g_render.numBufs || !g_render.isRendering.load();
+		});
+		++g_render.stats.stalls;
+		g_render.stats.stallUs += usSince(start);
+	}
+	if (!g_render.isRendering.load()) return -1;
+	int slot = next;
+	next = (next + 1) % g_render.numBufs;
+	++inUse;
+	return slot;
+}
+
+static void releaseSlot(int &inUse) {
+	std::lock_guard<std::mutex> lock(g_render.jobsLock);
+	--inUse;
+	g_render.slotFreed.notify_all();
 }
 
 // Utilities {{{
@@ -201,6 +284,118 @@ static uint16_t calcFrameWeight(double position) {
 
 // }}}
 
+// Blend kernels {{{
+
+// Frame weights are fixed-point with a total of BLEND_WEIGHT_ONE, so
+// the final normalize is a rounding shift rather than a divide. The
+// largest sum is then 255 << 15, and a single weight still fits the
+// unsigned 16-bit multiplies used by the SSE2 kernel.
+#define BLEND_WEIGHT_SHIFT 15
+#define BLEND_WEIGHT_ONE (1 << BLEND_WEIGHT_SHIFT)
+
+static void calcBlendWeights(std::vector<uint16_t> &weights, int toBlend, int start, int end) {
+	weights.assign(toBlend, 0);
+
+	std::vector<double> raw(toBlend, 0.0);
+	double total = 0.0;
+	for (int i = start; i < end; ++i) {
+		double framePos = end - start > 1 ? (double)(i - start) / (end - start - 1) : 0.5;
+		raw[i] = calcFrameWeight(framePos);
+		total += raw[i];
+	}
+
+	// Quantize, then hand whatever rounding left over to the heaviest
+	// frame so the weights sum to exactly BLEND_WEIGHT_ONE
+	int assigned = 0;
+	int heaviest = start;
+	for (int i = start; i < end; ++i) {
+		weights[i] = (uint16_t)(raw[i] / total * BLEND_WEIGHT_ONE);
+		assigned += weights[i];
+		if (weights[i] > weights[heaviest]) heaviest = i;
+	}
+	weights[heaviest] += BLEND_WEIGHT_ONE - assigned;
+}
+
+// sum[i] += weight * src[i]
+static void blendAccumulateScalar(uint32_t *sum, const uint8_t *src, size_t n, uint16_t weight) {
+	for (size_t i = 0; i < n; ++i) {
+		sum[i] += (uint32_t)weight * src[i];
+	}
+}
+
+SSE2_TARGET static void blendAccumulateSSE2(uint32_t *sum, const uint8_t *src, size_t n, uint16_t weight) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i w = _mm_set1_epi16((short)weight);
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m128i px = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i px16[2] = {_mm_unpacklo_epi8(px, zero), _mm_unpackhi_epi8(px, zero)};
+		for (int h = 0; h < 2; ++h) {
+			// 16x16 -> 32 bit products from the low and high halves
+			__m128i lo = _mm_mullo_epi16(px16[h], w);
+			__m128i hi = _mm_mulhi_epu16(px16[h], w);
+			__m128i *out = (__m128i *)(sum + i + h * 8);
+			_mm_storeu_si128(out, _mm_add_epi32(_mm_loadu_si128(out), _mm_unpacklo_epi16(lo, hi)));
+			_mm_storeu_si128(out + 1, _mm_add_epi32(_mm_loadu_si128(out + 1), _mm_unpackhi_epi16(lo, hi)));
+		}
+	}
+	blendAccumulateScalar(sum + i, src + i, n - i, weight);
+}
+
+AVX2_TARGET static void blendAccumulateAVX2(uint32_t *sum, const uint8_t *src, size_t n, uint16_t weight) {
+	const __m256i w = _mm256_set1_epi32(weight);
+	size_t i = 0;
+	for (; i + 32 <= n; i += 32) {
+		for (int q = 0; q < 4; ++q) {
+			__m256i px = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(src + i + q * 8)));
+			__m256i *out = (__m256i *)(sum + i + q * 8);
+			_mm256_storeu_si256(out, _mm256_add_epi32(_mm256_loadu_si256(out), _mm256_mullo_epi32(px, w)));
+		}
+	}
+	blendAccumulateScalar(sum + i, src + i, n - i, weight);
+}
+
+// dst[i] = round(sum[i] / BLEND_WEIGHT_ONE), and clears sum for the next
+// blend
+static void blendNormalizeScalar(uint8_t *dst, uint32_t *sum, size_t n) {
+	for (size_t i = 0; i < n; ++i) {
+		dst[i] = (uint8_t)((sum[i] + BLEND_WEIGHT_ONE / 2) >> BLEND_WEIGHT_SHIFT);
+		sum[i] = 0;
+	}
+}
+
+SSE2_TARGET static void blendNormalizeSSE2(uint8_t *dst, uint32_t *sum, size_t n) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i half = _mm_set1_epi32(BLEND_WEIGHT_ONE / 2);
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m128i *in = (__m128i *)(sum + i);
+		__m128i v[4];
+		for (int q = 0; q < 4; ++q) {
+			v[q] = _mm_srli_epi32(_mm_add_epi32(_mm_loadu_si128(in + q), half), BLEND_WEIGHT_SHIFT);
+			_mm_storeu_si128(in + q, zero);
+		}
+		// Every value is <= 255, so the saturating packs are exact
+		__m128i lo = _mm_packs_epi32(v[0], v[1]);
+		__m128i hi = _mm_packs_epi32(v[2], v[3]);
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+	}
+	blendNormalizeScalar(dst + i, sum + i, n - i);
+}
+
+static void (*g_blendAccumulate)(uint32_t *sum, const uint8_t *src, size_t n, uint16_t weight);
+static void (*g_blendNormalize)(uint8_t *dst, uint32_t *sum, size_t n);
+
+// Every kernel gives bit-identical results, so this only picks the
+// fastest one the CPU (and OS, for the AVX state) supports
+static void selectBlendKernels() {
+	auto &cpu = GetCpuFeatures();
+	g_blendAccumulate = cpu.avx2 ? blendAccumulateAVX2 : cpu.sse2 ? blendAccumulateSSE2 : blendAccumulateScalar;
+	g_blendNormalize = cpu.sse2 ? blendNormalizeSSE2 : blendNormalizeScalar;
+}
+
+// }}}
+
 // Movie command hooks {{{
 
 // We want to stop use of the normal movie system while a SAR render is
@@ -615,13 +810,17 @@ static void workerStartRender(AVCodecID videoCodec, AVCodecID audioCodec, int64_
 
 	g_render.channels = g_render.audioStream.enc->channels;
 
-	g_render.imageBuf = (uint8_t *)malloc(3 * g_render.width * g_render.height);
-	for (int i = 0; i < g_render.channels; ++i) {
-		g_render.audioBuf[i] = (int16_t *)malloc(g_render.audioBufSz * sizeof g_render.audioBuf[i][0]);
+	for (int n = 0; n < g_render.numBufs; ++n) {
+		g_render.imageBufs[n] = (uint8_t *)malloc(3 * g_render.width * g_render.height);
+		for (int i = 0; i < g_render.channels; ++i) {
+			g_render.audioBufs[n][i] = (int16_t *)malloc(g_render.audioBufSz * sizeof g_render.audioBufs[n][i][0]);
+		}
 	}
+	g_render.imageNext = g_render.imageInUse = 0;
+	g_render.audioNext = g_render.audioInUse = 0;
+	g_render.audioSlot = -1;
 
 	g_render.nextBlendIdx = 0;
-	g_render.totalBlendWeight = 0;
 	if (g_render.toBlend > 1) {
 		g_render.blendSumBuf = (uint32_t *)calloc(3 * g_render.width * g_render.height, sizeof g_render.blendSumBuf[0]);
 	}
@@ -631,7 +830,11 @@ static void workerStartRender(AVCodecID videoCodec, AVCodecID audioCodec, int64_
 	g_movieInfo->movieframe = 0;
 	g_movieInfo->type = 0;  // Should stop anything actually being output
 
-	g_render.isRendering.store(true);
+	{
+		std::lock_guard<std::mutex> lock(g_render.jobsLock);
+		g_render.isRendering.store(true);
+		g_render.slotFreed.notify_all();
+	}
 
 	THREAD_PRINT("Started rendering to '%s'\n", g_render.filename.c_str());
 
@@ -663,7 +866,14 @@ static void workerFinishRender(bool error) {
 		THREAD_PRINT("Stopping render...\n");
 	}
 
-	g_render.isRendering.store(false);
+	{
+		// Anything queued after the stop is dropped, and the game thread
+		// must not be left waiting for a slot that will never free up
+		std::lock_guard<std::mutex> lock(g_render.jobsLock);
+		g_render.isRendering.store(false);
+		g_render.jobs.clear();
+		g_render.slotFreed.notify_all();
+	}
 
 	flushStream(&g_render.videoStream, true);
 	flushStream(&g_render.audioStream, true);
@@ -679,9 +889,11 @@ static void workerFinishRender(bool error) {
 	closeStream(&g_render.audioStream);
 	avio_closep(&g_render.outCtx->pb);
 	avformat_free_context(g_render.outCtx);
-	free(g_render.imageBuf);
-	for (int i = 0; i < g_render.channels; ++i) {
-		free(g_render.audioBuf[i]);
+	for (int n = 0; n < g_render.numBufs; ++n) {
+		free(g_render.imageBufs[n]);
+		for (int i = 0; i < g_render.channels; ++i) {
+			free(g_render.audioBufs[n][i]);
+		}
 	}
 	if (g_render.toBlend > 1) {
 		free(g_render.blendSumBuf);
@@ -705,44 +917,53 @@ static void workerFinishRender(bool error) {
 
 // workerHandleVideoFrame {{{
 
-static bool workerHandleVideoFrame() {
-	g_render.imageBufLock.lock();
-	g_render.workerMsg.store(WorkerMsg::NONE);  // It's important that we do this *after* locking the image buffer
+// The slot is owned by the worker until it's released after this
+// returns, so there's no need to lock it
+static bool workerHandleVideoFrame(int slot) {
+	const uint8_t *imageBuf = g_render.imageBufs[slot];
 	size_t size = g_render.width * g_render.height * 3;
+	auto start = NOW_STEADY();
+	int64_t blendUs = 0, convertUs = 0, encodeUs = 0;
 	if (g_render.toBlend == 1) {
 		// We can just copy the data directly
-		memcpy(g_render.videoStream.tmpFrame->data[0], g_render.imageBuf, size);
-		g_render.imageBufLock.unlock();
+		memcpy(g_render.videoStream.tmpFrame->data[0], imageBuf, size);
 	} else {
-		if (g_render.nextBlendIdx >= g_render.toBlendStart && g_render.nextBlendIdx < g_render.toBlendEnd) {
-			double framePos = (g_render.nextBlendIdx - g_render.toBlendStart) / (g_render.toBlendEnd - g_render.toBlendStart - 1);
-			uint32_t weight = calcFrameWeight(framePos);
-			for (size_t i = 0; i < size; ++i) {
-				g_render.blendSumBuf[i] += weight * (uint32_t)g_render.imageBuf[i];
-			}
-			g_render.totalBlendWeight += weight;
+		uint16_t weight = g_render.blendWeights[g_render.nextBlendIdx];
+		if (weight) {
+			g_blendAccumulate(g_render.blendSumBuf, imageBuf, size, weight);
 		}
-		g_render.imageBufLock.unlock();
 
 		if (++g_render.nextBlendIdx != g_render.toBlend) {
 			// We've added in this frame, but not done blending yet
+			std::lock_guard<std::mutex> lock(g_render.jobsLock);
+			++g_render.stats.blended;
+			g_render.stats.blendUs += usSince(start);
 			return true;
 		}
 
-		for (size_t i = 0; i < size; ++i) {
-			g_render.videoStream.tmpFrame->data[0][i] = (uint8_t)(g_render.blendSumBuf[i] / g_render.totalBlendWeight);
-			g_render.blendSumBuf[i] = 0;
-		}
+		g_blendNormalize(g_render.videoStream.tmpFrame->data[0], g_render.blendSumBuf, size);
 
 		g_render.nextBlendIdx = 0;
-		g_render.totalBlendWeight = 0;
 	}
 
+	blendUs = usSince(start);
+
 	// tmpFrame is now our final frame; convert to the output format and
 	// process it
 
+	start = NOW_STEADY();
+
+	// The encoder may still hold a reference to the last frame we sent
+	if (av_frame_make_writable(g_render.videoStream.frame) < 0) {
+		THREAD_PRINT("Failed to make video frame writable!\n");
+		return false;
+	}
+
 	sws_scale(g_render.videoStream.swsCtx, (const uint8_t *const *)g_render.videoStream.tmpFrame->data, g_render.videoStream.tmpFrame->linesize, 0, g_render.height, g_render.videoStream.frame->data, g_render.videoStream.frame->linesize);
 
+	convertUs = usSince(start);
+	start = NOW_STEADY();
+
 	g_render.videoStream.frame->pts = g_render.videoStream.nextPts;
 
 	if (avcodec_send_frame(g_render.videoStream.enc, g_render.videoStream.frame) < 0) {
@@ -757,6 +978,15 @@ static bool workerHandleVideoFrame() {
 
 	++g_render.videoStream.nextPts;
 
+	encodeUs = usSince(start);
+
+	std::lock_guard<std::mutex> lock(g_render.jobsLock);
+	++g_render.stats.blended;
+	++g_render.stats.encoded;
+	g_render.stats.blendUs += blendUs;
+	g_render.stats.convertUs += convertUs;
+	g_render.stats.encodeUs += encodeUs;
+
 	return true;
 }
 
@@ -764,16 +994,11 @@ static bool workerHandleVideoFrame() {
 
 // workerHandleAudioFrame {{{
 
-static bool workerHandleAudioFrame() {
-	g_render.audioBufLock.lock();
-	g_render.workerMsg.store(WorkerMsg::NONE);  // It's important that we do this *after* locking the audio buffer
-
+static bool workerHandleAudioFrame(int slot) {
 	Stream *s = &g_render.audioStream;
 	for (int i = 0; i < g_render.channels; ++i) {
-		memcpy(s->tmpFrame->data[i], g_render.audioBuf[i], g_render.audioBufSz * sizeof g_render.audioBuf[i][0]);
+		memcpy(s->tmpFrame->data[i], g_render.audioBufs[slot][i], g_render.audioBufSz * sizeof g_render.audioBufs[slot][i][0]);
 	}
-	g_render.audioBufLock.unlock();
-
 
 	s->tmpFrame->pts = s->nextPts;
 	s->nextPts += s->frame->nb_samples;
@@ -800,6 +1025,9 @@ static bool workerHandleAudioFrame() {
 		return false;
 	}
 
+	std::lock_guard<std::mutex> lock(g_render.jobsLock);
+	++g_render.stats.audioFrames;
+
 	return true;
 }
 
@@ -808,25 +1036,38 @@ static bool workerHandleAudioFrame() {
 static void worker(AVCodecID videoCodec, AVCodecID audioCodec, int64_t videoBitrate, int64_t audioBitrate, AVDictionary *options) {
 	workerStartRender(videoCodec, audioCodec, videoBitrate, audioBitrate, options);
 	if (!g_render.isRendering.load()) {
+		std::lock_guard<std::mutex> lock(g_render.jobsLock);
 		g_render.workerFailedToStart.store(true);
+		g_render.slotFreed.notify_all();
 		return;
 	}
-	std::unique_lock<std::mutex> lock(g_render.workerUpdateLock);
 	while (true) {
-		g_render.workerUpdate.wait(lock);
-		switch (g_render.workerMsg.load()) {
-		case WorkerMsg::VIDEO_FRAME_READY:
-			if (!workerHandleVideoFrame()) {
+		WorkerJob job;
+		{
+			std::unique_lock<std::mutex> lock(g_render.jobsLock);
+			g_render.jobsReady.wait(lock, []() { return !g_render.jobs.empty(); });
+			job = g_render.jobs.front();
+			g_render.jobs.pop_front();
+		}
+		switch (job.msg) {
+		case WorkerMsg::VIDEO_FRAME_READY: {
+			bool ok = workerHandleVideoFrame(job.slot);
+			releaseSlot(g_render.imageInUse);
+			if (!ok) {
 				workerFinishRender(true);
 				return;
 			}
 			break;
-		case WorkerMsg::AUDIO_FRAME_READY:
-			if (!workerHandleAudioFrame()) {
+		}
+		case WorkerMsg::AUDIO_FRAME_READY: {
+			bool ok = workerHandleAudioFrame(job.slot);
+			releaseSlot(g_render.audioInUse);
+			if (!ok) {
 				workerFinishRender(true);
 				return;
 			}
 			break;
+		}
 		case WorkerMsg::STOP_RENDERING_ERROR:
 			workerFinishRender(true);
 			return;
@@ -894,6 +1135,10 @@ static void startRender() {
 		g_render.toBlendEnd = g_render.toBlend - toExclude;
 	}
 
+	if (g_render.toBlend > 1) {
+		calcBlendWeights(g_render.blendWeights, g_render.toBlend, g_render.toBlendStart, g_render.toBlendEnd);
+	}
+
 	if (snd_surround_speakers.GetInt() != 2) {
 		console->Print("Note: setting speaker configuration to stereo. You may wish to reset it after the render\n");
 		snd_surround_speakers.SetValue(2);
@@ -943,15 +1188,24 @@ static void startRender() {
 	g_render.width = GetScreenWidth();
 	g_render.height = GetScreenHeight();
 
+	g_render.numBufs = sar_render_buffers.GetInt();
+	if (g_render.numBufs < 1) g_render.numBufs = 1;
+	if (g_render.numBufs > MAX_RENDER_BUFFERS) g_render.numBufs = MAX_RENDER_BUFFERS;
+
 	g_render.workerFailedToStart.store(false);
+	g_render.jobs.clear();
+	g_render.stats = {};
 
-	g_render.workerMsg.store(WorkerMsg::NONE);
 	g_render.worker = std::thread(worker, videoCodec, audioCodec, videoBitrate * 1000, audioBitrate * 1000, options);
 
-	// Busy-wait until the rendering has started so that we don't miss
-	// any frames
-	while (!g_render.isRendering.load() && !g_render.workerFailedToStart.load())
-		;
+	// Wait until the rendering has started so that we don't miss any
+	// frames
+	{
+		std::unique_lock<std::mutex> lock(g_render.jobsLock);
+		g_render.slotFreed.wait(lock, []() {
+			return g_render.isRendering.load() || g_render.workerFailedToStart.load();
+		});
+	}
 
 	Event::Trigger<Event::RENDERER_START>({});
 }
@@ -982,52 +1236,48 @@ static void SND_RecordBuffer_Hook() {
 
 	if (engine->ConsoleVisible()) return;
 
-	// If the worker has received a message it hasn't yet handled,
-	// busy-wait; this is a really obscure race condition that should
-	// never happen
-	while (g_render.isRendering.load() && g_render.workerMsg.load() != WorkerMsg::NONE)
-		;
-
 	if (snd_surround_speakers.GetInt() != 2) {
 		console->Print("Speaker configuration changed!\n");
 		msgStopRender(true);
 		return;
 	}
 
-	g_render.audioBufLock.lock();
-
-	for (int i = 0; i < *g_snd_linear_count; i += g_render.channels) {
-		for (int c = 0; c < g_render.channels; ++c) {
-			g_render.audioBuf[c][g_render.audioBufIdx] = clip16(((*g_snd_p)[i + c] * *g_snd_vol) >> 8);
+	int i = 0;
+	while (i < *g_snd_linear_count) {
+		if (g_render.audioSlot == -1) {
+			// Don't hold the buffer lock while waiting, since the worker
+			// needs it to tear down if the render stops
+			int slot = acquireSlot(g_render.audioNext, g_render.audioInUse);
+			if (slot == -1) return;
+			g_render.audioSlot = slot;
+			g_render.audioBufIdx = 0;
 		}
 
-		++g_render.audioBufIdx;
-		if (g_render.audioBufIdx == g_render.audioBufSz) {
-			g_render.audioBufLock.unlock();
-
-			g_render.workerUpdateLock.lock();
-			g_render.workerMsg.store(WorkerMsg::AUDIO_FRAME_READY);
-			g_render.workerUpdate.notify_all();
-			g_render.workerUpdateLock.unlock();
+		g_render.audioBufLock.lock();
 
-			// Busy-wait until the worker locks the audio buffer; not
-			// ideal, but shouldn't take long
-			while (g_render.isRendering.load() && g_render.workerMsg.load() != WorkerMsg::NONE)
-				;
+		// The buffers may have been freed while we weren't holding the
+		// lock
+		if (!g_render.isRendering.load()) {
+			g_render.audioBufLock.unlock();
+			return;
+		}
 
-			if (!g_render.isRendering.load()) {
-				// We shouldn't write to that buffer anymore, it's been
-				// invalidated
-				// We've already unlocked audioBufLock so just return
-				return;
+		int16_t **audioBuf = g_render.audioBufs[g_render.audioSlot];
+		while (i < *g_snd_linear_count) {
+			for (int c = 0; c < g_render.channels; ++c) {
+				audioBuf[c][g_render.audioBufIdx] = clip16(((*g_snd_p)[i + c] * *g_snd_vol) >> 8);
 			}
+			i += g_render.channels;
 
-			g_render.audioBufLock.lock();
-			g_render.audioBufIdx = 0;
+			if (++g_render.audioBufIdx == g_render.audioBufSz) {
+				queueJob(WorkerMsg::AUDIO_FRAME_READY, g_render.audioSlot);
+				g_render.audioSlot = -1;
+				break;
+			}
 		}
-	}
 
-	g_render.audioBufLock.unlock();
+		g_render.audioBufLock.unlock();
+	}
 
 	return;
 }
@@ -1086,12 +1336,6 @@ void Renderer::Frame() {
 	// Don't render if the console is visible
 	if (engine->ConsoleVisible()) return;
 
-	// If the worker has received a message it hasn't yet handled,
-	// busy-wait; this is a really obscure race condition that should
-	// never happen
-	while (g_render.isRendering.load() && g_render.workerMsg.load() != WorkerMsg::NONE)
-		;
-
 	if (GetScreenWidth() != g_render.width) {
 		console->Print("Screen resolution has changed!\n");
 		msgStopRender(true);
@@ -1104,11 +1348,9 @@ void Renderer::Frame() {
 		return;
 	}
 
-	if (av_frame_make_writable(g_render.videoStream.frame) < 0) {
-		console->Print("Failed to make video frame writable!\n");
-		msgStopRender(true);
-		return;
-	}
+	// Blocks only if the worker has fallen a whole ring behind
+	int slot = acquireSlot(g_render.imageNext, g_render.imageInUse);
+	if (slot == -1) return;
 
 	g_render.imageBufLock.lock();
 
@@ -1119,17 +1361,15 @@ void Renderer::Frame() {
 		return;
 	}
 
-	ReadScreenPixels(0, 0, g_render.width, g_render.height, g_render.imageBuf, IMAGE_FORMAT_BGR888);
+	auto start = NOW_STEADY();
+	ReadScreenPixels(0, 0, g_render.width, g_render.height, g_render.imageBufs[slot], IMAGE_FORMAT_BGR888);
+	g_render.stats.captureUs += usSince(start);
+	++g_render.stats.captured;
 
 	g_render.imageBufLock.unlock();
 
-	// Signal to the worker thread that there is image data for it to
-	// process
-	{
-		std::lock_guard<std::mutex> lock(g_render.workerUpdateLock);
-		g_render.workerMsg.store(WorkerMsg::VIDEO_FRAME_READY);
-		g_render.workerUpdate.notify_all();
-	}
+	// Hand the slot to the worker thread
+	queueJob(WorkerMsg::VIDEO_FRAME_READY, slot);
 }
 
 // }}}
@@ -1145,6 +1385,8 @@ ON_EVENT(DEMO_STOP) {
 void Renderer::Init(void **videomode) {
 	g_videomode = videomode;
 
+	selectBlendKernels();
+
 	snd_surround_speakers = Variable("snd_surround_speakers");
 
 	SND_RecordBuffer = (void (*)())Memory::Scan(engine->Name(), Offsets::SND_RecordBuffer);
@@ -1205,4 +1447,105 @@ CON_COMMAND(sar_render_finish, "sar_render_finish - stop rendering frames\n") {
 	msgStopRender(false);
 }
 
+CON_COMMAND(sar_render_stats, "sar_render_stats - print capture queue and encoding timings for the current or last render\n") {
+	if (args.ArgC() != 1) {
+		console->Print(sar_render_stats.ThisPtr()->m_pszHelpString);
+		return;
+	}
+
+	RenderStats stats;
+	int depth, buffers;
+	{
+		std::lock_guard<std::mutex> lock(g_render.jobsLock);
+		stats = g_render.stats;
+		depth = g_render.jobs.size();
+		buffers = g_render.numBufs;
+	}
+
+	auto avg = [](int64_t us, int n) { return n ? us / 1000.0 / n : 0.0; };
+
+	console->Print("Render %s\n", g_render.isRendering.load() ? "running" : "not running");
+	console->Print("    buffers: %d (queued: %d, max queued: %d)\n", buffers, depth, stats.maxDepth);
+	console->Print("    frames: %d captured, %d blended, %d encoded, %d audio\n", stats.captured, stats.blended, stats.encoded, stats.audioFrames);
+	console->Print("    stalls: %d (%.2f ms total)\n", stats.stalls, stats.stallUs / 1000.0);
+	console->Print("    capture: %.3f ms/frame\n", avg(stats.captureUs, stats.captured));
+	console->Print("    blend: %.3f ms/frame\n", avg(stats.blendUs, stats.blended));
+	console->Print("    convert: %.3f ms/frame\n", avg(stats.convertUs, stats.encoded));
+	console->Print("    encode: %.3f ms/frame\n", avg(stats.encodeUs, stats.encoded));
+}
+
+CON_COMMAND(sar_render_blend_selftest, "sar_render_blend_selftest [frames] [width] [height] - blends synthetic frames through every blend kernel, checks they match the scalar one and reports their timings\n") {
+	if (args.ArgC() > 4) {
+		console->Print(sar_render_blend_selftest.ThisPtr()->m_pszHelpString);
+		return;
+	}
+
+	int toBlend = args.ArgC() > 1 ? atoi(args[1]) : 8;
+	int width = args.ArgC() > 2 ? atoi(args[2]) : 1920;
+	int height = args.ArgC() > 3 ? atoi(args[3]) : 1080;
+	if (toBlend < 1 || width < 1 || height < 1) {
+		console->Print(sar_render_blend_selftest.ThisPtr()->m_pszHelpString);
+		return;
+	}
+
+	struct Kernels {
+		const char *name;
+		void (*accumulate)(uint32_t *sum, const uint8_t *src, size_t n, uint16_t weight);
+		void (*normalize)(uint8_t *dst, uint32_t *sum, size_t n);
+	};
+	std::vector<Kernels> kernels = {{"scalar", blendAccumulateScalar, blendNormalizeScalar}};
+	auto &cpu = GetCpuFeatures();
+	if (cpu.sse2) kernels.push_back({"sse2", blendAccumulateSSE2, blendNormalizeSSE2});
+	if (cpu.avx2 && cpu.sse2) kernels.push_back({"avx2", blendAccumulateAVX2, blendNormalizeSSE2});
+
+	std::vector<uint16_t> weights;
+	calcBlendWeights(weights, toBlend, 0, toBlend);
+
+	// The real frame size, then an odd one so every kernel's scalar tail
+	// runs too. White frames give the largest possible sums.
+	size_t sizes[] = {(size_t)width * height * 3, (size_t)width * 3 + 7};
+	bool ok = true;
+	for (size_t size : sizes) {
+		std::vector<uint8_t> frames(size * toBlend);
+		uint32_t seed = 1;
+		for (auto &px : frames) {
+			seed = seed * 1664525 + 1013904223;
+			px = seed >> 24;
+		}
+
+		for (int white = 0; white < 2; ++white) {
+			if (white) std::fill(frames.begin(), frames.end(), 255);
+
+			std::vector<uint8_t> expect;
+			for (auto &k : kernels) {
+				std::vector<uint32_t> sum(size, 0);
+				std::vector<uint8_t> out(size);
+				int64_t accumulateUs = 0, normalizeUs = 0;
+
+				auto start = NOW_STEADY();
+				for (int i = 0; i < toBlend; ++i) {
+					if (weights[i]) k.accumulate(sum.data(), frames.data() + i * size, size, weights[i]);
+				}
+				accumulateUs = usSince(start);
+				start = NOW_STEADY();
+				k.normalize(out.data(), sum.data(), size);
+				normalizeUs = usSince(start);
+
+				bool cleared = std::all_of(sum.begin(), sum.end(), [](uint32_t v) { return v == 0; });
+				if (expect.empty()) expect = out;
+				bool match = out == expect && cleared && (!white || std::all_of(out.begin(), out.end(), [](uint8_t v) { return v == 255; }));
+				ok &= match;
+
+				if (size == sizes[0] && !white) {
+					console->Print("%s: accumulate %.3f ms/frame, normalize %.3f ms%s\n", k.name, accumulateUs / 1000.0 / toBlend, normalizeUs / 1000.0, match ? "" : " (MISMATCH)");
+				} else if (!match) {
+					console->Print("%s: mismatch on %s %u byte frames\n", k.name, white ? "white" : "random", (unsigned)size);
+				}
+			}
+		}
+	}
+
+	console->Print("%s\n", ok ? "Blend kernel self test passed" : "Blend kernel self test FAILED");
+}
+
 // }}}
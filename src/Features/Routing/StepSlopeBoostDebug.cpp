@@ -76,8 +76,7 @@ void drawBox(Vector position, Vector velocity, bool ducked, Color color) {
 	);
 }
 
-ON_EVENT(RENDER) {
-	if (!sar_debug_step_slope_boost.GetBool()) return;
+ON_EVENT_IF(RENDER, sar_debug_step_slope_boost) {
 	if (!sv_cheats.GetBool()) return;
 
 	if (!g_stepMoved) return;
@@ -11,12 +11,16 @@
 #include "Utils.hpp"
 
 #include <cctype>
+#include <chrono>
 #include <cstdlib>
 #include <memory>
 #include <optional>
+#include <type_traits>
+#include <unordered_map>
 #include <variant>
 
 Variable sar_speedrun_draw_triggers("sar_speedrun_draw_triggers", "0", "Draw the triggers associated with speedrun rules in the world.\n");
+Variable sar_speedrun_record_inputs("sar_speedrun_record_inputs", "0", "Record every entity input tested against speedrun rules, for sar_speedrun_rules_bench.\n");
 Variable sar_speedrun_triggers_info("sar_speedrun_triggers_info", "0", "Print player velocity (and position) upon mtrigger activation.\n1 - position and velocity\n2 - only horizontal velocity\n");
 
 static std::optional<std::vector<std::string>> extractPartialArgs(const char *str, const char *cmd) {
@@ -68,8 +72,104 @@ static std::string g_currentCategory = "Singleplayer";
 static std::map<std::string, SpeedrunCategory> g_categories;
 static std::map<std::string, SpeedrunRule> g_rules;
 
+static void invalidateRuleIndex();
+
 void SpeedrunTimer::InitCategories() {
 	InitSpeedrunCategoriesTo(&g_categories, &g_rules, &g_currentCategory);
+	invalidateRuleIndex();
+}
+
+// }}}
+
+// Rule index {{{
+
+// The rules of the current category which apply to the current map,
+// bucketed by type so that testing rules doesn't walk and look up every
+// rule in the category. Entity input rules are further keyed by
+// targetname and input, so an unrelated input is a single hash miss.
+// Rebuilt lazily after a map load or any change to the category.
+
+struct IndexedRule {
+	size_t order;  // Position in the category
+	const std::string *name;
+	SpeedrunRule *rule;
+};
+
+static struct {
+	bool valid;
+	std::vector<IndexedRule> byType[std::variant_size_v<SpeedrunRule::_RuleTypes>];
+	std::unordered_map<std::string, std::vector<IndexedRule>> inputs;     // Keyed by targetname and input
+	std::unordered_map<std::string, std::vector<IndexedRule>> anyTarget;  // Keyed by input only
+} g_ruleIndex;
+
+template <typename RuleType, size_t I = 0>
+static constexpr size_t ruleTypeIndex() {
+	if constexpr (std::is_same_v<RuleType, std::variant_alternative_t<I, SpeedrunRule::_RuleTypes>>) {
+		return I;
+	} else {
+		return ruleTypeIndex<RuleType, I + 1>();
+	}
+}
+
+// Reuses the same buffer, so lookups don't allocate
+static const std::string &inputKey(const char *targetname, const char *inputname) {
+	static std::string key;
+	key.assign(targetname);
+	key.push_back('\0');
+	key.append(inputname);
+	return key;
+}
+
+static const std::vector<IndexedRule> *lookupInputs(std::unordered_map<std::string, std::vector<IndexedRule>> &m, const char *targetname, const char *inputname) {
+	if (m.empty()) return nullptr;
+	auto search = m.find(inputKey(targetname, inputname));
+	if (search == m.end()) return nullptr;
+	return &search->second;
+}
+
+static void invalidateRuleIndex() {
+	g_ruleIndex.valid = false;
+}
+
+static void buildRuleIndex() {
+	for (auto &rules : g_ruleIndex.byType) rules.clear();
+	g_ruleIndex.inputs.clear();
+	g_ruleIndex.anyTarget.clear();
+
+	std::string map = engine->GetCurrentMapName();
+	auto &names = g_categories[g_currentCategory].rules;
+
+	for (size_t i = 0; i < names.size(); ++i) {
+		auto search = g_rules.find(names[i]);
+		if (search == g_rules.end()) continue;
+
+		SpeedrunRule *rule = &search->second;
+		if (!rule->AppliesToMap(map)) continue;
+
+		IndexedRule entry{i, &search->first, rule};
+
+		if (auto ent = std::get_if<EntityInputRule>(&rule->rule)) {
+			if (ent->typeMask & ENTRULE_TARGETNAME) {
+				g_ruleIndex.inputs[inputKey(ent->targetname.c_str(), ent->inputname.c_str())].push_back(entry);
+			} else {
+				g_ruleIndex.anyTarget[inputKey("", ent->inputname.c_str())].push_back(entry);
+			}
+		} else {
+			g_ruleIndex.byType[rule->rule.index()].push_back(entry);
+		}
+	}
+
+	g_ruleIndex.valid = true;
+}
+
+// Map loads and unloads both invalidate, so inputs fired while the next
+// map is loading don't test against the previous map's rules
+ON_EVENT_P(SESSION_START, 1000) {
+	invalidateRuleIndex();
+}
+
+ON_EVENT_P(SESSION_END, 1000) {
+	invalidateRuleIndex();
 }
 
 // }}}
@@ -169,31 +269,79 @@ static void dispatchRuleCycled(std::string name, SpeedrunRule *rule) {
 	g_scheduledRules.push_back({rule, name, tick});
 }
 
+template <typename RuleType, typename... Ts>
+static bool RuleMatches(SpeedrunRule *rule, std::optional<int> slot, Ts... args) {
+	if (!SpeedrunTimer::IsRunning() && rule->action != RuleAction::START && rule->action != RuleAction::FORCE_START) return false;
+	if (!rule->TestGeneral(slot)) return false;
+	return std::get<RuleType>(rule->rule).Test(args...);
+}
+
+template <typename RuleType, typename... Ts>
+static bool TestIndexedRule(const IndexedRule &entry, std::optional<int> slot, Ts... args) {
+	SpeedrunRule *rule = entry.rule;
+	if (!RuleMatches<RuleType>(rule, slot, args...)) return false;
+
+	dispatchRuleCycled(*entry.name, rule);
+
+	rule->fired = true;
+	return true;
+}
+
 template <typename RuleType, typename... Ts>
 static bool GeneralTestRules(std::optional<int> slot, Ts... args) {
 	if (engine->IsOrange()) return false;
-	for (std::string ruleName : g_categories[g_currentCategory].rules) {
-		auto rule = SpeedrunTimer::GetRule(ruleName);
-		if (!rule) continue;
-		if (!std::holds_alternative<RuleType>(rule->rule)) continue;
-		if (!SpeedrunTimer::IsRunning() && rule->action != RuleAction::START && rule->action != RuleAction::FORCE_START) continue;
-		if (!rule->TestGeneral(slot)) continue;
-		if (!std::get<RuleType>(rule->rule).Test(args...)) continue;
+	if (!g_ruleIndex.valid) buildRuleIndex();
+	for (auto &entry : g_ruleIndex.byType[ruleTypeIndex<RuleType>()]) {
+		// We don't want to dispatch any more rules in this tick lest shit get fucked
+		if (TestIndexedRule<RuleType>(entry, slot, args...)) return true;
+	}
+	return false;
+}
+
+// The first input rule in the category the input satisfies, if any
+static const IndexedRule *findInputRule(const char *targetname, const char *classname, const char *inputname, const char *parameter, std::optional<int> triggerSlot) {
+	if (!g_ruleIndex.valid) buildRuleIndex();
 
-		dispatchRuleCycled(ruleName, rule);
+	auto named = lookupInputs(g_ruleIndex.inputs, targetname, inputname);
+	auto any = lookupInputs(g_ruleIndex.anyTarget, "", inputname);
+	size_t nnamed = named ? named->size() : 0;
+	size_t nany = any ? any->size() : 0;
 
-		rule->fired = true;
-		return true;  // We don't want to dispatch any more rules in this tick lest shit get fucked
+	// Walk both buckets in category order, so the first matching rule
+	// wins just like it would scanning the whole category
+	size_t i = 0, j = 0;
+	while (i < nnamed || j < nany) {
+		bool takeNamed = j == nany || (i < nnamed && (*named)[i].order < (*any)[j].order);
+		const IndexedRule &entry = takeNamed ? (*named)[i++] : (*any)[j++];
+		if (RuleMatches<EntityInputRule>(entry.rule, triggerSlot, targetname, classname, inputname, parameter)) return &entry;
 	}
-	return false;
+
+	return nullptr;
 }
 
-bool SpeedrunTimer::TestInputRules(std::string targetname, std::string classname, std::string inputname, std::string parameter, std::optional<int> triggerSlot) {
-	bool result = GeneralTestRules<EntityInputRule>(triggerSlot, targetname, classname, inputname, parameter);
-	if (result)
-		demoGhostPlayer.TestInputRule(targetname.c_str(), classname.c_str(), inputname.c_str(), parameter.c_str(), triggerSlot);
+struct RecordedInput {
+	std::string targetname, classname, inputname, parameter;
+	std::optional<int> slot;
+};
 
-	return result;
+#define MAX_RECORDED_INPUTS 1000000
+
+static std::vector<RecordedInput> g_recordedInputs;
+
+bool SpeedrunTimer::TestInputRules(const char *targetname, const char *classname, const char *inputname, const char *parameter, std::optional<int> triggerSlot) {
+	if (engine->IsOrange()) return false;
+
+	if (sar_speedrun_record_inputs.GetBool() && g_recordedInputs.size() < MAX_RECORDED_INPUTS) {
+		g_recordedInputs.push_back({targetname, classname, inputname, parameter, triggerSlot});
+	}
+
+	auto entry = findInputRule(targetname, classname, inputname, parameter, triggerSlot);
+	if (!entry) return false;
+
+	dispatchRuleCycled(*entry->name, entry->rule);
+	entry->rule->fired = true;
+	demoGhostPlayer.TestInputRule(targetname, classname, inputname, parameter, triggerSlot);
+	return true;
 }
 
 void SpeedrunTimer::TestZoneRules(Vector pos, int slot) {
@@ -271,8 +419,7 @@ void SpeedrunTimer::ResetCategory() {
 	g_scheduledRules.clear();
 }
 
-ON_EVENT(RENDER) {
-	if (!sar_speedrun_draw_triggers.GetBool()) return;
+ON_EVENT_IF(RENDER, sar_speedrun_draw_triggers) {
 	if (!sv_cheats.GetBool()) return;
 
 	for (std::string ruleName : g_categories[g_currentCategory].rules) {
@@ -362,6 +509,7 @@ CON_COMMAND_F_COMPLETION(sar_speedrun_category, "sar_speedrun_category [category
 			bool same = g_currentCategory == args[1];
 			if (!same) {
 				g_currentCategory = args[1];
+				invalidateRuleIndex();
 				SpeedrunTimer::CategoryChanged();
 				g_scheduledRules.clear();
 			}
@@ -479,6 +627,7 @@ bool SpeedrunTimer::AddRuleToCategory(std::string category, std::string rule) {
 	}
 
 	cat->rules.push_back(rule);
+	invalidateRuleIndex();
 	return true;
 }
 
@@ -510,6 +659,7 @@ CON_COMMAND_F_COMPLETION(sar_speedrun_category_remove_rule, "sar_speedrun_catego
 	}
 
 	cat->rules.erase(it);
+	invalidateRuleIndex();
 }
 
 // }}}
@@ -680,3 +830,108 @@ CON_COMMAND(sar_speedrun_reset_categories, "sar_speedrun_reset_categories - dele
 	SpeedrunTimer::CategoryChanged();
 	g_scheduledRules.clear();
 }
+
+// Rule index benchmark {{{
+
+// How inputs were matched before the index: every rule in the category,
+// looked up by name and checked for the current map
+static SpeedrunRule *findInputRuleLinear(const char *targetname, const char *classname, const char *inputname, const char *parameter, std::optional<int> triggerSlot) {
+	std::string map = engine->GetCurrentMapName();
+	for (std::string ruleName : g_categories[g_currentCategory].rules) {
+		auto rule = SpeedrunTimer::GetRule(ruleName);
+		if (!rule) continue;
+		if (!std::holds_alternative<EntityInputRule>(rule->rule)) continue;
+		if (!rule->AppliesToMap(map)) continue;
+		if (RuleMatches<EntityInputRule>(rule, triggerSlot, targetname, classname, inputname, parameter)) return rule;
+	}
+	return nullptr;
+}
+
+// Without a recording, inputs that hit, nearly hit and miss every input
+// rule of the category on this map
+static std::vector<RecordedInput> syntheticInputs() {
+	std::vector<RecordedInput> inputs;
+	std::string map = engine->GetCurrentMapName();
+	for (auto &name : g_categories[g_currentCategory].rules) {
+		auto rule = SpeedrunTimer::GetRule(name);
+		if (!rule || !rule->AppliesToMap(map)) continue;
+		auto ent = std::get_if<EntityInputRule>(&rule->rule);
+		if (!ent) continue;
+
+		RecordedInput in{ent->targetname, ent->classname, ent->inputname, ent->parameter, rule->slot};
+		inputs.push_back(in);
+		inputs.push_back({in.targetname + "_other", in.classname, in.inputname, in.parameter, in.slot});
+		inputs.push_back({in.targetname, in.classname, in.inputname, in.parameter + "_other", in.slot});
+		inputs.push_back({in.targetname, in.classname, "FireUser4", in.parameter, in.slot});
+	}
+
+	static const char *unrelated[] = {"Enable", "Disable", "Trigger", "Open", "Close", "SetAnimation", "FireUser1", "Kill"};
+	for (int i = 0; i < 64; ++i) {
+		inputs.push_back({Utils::ssprintf("ent_%d", i), "logic_relay", unrelated[i % 8], "", std::nullopt});
+	}
+	return inputs;
+}
+
+CON_COMMAND(sar_speedrun_rules_bench, "sar_speedrun_rules_bench [repeats] - replays the entity inputs recorded with sar_speedrun_record_inputs, or synthetic ones if there are none, through the rule index and the old linear walk, checking they pick the same rules\n") {
+	if (args.ArgC() > 2) {
+		return console->Print(sar_speedrun_rules_bench.ThisPtr()->m_pszHelpString);
+	}
+
+	int repeats = args.ArgC() == 2 ? std::atoi(args[1]) : 100;
+	if (repeats <= 0) {
+		return console->Print(sar_speedrun_rules_bench.ThisPtr()->m_pszHelpString);
+	}
+
+	bool recorded = !g_recordedInputs.empty();
+	auto inputs = recorded ? g_recordedInputs : syntheticInputs();
+
+	// Nothing is dispatched, so rule state stays the same throughout and
+	// both walks see the same rules as eligible
+	std::vector<SpeedrunRule *> indexed, linear;
+	for (auto &in : inputs) {
+		auto entry = findInputRule(in.targetname.c_str(), in.classname.c_str(), in.inputname.c_str(), in.parameter.c_str(), in.slot);
+		indexed.push_back(entry ? entry->rule : nullptr);
+		linear.push_back(findInputRuleLinear(in.targetname.c_str(), in.classname.c_str(), in.inputname.c_str(), in.parameter.c_str(), in.slot));
+	}
+
+	int mismatches = 0, matched = 0;
+	for (size_t i = 0; i < inputs.size(); ++i) {
+		if (indexed[i]) ++matched;
+		if (indexed[i] != linear[i]) {
+			if (mismatches < 10) console->Print("Input %s.%s(%s) picked different rules\n", inputs[i].targetname.c_str(), inputs[i].inputname.c_str(), inputs[i].parameter.c_str());
+			++mismatches;
+		}
+	}
+
+	auto time = [&](auto find) {
+		size_t hits = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (int r = 0; r < repeats; ++r) {
+			for (auto &in : inputs) {
+				hits += find(in) != nullptr;
+			}
+		}
+		float us = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count();
+		return std::make_pair(us, hits);
+	};
+	auto fast = time([](const RecordedInput &in) {
+		return findInputRule(in.targetname.c_str(), in.classname.c_str(), in.inputname.c_str(), in.parameter.c_str(), in.slot);
+	});
+	auto slow = time([](const RecordedInput &in) {
+		return findInputRuleLinear(in.targetname.c_str(), in.classname.c_str(), in.inputname.c_str(), in.parameter.c_str(), in.slot);
+	});
+	if (fast.second != slow.second) ++mismatches;
+
+	size_t total = inputs.size() * repeats;
+	console->Print("%d %s inputs against %d rules in %s: %d match a rule, %d mismatches\n", (int)inputs.size(), recorded ? "recorded" : "synthetic", (int)g_categories[g_currentCategory].rules.size(), g_currentCategory.c_str(), matched, mismatches);
+	console->Print("Rule index: %.1f ns/input\n", total ? fast.first * 1000 / total : 0.0f);
+	console->Print("Linear walk: %.1f ns/input\n", total ? slow.first * 1000 / total : 0.0f);
+	console->Print("%s\n", mismatches ? "Rule index check FAILED" : "Rule index check passed");
+}
+
+CON_COMMAND(sar_speedrun_record_inputs_clear, "sar_speedrun_record_inputs_clear - discards the entity inputs recorded with sar_speedrun_record_inputs\n") {
+	g_recordedInputs.clear();
+	g_recordedInputs.shrink_to_fit();
+}
+
+// }}}
@@ -12,7 +12,7 @@ struct SpeedrunCategory {
 };
 
 namespace SpeedrunTimer {
-	bool TestInputRules(std::string targetname, std::string classname, std::string inputname, std::string parameter, std::optional<int> triggerSlot);
+	bool TestInputRules(const char *targetname, const char *classname, const char *inputname, const char *parameter, std::optional<int> triggerSlot);
 	void TestZoneRules(Vector pos, int slot);
 	void TestJumpRules(Vector pos, int slot);
 	bool TestPortalRules(Vector pos, int slot, PortalColor portal);
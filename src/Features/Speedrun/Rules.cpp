@@ -1,6 +1,7 @@
 #include "Rules.hpp"
 
 #include "Categories.hpp"
+#include "Event.hpp"
 #include "Features/EntityList.hpp"
 #include "Features/OverlayRender.hpp"
 #include "Features/Session.hpp"
@@ -22,11 +23,11 @@ static inline V *lookupMap(std::map<std::string, V> &m, std::string k) {
 }
 
 
-bool EntityInputRule::Test(std::string targetname, std::string classname, std::string inputname, std::string parameter) {
-	if ((this->typeMask & ENTRULE_TARGETNAME) && targetname != this->targetname) return false;
-	if ((this->typeMask & ENTRULE_CLASSNAME) && classname != this->classname) return false;
-	if (inputname != this->inputname) return false;
-	if ((this->typeMask & ENTRULE_PARAMETER) && parameter != this->parameter) return false;
+bool EntityInputRule::Test(const char *targetname, const char *classname, const char *inputname, const char *parameter) {
+	if ((this->typeMask & ENTRULE_TARGETNAME) && this->targetname != targetname) return false;
+	if ((this->typeMask & ENTRULE_CLASSNAME) && this->classname != classname) return false;
+	if (this->inputname != inputname) return false;
+	if ((this->typeMask & ENTRULE_PARAMETER) && this->parameter != parameter) return false;
 	return true;
 }
 
@@ -85,19 +86,66 @@ static bool pointInBox(Vector point, Vector center, Vector size, double rotation
 	return inX && inY && inZ;
 }
 
+// Trigger boxes {{{
+
+// Trigger boxes only change when their rule does, so they're kept in
+// retained meshes keyed by their geometry. A box that wasn't drawn since
+// the last frame - its rule was edited or removed, or drawing turned off -
+// is freed again.
+struct TriggerMesh {
+	Vector center;
+	Vector size;
+	double rotation;
+	Color col;
+	MeshId solid, wireframe;
+	bool drawn;
+};
+
+static std::vector<TriggerMesh> g_triggerMeshes;
+
+static void drawTriggerBox(Vector center, Vector size, double rotation, Color col) {
+	for (auto &m : g_triggerMeshes) {
+		if (m.center == center && m.size == size && m.rotation == rotation && m.col == col) {
+			OverlayRender::drawRetainedMesh(m.solid);
+			OverlayRender::drawRetainedMesh(m.wireframe);
+			m.drawn = true;
+			return;
+		}
+	}
+
+	TriggerMesh m{center, size, rotation, col};
+	m.solid = OverlayRender::createRetainedMesh(RenderCallback::constant({col.r, col.g, col.b, 100}), RenderCallback::none);
+	m.wireframe = OverlayRender::createRetainedMesh(RenderCallback::none, RenderCallback::constant({col.r, col.g, col.b, 255}));
+	OverlayRender::addBox(m.solid, m.wireframe, center, -size / 2, size / 2, {0, (float)(rotation * 360.0f / TAU), 0});
+	OverlayRender::drawRetainedMesh(m.solid);
+	OverlayRender::drawRetainedMesh(m.wireframe);
+	m.drawn = true;
+	g_triggerMeshes.push_back(m);
+}
+
+ON_EVENT(FRAME) {
+	for (size_t i = 0; i < g_triggerMeshes.size();) {
+		auto &m = g_triggerMeshes[i];
+		if (m.drawn) {
+			m.drawn = false;
+			++i;
+			continue;
+		}
+		OverlayRender::destroyRetainedMesh(m.solid);
+		OverlayRender::destroyRetainedMesh(m.wireframe);
+		m = g_triggerMeshes.back();
+		g_triggerMeshes.pop_back();
+	}
+}
+
+// }}}
+
 bool ZoneTriggerRule::Test(Vector pos) {
 	return pointInBox(pos, this->center, this->size, this->rotation);
 }
 
 void ZoneTriggerRule::DrawInWorld() {
-	OverlayRender::addBoxMesh(
-		this->center,
-		-this->size / 2,
-		this->size / 2,
-		{0, (float)(this->rotation * 360.0f / TAU), 0},
-		RenderCallback::constant({ 140, 6, 195, 100 }),
-		RenderCallback::constant({ 140, 6, 195, 255 })
-	);
+	drawTriggerBox(this->center, this->size, this->rotation, { 140, 6, 195 });
 }
 
 void ZoneTriggerRule::OverlayInfo(SpeedrunRule *rule) {
@@ -151,14 +199,7 @@ bool JumpTriggerRule::Test(Vector pos) {
 }
 
 void JumpTriggerRule::DrawInWorld() {
-	OverlayRender::addBoxMesh(
-		this->center,
-		-this->size / 2,
-		this->size / 2,
-		{0, (float)(this->rotation * 360.0f / TAU), 0},
-		RenderCallback::constant({ 140, 6, 195, 100 }),
-		RenderCallback::constant({ 140, 6, 195, 255 })
-	);
+	drawTriggerBox(this->center, this->size, this->rotation, { 140, 6, 195 });
 }
 
 void JumpTriggerRule::OverlayInfo(SpeedrunRule *rule) {
@@ -230,14 +271,7 @@ void PortalPlacementRule::DrawInWorld() {
 		}
 	}
 
-	OverlayRender::addBoxMesh(
-		this->center,
-		-this->size / 2,
-		this->size / 2,
-		{0, (float)(this->rotation * 360.0f / TAU), 0},
-		RenderCallback::constant({ r, g, b, 100 }),
-		RenderCallback::constant({ r, g, b, 255 })
-	);
+	drawTriggerBox(this->center, this->size, this->rotation, { r, g, b });
 }
 
 void PortalPlacementRule::OverlayInfo(SpeedrunRule *rule) {
@@ -336,15 +370,18 @@ bool CrouchFlyRule::Test() {
 	return true;
 }
 
+bool SpeedrunRule::AppliesToMap(const std::string &map) {
+	return std::find_if(this->maps.begin(), this->maps.end(), [&](const std::string &m) {
+		return m == "*" || !strcasecmp(m.c_str(), map.c_str());
+	}) != this->maps.end();
+}
+
 bool SpeedrunRule::TestGeneral(std::optional<int> slot) {
 	if (this->fired && this->action != RuleAction::FORCE_START) return false;
 	if (this->onlyAfter) {
 		auto prereq = SpeedrunTimer::GetRule(*this->onlyAfter);
 		if (!prereq || !prereq->fired) return false;
 	}
-	if (std::find_if(this->maps.begin(), this->maps.end(), [](std::string map) {
-				return map == "*" || !strcasecmp(map.c_str(), engine->GetCurrentMapName().c_str());
-			}) == this->maps.end()) return false;
 	if (this->slot) {
 		if (this->slot != slot) return false;
 	}
@@ -500,8 +537,8 @@ void SpeedrunTimer::TickRules() {
 			continue;
 		}
 
-		auto m_hPrimaryPortal = SE(portalGun)->field<CBaseHandle>("m_hPrimaryPortal");
-		auto m_hSecondaryPortal = SE(portalGun)->field<CBaseHandle>("m_hSecondaryPortal");
+		auto m_hPrimaryPortal = SE(portalGun)->field<CBaseHandle>(ENT_FIELD("m_hPrimaryPortal"));
+		auto m_hSecondaryPortal = SE(portalGun)->field<CBaseHandle>(ENT_FIELD("m_hSecondaryPortal"));
 
 		auto bluePortal = entityList->LookupEntity(m_hPrimaryPortal);
 		auto orangePortal = entityList->LookupEntity(m_hSecondaryPortal);
@@ -513,13 +550,13 @@ void SpeedrunTimer::TickRules() {
 				continue;
 			}
 
-			auto fromPlayer = SE(portal)->field<CBaseHandle>("m_hFiredByPlayer");
+			auto fromPlayer = SE(portal)->field<CBaseHandle>(ENT_FIELD("m_hFiredByPlayer"));
 			if (!fromPlayer) {
 				portalPositions[slot][i] = {};
 				continue;
 			}
 
-			bool activated = SE(portal)->field<bool>("m_bActivated");
+			bool activated = SE(portal)->field<bool>(ENT_FIELD("m_bActivated"));
 			if (!activated) {
 				portalPositions[slot][i] = {};
 				continue;
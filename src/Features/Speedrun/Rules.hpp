@@ -35,7 +35,7 @@ struct EntityInputRule {
 	std::string inputname;
 	std::string parameter;
 
-	bool Test(std::string targetname, std::string classname, std::string inputname, std::string parameter);
+	bool Test(const char *targetname, const char *classname, const char *inputname, const char *parameter);
 
 	static std::optional<SpeedrunRule> Create(std::map<std::string, std::string> params);
 };
@@ -138,6 +138,9 @@ struct SpeedrunRule {
 		, fired(false) {
 	}
 
+	bool AppliesToMap(const std::string &map);
+	// Doesn't check the map; rules are filtered by AppliesToMap when the
+	// category's rule index is built
 	bool TestGeneral(std::optional<int> slot);
 };
 
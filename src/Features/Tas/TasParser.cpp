@@ -1,7 +1,10 @@
 #include "TasParser.hpp"
 #include "Modules/Console.hpp"
+#include "Modules/Engine.hpp"
 #include "Modules/FileSystem.hpp"
 #include "TasPlayer.hpp"
+#include "Variable.hpp"
+#include "Version.hpp"
 
 #include <algorithm>
 #include <fstream>
@@ -10,6 +13,8 @@
 #include <sstream>
 #include <optional>
 #include <cfloat>
+#include <chrono>
+#include <cstring>
 
 struct TasToken {
 	enum {
@@ -372,7 +377,7 @@ static std::optional<TasToolCommand> parseToolCmd(const std::vector<std::string>
 
 			auto params = tool->ParseParams(args);
 
-			return TasToolCommand{tool, params};
+			return TasToolCommand{tool, params, args};
 		}
 	}
 
@@ -537,7 +542,9 @@ static TasFramebulk parseFramebulk(int last_tick, const TasFramebulk &base, cons
 	return bulk;
 }
 
-static std::vector<TasFramebulk> parseFramebulks(const char *filepath, const Line *lines, size_t nlines) {
+// bulk_lines, if given, receives the source line of each framebulk (0 for
+// bulks generated by button timeouts)
+static std::vector<TasFramebulk> parseFramebulks(const char *filepath, const Line *lines, size_t nlines, std::vector<unsigned> *bulk_lines) {
 	int last_tick = -1;
 	TasFramebulk last;
 	std::vector<TasFramebulk> bulks;
@@ -570,6 +577,7 @@ static std::vector<TasFramebulk> parseFramebulks(const char *filepath, const Lin
 
 				if (dirty) {
 					bulks.push_back(mid_bulk);
+					if (bulk_lines) bulk_lines->push_back(0);
 					last = mid_bulk;
 				}
 			}
@@ -590,6 +598,7 @@ static std::vector<TasFramebulk> parseFramebulks(const char *filepath, const Lin
 			TasFramebulk bulk = parseFramebulk(last_tick, base, line, &button_timeouts);
 
 			bulks.push_back(bulk);
+			if (bulk_lines) bulk_lines->push_back(line.num);
 			last_tick = bulk.tick;
 			last = bulk;
 		} catch (TasParserException &e) {
@@ -617,6 +626,7 @@ static std::vector<TasFramebulk> parseFramebulks(const char *filepath, const Lin
 
 		if (dirty) {
 			bulks.push_back(mid_bulk);
+			if (bulk_lines) bulk_lines->push_back(0);
 			last = mid_bulk;
 		} else if (done) {
 			break;
@@ -693,7 +703,7 @@ static std::vector<Line> preProcess(const char *filepath, const Line *lines, siz
 	return current;
 }
 
-static void parseStream(TasScript &script, std::string name, std::istream &stream) {
+static void parseStream(TasScript &script, std::string name, std::istream &stream, std::vector<unsigned> *bulk_lines = nullptr) {
 	
 	auto lines = tokenize(stream);
 
@@ -724,7 +734,7 @@ static void parseStream(TasScript &script, std::string name, std::istream &strea
 		throw TasParserException(Utils::ssprintf("[%s:%u] %s", name.c_str(), lines[2].num, e.msg.c_str()));
 	}
 
-	script.framebulks = parseFramebulks(name.c_str(), lines.data() + script_start, lines.size() - script_start);  // skip version and start lines
+	script.framebulks = parseFramebulks(name.c_str(), lines.data() + script_start, lines.size() - script_start, bulk_lines);  // skip version and start lines
 
 	if (script.framebulks.size() == 0) {
 		throw TasParserException(Utils::ssprintf("[%s] no framebulks in TAS script", name.c_str()));
@@ -733,16 +743,271 @@ static void parseStream(TasScript &script, std::string name, std::istream &strea
 	return;
 }
 
+// Compiled scripts {{{
+
+// A compiled script is the result of parseStream stored next to the source
+// as <name>.p2tasc: header, framebulks, tool arguments and the source line
+// of every bulk. It is keyed on a hash of the source text, its path and the
+// parser version, so it's only used while the source is unchanged. Tool
+// params are stored as their source arguments and re-parsed on load, since
+// they're polymorphic and cheap to parse compared to tokenizing the script.
+
+#define TAS_COMPILED_MAGIC 0x43543250  // "P2TC"
+#define TAS_COMPILED_VERSION 1
+
+Variable sar_tas_autocompile("sar_tas_autocompile", "0", "Write a compiled copy of TAS scripts when they're parsed so later loads of the unchanged script skip the parser.\n");
+
+static uint64_t hashScriptSource(const std::string &path, const std::string &source) {
+	// FNV-1a; only has to tell revisions of a script apart
+	uint64_t hash = 14695981039346656037ull;
+	auto feed = [&](const void *data, size_t size) {
+		auto p = (const uint8_t *)data;
+		for (size_t i = 0; i < size; ++i) hash = (hash ^ p[i]) * 1099511628211ull;
+	};
+	uint32_t versions[] = {TAS_COMPILED_VERSION, MAX_SCRIPT_VERSION};
+	feed(versions, sizeof versions);
+	feed(SAR_VERSION, sizeof SAR_VERSION);
+	feed(path.c_str(), path.size() + 1);
+	feed(source.data(), source.size());
+	return hash;
+}
+
+static std::string compiledPathFor(const std::string &path) {
+	std::string compiled = path;
+	size_t lastdot = compiled.find_last_of(".");
+	if (lastdot != std::string::npos) {
+		compiled = compiled.substr(0, lastdot);
+	}
+	return compiled + "." + TAS_COMPILED_EXT;
+}
+
+static bool readSource(const std::string &path, std::string &out) {
+	std::ifstream file(path, std::ios::in | std::ios::binary);
+	if (!file) return false;
+	std::ostringstream ss;
+	ss << file.rdbuf();
+	out = ss.str();
+	return true;
+}
+
+struct CompiledWriter {
+	std::string buf;
+
+	template <typename T>
+	void Put(T val) {
+		buf.append((const char *)&val, sizeof val);
+	}
+	void PutString(const std::string &str) {
+		Put<uint32_t>(str.size());
+		buf.append(str);
+	}
+};
+
+struct CompiledTruncated {};
+
+struct CompiledReader {
+	const char *cur;
+	const char *end;
+
+	template <typename T>
+	T Get() {
+		if ((size_t)(end - cur) < sizeof(T)) throw CompiledTruncated{};
+		T val;
+		memcpy(&val, cur, sizeof val);
+		cur += sizeof val;
+		return val;
+	}
+	std::string GetString() {
+		uint32_t len = Get<uint32_t>();
+		if ((size_t)(end - cur) < len) throw CompiledTruncated{};
+		std::string str(cur, len);
+		cur += len;
+		return str;
+	}
+};
+
+static void writeCompiled(const TasScript &script, const std::vector<unsigned> &bulkLines, uint64_t key, const std::string &compiledPath) {
+	CompiledWriter w;
+	w.Put<uint32_t>(TAS_COMPILED_MAGIC);
+	w.Put<uint32_t>(TAS_COMPILED_VERSION);
+	w.Put<uint64_t>(key);
+
+	w.Put<int32_t>(script.header.version);
+	w.Put<uint8_t>(script.header.startInfo.isNext);
+	w.Put<int32_t>(script.header.startInfo.type);
+	w.PutString(script.header.startInfo.param);
+	w.PutString(script.header.rngManipFile);
+
+	w.Put<uint32_t>(script.framebulks.size());
+	for (size_t i = 0; i < script.framebulks.size(); ++i) {
+		const TasFramebulk &fb = script.framebulks[i];
+		w.Put<int32_t>(fb.tick);
+		w.Put<uint32_t>(i < bulkLines.size() ? bulkLines[i] : 0);
+		w.Put<float>(fb.moveAnalog.x);
+		w.Put<float>(fb.moveAnalog.y);
+		w.Put<float>(fb.viewAnalog.x);
+		w.Put<float>(fb.viewAnalog.y);
+
+		uint32_t buttons = 0;
+		for (int b = 0; b < TAS_CONTROLLER_INPUT_COUNT; ++b) {
+			if (fb.buttonStates[b]) buttons |= 1 << b;
+		}
+		w.Put<uint32_t>(buttons);
+
+		w.Put<uint32_t>(fb.commands.size());
+		for (const std::string &cmd : fb.commands) w.PutString(cmd);
+
+		w.Put<uint32_t>(fb.toolCmds.size());
+		for (const TasToolCommand &cmd : fb.toolCmds) {
+			w.PutString(cmd.tool->GetName());
+			w.Put<uint32_t>(cmd.args.size());
+			for (const std::string &arg : cmd.args) w.PutString(arg);
+		}
+	}
+
+	std::ofstream file(compiledPath, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file) {
+		throw TasParserException(Utils::ssprintf("[%s] failed to write compiled script", compiledPath.c_str()));
+	}
+	file.write(w.buf.data(), w.buf.size());
+}
+
+// Fills script from a compiled file. Returns false if there's no usable
+// compiled file for this key; throws only for errors in the script itself.
+static bool loadCompiled(TasScript &script, const std::string &name, uint64_t key, const std::string &compiledPath) {
+	std::string data;
+	if (!readSource(compiledPath, data)) return false;
+
+	CompiledReader r{data.data(), data.data() + data.size()};
+	TasScriptHeader header;
+	std::vector<TasFramebulk> bulks;
+
+	try {
+		if (r.Get<uint32_t>() != TAS_COMPILED_MAGIC) return false;
+		if (r.Get<uint32_t>() != TAS_COMPILED_VERSION) return false;
+		if (r.Get<uint64_t>() != key) return false;
+
+		header.version = r.Get<int32_t>();
+		header.startInfo.isNext = r.Get<uint8_t>();
+		header.startInfo.type = (TasScriptStartType)r.Get<int32_t>();
+		header.startInfo.param = r.GetString();
+		header.rngManipFile = r.GetString();
+
+		uint32_t nbulks = r.Get<uint32_t>();
+		bulks.reserve(std::min<size_t>(nbulks, data.size() / 32));
+		for (uint32_t i = 0; i < nbulks; ++i) {
+			TasFramebulk fb;
+			fb.tick = r.Get<int32_t>();
+			unsigned line = r.Get<uint32_t>();
+			fb.moveAnalog.x = r.Get<float>();
+			fb.moveAnalog.y = r.Get<float>();
+			fb.viewAnalog.x = r.Get<float>();
+			fb.viewAnalog.y = r.Get<float>();
+
+			uint32_t buttons = r.Get<uint32_t>();
+			for (int b = 0; b < TAS_CONTROLLER_INPUT_COUNT; ++b) {
+				fb.buttonStates[b] = buttons & (1 << b);
+			}
+
+			uint32_t ncmds = r.Get<uint32_t>();
+			for (uint32_t c = 0; c < ncmds; ++c) fb.commands.push_back(r.GetString());
+
+			uint32_t ntools = r.Get<uint32_t>();
+			for (uint32_t t = 0; t < ntools; ++t) {
+				std::vector<std::string> toks{r.GetString()};
+				uint32_t nargs = r.Get<uint32_t>();
+				for (uint32_t a = 0; a < nargs; ++a) toks.push_back(r.GetString());
+
+				try {
+					auto cmd = parseToolCmd(toks);
+					if (cmd) fb.toolCmds.push_back(*cmd);
+				} catch (TasParserException &e) {
+					throw TasParserException(Utils::ssprintf("[%s:%u] %s", name.c_str(), line, e.msg.c_str()));
+				}
+			}
+
+			bulks.push_back(std::move(fb));
+		}
+	} catch (CompiledTruncated &) {
+		return false;
+	}
+
+	if (bulks.size() == 0) return false;
+
+	script.header = header;
+	script.framebulks = std::move(bulks);
+	return true;
+}
+
+TasCompileResult TasParser::CompileFile(TasScript &script, std::string filePath) {
+	TasCompileResult result;
+
+	auto path = fileSystem->FindFileSomewhere(filePath).value_or(filePath);
+	std::string source;
+	if (!readSource(path, source)) {
+		throw TasParserException(Utils::ssprintf("[%s] failed to open the file", filePath.c_str()));
+	}
+
+	script.loadedFromFile = true;
+	script.path = path;
+
+	std::vector<unsigned> bulkLines;
+	auto start = NOW_STEADY();
+	std::istringstream stream(source);
+	parseStream(script, path, stream, &bulkLines);
+	auto parsed = NOW_STEADY();
+
+	uint64_t key = hashScriptSource(path, source);
+	result.path = compiledPathFor(path);
+	writeCompiled(script, bulkLines, key, result.path);
+
+	// Load it straight back so the caller can compare the two paths
+	TasScript check = script;
+	auto loadStart = NOW_STEADY();
+	if (!loadCompiled(check, path, key, result.path)) {
+		throw TasParserException(Utils::ssprintf("[%s] compiled script failed to load back", result.path.c_str()));
+	}
+	auto loaded = NOW_STEADY();
+
+	result.framebulks = script.framebulks.size();
+	result.sourceBytes = source.size();
+	std::ifstream compiled(result.path, std::ios::in | std::ios::binary | std::ios::ate);
+	result.compiledBytes = compiled ? (size_t)compiled.tellg() : 0;
+	result.parseMs = std::chrono::duration<double, std::milli>(parsed - start).count();
+	result.loadMs = std::chrono::duration<double, std::milli>(loaded - loadStart).count();
+	return result;
+}
+
+// }}}
+
 TasScript TasParser::ParseFile(TasScript &script, std::string filePath) {
 	auto path = fileSystem->FindFileSomewhere(filePath).value_or(filePath);
-	std::ifstream file(path, std::fstream::in);
-	if (!file) {
+	std::string source;
+	if (!readSource(path, source)) {
 		throw TasParserException(Utils::ssprintf("[%s] failed to open the file", filePath.c_str()));
 	}
 
 	script.loadedFromFile = true;
 	script.path = path;
-	parseStream(script, path, file);
+
+	uint64_t key = hashScriptSource(path, source);
+	auto compiledPath = compiledPathFor(path);
+	if (loadCompiled(script, path, key, compiledPath)) {
+		return script;
+	}
+
+	std::istringstream stream(source);
+	if (sar_tas_autocompile.GetBool()) {
+		std::vector<unsigned> bulkLines;
+		parseStream(script, path, stream, &bulkLines);
+		try {
+			writeCompiled(script, bulkLines, key, compiledPath);
+		} catch (TasParserException &e) {
+			console->Warning("%s\n", e.what());
+		}
+	} else {
+		parseStream(script, path, stream);
+	}
 	return script;
 }
 
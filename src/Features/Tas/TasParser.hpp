@@ -2,6 +2,7 @@
 #include "TasScript.hpp"
 
 #define MAX_SCRIPT_VERSION 8
+#define TAS_COMPILED_EXT "p2tasc"
 
 #include <iostream>
 #include <string>
@@ -18,8 +19,18 @@ struct TasParserException : public std::exception {
 	const char *what() const throw() { return msg.c_str(); }
 };
 
+struct TasCompileResult {
+	std::string path;
+	size_t framebulks;
+	size_t sourceBytes;
+	size_t compiledBytes;
+	double parseMs;
+	double loadMs;
+};
+
 namespace TasParser {
 	TasScript ParseFile(TasScript &script, std::string filePath);
+	TasCompileResult CompileFile(TasScript &script, std::string filePath);
 	TasScript ParseScript(TasScript &script, std::string scriptName, std::string scriptString);
 	void SaveRawScriptToFile(TasScript script);
 	std::string SaveRawScriptToString(TasScript script);
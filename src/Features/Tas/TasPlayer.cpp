@@ -1,5 +1,6 @@
 #include "TasPlayer.hpp"
 
+#include "Features/EntityList.hpp"
 #include "Features/Session.hpp"
 #include "Features/Tas/TasParser.hpp"
 #include "Features/Tas/TasTool.hpp"
@@ -15,6 +16,8 @@
 #include "Event.hpp"
 #include "Variable.hpp"
 
+#include <algorithm>
+#include <chrono>
 #include <climits>
 #include <fstream>
 #include "TasTools/AutoJumpTool.hpp"
@@ -108,14 +111,9 @@ void SetPlaybackVars(bool active) {
 ON_EVENT(FRAME) {
 	bool tools = tasPlayer->IsUsingTools();
 	if (tasPlayer->IsRunning() && !sar_tas_interpolate.GetBool() && tools) {
-		for (int i = 0; i < Offsets::NUM_ENT_ENTRIES; ++i) {
-			// check for prop_portal on the server cuz i can't figure out how
-			// to do it client-side lol
-			void *ent = server->m_EntPtrArray[i].m_pEntity;
-			if (!ent) continue;
-			const char *classname = server->GetEntityClassName(ent);
-			if (!classname || strcmp(classname, "prop_portal")) continue;
-
+		// check for prop_portal on the server cuz i can't figure out how
+		// to do it client-side lol
+		for (int i : entityList->GetEntityIndicesByClassName("prop_portal")) {
 			// it's a portal, so get the corresponding client entity and
 			// insta-open it
 			void *cl_ent = client->GetPlayer(i);
@@ -165,7 +163,7 @@ void TasPlayer::Activate(TasPlaybackInfo info) {
 
 	lastTick = 0;
 	for (int slot = 0; slot < (info.IsCoop() ? 2 : 1); ++slot) {
-		for (TasFramebulk fb : info.slots[slot].framebulks) {
+		for (const TasFramebulk &fb : info.slots[slot].framebulks) {
 			if (fb.tick > lastTick) {
 				lastTick = fb.tick;
 			}
@@ -306,48 +304,46 @@ void TasPlayer::AdvanceFrame() {
 }
 
 // returns raw framebulk that should be used for given tick
-TasFramebulk TasPlayer::GetRawFramebulkAt(int slot, int tick) {
-	// Do binary search for bulks immediately before and after our target tick
-	uint32_t before = 0;
-	uint32_t after = playbackInfo.slots[slot].framebulks.size() - 1;
-
-	if (playbackInfo.slots[slot].framebulks[before].tick  == tick) {
-		return playbackInfo.slots[slot].framebulks[before];
-	}
-	if (playbackInfo.slots[slot].framebulks[after].tick  == tick) {
-		return playbackInfo.slots[slot].framebulks[after];
-	}
-
-	while (before + 1 != after) {
-		uint32_t middle = (before + after) / 2;
-		TasFramebulk middle_bulk = playbackInfo.slots[slot].framebulks[middle];
+const TasFramebulk &TasPlayer::GetRawFramebulkAt(int slot, int tick) {
+	const auto &framebulks = playbackInfo.slots[slot].framebulks;
 
-		if (middle_bulk.tick < tick) {
-			before = middle;
-		} else if (middle_bulk.tick > tick) {
-			after = middle;
-		} else {
-			return middle_bulk;
-		}
-	}
+	// Last bulk whose tick is <= the target; ticks before the first bulk
+	// still map to the first one
+	auto it = std::upper_bound(framebulks.begin(), framebulks.end(), tick, [](int t, const TasFramebulk &fb) {
+		return t < fb.tick;
+	});
+	if (it != framebulks.begin()) --it;
 
-	return playbackInfo.slots[slot].framebulks[before];
+	return *it;
 }
 
 // returns raw framebulk using more efficient method with cached incremented index of last used tick
-TasFramebulk TasPlayer::GetRawFramebulkAt(int slot, int tick, unsigned& cachedIndex) {
-
-	auto maxIndex = playbackInfo.slots[slot].framebulks.size() - 1;
-
-	if (cachedIndex >= maxIndex) {
-		return playbackInfo.slots[slot].framebulks[maxIndex];
+const TasFramebulk &TasPlayer::GetRawFramebulkAt(int slot, int tick, unsigned &cachedIndex) {
+	const auto &framebulks = playbackInfo.slots[slot].framebulks;
+	unsigned maxIndex = framebulks.size() - 1;
+
+	if (cachedIndex > maxIndex || framebulks[cachedIndex].tick > tick) {
+		// The cursor only moves forward; if the tick went backwards (or the
+		// script changed under us) redo the search from scratch
+		cachedIndex = &GetRawFramebulkAt(slot, tick) - framebulks.data();
+		return framebulks[cachedIndex];
 	}
 
-	while (cachedIndex < maxIndex && playbackInfo.slots[slot].framebulks[cachedIndex + 1].tick <= tick) {
+	// Normal playback advances at most one bulk per tick, so a short linear
+	// step covers it. Anything further is a jump - binary search the rest.
+	for (int step = 0; step < 4; ++step) {
+		if (cachedIndex == maxIndex || framebulks[cachedIndex + 1].tick > tick) {
+			return framebulks[cachedIndex];
+		}
 		cachedIndex++;
 	}
 
-	return playbackInfo.slots[slot].framebulks[cachedIndex];
+	auto it = std::upper_bound(framebulks.begin() + cachedIndex, framebulks.end(), tick, [](int t, const TasFramebulk &fb) {
+		return t < fb.tick;
+	});
+	cachedIndex = (it - framebulks.begin()) - 1;
+
+	return framebulks[cachedIndex];
 }
 
 TasPlayerInfo TasPlayer::GetPlayerInfo(int slot, void *player, CUserCmd *cmd, bool clientside) {
@@ -358,16 +354,16 @@ TasPlayerInfo TasPlayer::GetPlayerInfo(int slot, void *player, CUserCmd *cmd, bo
 	if (!clientside) {
 		ServerEnt *pl = (ServerEnt *)player;
 
-		m_nOldButtons = pl->template field<int>("m_nOldButtons");
+		m_nOldButtons = pl->template field<int>(ENT_FIELD("m_nOldButtons"));
 
 		pi.slot = server->GetSplitScreenPlayerSlot(player);
 		pi.surfaceFriction = *reinterpret_cast<float *>((uintptr_t)player + Offsets::S_m_surfaceFriction);
 		pi.ducked = pl->ducked();
 
-		float *m_flMaxspeed = &pl->template field<float>("m_flMaxspeed");
+		float *m_flMaxspeed = &pl->template field<float>(ENT_FIELD("m_flMaxspeed"));
 		pi.maxSpeed = *m_flMaxspeed;
 
-		pi.waterLevel = pl->template field<char>("m_nWaterLevel");
+		pi.waterLevel = pl->template field<char>(ENT_FIELD("m_nWaterLevel"));
 
 		pi.grounded = pl->ground_entity();
 		pi.position = pl->abs_origin();
@@ -401,16 +397,16 @@ TasPlayerInfo TasPlayer::GetPlayerInfo(int slot, void *player, CUserCmd *cmd, bo
 	} else {
 		ClientEnt *pl = (ClientEnt *)player;
 
-		m_nOldButtons = pl->template field<int>("m_nOldButtons");
+		m_nOldButtons = pl->template field<int>(ENT_FIELD("m_nOldButtons"));
 
 		pi.slot = server->GetSplitScreenPlayerSlot(player);
 		pi.surfaceFriction = *reinterpret_cast<float *>((uintptr_t)player + Offsets::C_m_surfaceFriction);
 		pi.ducked = pl->ducked();
 
-		float *m_flMaxspeed = &pl->template field<float>("m_flMaxspeed");
+		float *m_flMaxspeed = &pl->template field<float>(ENT_FIELD("m_flMaxspeed"));
 		pi.maxSpeed = *m_flMaxspeed;
 
-		pi.waterLevel = pl->template field<char>("m_nWaterLevel");
+		pi.waterLevel = pl->template field<char>(ENT_FIELD("m_nWaterLevel"));
 
 		pi.grounded = pl->ground_entity();
 		pi.position = pl->abs_origin();
@@ -452,10 +448,10 @@ TasPlayerInfo TasPlayer::GetPlayerInfo(int slot, void *player, CUserCmd *cmd, bo
 int TasPlayer::FetchCurrentPlayerTickBase(void *player, bool clientside) {
 	if (!clientside) {
 		ServerEnt *pl = (ServerEnt *)player;
-		return pl->template field<int>("m_nTickBase");
+		return pl->template field<int>(ENT_FIELD("m_nTickBase"));
 	} else {
 		ClientEnt *pl = (ClientEnt *)player;
-		return pl->template field<int>("m_nTickBase");
+		return pl->template field<int>(ENT_FIELD("m_nTickBase"));
 	}
 }
 
@@ -551,7 +547,7 @@ void TasPlayer::FetchInputs(int slot, TasController *controller) {
 	// to actually hook at _Host_RunFrame_Input or CL_Move.
 	int tick = currentTick + 1;
 
-	TasFramebulk fb = GetRawFramebulkAt(slot, tick, currentInputFramebulkIndex[slot]);
+	const TasFramebulk &fb = GetRawFramebulkAt(slot, tick, currentInputFramebulkIndex[slot]);
 
 	int fbTick = fb.tick;
 
@@ -568,22 +564,22 @@ void TasPlayer::FetchInputs(int slot, TasController *controller) {
 	if (tick == 1) {
 		// on tick 1, we'll run the commands from the bulk at tick 0 because
 		// of the annoying off-by-one thing explained above
-		TasFramebulk fb0 = GetRawFramebulkAt(slot, 0);
-		for (std::string cmd : fb0.commands) {
+		const TasFramebulk &fb0 = GetRawFramebulkAt(slot, 0);
+		for (const std::string &cmd : fb0.commands) {
 			controller->AddCommandToQueue(cmd);
 		}
 	}
 
 	// add commands only for tick when framebulk is placed. Don't preserve it to other ticks.
 	if (tick == fbTick) {
-		for (std::string cmd : fb.commands) {
+		for (const std::string &cmd : fb.commands) {
 			controller->AddCommandToQueue(cmd);
 		}
 	}
 }
 
 static bool IsTaunting(ClientEnt *player) {
-	int cond = player->field<int>("m_nPlayerCond");
+	int cond = player->field<int>(ENT_FIELD("m_nPlayerCond"));
 	if (cond & (1 << PORTAL_COND_TAUNTING)) return true;
 	if (cond & (1 << PORTAL_COND_DROWNING)) return true;
 	if (cond & (1 << PORTAL_COND_DEATH_CRUSH)) return true;
@@ -603,13 +599,14 @@ void TasPlayer::PostProcess(int slot, void *player, CUserCmd *cmd) {
 	// every other way of getting time is incorrect due to alternateticks
 	int tasTick = FetchCurrentPlayerTickBase(player) - startTick;
 
+	// Tools modify the bulk in place, so this is the one copy made per tick
 	TasFramebulk fb = GetRawFramebulkAt(slot, tasTick, currentToolsFramebulkIndex[slot]);
 
 	// update all tools that needs to be updated
 	auto fbTick = fb.tick;
 	fb.tick = tasTick;
 	if (fbTick == tasTick) {
-		for (TasToolCommand cmd : fb.toolCmds) {
+		for (const TasToolCommand &cmd : fb.toolCmds) {
 			auto tool = TasTool::GetInstanceByName(slot, cmd.tool->GetName());
 			if (tool == nullptr) continue;
 			tool->SetParams(cmd.params);
@@ -637,7 +634,7 @@ void TasPlayer::PostProcess(int slot, void *player, CUserCmd *cmd) {
 	// applying tools
 	if (playbackInfo.slots[slot].header.version >= 3) {
 		// use priority list for newer versions. technically all tools should be in the list
-		for (std::string toolName : TasTool::priorityList) {
+		for (const std::string &toolName : TasTool::priorityList) {
 			auto tool = TasTool::GetInstanceByName(slot, toolName);
 			if (tool == nullptr) continue;
 			tool->Apply(fb, playerInfo);
@@ -714,7 +711,7 @@ void TasPlayer::PostProcess(int slot, void *player, CUserCmd *cmd) {
 	// UPDATE: OKAY, actually, only do this if tools changed our movement
 	// analog, so we can at least try and counteract the bullshit described above
 	if (fabsf(cmd->forwardmove - orig_forward) + fabsf(cmd->sidemove - orig_side) + fabsf(cmd->upmove - orig_up) > 0.01) {
-		SE(player)->fieldOff<CUserCmd>("m_hViewModel", 8) /* m_LastCmd */ = *cmd;
+		SE(player)->fieldOff<CUserCmd>(ENT_FIELD("m_hViewModel"), 8) /* m_LastCmd */ = *cmd;
 	}
 
 	// put processed framebulk in the list
@@ -858,6 +855,7 @@ void TasPlayer::UpdateServer() {
 
 DECL_COMMAND_FILE_COMPLETION(sar_tas_play, TAS_SCRIPT_EXT, TAS_SCRIPTS_DIR, 2)
 DECL_COMMAND_FILE_COMPLETION(sar_tas_play_single, TAS_SCRIPT_EXT, TAS_SCRIPTS_DIR, 1)
+DECL_COMMAND_FILE_COMPLETION(sar_tas_compile, TAS_SCRIPT_EXT, TAS_SCRIPTS_DIR, 1)
 
 
 void TasPlayer::PlayFile(std::string slot0scriptPath, std::string slot1scriptPath) {
@@ -991,6 +989,29 @@ CON_COMMAND_F_COMPLETION(
 	tasPlayer->PlaySingleCoop(args[1], args.ArgC() == 3 ? atoi(args[2]) : 0);
 }
 
+CON_COMMAND_F_COMPLETION(
+	sar_tas_compile,
+	"sar_tas_compile <filename> - writes a compiled copy of a TAS script, used by later loads while the script is unchanged\n",
+	0,
+	AUTOCOMPLETION_FUNCTION(sar_tas_compile)) {
+	if (args.ArgC() != 2) {
+		return console->Print(sar_tas_compile.ThisPtr()->m_pszHelpString);
+	}
+
+	try {
+		TasScript script;
+		script.name = args[1];
+		std::string filePath(std::string(TAS_SCRIPTS_DIR) + "/" + args[1] + "." + TAS_SCRIPT_EXT);
+		auto res = TasParser::CompileFile(script, filePath);
+
+		console->Print("Compiled %zu framebulks to %s\n", res.framebulks, res.path.c_str());
+		console->Print("  source:   %zu bytes, parsed in %.2fms\n", res.sourceBytes, res.parseMs);
+		console->Print("  compiled: %zu bytes, loaded in %.2fms\n", res.compiledBytes, res.loadMs);
+	} catch (TasParserException &e) {
+		console->ColorMsg(Color(255, 100, 100), "Error while compiling TAS file: %s\n", e.what());
+	}
+}
+
 CON_COMMAND(sar_tas_replay, "sar_tas_replay - replays the last played TAS\n") {
 	if (!tasPlayer->previousPlaybackInfo.HasActiveSlot() && !tasPlayer->IsRunning()) {
 		return console->Print("No TAS to replay\n");
@@ -1033,6 +1054,112 @@ CON_COMMAND(sar_tas_save_raw, "sar_tas_save_raw - saves a processed version of j
 	tasPlayer->SaveProcessedFramebulks();
 }
 
+// Framebulk lookup self test {{{
+
+// The lookup GetRawFramebulkAt used to do: a hand-rolled binary search that
+// copied a framebulk at every step and returned another copy. Kept for
+// timing; note it returns the second to last bulk for ticks past the last
+// one, which the self test reports separately
+static TasFramebulk legacyFramebulkAt(const std::vector<TasFramebulk> &framebulks, int tick) {
+	uint32_t before = 0;
+	uint32_t after = framebulks.size() - 1;
+
+	if (framebulks[before].tick == tick) return framebulks[before];
+	if (framebulks[after].tick == tick) return framebulks[after];
+
+	while (before + 1 != after) {
+		uint32_t middle = (before + after) / 2;
+		TasFramebulk middle_bulk = framebulks[middle];
+
+		if (middle_bulk.tick < tick) {
+			before = middle;
+		} else if (middle_bulk.tick > tick) {
+			after = middle;
+		} else {
+			return middle_bulk;
+		}
+	}
+
+	return framebulks[before];
+}
+
+CON_COMMAND(sar_tas_framebulk_selftest, "sar_tas_framebulk_selftest [framebulks] - checks and times the TAS framebulk lookups on a synthetic script\n") {
+	if (args.ArgC() > 2) return console->Print(sar_tas_framebulk_selftest.ThisPtr()->m_pszHelpString);
+	int count = args.ArgC() == 2 ? atoi(args[1]) : 100000;
+	if (count < 2) return console->Print(sar_tas_framebulk_selftest.ThisPtr()->m_pszHelpString);
+	if (tasPlayer->IsActive()) return console->Print("Cannot run the self test during TAS playback.\n");
+
+	// Bulks a few ticks apart with the odd command, like a real script
+	uint32_t seed = 1;
+	auto rand = [&]() { return (seed = seed * 1664525 + 1013904223) >> 8; };
+	std::vector<TasFramebulk> framebulks(count);
+	int tick = 0;
+	for (int i = 0; i < count; ++i) {
+		framebulks[i].tick = tick;
+		if (rand() % 16 == 0) framebulks[i].commands.push_back(Utils::ssprintf("echo %d", tick));
+		tick += 1 + rand() % 8;
+	}
+	int lastTick = framebulks.back().tick + 5;
+
+	struct Pattern {
+		const char *name;
+		std::vector<int> ticks;
+	};
+	Pattern patterns[3] = {{"forward"}, {"backward"}, {"jump"}};
+	for (int t = 0; t <= lastTick; ++t) patterns[0].ticks.push_back(t);
+	for (int t = lastTick; t >= 0; --t) patterns[1].ticks.push_back(t);
+	// Mostly playback with a skip or rewind every so often
+	for (int t = 0, i = 0; i <= lastTick; ++i) {
+		patterns[2].ticks.push_back(t);
+		auto r = rand() % 64;
+		t = r == 0 ? (int)(rand() % (lastTick + 1)) : r == 1 ? t + (int)(rand() % 500) : t + 1;
+		if (t > lastTick) t = 0;
+	}
+
+	// Run against the synthetic script in place of slot 0's, and put it
+	// back afterwards
+	auto &slotBulks = tasPlayer->playbackInfo.slots[0].framebulks;
+	std::swap(slotBulks, framebulks);
+
+	using clock = std::chrono::steady_clock;
+	auto ns = [](clock::duration d, size_t n) { return std::chrono::duration<double, std::nano>(d).count() / n; };
+
+	int mismatches = 0;
+	int legacyDiffs = 0;
+	for (auto &p : patterns) {
+		unsigned cursor = 0;
+		for (int t : p.ticks) {
+			auto expected = &tasPlayer->GetRawFramebulkAt(0, t);
+			auto cursored = &tasPlayer->GetRawFramebulkAt(0, t, cursor);
+			bool isLast = expected + 1 == slotBulks.data() + slotBulks.size();
+			if (cursored != expected || (expected->tick > t && expected != slotBulks.data()) || (!isLast && expected[1].tick <= t)) {
+				if (++mismatches <= 10) console->Print("%s: tick %d got bulk %d, cursor %d\n", p.name, t, expected->tick, cursored->tick);
+			}
+			if (legacyFramebulkAt(slotBulks, t).tick != expected->tick) ++legacyDiffs;
+		}
+
+		volatile int sink = 0;
+		auto start = clock::now();
+		for (int t : p.ticks) sink = sink + legacyFramebulkAt(slotBulks, t).tick;
+		auto searchStart = clock::now();
+		for (int t : p.ticks) sink = sink + tasPlayer->GetRawFramebulkAt(0, t).tick;
+		auto cursorStart = clock::now();
+		cursor = 0;
+		for (int t : p.ticks) sink = sink + tasPlayer->GetRawFramebulkAt(0, t, cursor).tick;
+		auto end = clock::now();
+
+		size_t n = p.ticks.size();
+		console->Print("%-8s %7d lookups: old copy %.1f ns, upper_bound %.1f ns, cursor %.1f ns\n", p.name, (int)n, ns(searchStart - start, n), ns(cursorStart - searchStart, n), ns(end - cursorStart, n));
+	}
+
+	std::swap(slotBulks, framebulks);
+
+	if (legacyDiffs) console->Print("The old search picked a different bulk for %d lookups past the last bulk\n", legacyDiffs);
+	console->Print(mismatches ? "Framebulk lookup self test FAILED (%d mismatches)\n" : "Framebulk lookup self test passed\n", mismatches);
+}
+
+// }}}
+
 
 HUD_ELEMENT2(tastick, "0", "Draws current TAS playback tick.\n", HudType_InGame | HudType_Paused | HudType_Menu | HudType_LoadingScreen) {
 	if (!tasPlayer->IsActive()) {
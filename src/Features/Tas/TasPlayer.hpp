@@ -34,13 +34,13 @@ struct TasPlaybackInfo {
 
 	inline bool IsCoop() const { return slots[1].IsActive() || coopControlSlot == 1; }
 	inline bool HasActiveSlot() const { return slots[0].IsActive() || slots[1].IsActive(); }
-	inline TasScript GetMainScript() const {
+	inline const TasScript &GetMainScript() const {
 		if (coopControlSlot >= 0 && slots[1 - coopControlSlot].IsActive()) {
 			return slots[1 - coopControlSlot];
 		}
 		return slots[0].IsActive() ? slots[0] : slots[1]; 
 	}
-	inline TasScriptHeader GetMainHeader() const { return GetMainScript().header; }
+	inline const TasScriptHeader &GetMainHeader() const { return GetMainScript().header; }
 };
 
 struct TasPlayerInfo {
@@ -109,8 +109,8 @@ public:
 	void Resume();
 	void AdvanceFrame();
 
-	TasFramebulk GetRawFramebulkAt(int slot, int tick);
-	TasFramebulk GetRawFramebulkAt(int slot, int tick, unsigned &cachedIndex);
+	const TasFramebulk &GetRawFramebulkAt(int slot, int tick);
+	const TasFramebulk &GetRawFramebulkAt(int slot, int tick, unsigned &cachedIndex);
 
 	TasPlayerInfo GetPlayerInfo(int slot, void *player, CUserCmd *cmd, bool clientside = false);
 	int FetchCurrentPlayerTickBase(void *player, bool clientside = false);
@@ -9,6 +9,8 @@
 #	include <arpa/inet.h>
 #	include <netinet/in.h>
 #	include <unistd.h>
+#	include <fcntl.h>
+#	include <errno.h>
 #endif
 
 #ifndef _WIN32
@@ -19,6 +21,12 @@
 #	define WSACleanup() (void)0
 #endif
 
+#ifdef MSG_NOSIGNAL
+#	define SEND_FLAGS MSG_NOSIGNAL
+#else
+#	define SEND_FLAGS 0
+#endif
+
 #include "TasProtocol.hpp"
 #include "TasPlayer.hpp"
 #include "Event.hpp"
@@ -29,18 +37,25 @@
 #include "Features/EntityList.hpp"
 
 #include <vector>
-#include <deque>
 #include <thread>
 #include <atomic>
+#include <cstring>
 #include <mutex>
 #include <filesystem>
+#include <chrono>
 
 #define DEFAULT_TAS_CLIENT_SOCKET 6555
 #define DEFAULT_TAS_SERVER_SOCKET 6555
 
+// A client that falls this far behind is dropped instead of buffering forever
+#define MAX_TAS_OUTBOUND_QUEUE (8 * 1024 * 1024)
+#define TAS_RECV_CHUNK 16384
+
 Variable sar_tas_protocol_reconnect_delay("sar_tas_protocol_reconnect_delay", "0", 0, 
 	"A number of seconds after which reconnection to TAS protocol server should be made.\n"
 	"0 means no reconnect attempts will be made.\n");
+Variable sar_tas_protocol_coalesce("sar_tas_protocol_coalesce", "1",
+	"Only keep the latest per-tick status and entity info update for TAS protocol clients which can't keep up.\n");
 
 using namespace TasProtocol;
 
@@ -56,6 +71,8 @@ static std::string g_client_ip;
 static int g_client_port;
 static int g_server_port;
 static std::mutex g_conn_data_mutex;
+// guards g_connections against the main thread queueing sends
+static std::mutex g_connections_mutex;
 
 static Status g_last_status;
 static Status g_current_status;
@@ -63,71 +80,182 @@ static int g_last_debug_tick;
 static int g_current_debug_tick;
 static std::mutex g_status_mutex;
 
-static bool popByte(std::deque<uint8_t> &buf, uint8_t &val) {
-	if (buf.size() < 1) return false;
-	val = buf[0];
-	buf.pop_front();
-	return true;
-}
+// Byte queue {{{
 
-// static void encodeByte(std::deque<uint8_t>& buf, uint8_t val) {
-// 	buf.push_back(val);
-// }
+void ByteQueue::Append(const uint8_t *bytes, size_t len) {
+	data.insert(data.end(), bytes, bytes + len);
+}
 
-static bool popRaw32(std::deque<uint8_t> &buf, uint32_t& val) {
+uint8_t *ByteQueue::Reserve(size_t len) {
+	size_t old = data.size();
+	data.resize(old + len);
+	reserved = len;
+	return data.data() + old;
+}
 
-	if (buf.size() < 4) return false;
+void ByteQueue::Commit(size_t len) {
+	data.resize(data.size() - reserved + len);
+	reserved = 0;
+}
 
-	val = 0;
-	for (int i = 0; i < 4; ++i) {
-		val <<= 8;
-		val |= buf[0];
-		buf.pop_front();
+void ByteQueue::Consume(size_t len) {
+	head += len;
+	if (head == data.size()) {
+		Clear();
+	} else if (head >= 4096 && head * 2 >= data.size()) {
+		// most of the buffer is dead space; slide the live tail down
+		data.erase(data.begin(), data.begin() + head);
+		head = 0;
 	}
+}
 
-	return true;
+void ByteQueue::Clear() {
+	data.clear();
+	head = 0;
 }
 
+// }}}
+
+// Message encoding {{{
+
+// Reads fields in place from a received buffer. Every getter fails without
+// side effects on the caller's buffer if the message isn't complete yet.
+struct MsgReader {
+	const uint8_t *cur;
+	const uint8_t *end;
+
+	bool Byte(uint8_t &val) {
+		if (end - cur < 1) return false;
+		val = *cur++;
+		return true;
+	}
+
+	bool Raw32(uint32_t &val) {
+		if (end - cur < 4) return false;
+		val = (uint32_t)cur[0] << 24 | (uint32_t)cur[1] << 16 | (uint32_t)cur[2] << 8 | (uint32_t)cur[3];
+		cur += 4;
+		return true;
+	}
+
+	bool Float(float &val) {
+		uint32_t raw;
+		if (!Raw32(raw)) return false;
+		memcpy(&val, &raw, sizeof val);
+		return true;
+	}
+
+	bool String(std::string &val) {
+		uint32_t len;
+		if (!Raw32(len)) return false;
+		if ((size_t)(end - cur) < len) return false;
+		val.assign((const char *)cur, len);
+		cur += len;
+		return true;
+	}
+};
+
 static void encodeRaw32(std::vector<uint8_t> &buf, uint32_t val) {
-	buf.push_back((val >> 24) & 0xFF);
-	buf.push_back((val >> 16) & 0xFF);
-	buf.push_back((val >> 8)  & 0xFF);
-	buf.push_back((val >> 0)  & 0xFF);
+	uint8_t bytes[4] = {
+		(uint8_t)(val >> 24),
+		(uint8_t)(val >> 16),
+		(uint8_t)(val >> 8),
+		(uint8_t)(val >> 0),
+	};
+	buf.insert(buf.end(), bytes, bytes + 4);
 }
 
-static bool popRawFloat(std::deque<uint8_t>& buf, float& val) {
-	return popRaw32(buf, (uint32_t&)val);
+static void encodeRawFloat(std::vector<uint8_t> &buf, float val) {
+	uint32_t raw;
+	memcpy(&raw, &val, sizeof raw);
+	encodeRaw32(buf, raw);
 }
 
-static void encodeRawFloat(std::vector<uint8_t> &buf, float val) {
-	encodeRaw32(buf, *(uint32_t *)&val);
+static void encodeString(std::vector<uint8_t> &buf, const std::string &val) {
+	encodeRaw32(buf, (uint32_t)val.size());
+	buf.insert(buf.end(), val.begin(), val.end());
 }
 
-static bool popString(std::deque<uint8_t> &buf, std::string &val) {
-	uint32_t len;
-	if(!popRaw32(buf, len)) return false;
-	if (buf.size() < len) return false;
+// }}}
+
+// Sending {{{
+
+static bool socketWouldBlock() {
+#ifdef _WIN32
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+	return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
 
-	for (size_t i = 0; i < len; ++i) {
-		val += buf[0];
-		buf.pop_front();
+static void setNonBlocking(SOCKET sock) {
+#ifdef _WIN32
+	u_long mode = 1;
+	ioctlsocket(sock, FIONBIO, &mode);
+#else
+	fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+#endif
+}
+
+// Writes as much of the outbound queue as the socket takes without
+// blocking. Once it drains, any held-back tick update goes out.
+// Must be called with g_connections_mutex held.
+static void flushConnection(ConnectionData &cl) {
+	while (!cl.dead) {
+		if (cl.outbuf.Empty()) {
+			if (cl.pendingTickUpdate.empty()) return;
+			cl.outbuf.Append(cl.pendingTickUpdate.data(), cl.pendingTickUpdate.size());
+			cl.pendingTickUpdate.clear();
+		}
+
+		int len = send(cl.sock, (const char *)cl.outbuf.Data(), cl.outbuf.Size(), SEND_FLAGS);
+		if (len == SOCKET_ERROR) {
+			if (!socketWouldBlock()) cl.dead = true;
+			return;
+		}
+		cl.outbuf.Consume(len);
 	}
-	return true;
 }
 
-static void encodeString(std::vector<uint8_t>& buf, std::string val) {
-	encodeRaw32(buf, (uint32_t)val.size());
-	for (char c : val) {
-		buf.push_back(c);
+// Must be called with g_connections_mutex held.
+static void queueSend(ConnectionData &cl, const std::vector<uint8_t> &buf) {
+	if (cl.dead) return;
+
+	if (cl.outbuf.Size() + buf.size() > MAX_TAS_OUTBOUND_QUEUE) {
+		THREAD_PRINT("TAS protocol client is not keeping up; disconnecting it.\n");
+		cl.dead = true;
+		return;
+	}
+
+	if (!cl.pendingTickUpdate.empty()) {
+		// keep the held-back update ordered before anything newer
+		cl.outbuf.Append(cl.pendingTickUpdate.data(), cl.pendingTickUpdate.size());
+		cl.pendingTickUpdate.clear();
 	}
+
+	cl.outbuf.Append(buf.data(), buf.size());
+	flushConnection(cl);
+}
+
+// Per-tick updates are superseded by the next tick's, so while a client is
+// backed up we only keep the newest one instead of queueing all of them.
+// Must be called with g_connections_mutex held.
+static void queueTickUpdate(ConnectionData &cl, std::vector<uint8_t> &&buf) {
+	if (sar_tas_protocol_coalesce.GetBool() && !cl.outbuf.Empty()) {
+		cl.pendingTickUpdate = std::move(buf);
+		return;
+	}
+	queueSend(cl, buf);
 }
 
+// Must be called with g_connections_mutex held.
 static void sendAll(const std::vector<uint8_t> &buf) {
 	for (auto &cl : g_connections) {
-		send(cl.sock, (const char *)buf.data(), buf.size(), 0);
+		queueSend(cl, buf);
 	}
 }
 
+// }}}
+
 static void fullUpdate(TasProtocol::ConnectionData &cl, bool first_packet = false) {
 	std::vector<uint8_t> buf;
 
@@ -171,7 +299,7 @@ static void fullUpdate(TasProtocol::ConnectionData &cl, bool first_packet = fals
 	buf.push_back(SEND_DEBUG_TICK);
 	encodeRaw32(buf, (uint32_t)g_last_debug_tick);
 
-	send(cl.sock, (const char *)buf.data(), buf.size(), 0);
+	queueSend(cl, buf);
 }
 
 static void update() {
@@ -180,6 +308,8 @@ static void update() {
 	int debug_tick = g_current_debug_tick;
 	g_status_mutex.unlock();
 
+	std::lock_guard<std::mutex> lock(g_connections_mutex);
+
 	if (status.active != g_last_status.active || status.tas_path[0] != g_last_status.tas_path[0] || status.tas_path[1] != g_last_status.tas_path[1]) {
 		// big change; we might as well just do a full update
 		g_last_status = status;
@@ -235,94 +365,97 @@ static void update() {
 // returns 0 if command has been handled properly
 // returns 1 if there's no data to fully process a command
 // returns 2 if bad command is received
+// fields are read in place; the command is only consumed once it's complete
 static int processCommand(ConnectionData &cl) {
-	std::deque<uint8_t> copy = cl.cmdbuf;
+	MsgReader r{cl.cmdbuf.Data(), cl.cmdbuf.Data() + cl.cmdbuf.Size()};
 
 	uint8_t packetId;
-	if (popByte(cl.cmdbuf, packetId)) switch (packetId) {
+	if (!r.Byte(packetId)) return 1;
+
+	switch (packetId) {
 
 	case RECV_PLAY_SCRIPT: {
 		std::string filename1;
 		std::string filename2;
 
-		if (!popString(cl.cmdbuf, filename1)) break;
-		if (!popString(cl.cmdbuf, filename2)) break;
+		if (!r.String(filename1)) return 1;
+		if (!r.String(filename2)) return 1;
 
 		Scheduler::OnMainThread([=](){
 			tasPlayer->PlayFile(filename1, filename2);
 		});
 		
-		return 0;
+		break;
 	}
 	case RECV_STOP: {
 		Scheduler::OnMainThread([=](){
 			tasPlayer->Stop(true);
 		});
 
-		return 0;
+		break;
 	}
 	case RECV_PLAYBACK_RATE: {
 		float rate;
 
-		popRawFloat(cl.cmdbuf, rate);
+		if (!r.Float(rate)) return 1;
 
 		Scheduler::OnMainThread([=](){
 			sar_tas_playback_rate.SetValue(rate);
 		});
 		
-		return 0;
+		break;
 	}
 	case RECV_RESUME: {
 		Scheduler::OnMainThread([=]() {
 			tasPlayer->Resume();
 		});
 
-		return 0;
+		break;
 	}
 	case RECV_PAUSE: {
 		Scheduler::OnMainThread([=]() {
 			tasPlayer->Pause();
 		});
 
-		return 0;
+		break;
 	}
 	case RECV_FAST_FORWARD: {
 		int tick;
-		bool pause_after;
+		uint8_t pause_after;
 
-		if (!popRaw32(cl.cmdbuf, (uint32_t &)tick)) break;
-		if (!popByte(cl.cmdbuf, (uint8_t &)pause_after)) break;
+		if (!r.Raw32((uint32_t &)tick)) return 1;
+		if (!r.Byte(pause_after)) return 1;
 		
 		Scheduler::OnMainThread([=]() {
 			sar_tas_skipto.SetValue(tick);
 			if (pause_after) sar_tas_pauseat.SetValue(tick);
 		});
-		return 0;
+		break;
 	}
 	case RECV_SET_PAUSE_TICK: {
 		int tick;
 
-		if (!popRaw32(cl.cmdbuf, (uint32_t &)tick)) break;
+		if (!r.Raw32((uint32_t &)tick)) return 1;
 
 		Scheduler::OnMainThread([=]() {
 			sar_tas_pauseat.SetValue(tick);
 		});
-		return 0;
+		break;
 	}
 	case RECV_ADVANCE_TICK: {
 		Scheduler::OnMainThread([]() {
 			tasPlayer->AdvanceFrame();
 		});
-		return 0;
+		break;
 	}
 	case RECV_MESSAGE: {
 		std::string message;
 
-		if (!popString(cl.cmdbuf, message)) break;
+		if (!r.String(message)) return 1;
 
 		THREAD_PRINT("[TAS Protocol] %s\n", message.c_str());
 
-		return 0;
+		break;
 	}
 	case RECV_PLAY_SCRIPT_PROTOCOL: {
 
@@ -331,51 +464,52 @@ static int processCommand(ConnectionData &cl) {
 		std::string slot1Name;
 		std::string slot1Script;
 
-		if (!popString(cl.cmdbuf, slot0Name)) break;
-		if (!popString(cl.cmdbuf, slot0Script)) break;
-		if (!popString(cl.cmdbuf, slot1Name)) break;
-		if (!popString(cl.cmdbuf, slot1Script)) break;
+		if (!r.String(slot0Name)) return 1;
+		if (!r.String(slot0Script)) return 1;
+		if (!r.String(slot1Name)) return 1;
+		if (!r.String(slot1Script)) return 1;
 
 		Scheduler::OnMainThread([=]() {
 			tasPlayer->PlayScript(slot0Name, slot0Script, slot1Name, slot1Script);
 		});
 
-		return 0;
+		break;
 	}
 	case RECV_ENTITY_INFO:
 	case RECV_SET_CONT_ENTITY_INFO: {
 		std::string entSelector;
 
-		if (!popString(cl.cmdbuf, entSelector)) break;
+		if (!r.String(entSelector)) return 1;
 
 		if (packetId == RECV_SET_CONT_ENTITY_INFO) {
 			cl.contInfoEntSelector = entSelector;
 		} else {
-			SendEntityInfo(cl, entSelector);
+			SendEntityInfo(cl.sock, entSelector);
 		}
-		return 0;
+		break;
 	}
 	default:
 		// Bad command - disconnect
 		return 2; 
 	}
 
-	// command hasn't been fully read - recover to the copy
-	cl.cmdbuf = copy;
-	return 1;
+	cl.cmdbuf.Consume(r.cur - cl.cmdbuf.Data());
+	return 0;
 }
 
 static bool receiveFromConnection(TasProtocol::ConnectionData &cl) {
-	char buf[1024];
-	int len = recv(cl.sock, buf, sizeof buf, 0);
+	// receive straight into the command buffer
+	uint8_t *buf = cl.cmdbuf.Reserve(TAS_RECV_CHUNK);
+	int len = recv(cl.sock, (char *)buf, TAS_RECV_CHUNK, 0);
+	cl.cmdbuf.Commit(len > 0 ? len : 0);
+
+	if (len == SOCKET_ERROR && socketWouldBlock()) return true;
 
 	if (len == 0 || len == SOCKET_ERROR) {  // Connection closed or errored
 		closesocket(cl.sock);
 		return false;
 	}
 
-	cl.cmdbuf.insert(cl.cmdbuf.end(), std::begin(buf), std::begin(buf) + len);
-
 	while (true) {
 		int result = processCommand(cl);
 
@@ -462,8 +596,13 @@ static bool attemptConnectionToServer() {
 		return false;
 	}
 
-	g_connections.push_back({clientSocket, {}});
-	fullUpdate(g_connections[g_connections.size() - 1], true);
+	setNonBlocking(clientSocket);
+
+	g_connections_mutex.lock();
+	g_connections.push_back({clientSocket});
+	fullUpdate(g_connections.back(), true);
+	g_connections_mutex.unlock();
+
 	THREAD_PRINT("Successfully connected to TAS server %s:%d.\n", ip.c_str(), port);
 
 	return true;
@@ -471,43 +610,61 @@ static bool attemptConnectionToServer() {
 
 static void processConnections(bool is_server) {
 	fd_set set;
+	fd_set writeSet;
 	FD_ZERO(&set);
+	FD_ZERO(&writeSet);
 
 	SOCKET max = g_listen_sock;
 
 	if (is_server) {
 		FD_SET(g_listen_sock, &set);
 	}
-	for (auto client : g_connections) {
+
+	g_connections_mutex.lock();
+	for (auto &client : g_connections) {
 		FD_SET(client.sock, &set);
+		if (!client.outbuf.Empty()) FD_SET(client.sock, &writeSet);
 		if (max < client.sock) max = client.sock;
 	}
+	g_connections_mutex.unlock();
 
 	// 0.05s timeout
 	timeval tv;
 	tv.tv_sec = 0;
 	tv.tv_usec = 50000;
 
-	int nsock = select(max + 1, &set, nullptr, nullptr, &tv);
-	if (nsock == SOCKET_ERROR || !nsock) {
+	int nsock = select(max + 1, &set, &writeSet, nullptr, &tv);
+	if (nsock == SOCKET_ERROR) {
 		return;
 	}
 
-	if (is_server && FD_ISSET(g_listen_sock, &set)) {
+	std::lock_guard<std::mutex> lock(g_connections_mutex);
+
+	if (nsock && is_server && FD_ISSET(g_listen_sock, &set)) {
 		SOCKET cl = accept(g_listen_sock, nullptr, nullptr);
 		if (cl != INVALID_SOCKET) {
-			g_connections.push_back({ cl, {} });
+			setNonBlocking(cl);
+			g_connections.push_back({ cl });
 			THREAD_PRINT("A controller connected to TAS server. Number of controllers: %d\n", g_connections.size());
-			fullUpdate(g_connections[g_connections.size() - 1], true);
+			fullUpdate(g_connections.back(), true);
 		}
 	}
 
 	for (size_t i = 0; i < g_connections.size(); ++i) {
 		auto &cl = g_connections[i];
 
-		if (!FD_ISSET(cl.sock, &set)) continue;
+		bool alive = !cl.dead;
+		if (alive && nsock && FD_ISSET(cl.sock, &writeSet)) {
+			flushConnection(cl);
+			alive = !cl.dead;
+		}
+		if (alive && nsock && FD_ISSET(cl.sock, &set)) {
+			alive = receiveFromConnection(cl);
+		} else if (!alive) {
+			closesocket(cl.sock);
+		}
 
-		if (!receiveFromConnection(cl)) {
+		if (!alive) {
 			g_connections.erase(g_connections.begin() + i);
 			--i;
 
@@ -559,10 +716,12 @@ static void mainThread() {
 		THREAD_PRINT("Stopping TAS client\n");
 	}
 
+	g_connections_mutex.lock();
 	for (auto &cl : g_connections) {
 		closesocket(cl.sock);
 	}
 	g_connections.clear();
+	g_connections_mutex.unlock();
 
 	closesocket(g_listen_sock);
 	WSACleanup();
@@ -608,25 +767,55 @@ ON_EVENT_P(SAR_UNLOAD, -100) {
 	if (g_net_thread.joinable()) g_net_thread.join();
 }
 
+static void encodeEntityInfo(std::vector<uint8_t> &buf, const std::string &entSelector) {
+	buf.push_back(SEND_ENTITY_INFO);
+
+	CEntInfo *entInfo = entityList->QuerySelector(entSelector.c_str());
+	if (entInfo != NULL) {
+		buf.push_back(1);
+		ServerEnt *ent = (ServerEnt *)entInfo->m_pEntity;
+
+		Vector position = ent->abs_origin();
+		encodeRawFloat(buf, position.x);
+		encodeRawFloat(buf, position.y);
+		encodeRawFloat(buf, position.z);
+
+		QAngle angles = ent->abs_angles();
+		encodeRawFloat(buf, angles.x);
+		encodeRawFloat(buf, angles.y);
+		encodeRawFloat(buf, angles.z);
+
+		Vector velocity = ent->abs_velocity();
+		encodeRawFloat(buf, velocity.x);
+		encodeRawFloat(buf, velocity.y);
+		encodeRawFloat(buf, velocity.z);
+
+	} else {
+		buf.push_back(0);
+	}
+}
+
 void TasProtocol::SetStatus(Status s) {
 	g_status_mutex.lock();
 	g_current_status = s;
 	g_status_mutex.unlock();
 
 	if (s.active) {
+		std::lock_guard<std::mutex> lock(g_connections_mutex);
 		for (auto &cl : g_connections) {
 			if (cl.contInfoEntSelector.length() == 0) continue;
 
 			std::vector<uint8_t> buf{SEND_CURRENT_TICK};
 			encodeRaw32(buf, s.playback_tick);
-			send(cl.sock, (const char *)buf.data(), buf.size(), 0);
-			SendEntityInfo(cl, cl.contInfoEntSelector);
+			encodeEntityInfo(buf, cl.contInfoEntSelector);
+			queueTickUpdate(cl, std::move(buf));
 		}
 	}
 }
 
 void TasProtocol::SendProcessedScript(uint8_t slot, std::string scriptString) {
 	std::vector<uint8_t> buf;
+	buf.reserve(scriptString.size() + 6);
 
 	buf.push_back(SEND_PROCESSED_SCRIPT);
 
@@ -636,44 +825,30 @@ void TasProtocol::SendProcessedScript(uint8_t slot, std::string scriptString) {
 	// script
 	encodeString(buf, scriptString);
 
+	std::lock_guard<std::mutex> lock(g_connections_mutex);
 	sendAll(buf);
 }
 
-void TasProtocol::SendEntityInfo(TasProtocol::ConnectionData &conn, std::string entSelector) {
-	std::vector<uint8_t> buf;
-	buf.push_back(SEND_ENTITY_INFO);
-
-	CEntInfo *entInfo = entityList->QuerySelector(entSelector.c_str());
-	if (entInfo != NULL) {
-		buf.push_back(1);
-		ServerEnt *ent = (ServerEnt *)entInfo->m_pEntity;
+// The entity list is main thread only, so the lookup happens there and
+// the reply is queued for whichever connection still has this socket.
+void TasProtocol::SendEntityInfo(SOCKET sock, std::string entSelector) {
+	Scheduler::OnMainThread([=]() {
+		std::vector<uint8_t> buf;
+		encodeEntityInfo(buf, entSelector);
 
-		Vector position = ent->abs_origin();
-		encodeRawFloat(buf, position.x);
-		encodeRawFloat(buf, position.y);
-		encodeRawFloat(buf, position.z);
-
-		QAngle angles = ent->abs_angles();
-		encodeRawFloat(buf, angles.x);
-		encodeRawFloat(buf, angles.y);
-		encodeRawFloat(buf, angles.z);
-
-		Vector velocity = ent->abs_velocity();
-		encodeRawFloat(buf, velocity.x);
-		encodeRawFloat(buf, velocity.y);
-		encodeRawFloat(buf, velocity.z);
-
-	} else {
-		buf.push_back(0);
-	}
-
-	send(conn.sock, (const char *)buf.data(), buf.size(), 0);
+		std::lock_guard<std::mutex> lock(g_connections_mutex);
+		for (auto &cl : g_connections) {
+			if (cl.sock == sock) queueSend(cl, buf);
+		}
+	});
 }
 
 void TasProtocol::SendTextMessage(std::string message) {
 	std::vector<uint8_t> buf;
 	buf.push_back(SEND_MESSAGE);
 	encodeString(buf, message);
+
+	std::lock_guard<std::mutex> lock(g_connections_mutex);
 	sendAll(buf);
 }
 
@@ -743,3 +918,230 @@ CON_COMMAND(sar_tas_protocol_send_msg, "sar_tas_protocol_send_msg <message> - se
 	
 	TasProtocol::SendTextMessage(args[1]);
 }
+
+// Self test {{{
+
+// Connects a mock client over loopback and floods it through the same
+// queueing and flushing code the server uses. Our send buffer is kept
+// tiny, so sends are partial or would block almost immediately.
+
+static bool loopbackPair(SOCKET &ours, SOCKET &peer) {
+	SOCKET listener = socket(AF_INET, SOCK_STREAM, 0);
+	if (listener == INVALID_SOCKET) return false;
+
+	sockaddr_in addr{};
+	addr.sin_family = AF_INET;
+	addr.sin_port = 0;
+	inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+	socklen_t len = sizeof addr;
+
+	peer = INVALID_SOCKET;
+	ours = INVALID_SOCKET;
+	if (bind(listener, (sockaddr *)&addr, sizeof addr) != SOCKET_ERROR && listen(listener, 1) != SOCKET_ERROR && getsockname(listener, (sockaddr *)&addr, &len) != SOCKET_ERROR) {
+		peer = socket(AF_INET, SOCK_STREAM, 0);
+		if (peer != INVALID_SOCKET && connect(peer, (sockaddr *)&addr, sizeof addr) != SOCKET_ERROR) {
+			ours = accept(listener, nullptr, nullptr);
+		}
+	}
+	closesocket(listener);
+
+	if (ours == INVALID_SOCKET) {
+		if (peer != INVALID_SOCKET) closesocket(peer);
+		return false;
+	}
+
+	int size = 4096;
+	setsockopt(ours, SOL_SOCKET, SO_SNDBUF, (const char *)&size, sizeof size);
+	setNonBlocking(ours);
+	return true;
+}
+
+struct SelftestMsg {
+	uint8_t id;
+	uint32_t tick;
+	std::string text;
+};
+
+// Flushes everything queued on cl, then a marker message, reading them all
+// on peer. Returns false if the connection died or stalled
+static bool selftestDrain(ConnectionData &cl, SOCKET peer, std::vector<SelftestMsg> &out) {
+	std::vector<uint8_t> marker{SEND_MESSAGE};
+	encodeString(marker, "end");
+	queueSend(cl, marker);
+
+	ByteQueue in;
+	auto start = std::chrono::steady_clock::now();
+	while (true) {
+		flushConnection(cl);
+		if (cl.dead) return false;
+		if (std::chrono::steady_clock::now() - start > std::chrono::seconds(10)) return false;
+
+		fd_set set;
+		FD_ZERO(&set);
+		FD_SET(peer, &set);
+		timeval tv{0, 10000};
+		if (select(peer + 1, &set, nullptr, nullptr, &tv) <= 0) continue;
+
+		uint8_t *dst = in.Reserve(TAS_RECV_CHUNK);
+		int len = recv(peer, (char *)dst, TAS_RECV_CHUNK, 0);
+		in.Commit(len > 0 ? len : 0);
+		if (len <= 0) return false;
+
+		while (true) {
+			MsgReader r{in.Data(), in.Data() + in.Size()};
+			SelftestMsg msg{};
+			if (!r.Byte(msg.id)) break;
+			bool complete;
+			if (msg.id == SEND_MESSAGE) {
+				complete = r.String(msg.text);
+			} else if (msg.id == SEND_CURRENT_TICK) {
+				complete = r.Raw32(msg.tick);
+			} else {
+				return false;
+			}
+			if (!complete) break;
+			in.Consume(r.cur - in.Data());
+
+			if (msg.id == SEND_MESSAGE && msg.text == "end") return true;
+			out.push_back(msg);
+		}
+	}
+}
+
+static std::string selftestText(int seq) {
+	std::string text = Utils::ssprintf("%d|", seq);
+	text.resize(text.size() + (seq * 37) % 4096, 'a' + seq % 26);
+	return text;
+}
+
+CON_COMMAND(sar_tas_protocol_selftest, "sar_tas_protocol_selftest - floods a loopback mock client through the TAS protocol send queue and checks message order, coalescing and the slow client disconnect\n") {
+#ifdef _WIN32
+	WSADATA wsa_data;
+	if (WSAStartup(MAKEWORD(2, 2), &wsa_data)) return console->Print("WSAStartup failed\n");
+#endif
+	std::string coalesce = sar_tas_protocol_coalesce.GetString();
+	sar_tas_protocol_coalesce.SetValue(1);
+
+	bool ok = true;
+	auto check = [&](bool cond, const char *what) {
+		console->Print("%s: %s\n", what, cond ? "ok" : "FAILED");
+		ok &= cond;
+	};
+
+	// Bulk messages, queued without the client reading, then drained
+	{
+		ConnectionData cl{};
+		SOCKET peer;
+		if (!loopbackPair(cl.sock, peer)) {
+			check(false, "Loopback connection");
+		} else {
+			const int count = 2000;
+			int backedUp = 0;
+			size_t bytes = 0;
+			auto start = std::chrono::steady_clock::now();
+			for (int seq = 0; seq < count; ++seq) {
+				std::vector<uint8_t> buf{SEND_MESSAGE};
+				encodeString(buf, selftestText(seq));
+				bytes += buf.size();
+				queueSend(cl, buf);
+				if (!cl.outbuf.Empty()) ++backedUp;
+			}
+
+			std::vector<SelftestMsg> msgs;
+			bool drained = selftestDrain(cl, peer, msgs);
+			float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+			bool inOrder = msgs.size() == count;
+			for (int seq = 0; inOrder && seq < count; ++seq) {
+				inOrder = msgs[seq].id == SEND_MESSAGE && msgs[seq].text == selftestText(seq);
+			}
+			console->Print("%d messages, %.2f MiB in %.1fms; %d sends left data queued\n", count, bytes / 1048576.0f, ms, backedUp);
+			check(backedUp > 0, "Partial and blocked sends");
+			check(drained && inOrder, "Bulk messages arrive complete and in order");
+
+			closesocket(cl.sock);
+			closesocket(peer);
+		}
+	}
+
+	// Per-tick updates interleaved with messages while backed up: only the
+	// newest tick is held back, and never reordered past a later message
+	{
+		ConnectionData cl{};
+		SOCKET peer;
+		if (!loopbackPair(cl.sock, peer)) {
+			check(false, "Loopback connection");
+		} else {
+			const int steps = 1000;
+			for (int step = 0; step < steps; ++step) {
+				std::vector<uint8_t> tick{SEND_CURRENT_TICK};
+				encodeRaw32(tick, step);
+				queueTickUpdate(cl, std::move(tick));
+				if (step % 10 == 0) {
+					std::vector<uint8_t> buf{SEND_MESSAGE};
+					encodeString(buf, selftestText(step));
+					queueSend(cl, buf);
+				}
+			}
+
+			std::vector<SelftestMsg> msgs;
+			bool drained = selftestDrain(cl, peer, msgs);
+
+			// tick n is queued just before message n, so every tick before
+			// message n is at most n and every tick after it is above n
+			int ticks = 0, lastTick = -1, lastMsg = -1, nextMsg = 0;
+			bool ordered = true;
+			for (auto &msg : msgs) {
+				if (msg.id == SEND_CURRENT_TICK) {
+					ordered &= (int)msg.tick > lastTick && (int)msg.tick > lastMsg && (int)msg.tick <= nextMsg;
+					lastTick = msg.tick;
+					++ticks;
+				} else {
+					ordered &= msg.text == selftestText(nextMsg) && lastTick <= nextMsg;
+					lastMsg = nextMsg;
+					nextMsg += 10;
+				}
+			}
+
+			console->Print("%d tick updates queued, %d sent\n", steps, ticks);
+			check(drained && nextMsg == steps, "Messages survive coalescing");
+			check(ordered, "Tick updates stay ordered around messages");
+			check(lastTick == steps - 1, "The newest tick update is delivered");
+			check(ticks < steps, "Tick updates are coalesced while backed up");
+
+			closesocket(cl.sock);
+			closesocket(peer);
+		}
+	}
+
+	// A client that never reads is dropped once the queue limit is reached
+	{
+		ConnectionData cl{};
+		SOCKET peer;
+		if (!loopbackPair(cl.sock, peer)) {
+			check(false, "Loopback connection");
+		} else {
+			std::vector<uint8_t> buf{SEND_MESSAGE};
+			encodeString(buf, std::string(65536, 'x'));
+			size_t queued = 0;
+			while (!cl.dead && queued < 2 * MAX_TAS_OUTBOUND_QUEUE) {
+				queueSend(cl, buf);
+				queued += buf.size();
+			}
+
+			console->Print("Disconnected after %.2f MiB, %.2f MiB still queued\n", queued / 1048576.0f, cl.outbuf.Size() / 1048576.0f);
+			check(cl.dead && cl.outbuf.Size() <= MAX_TAS_OUTBOUND_QUEUE, "Slow client is dropped at the queue limit");
+
+			closesocket(cl.sock);
+			closesocket(peer);
+		}
+	}
+
+	sar_tas_protocol_coalesce.SetValue(coalesce.c_str());
+#ifdef _WIN32
+	WSACleanup();
+#endif
+	console->Print("%s\n", ok ? "TAS protocol self test passed" : "TAS protocol self test FAILED");
+}
+
+// }}}
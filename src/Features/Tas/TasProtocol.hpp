@@ -2,7 +2,7 @@
 
 #include <string>
 #include <cstdint>
-#include <deque>
+#include <vector>
 
 // defining socket here manually because
 // for unknown reasons winsock cannot be included here
@@ -58,15 +58,41 @@ namespace TasProtocol {
 		int playback_tick;
 	};
 
+	// Contiguous byte queue: appends at the back, consumes from a head offset
+	// and only compacts once the consumed prefix dominates, so messages can
+	// be parsed and sent straight out of the buffer.
+	class ByteQueue {
+	public:
+		inline const uint8_t *Data() const { return data.data() + head; }
+		inline size_t Size() const { return data.size() - head; }
+		inline bool Empty() const { return Size() == 0; }
+
+		void Append(const uint8_t *bytes, size_t len);
+		// Returns space for up to len bytes at the back; Commit how many were written
+		uint8_t *Reserve(size_t len);
+		void Commit(size_t len);
+		void Consume(size_t len);
+		void Clear();
+
+	private:
+		std::vector<uint8_t> data;
+		size_t head = 0;
+		size_t reserved = 0;
+	};
+
 	struct ConnectionData {
 		SOCKET sock;
-		std::deque<uint8_t> cmdbuf;
+		ByteQueue cmdbuf;
+		ByteQueue outbuf;
+		// latest per-tick update, held back while outbuf is backed up
+		std::vector<uint8_t> pendingTickUpdate;
+		bool dead = false;
 		std::string contInfoEntSelector;
 	};
 
 	void SetStatus(Status s);
 	void SendProcessedScript(uint8_t slot, std::string scriptString);
-	void SendEntityInfo(ConnectionData& conn, std::string entSelector);
+	void SendEntityInfo(SOCKET sock, std::string entSelector);
 	void SendTextMessage(std::string message);
 
 } // namespace TasProtocol
@@ -30,7 +30,7 @@ struct TasFramebulk {
 	std::vector<std::string> commands;
 	std::vector<TasToolCommand> toolCmds;
 
-	std::string ToString();
+	std::string ToString() const;
 };
 
 
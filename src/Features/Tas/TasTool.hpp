@@ -73,10 +73,13 @@ class TasToolCommand {
 public:
 	TasTool *tool;
 	std::shared_ptr<TasToolParams> params;
+	// source arguments the params were parsed from; kept for compiled scripts
+	std::vector<std::string> args;
 
-	TasToolCommand(TasTool *tool, std::shared_ptr<TasToolParams> params)
+	TasToolCommand(TasTool *tool, std::shared_ptr<TasToolParams> params, std::vector<std::string> args = {})
 		: tool(tool)
-		, params(params) {}
+		, params(params)
+		, args(std::move(args)) {}
 
 	~TasToolCommand() {}
 };
@@ -55,7 +55,7 @@ void CheckTool::Apply(TasFramebulk &fb, const TasPlayerInfo &info) {
 	if (params.holding) {
 		auto player = server->GetPlayer(info.slot + 1);
 		if (player) {
-			auto held = player->field<CBaseHandle>("m_hAttachedObject");
+			auto held = player->field<CBaseHandle>(ENT_FIELD("m_hAttachedObject"));
 			if (held) {
 				if (params.holding.value().size() != 0) {
 					CEntInfo *entity = entityList->QuerySelector(params.holding.value().c_str());
@@ -18,7 +18,7 @@ void ShootTool::Apply(TasFramebulk &bulk, const TasPlayerInfo &pInfo) {
 		uintptr_t portalgun = (uintptr_t)entityList->LookupEntity(SE(player)->active_weapon());
 		if (!portalgun) return;
 
-		float nextPrimaryAttack = SE(portalgun)->field<float>("m_flNextPrimaryAttack");
+		float nextPrimaryAttack = SE(portalgun)->field<float>(ENT_FIELD("m_flNextPrimaryAttack"));
 
 		float currTime = pInfo.tick * pInfo.ticktime;
 
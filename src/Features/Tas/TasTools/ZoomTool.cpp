@@ -15,7 +15,7 @@ void ZoomTool::Apply(TasFramebulk &bulk, const TasPlayerInfo &pInfo) {
 
 		if (player == nullptr || (int)player == -1) return;
 
-		bool isZoomedIn = SE(player)->field<CBaseHandle>("m_hZoomOwner");
+		bool isZoomedIn = SE(player)->field<CBaseHandle>(ENT_FIELD("m_hZoomOwner"));
 
 		if (
 			(params.zoomType == ZoomType::In && !isZoomedIn) ||
@@ -88,13 +88,13 @@ void Teleporter::SaveLocal(int slot, QAngle ang) {
 
 	auto portalGun = entityList->LookupEntity(player->active_weapon());
 	if (portalGun) {
-		unsigned char linkage = SE(portalGun)->field<unsigned char>("m_iPortalLinkageGroupID");
+		unsigned char linkage = SE(portalGun)->field<unsigned char>(ENT_FIELD("m_iPortalLinkageGroupID"));
 		void *bluePortal = (void *)server->FindPortal(linkage, false, false);
 		void *orangePortal = (void *)server->FindPortal(linkage, true, false);
 		for (int i = 0; i < 2; ++i) {
 			auto portal = i == 0 ? bluePortal : orangePortal;
 			location.portals[i].linkage = linkage;
-			if (portal && SE(portal)->field<bool>("m_bActivated")) {
+			if (portal && SE(portal)->field<bool>(ENT_FIELD("m_bActivated"))) {
 				location.portals[i].pos = server->GetAbsOrigin(portal);
 				location.portals[i].ang = server->GetAbsAngles(portal);
 				location.portals[i].isSet = true;
@@ -131,8 +131,8 @@ void Teleporter::TeleportLocal(int slot, bool portals) {
 	uintptr_t player = (uintptr_t)server->GetPlayer(slot + 1);
 	if (!player) return;
 
-	SE(player)->field<Vector>("m_vecVelocity") = location.velocity;
-	SE(player)->field<int>("m_iEFlags") |= (1<<12); // EFL_DIRTY_ABSVELOCITY
+	SE(player)->field<Vector>(ENT_FIELD("m_vecVelocity")) = location.velocity;
+	SE(player)->field<int>(ENT_FIELD("m_iEFlags")) |= (1<<12); // EFL_DIRTY_ABSVELOCITY
 
 	char setpos[64];
 	std::snprintf(setpos, sizeof(setpos), "setpos_player %d %f %f %f", slot + 1, location.origin.x, location.origin.y, location.origin.z);
@@ -155,7 +155,7 @@ void Teleporter::TeleportLocal(int slot, bool portals) {
 				engine->ExecuteCommand(cmd.c_str());
 			} else {
 				auto portal = server->FindPortal(location.portals[i].linkage, i == 1, false);
-				if (portal) SE(portal)->field<bool>("m_bActivated") = false;
+				if (portal) SE(portal)->field<bool>(ENT_FIELD("m_bActivated")) = false;
 			}
 		}
 	}
@@ -12,8 +12,7 @@ Variable sar_allow_resizing_window("sar_allow_resizing_window", "0", 0, 1, "EXPE
 static HWND g_windowHandle = NULL;
 #endif
 
-ON_EVENT(FRAME) {
-	if (!sar_allow_resizing_window.GetBool()) return;
+ON_EVENT_IF(FRAME, sar_allow_resizing_window) {
 
 #ifndef _WIN32
 	console->Print("sar_allow_resizing_window is currently working for Windows only.");
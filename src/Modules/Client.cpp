@@ -234,7 +234,7 @@ CMStatus Client::GetChallengeStatus() {
 		return CMStatus::NONE;
 	}
 
-	int bonusChallenge = player->field<int>("m_iBonusChallenge");
+	int bonusChallenge = player->field<int>(ENT_FIELD("m_iBonusChallenge"));
 
 	if (bonusChallenge) {
 		return CMStatus::CHALLENGE;
@@ -266,9 +266,9 @@ Vector Client::GetPlayerSize(bool ducked) {
 	auto player = client->GetPlayer(1);
 	if (!player) return {32, 32, 72};
 	if (ducked) {
-		return player_size_ducked = player->field<Vector>("m_DuckHullMax") - player->field<Vector>("m_DuckHullMin");
+		return player_size_ducked = player->field<Vector>(ENT_FIELD("m_DuckHullMax")) - player->field<Vector>(ENT_FIELD("m_DuckHullMin"));
 	} else {
-		return player_size_standing = player->field<Vector>("m_StandHullMax") - player->field<Vector>("m_StandHullMin");
+		return player_size_standing = player->field<Vector>(ENT_FIELD("m_StandHullMax")) - player->field<Vector>(ENT_FIELD("m_StandHullMin"));
 	}
 }
 
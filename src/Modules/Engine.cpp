@@ -255,7 +255,7 @@ bool Engine::IsSplitscreen() {
 		if (!player) continue;
 
 		// m_hSplitScreenPlayers
-		auto &splitscreen_players = player->fieldOff<CUtlVector<CBaseHandle>>("m_szLastPlaceName", 40);
+		auto &splitscreen_players = player->fieldOff<CUtlVector<CBaseHandle>>(ENT_FIELD("m_szLastPlaceName"), 40);
 		if (splitscreen_players.m_Size > 0) return true;
 	}
 
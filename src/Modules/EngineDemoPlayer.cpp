@@ -365,12 +365,12 @@ void InterpolateDemoCommand_Detour(void *thisptr, int slot, int target_tick, Dem
 		// are we currently in a portal bubble?
 		ClientEnt *player = client->GetPlayer(slot + 1);
 		if (!player) return;
-		CBaseHandle portal_handle = player->field<CBaseHandle>("m_hPortalEnvironment");
+		CBaseHandle portal_handle = player->field<CBaseHandle>(ENT_FIELD("m_hPortalEnvironment"));
 		ClientEnt *portal_ent = client->GetPlayer(portal_handle.GetEntryIndex());
 		if (!portal_ent) return;
 
 		// we'll also need the linked portal later
-		CBaseHandle linked_handle = portal_ent->field<CBaseHandle>("m_hLinkedPortal");
+		CBaseHandle linked_handle = portal_ent->field<CBaseHandle>(ENT_FIELD("m_hLinkedPortal"));
 		ClientEnt *linked = client->GetPlayer(linked_handle.GetEntryIndex());
 		if (!linked) return;
 
@@ -427,8 +427,8 @@ void InterpolateDemoCommand_Detour(void *thisptr, int slot, int target_tick, Dem
 		//Vector exit_pos = exit->abs_origin();
 		Vector entry_norm = entry == portal_ent ? portal_norm : linked_norm;
 		//Vector exit_norm = exit == portal_ent ? portal_norm : linked_norm;
-		VMatrix forward_matrix = entry->field<VMatrix>("m_matrixThisToLinked");
-		VMatrix backward_matrix = exit->field<VMatrix>("m_matrixThisToLinked");
+		VMatrix forward_matrix = entry->field<VMatrix>(ENT_FIELD("m_matrixThisToLinked"));
+		VMatrix backward_matrix = exit->field<VMatrix>(ENT_FIELD("m_matrixThisToLinked"));
 
 		// we're pretty sure we're transitioning from entry to exit. as a
 		// sanity check, ensure that we start in front of entry and finish
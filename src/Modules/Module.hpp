@@ -4,8 +4,8 @@
 #include "Entity.hpp"
 
 #define DECL_M(name, type) type name(void *entity)
-#define SMDECL(name, type, field_name) type name(void *entity) { return SE(entity)->field<type>(#field_name); }
-#define CMDECL(name, type, field_name) type name(void *entity) { return CE(entity)->field<type>(#field_name); }
+#define SMDECL(name, type, field_name) type name(void *entity) { static EntField::Handle h(#field_name); return SE(entity)->field<type>(h); }
+#define CMDECL(name, type, field_name) type name(void *entity) { static EntField::Handle h(#field_name); return CE(entity)->field<type>(h); }
 
 class Module {
 public:
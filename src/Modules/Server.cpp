@@ -80,6 +80,7 @@ REDECL(Server::AirMove);
 REDECL(Server::AirMoveBase);
 REDECL(Server::GameFrame);
 REDECL(Server::ApplyGameSettings);
+REDECL(Server::OnAddEntity);
 REDECL(Server::OnRemoveEntity);
 REDECL(Server::PlayerRunCommand);
 REDECL(Server::ViewPunch);
@@ -136,9 +137,9 @@ float Server::GetCMTimer() {
 	if (!sv_player) {
 		ClientEnt *cl_player = client->GetPlayer(1);
 		if (!cl_player) return 0.0f;
-		return cl_player->field<float>("fNumSecondsTaken");
+		return cl_player->field<float>(ENT_FIELD("fNumSecondsTaken"));
 	}
-	return sv_player->field<float>("fNumSecondsTaken");
+	return sv_player->field<float>(ENT_FIELD("fNumSecondsTaken"));
 }
 
 // CGameMovement::CheckJumpButton
@@ -234,9 +235,9 @@ DETOUR(Server::PlayerMove) {
 	auto player = *reinterpret_cast<void **>((uintptr_t)thisptr + Offsets::player);
 	auto mv = *reinterpret_cast<const CHLMoveData **>((uintptr_t)thisptr + Offsets::mv);
 
-	auto m_fFlags = SE(player)->field<int>("m_fFlags");
-	auto m_MoveType = SE(player)->field<char>("m_MoveType");
-	auto m_nWaterLevel = SE(player)->field<char>("m_nWaterLevel");
+	auto m_fFlags = SE(player)->field<int>(ENT_FIELD("m_fFlags"));
+	auto m_MoveType = SE(player)->field<char>(ENT_FIELD("m_MoveType"));
+	auto m_nWaterLevel = SE(player)->field<char>(ENT_FIELD("m_nWaterLevel"));
 
 	auto stat = stats->Get(server->GetSplitScreenPlayerSlot(player));
 
@@ -464,7 +465,7 @@ DETOUR(Server::FinishGravity) {
 
 			auto m_pSurfaceData = *reinterpret_cast<uintptr_t *>(player + Offsets::m_pSurfaceData);
 			auto m_bDucked = SE(player)->ducked();
-			auto m_fFlags = SE(player)->field<int>("m_fFlags");
+			auto m_fFlags = SE(player)->field<int>(ENT_FIELD("m_fFlags"));
 
 			auto flGroundFactor = (m_pSurfaceData) ? *reinterpret_cast<float *>(m_pSurfaceData + Offsets::jumpFactor) : 1.0f;
 			auto flMul = std::sqrt(2 * sv_gravity.GetFloat() * GAMEMOVEMENT_JUMP_HEIGHT);
@@ -745,7 +746,14 @@ DETOUR(Server::ApplyGameSettings, KeyValues *pKV) {
 	return result;
 }
 
+DETOUR_T(void, Server::OnAddEntity, IHandleEntity *ent, CBaseHandle handle) {
+	entityList->OnEntityAdded(handle.GetEntryIndex());
+	return Server::OnAddEntity(thisptr, ent, handle);
+}
+
 DETOUR_T(void, Server::OnRemoveEntity, IHandleEntity *ent, CBaseHandle handle) {
+	entityList->OnEntityRemoved(handle.GetEntryIndex());
+
 	auto info = entityList->GetEntityInfoByIndex(handle.GetEntryIndex());
 	bool hasSerialChanged = false;
 	
@@ -865,6 +873,7 @@ bool Server::Init() {
 #endif
 
 		if (this->gEntList = Interface::Create((void *)((uintptr_t)this->m_EntPtrArray - 4))) {
+			this->gEntList->Hook(Server::OnAddEntity_Hook, Server::OnAddEntity, Offsets::OnAddEntity);
 			this->gEntList->Hook(Server::OnRemoveEntity_Hook, Server::OnRemoveEntity, Offsets::OnRemoveEntity);
 		}
 
@@ -1016,7 +1025,7 @@ CON_COMMAND(sar_give_fly, "sar_give_fly [n] - gives the player in slot n (0 by d
 	int slot = args.ArgC() == 2 ? atoi(args[1]) : 0;
 	void *player = server->GetPlayer(slot + 1);
 	if (player) {
-		SE(player)->field<float>("m_flGravity") = FLT_MIN;
+		SE(player)->field<float>(ENT_FIELD("m_flGravity")) = FLT_MIN;
 		console->Print("Gave fly to player %d\n", slot);
 	}
 }
@@ -1026,7 +1035,7 @@ CON_COMMAND(sar_give_betsrighter, "sar_give_betsrighter [n] - gives the player i
 	int slot = args.ArgC() == 2 ? atoi(args[1]) : 0;
 	ServerEnt *player = server->GetPlayer(slot + 1);
 	if (player) {
-		player->field<char>("m_takedamage") = 0;
+		player->field<char>(ENT_FIELD("m_takedamage")) = 0;
 		console->Print("Gave betsrighter to player %d\n", slot);
 	}
 }
@@ -1082,14 +1091,9 @@ CON_COMMAND(sar_paint_reseed, "sar_paint_reseed <seed> - re-seed all paint spray
 
 	unsigned count = 0;
 
-	for (int i = 0; i < Offsets::NUM_ENT_ENTRIES; ++i) {
+	for (int i : entityList->GetEntityIndicesByClassName("info_paint_sprayer")) {
 		void *ent = server->m_EntPtrArray[i].m_pEntity;
-		if (!ent) continue;
-
-		auto classname = server->GetEntityClassName(ent);
-		if (!classname || strcmp(classname, "info_paint_sprayer")) continue;
-
-		SE(ent)->field<int>("m_nBlobRandomSeed") = seed;
+		SE(ent)->field<int>(ENT_FIELD("m_nBlobRandomSeed")) = seed;
 		++count;
 	}
 
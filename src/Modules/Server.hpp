@@ -131,6 +131,9 @@ public:
 	// CServerGameDLL::ApplyGameSettings
 	DECL_DETOUR(ApplyGameSettings, KeyValues *pKV);
 
+	// CGlobalEntityList::OnAddEntity
+	DECL_DETOUR_T(void, OnAddEntity, IHandleEntity *ent, CBaseHandle handle);
+
 	// CGlobalEntityList::OnRemoveEntity
 	DECL_DETOUR_T(void, OnRemoveEntity, IHandleEntity *ent, CBaseHandle handle);
 
@@ -23,3 +23,20 @@
 namespace Offsets {
     #include "Offsets/Default.hpp"
 }
+
+#undef OFFSET_DEFAULT
+#undef OFFSET_EMPTY
+#undef SIGSCAN_DEFAULT
+#undef SIGSCAN_EMPTY
+
+#define OFFSET_DEFAULT(name, win, linux)
+#define OFFSET_EMPTY(name)
+
+#define SIGSCAN_DEFAULT(name, win, linux) if (name && *name) sigs.push_back(name);
+#define SIGSCAN_EMPTY(name) if (name && *name) sigs.push_back(name);
+
+std::vector<const char *> Offsets::GetSignatures() {
+    std::vector<const char *> sigs;
+    #include "Offsets/Default.hpp"
+    return sigs;
+}
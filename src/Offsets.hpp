@@ -10,9 +10,14 @@
 #define SIGSCAN_WINDOWS(name, sig)
 #define SIGSCAN_LINUX(name, sig)
 
+#include <vector>
+
 namespace Offsets {
     // All offset types should be defined here
     #include "Offsets/Default.hpp"
+
+    // Every signature of the loaded game, used to batch-resolve them per module
+    std::vector<const char *> GetSignatures();
 }
 
 #undef OFFSET_DEFAULT
@@ -209,6 +209,7 @@ OFFSET_DEFAULT(IsRestoring, 24, 24)
 OFFSET_DEFAULT(ShouldDraw, 11, 12)
 
 // CGlobalEntityList
+OFFSET_DEFAULT(OnAddEntity, 0, 0)
 OFFSET_DEFAULT(OnRemoveEntity, 1, 1)
 
 // CHud
@@ -4,6 +4,9 @@
 
 #include <cstring>
 #include <ctime>
+#include <fstream>
+#include <iterator>
+#include <vector>
 #include <curl/curl.h>
 
 #ifdef _WIN32
@@ -22,6 +25,7 @@
 #include "Hook.hpp"
 #include "Interface.hpp"
 #include "Modules.hpp"
+#include "Offsets.hpp"
 #include "Variable.hpp"
 
 SAR sar;
@@ -54,6 +58,7 @@ bool SAR::Load(CreateInterfaceFn interfaceFactory, CreateInterfaceFn gameServerF
 
 	if (this->game) {
 		this->game->LoadOffsets();
+		Memory::RegisterSignatures(Offsets::GetSignatures());
 
 		CrashHandler::Init();
 
@@ -102,6 +107,10 @@ bool SAR::Load(CreateInterfaceFn interfaceFactory, CreateInterfaceFn gameServerF
 			this->modules->InitAll();
 
 			SarInitHandler::RunAll();
+			Event::Finalize();
+
+			// Every module has been scanned by now; write any new results once
+			Memory::FlushSignatureCache();
 
 			if (engine && engine->hasLoaded) {
 				engine->demoplayer->Init();
@@ -219,6 +228,9 @@ void SAR::Unload() {
 
 	networkManager.Disconnect();
 
+	// Catch anything resolved after load
+	Memory::FlushSignatureCache();
+
 	Variable::ClearAllCallbacks();
 
 	Hook::DisableAll();
@@ -324,6 +336,40 @@ CON_COMMAND(sar_cvars_unlock, "sar_cvars_unlock - unlocks all special cvars\n")
 CON_COMMAND(sar_cvarlist, "sar_cvarlist - lists all SAR cvars and unlocked engine cvars\n") {
 	cvars->ListAll();
 }
+CON_COMMAND(sar_sigcache_stats, "sar_sigcache_stats - prints statistics about the signature scan cache\n") {
+	auto &stats = Memory::sigCacheStats;
+	console->Print("Cache file: %s\n", SIGNATURE_CACHE_FILE);
+	console->Print("Module hits: %d\n", stats.hits);
+	console->Print("Module misses: %d\n", stats.misses);
+	console->Print("Invalidated: %d\n", stats.invalidated);
+	console->Print("Signatures from cache: %d\n", stats.signatures);
+	console->Print("Time saved: %.2fms\n", stats.savedUs / 1000.0f);
+}
+CON_COMMAND(sar_sigscan_selftest, "sar_sigscan_selftest <file> - scans a file for every SAR signature, checks the compiled scanners against the original matcher and times them\n") {
+	if (args.ArgC() != 2) {
+		return console->Print(sar_sigscan_selftest.ThisPtr()->m_pszHelpString);
+	}
+
+	// The old matcher skips a match that starts inside a failed partial one
+	static const uint8_t overlap[] = {0x90, 0x55, 0x55, 0x55, 0x8B, 0xEC, 0x90};
+	auto res = Memory::ScanSelfTest(overlap, sizeof overlap, {"55 55 8B EC"});
+	bool ok = res.mismatches == 0 && res.found == 1 && res.legacyMissed == 1;
+	console->Print("Overlapping partial match: %s\n", ok ? "ok" : "FAILED");
+
+	std::ifstream file(args[1], std::ios::binary);
+	if (!file) {
+		return console->Print("Could not open %s\n", args[1]);
+	}
+	std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+	res = Memory::ScanSelfTest(data.data(), data.size(), Offsets::GetSignatures());
+	ok &= res.mismatches == 0;
+	console->Print("%d signatures over %.2f MiB: %d found, %d missed by the old matcher, %d mismatches\n", res.signatures, data.size() / 1048576.0f, res.found, res.legacyMissed, res.mismatches);
+	console->Print("Batch scan: %.2fms\n", res.batchUs / 1000.0f);
+	console->Print("Single scans: %.2fms\n", res.singleUs / 1000.0f);
+	console->Print("Old matcher: %.2fms\n", res.legacyUs / 1000.0f);
+	console->Print("%s\n", ok ? "Signature scan self test passed" : "Signature scan self test FAILED");
+}
 CON_COMMAND(sar_rename, "sar_rename <name> - changes your name\n") {
 	if (args.ArgC() != 2) {
 		return console->Print(sar_rename.ThisPtr()->m_pszHelpString);
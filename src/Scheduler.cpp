@@ -1,24 +1,260 @@
 #include "Scheduler.hpp"
+#include "Command.hpp"
 #include "Event.hpp"
+#include "Modules/Console.hpp"
 #include "Modules/Engine.hpp"
 #include "Features/Session.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <queue>
 #include <vector>
 #include <mutex>
 
-static std::vector<std::pair<int, std::function<void()>>> g_serverScheds;
-static std::vector<std::pair<int, std::function<void()>>> g_hostScheds;
-static std::vector<std::function<void()>> g_mainThreadScheds;
-static std::mutex g_mainThreadMutex;
+// Hierarchical timer wheel; each level has 64 slots, each covering 64
+// times as many ticks as a slot on the level below
+#define WHEEL_LEVELS 4
+#define WHEEL_SLOT_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_SLOT_BITS)
+#define WHEEL_SLOT_MASK (WHEEL_SLOTS - 1)
+// Past this many ticks at once, re-sort everything rather than stepping
+#define WHEEL_MAX_STEP (WHEEL_SLOTS * WHEEL_SLOTS)
 
-void Scheduler::InServerTicks(int ticks, std::function<void()> fn) {
-	if (!session->isRunning) return;
-	g_serverScheds.push_back({ session->GetTick() + ticks, fn });
+struct TimerEntry {
+	int due;
+	uint32_t seq; // order of scheduling, to break ties in due
+	uint32_t generation = 0;
+	bool pending = false;
+	bool cancelled = false;
+	std::function<void()> fn;
+};
+
+class TimerWheel {
+public:
+	uint32_t Add(int now, int ticks, std::function<void()> fn);
+	uint32_t Generation(uint32_t idx) const { return this->entries[idx].generation; }
+	bool Cancel(uint32_t idx, uint32_t generation);
+	void Run(int now);
+	void Clear();
+
+private:
+	int now = 0;
+	uint32_t nextSeq = 0;
+	size_t count = 0; // pending and not cancelled
+	std::vector<TimerEntry> entries;
+	std::vector<uint32_t> free;
+	std::vector<uint32_t> slots[WHEEL_LEVELS][WHEEL_SLOTS];
+	std::vector<uint32_t> far; // beyond the top level
+	std::vector<uint32_t> ready;
+
+	void Place(uint32_t idx);
+	void Release(uint32_t idx);
+	void Replace(std::vector<uint32_t> &list);
+	void Step();
+	void Rebuild(int now);
+};
+
+uint32_t TimerWheel::Add(int now, int ticks, std::function<void()> fn) {
+	// Nothing pending means nothing to keep in step with; jump straight
+	// to the current tick
+	if (this->count == 0) this->Clear();
+	if (this->count == 0 && this->ready.empty()) this->now = now;
+
+	uint32_t idx;
+	if (!this->free.empty()) {
+		idx = this->free.back();
+		this->free.pop_back();
+	} else {
+		idx = this->entries.size();
+		this->entries.emplace_back();
+	}
+
+	auto &e = this->entries[idx];
+	e.due = now + ticks;
+	e.seq = this->nextSeq++;
+	e.pending = true;
+	e.cancelled = false;
+	e.fn = std::move(fn);
+	this->count += 1;
+
+	this->Place(idx);
+	return idx;
+}
+
+bool TimerWheel::Cancel(uint32_t idx, uint32_t generation) {
+	if (idx >= this->entries.size()) return false;
+	auto &e = this->entries[idx];
+	if (!e.pending || e.cancelled || e.generation != generation) return false;
+
+	// Left in its slot; it's released when the wheel gets to it
+	e.cancelled = true;
+	e.fn = nullptr;
+	this->count -= 1;
+	return true;
+}
+
+void TimerWheel::Place(uint32_t idx) {
+	int due = this->entries[idx].due;
+	if (due <= this->now) {
+		this->ready.push_back(idx);
+		return;
+	}
+
+	// The level is the lowest one where the due tick and the current tick
+	// share a block, so entries only ever move down as time passes
+	uint32_t diff = (uint32_t)due ^ (uint32_t)this->now;
+	for (int level = 0; level < WHEEL_LEVELS; ++level) {
+		if ((diff >> (WHEEL_SLOT_BITS * (level + 1))) == 0) {
+			int slot = ((uint32_t)due >> (WHEEL_SLOT_BITS * level)) & WHEEL_SLOT_MASK;
+			this->slots[level][slot].push_back(idx);
+			return;
+		}
+	}
+
+	this->far.push_back(idx);
+}
+
+void TimerWheel::Release(uint32_t idx) {
+	auto &e = this->entries[idx];
+	e.pending = false;
+	e.cancelled = false;
+	e.fn = nullptr;
+	e.generation += 1;
+	this->free.push_back(idx);
+}
+
+void TimerWheel::Replace(std::vector<uint32_t> &list) {
+	std::vector<uint32_t> moving;
+	moving.swap(list);
+	for (uint32_t idx : moving) {
+		if (this->entries[idx].cancelled) {
+			this->Release(idx);
+		} else {
+			this->Place(idx);
+		}
+	}
+}
+
+void TimerWheel::Step() {
+	this->now += 1;
+	uint32_t t = (uint32_t)this->now;
+
+	// Crossing into a new block on some level; spread the matching slot
+	// out over the levels below, from the top down
+	if ((t & ((1u << (WHEEL_SLOT_BITS * WHEEL_LEVELS)) - 1)) == 0) {
+		this->Replace(this->far);
+	}
+	for (int level = WHEEL_LEVELS - 1; level > 0; --level) {
+		if ((t & ((1u << (WHEEL_SLOT_BITS * level)) - 1)) == 0) {
+			this->Replace(this->slots[level][(t >> (WHEEL_SLOT_BITS * level)) & WHEEL_SLOT_MASK]);
+		}
+	}
+
+	this->Replace(this->slots[0][t & WHEEL_SLOT_MASK]);
 }
 
-void Scheduler::InHostTicks(int ticks, std::function<void()> fn) {
+void TimerWheel::Rebuild(int now) {
+	std::vector<uint32_t> all;
+	for (auto &level : this->slots) {
+		for (auto &slot : level) {
+			all.insert(all.end(), slot.begin(), slot.end());
+			slot.clear();
+		}
+	}
+	all.insert(all.end(), this->far.begin(), this->far.end());
+	this->far.clear();
+	all.insert(all.end(), this->ready.begin(), this->ready.end());
+	this->ready.clear();
+
+	// Slots only keep scheduling order, so anything that's become due has
+	// to be put back in due order
+	std::sort(all.begin(), all.end(), [&](uint32_t a, uint32_t b) {
+		auto &ea = this->entries[a];
+		auto &eb = this->entries[b];
+		return ea.due != eb.due ? ea.due < eb.due : (int32_t)(ea.seq - eb.seq) < 0;
+	});
+
+	this->now = now;
+	this->Replace(all);
+}
+
+void TimerWheel::Run(int now) {
+	if (this->count == 0 && this->ready.empty()) {
+		this->Clear();
+		this->now = now;
+		return;
+	}
+
+	if (now < this->now || now - this->now > WHEEL_MAX_STEP) {
+		this->Rebuild(now);
+	} else {
+		while (this->now < now) this->Step();
+	}
+
+	// Callbacks can schedule more callbacks, including ones due right now,
+	// or clear the whole wheel
+	while (!this->ready.empty()) {
+		std::vector<std::pair<uint32_t, uint32_t>> batch;
+		for (uint32_t idx : this->ready) batch.push_back({idx, this->entries[idx].generation});
+		this->ready.clear();
+
+		for (auto [idx, generation] : batch) {
+			auto &e = this->entries[idx];
+			if (!e.pending || e.generation != generation) continue;
+			if (e.cancelled) {
+				this->Release(idx);
+				continue;
+			}
+
+			auto fn = std::move(e.fn);
+			this->Release(idx);
+			this->count -= 1;
+			fn();
+		}
+	}
+}
+
+void TimerWheel::Clear() {
+	for (uint32_t idx = 0; idx < this->entries.size(); ++idx) {
+		if (this->entries[idx].pending) this->Release(idx);
+	}
+	for (auto &level : this->slots) {
+		for (auto &slot : level) slot.clear();
+	}
+	this->far.clear();
+	this->ready.clear();
+	this->count = 0;
+}
+
+#define WHEEL_SERVER 0
+#define WHEEL_HOST 1
+
+static TimerWheel g_scheds[2];
+static std::vector<std::function<void()>> g_mainThreadScheds;
+static std::mutex g_mainThreadMutex;
+
+static int hostTick() {
 	int host, server, client;
 	engine->GetTicks(host, server, client);
-	g_hostScheds.push_back({ host + ticks, fn });
+	return host;
+}
+
+static Scheduler::Handle schedule(int wheel, int now, int ticks, std::function<void()> fn) {
+	Scheduler::Handle h;
+	h.wheel = wheel;
+	h.index = g_scheds[wheel].Add(now, ticks, std::move(fn));
+	h.generation = g_scheds[wheel].Generation(h.index);
+	return h;
+}
+
+Scheduler::Handle Scheduler::InServerTicks(int ticks, std::function<void()> fn) {
+	if (!session->isRunning) return {};
+	return schedule(WHEEL_SERVER, session->GetTick(), ticks, std::move(fn));
+}
+
+Scheduler::Handle Scheduler::InHostTicks(int ticks, std::function<void()> fn) {
+	return schedule(WHEEL_HOST, hostTick(), ticks, std::move(fn));
 }
 
 void Scheduler::OnMainThread(std::function<void()> fn) {
@@ -27,21 +263,17 @@ void Scheduler::OnMainThread(std::function<void()> fn) {
 	g_mainThreadMutex.unlock();
 }
 
+bool Scheduler::Cancel(Scheduler::Handle handle) {
+	if (handle.wheel != WHEEL_SERVER && handle.wheel != WHEEL_HOST) return false;
+	return g_scheds[handle.wheel].Cancel(handle.index, handle.generation);
+}
+
 ON_EVENT(SESSION_START) {
-	g_serverScheds.clear();
+	g_scheds[WHEEL_SERVER].Clear();
 }
 
 ON_EVENT(FRAME) {
-	int host, server, client;
-	engine->GetTicks(host, server, client);
-
-	for (size_t i = 0; i < g_hostScheds.size(); ++i) {
-		if (host >= g_hostScheds[i].first) {
-			g_hostScheds[i].second();
-			g_hostScheds.erase(g_hostScheds.begin() + i);
-			--i;
-		}
-	}
+	g_scheds[WHEEL_HOST].Run(hostTick());
 
 	g_mainThreadMutex.lock();
 	for (auto &f : g_mainThreadScheds) {
@@ -53,11 +285,93 @@ ON_EVENT(FRAME) {
 
 ON_EVENT(PRE_TICK) {
 	if (!session->isRunning) return;
-	for (size_t i = 0; i < g_serverScheds.size(); ++i) {
-		if (session->GetTick() >= g_serverScheds[i].first) {
-			g_serverScheds[i].second();
-			g_serverScheds.erase(g_serverScheds.begin() + i);
-			--i;
+	g_scheds[WHEEL_SERVER].Run(session->GetTick());
+}
+
+CON_COMMAND(sar_scheduler_selftest, "sar_scheduler_selftest [callbacks] - schedules, cancels and runs callbacks on a timer wheel and checks they fire in the same order as on a reference heap\n") {
+	if (args.ArgC() > 2) return console->Print(sar_scheduler_selftest.ThisPtr()->m_pszHelpString);
+
+	int total = args.ArgC() == 2 ? std::atoi(args[1]) : 100000;
+	if (total <= 0) return console->Print(sar_scheduler_selftest.ThisPtr()->m_pszHelpString);
+
+	struct Timer {
+		uint32_t idx;
+		uint32_t generation;
+		bool live;
+	};
+	std::vector<Timer> timers;
+	TimerWheel wheel;
+	std::vector<uint32_t> fired, expected;
+	// (due, id); ids are handed out in scheduling order
+	std::priority_queue<std::pair<int, uint32_t>, std::vector<std::pair<int, uint32_t>>, std::greater<std::pair<int, uint32_t>>> heap;
+
+	uint32_t seed = 1;
+	auto rand = [&](uint32_t n) {
+		seed = seed * 1664525 + 1013904223;
+		return (seed >> 8) % n;
+	};
+
+	auto now = std::chrono::steady_clock::now;
+	std::chrono::steady_clock::duration wheelTime{}, heapTime{};
+	int tick = 0, cancelled = 0, badCancels = 0;
+	while (timers.size() < (size_t)total || !heap.empty()) {
+		for (int n = timers.size() < (size_t)total ? rand(8) : 0; n > 0; --n) {
+			// mostly the next few ticks, some far off enough to go through
+			// every level and past the top one
+			uint32_t r = rand(100);
+			int ticks = r < 60 ? rand(64) : r < 90 ? rand(4096) : r < 99 ? rand(300000) : 0;
+			uint32_t id = timers.size();
+
+			auto start = now();
+			uint32_t idx = wheel.Add(tick, ticks, [&fired, id]() { fired.push_back(id); });
+			timers.push_back({idx, wheel.Generation(idx), true});
+			wheelTime += now() - start;
+
+			start = now();
+			heap.push({tick + ticks, id});
+			heapTime += now() - start;
+		}
+
+		// Mostly recent ones, which are likely still pending. Cancelling
+		// anything that's already run or been cancelled has to fail, even
+		// once its slot is reused.
+		if (!timers.empty() && rand(4) == 0) {
+			auto &t = timers[timers.size() - 1 - rand(std::min<size_t>(timers.size(), 2000))];
+			bool ok = wheel.Cancel(t.idx, t.generation);
+			if (ok != t.live) ++badCancels;
+			if (ok) ++cancelled;
+			t.live = false;
+		}
+
+		// Mostly one tick at a time, sometimes far enough to rebuild the
+		// wheel, and now and then backwards as on a load
+		uint32_t r = rand(1000);
+		tick += r < 900 ? 1 : r < 990 ? rand(200) : r < 998 ? WHEEL_MAX_STEP + rand(100000) : -(int)rand(100);
+
+		auto start = now();
+		wheel.Run(tick);
+		wheelTime += now() - start;
+
+		start = now();
+		while (!heap.empty() && heap.top().first <= tick) {
+			uint32_t id = heap.top().second;
+			heap.pop();
+			if (timers[id].live) {
+				timers[id].live = false;
+				expected.push_back(id);
+			}
 		}
+		heapTime += now() - start;
 	}
+
+	size_t diverged = 0;
+	while (diverged < fired.size() && diverged < expected.size() && fired[diverged] == expected[diverged]) ++diverged;
+	bool ok = fired == expected && badCancels == 0;
+
+	console->Print("%d scheduled, %d cancelled, %d fired over %d ticks\n", total, cancelled, (int)fired.size(), tick);
+	if (fired != expected) console->Print("Firing order differs from the reference at callback %d of %d\n", (int)diverged, (int)expected.size());
+	if (badCancels) console->Print("%d cancels returned the wrong result\n", badCancels);
+	console->Print("Timer wheel: %.2fms\n", std::chrono::duration<float, std::milli>(wheelTime).count());
+	console->Print("Reference heap: %.2fms\n", std::chrono::duration<float, std::milli>(heapTime).count());
+	console->Print("%s\n", ok ? "Scheduler self test passed" : "Scheduler self test FAILED");
 }
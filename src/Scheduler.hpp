@@ -1,7 +1,19 @@
+#pragma once
+#include <cstdint>
 #include <functional>
 
 namespace Scheduler {
-	void InServerTicks(int ticks, std::function<void()> fn);
-	void InHostTicks(int ticks, std::function<void()> fn);
+	// Refers to a callback scheduled in server or host ticks so it can be
+	// cancelled. Cancelling is a no-op once the callback has run or the
+	// schedule has been cleared.
+	struct Handle {
+		int wheel = -1;
+		uint32_t index = 0;
+		uint32_t generation = 0;
+	};
+
+	Handle InServerTicks(int ticks, std::function<void()> fn);
+	Handle InHostTicks(int ticks, std::function<void()> fn);
 	void OnMainThread(std::function<void()> fn);
+	bool Cancel(Handle handle);
 }
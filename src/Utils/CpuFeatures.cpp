@@ -0,0 +1,45 @@
+#include "CpuFeatures.hpp"
+
+#ifdef _WIN32
+#	include <immintrin.h>
+#	include <intrin.h>
+#else
+#	include <cpuid.h>
+#endif
+
+static CpuFeatures detectCpuFeatures() {
+	CpuFeatures features{};
+#ifdef _WIN32
+	int info[4];
+	__cpuid(info, 0);
+	int maxLeaf = info[0];
+	__cpuid(info, 1);
+	features.sse2 = info[3] & (1 << 26);
+	features.pclmul = info[2] & (1 << 1);
+	bool osxsave = info[2] & (1 << 27);
+	if (maxLeaf >= 7 && osxsave && (_xgetbv(0) & 6) == 6) {
+		__cpuidex(info, 7, 0);
+		features.avx2 = info[1] & (1 << 5);
+	}
+#else
+	unsigned a, b, c, d;
+	if (__get_cpuid(1, &a, &b, &c, &d)) {
+		features.sse2 = d & bit_SSE2;
+		features.pclmul = c & bit_PCLMUL;
+		bool osxsave = c & bit_OSXSAVE;
+		if (osxsave && __get_cpuid_max(0, nullptr) >= 7) {
+			unsigned xcr0, xcr0Hi;
+			__asm__ volatile("xgetbv" : "=a"(xcr0), "=d"(xcr0Hi) : "c"(0));
+			__cpuid_count(7, 0, a, b, c, d);
+			features.avx2 = (xcr0 & 6) == 6 && (b & bit_AVX2);
+		}
+	}
+#endif
+	return features;
+}
+
+const CpuFeatures &GetCpuFeatures() {
+	// Function-local so it's safe to use from static initializers
+	static const CpuFeatures features = detectCpuFeatures();
+	return features;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+// Instruction set extensions usable on this machine, for picking
+// between SIMD code paths at runtime. AVX features also require the OS to
+// save the YMM state, so they're only reported if it does.
+struct CpuFeatures {
+	bool sse2;
+	bool pclmul;
+	bool avx2;
+};
+
+const CpuFeatures &GetCpuFeatures();
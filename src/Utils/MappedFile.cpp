@@ -0,0 +1,87 @@
+#include "MappedFile.hpp"
+
+#ifdef _WIN32
+#	include <Windows.h>
+#else
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+	this->Close();
+}
+
+bool MappedFile::Open(const std::string &path) {
+	this->Close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.HighPart != 0) {
+		CloseHandle(file);
+		return false;
+	}
+
+	this->file = file;
+	this->size = size.LowPart;
+	if (this->size == 0) return true;  // Can't map an empty file, but it's not an error
+
+	this->mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!this->mapping) {
+		this->Close();
+		return false;
+	}
+
+	this->data = (const uint8_t *)MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!this->data) {
+		this->Close();
+		return false;
+	}
+#else
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd == -1) return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+		close(fd);
+		return false;
+	}
+
+	this->size = st.st_size;
+	if (this->size == 0) {
+		close(fd);
+		return true;
+	}
+
+	// The mapping keeps its own reference to the file
+	void *data = mmap(NULL, this->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		this->size = 0;
+		return false;
+	}
+
+	madvise(data, this->size, MADV_SEQUENTIAL);
+	this->data = (const uint8_t *)data;
+#endif
+
+	return true;
+}
+
+void MappedFile::Close() {
+#ifdef _WIN32
+	if (this->data) UnmapViewOfFile(this->data);
+	if (this->mapping) CloseHandle(this->mapping);
+	if (this->file) CloseHandle(this->file);
+	this->mapping = nullptr;
+	this->file = nullptr;
+#else
+	if (this->data) munmap((void *)this->data, this->size);
+#endif
+	this->data = nullptr;
+	this->size = 0;
+}
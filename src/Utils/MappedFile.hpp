@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Read-only view of a whole file mapped into memory. The mapping is
+// released when the object is destroyed or Close() is called.
+class MappedFile {
+private:
+	const uint8_t *data = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	void *file = nullptr;
+	void *mapping = nullptr;
+#endif
+
+public:
+	MappedFile() = default;
+	~MappedFile();
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	bool Open(const std::string &path);
+	void Close();
+	const uint8_t *Data() const { return data; }
+	size_t Size() const { return size; }
+};
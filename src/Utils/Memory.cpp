@@ -3,8 +3,16 @@
 #include "Modules/Console.hpp"
 #include "Version.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <climits>
 #include <cstring>
+#include <emmintrin.h>
+#include <fstream>
 #include <memory>
+#include <sys/stat.h>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #ifdef _WIN32
@@ -22,9 +30,12 @@
 #	include <signal.h>
 #endif
 
-#define INRANGE(x, a, b) ((x) >= (a) && (x) <= (b))
-#define getBits(x) (INRANGE(((x) & (~0x20)), 'A', 'F') ? (((x) & (~0x20)) - 'A' + 0xA) : (INRANGE(x, '0', '9') ? x - '0' : 0))
-#define getByte(x) (getBits(x[0]) << 4 | getBits(x[1]))
+#ifdef _WIN32
+#	include <intrin.h>
+#	define SSE2_TARGET
+#else
+#	define SSE2_TARGET __attribute__((target("sse2")))
+#endif
 
 std::vector<Memory::ModuleInfo> Memory::moduleList;
 
@@ -111,7 +122,457 @@ void Memory::CloseModuleHandle(void *moduleHandle) {
 #endif
 }
 
-uintptr_t Memory::FindAddress(const uintptr_t start, const uintptr_t end, const char *target) {
+// How often a byte shows up in x86 code; anchors avoid the common ones so
+// the prefilter rejects as many positions as possible
+static int byteCommonness(uint8_t b) {
+	switch (b) {
+	case 0x00: case 0xFF: case 0x8B: case 0x89: case 0xCC: case 0x90:
+		return 4;
+	case 0x24: case 0x44: case 0x45: case 0x83: case 0xE8: case 0x0F:
+	case 0x55: case 0xEC: case 0xE5: case 0x8D: case 0x04: case 0x01:
+		return 3;
+	case 0x5D: case 0xC3: case 0x85: case 0x74: case 0x75: case 0x10:
+	case 0x08: case 0x53: case 0x56: case 0x57: case 0x5B: case 0x5E:
+	case 0x5F: case 0x50: case 0xC0: case 0x0C: case 0x14: case 0x18:
+		return 2;
+	case 0x1C: case 0x20: case 0x84: case 0xEB: case 0xF3: case 0x66:
+	case 0x06: case 0x02: case 0x03: case 0x40: case 0x80: case 0xC7:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+static int hexValue(char c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 0xA;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 0xA;
+	return -1;
+}
+
+static bool parseSignature(const char *pattern, Memory::Signature *sig) {
+	for (const char *p = pattern; *p;) {
+		if (*p == ' ') {
+			++p;
+		} else if (*p == '?') {
+			sig->bytes.push_back(0);
+			sig->mask.push_back(0);
+			while (*p == '?') ++p;
+		} else {
+			int hi = hexValue(p[0]);
+			int lo = hi < 0 ? -1 : hexValue(p[1]);
+			if (lo < 0) return false;
+			sig->bytes.push_back((uint8_t)(hi << 4 | lo));
+			sig->mask.push_back(0xFF);
+			p += 2;
+		}
+	}
+	if (sig->bytes.empty()) return false;
+
+	// Pick the rarest run of two fixed bytes, or a single fixed byte if the
+	// pattern has no such run
+	int best = INT_MAX;
+	sig->anchor = 0;
+	sig->anchorLen = 0;
+	for (size_t i = 0; i < sig->bytes.size(); ++i) {
+		if (!sig->mask[i]) continue;
+		if (i + 1 < sig->bytes.size() && sig->mask[i + 1]) {
+			int score = byteCommonness(sig->bytes[i]) + byteCommonness(sig->bytes[i + 1]);
+			if (sig->anchorLen < 2 || score < best) {
+				best = score;
+				sig->anchor = i;
+				sig->anchorLen = 2;
+			}
+		} else if (sig->anchorLen < 2) {
+			int score = byteCommonness(sig->bytes[i]) * 2;
+			if (sig->anchorLen == 0 || score < best) {
+				best = score;
+				sig->anchor = i;
+				sig->anchorLen = 1;
+			}
+		}
+	}
+	return true;
+}
+
+static inline bool matchAt(const uint8_t *p, const Memory::Signature *sig) {
+	auto n = sig->bytes.size();
+	for (size_t i = 0; i < n; ++i) {
+		if ((p[i] & sig->mask[i]) != sig->bytes[i]) return false;
+	}
+	return true;
+}
+
+static inline unsigned countTrailingZeros(unsigned x) {
+#ifdef _WIN32
+	unsigned long idx;
+	_BitScanForward(&idx, x);
+	return idx;
+#else
+	return __builtin_ctz(x);
+#endif
+}
+
+// Returns the first position in [begin, last] where the signature matches.
+// Every candidate is verified independently, so overlapping partial matches
+// can't hide a real one.
+SSE2_TARGET static const uint8_t *findAnchored(const uint8_t *begin, const uint8_t *last, const Memory::Signature *sig) {
+	const uint8_t *end = last + sig->bytes.size();
+	auto a = sig->anchor;
+	auto a1 = sig->anchor + sig->anchorLen - 1;
+	auto b0 = _mm_set1_epi8((char)sig->bytes[a]);
+	auto b1 = _mm_set1_epi8((char)sig->bytes[a1]);
+
+	auto p = begin;
+	while ((uintptr_t)(end - p) >= a1 + 16) {
+		auto v0 = _mm_loadu_si128((const __m128i *)(p + a));
+		auto v1 = _mm_loadu_si128((const __m128i *)(p + a1));
+		unsigned m = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(v0, b0), _mm_cmpeq_epi8(v1, b1)));
+		while (m) {
+			auto cand = p + countTrailingZeros(m);
+			if (cand > last) return nullptr;
+			if (matchAt(cand, sig)) return cand;
+			m &= m - 1;
+		}
+		p += 16;
+	}
+	for (; p <= last; ++p) {
+		if (matchAt(p, sig)) return p;
+	}
+	return nullptr;
+}
+
+static std::unordered_map<std::string, std::unique_ptr<Memory::Signature>> g_compiledSigs;
+static std::unordered_set<const Memory::Signature *> g_registeredSigs;
+struct SignatureBatch {
+	std::unordered_map<const Memory::Signature *, uintptr_t> results;  // 0 if not present
+	bool complete = false;  // every registered signature is in results
+};
+static std::unordered_map<std::string, SignatureBatch> g_sigBatches;
+
+struct SignatureCacheEntry {
+	uint64_t size;
+	int64_t mtime;
+	uint32_t hash;
+	int64_t scanUs;
+	std::vector<std::pair<std::string, int64_t>> offsets;  // relative to the module base, -1 if not present
+	std::unordered_set<std::string> wanted;  // patterns actually looked up in this module
+};
+static std::unordered_map<std::string, SignatureCacheEntry> g_sigCache;
+static bool g_sigCacheLoaded = false;
+static bool g_sigCacheDirty = false;
+Memory::SignatureCacheStats Memory::sigCacheStats;
+
+const Memory::Signature *Memory::CompileSignature(const char *pattern) {
+	if (!pattern || !*pattern) return nullptr;
+
+	auto it = g_compiledSigs.find(pattern);
+	if (it != g_compiledSigs.end()) return it->second.get();
+
+	auto sig = std::make_unique<Memory::Signature>();
+	if (!parseSignature(pattern, sig.get())) {
+		if (console) console->DevWarning("Invalid signature \"%s\"\n", pattern);
+		sig = nullptr;
+	}
+	auto ret = sig.get();
+	g_compiledSigs[pattern] = std::move(sig);
+	return ret;
+}
+bool Memory::MatchSignature(uintptr_t address, const Memory::Signature *sig) {
+	return sig && matchAt((const uint8_t *)address, sig);
+}
+uintptr_t Memory::FindSignature(uintptr_t start, uintptr_t end, const Memory::Signature *sig) {
+	if (!sig || end < start || end - start < sig->bytes.size()) return 0;
+	if (sig->anchorLen == 0) return start;
+
+	auto last = (const uint8_t *)(end - sig->bytes.size());
+	return (uintptr_t)findAnchored((const uint8_t *)start, last, sig);
+}
+void Memory::RegisterSignatures(const std::vector<const char *> &patterns) {
+	for (auto pattern : patterns) {
+		auto sig = Memory::CompileSignature(pattern);
+		if (sig) g_registeredSigs.insert(sig);
+	}
+	g_sigBatches.clear();
+}
+
+// Resolves a set of signatures against a module in one pass. Signatures
+// anchored on a byte pair are bucketed by that pair behind a 64K-bit filter,
+// so most positions cost a single bit test; the few anchored on a lone byte
+// get their own SSE2 scan. The pair filter stays scalar: SSE2 has no byte
+// shuffle or gather to test 16 positions against a set of hundreds of
+// anchors at once, and comparing each block against every anchor in turn
+// is the per-signature cost this pass exists to avoid.
+//
+// If we know from a previous launch which signatures this module is asked
+// for, the pass stops once those are found and the batch is left
+// incomplete; anything else is scanned for on demand.
+static void scanBatch(const Memory::ModuleInfo &info, const std::unordered_set<const Memory::Signature *> &sigs, const std::unordered_set<const Memory::Signature *> &wanted, SignatureBatch *batch) {
+	struct Bucket {
+		uint16_t key;
+		bool pending;  // counts towards stopping early
+		const Memory::Signature *sig;
+	};
+	std::vector<Bucket> buckets;
+	std::vector<const Memory::Signature *> singles;
+	std::vector<uint32_t> filter(65536 / 32);
+
+	size_t remaining = 0;
+	bool skipped = false;
+	for (auto sig : sigs) {
+		bool pending = wanted.empty() || wanted.count(sig);
+		if (sig->anchorLen == 2) {
+			uint16_t key = sig->bytes[sig->anchor] | sig->bytes[sig->anchor + 1] << 8;
+			buckets.push_back({key, pending, sig});
+			filter[key >> 5] |= 1u << (key & 31);
+			if (pending) ++remaining;
+		} else if (pending) {
+			singles.push_back(sig);
+		} else {
+			skipped = true;
+		}
+	}
+	std::sort(buckets.begin(), buckets.end(), [](const auto &a, const auto &b) { return a.key < b.key; });
+
+	auto start = info.base;
+	auto end = info.base + info.size;
+	auto pos = start;
+	for (; pos + 1 < end && remaining; ++pos) {
+		auto p = (const uint8_t *)pos;
+		uint16_t key = p[0] | p[1] << 8;
+		if (!(filter[key >> 5] & (1u << (key & 31)))) continue;
+
+		auto it = std::lower_bound(buckets.begin(), buckets.end(), key, [](const auto &a, uint16_t k) { return a.key < k; });
+		for (; it != buckets.end() && it->key == key; ++it) {
+			auto sig = it->sig;
+			if (pos - start < sig->anchor) continue;
+			auto cand = pos - sig->anchor;
+			if (end - cand < sig->bytes.size()) continue;
+			if (batch->results.count(sig)) continue;
+			if (matchAt((const uint8_t *)cand, sig)) {
+				batch->results[sig] = cand;
+				if (it->pending) --remaining;
+			}
+		}
+	}
+
+	for (auto sig : singles) {
+		batch->results[sig] = Memory::FindSignature(start, end, sig);
+	}
+
+	// Without a wanted set everything was pending, so stopping early means
+	// everything was found
+	batch->complete = wanted.empty() || (pos + 1 >= end && !skipped);
+	if (!batch->complete) return;
+	for (auto sig : sigs) {
+		if (!batch->results.count(sig)) batch->results[sig] = 0;
+	}
+}
+
+// Tells builds of a module apart. It has to be the same across launches, so
+// it can't cover anything the loader writes to.
+static uint32_t moduleFingerprint(const Memory::ModuleInfo &info) {
+	// FNV-1a over 32-bit words; only has to tell builds apart, not resist tampering
+	uint32_t hash = 2166136261u;
+#ifdef _WIN32
+	// The mapped image is rebased and includes .data/.bss, so hashing it
+	// would never match twice; the link timestamp and checksum in the PE
+	// header identify the build instead
+	auto dos = (const IMAGE_DOS_HEADER *)info.base;
+	auto nt = (const IMAGE_NT_HEADERS *)(info.base + dos->e_lfanew);
+	uint32_t words[] = {
+		(uint32_t)nt->FileHeader.TimeDateStamp,
+		(uint32_t)nt->OptionalHeader.CheckSum,
+		(uint32_t)nt->OptionalHeader.SizeOfImage,
+	};
+	for (auto word : words) hash = (hash ^ word) * 16777619u;
+#else
+	// info covers just the executable segment, which is position
+	// independent and so identical in every process
+	auto p = (const uint8_t *)info.base;
+	size_t i = 0;
+	for (; i + 4 <= info.size; i += 4) {
+		uint32_t word;
+		memcpy(&word, p + i, 4);
+		hash = (hash ^ word) * 16777619u;
+	}
+	for (; i < info.size; ++i) hash = (hash ^ p[i]) * 16777619u;
+#endif
+	return hash;
+}
+
+static bool getModuleFileInfo(const Memory::ModuleInfo &info, uint64_t *size, int64_t *mtime) {
+	struct stat st;
+	if (!info.path[0] || stat(info.path, &st)) return false;
+	*size = st.st_size;
+	*mtime = st.st_mtime;
+	return true;
+}
+
+static void loadSignatureCache() {
+	g_sigCacheLoaded = true;
+	std::ifstream file(SIGNATURE_CACHE_FILE);
+	if (!file.good()) return;
+
+	std::string line;
+	SignatureCacheEntry *entry = nullptr;
+	while (std::getline(file, line)) {
+		if (line.empty()) continue;
+		auto tab = line.find('\t');
+		if (tab == std::string::npos) continue;
+		if (line.rfind("module\t", 0) == 0) {
+			// module<TAB>path<TAB>size<TAB>mtime<TAB>hash<TAB>scanUs
+			auto fields = std::vector<std::string>();
+			size_t pos = 0;
+			while (pos <= line.size()) {
+				auto next = line.find('\t', pos);
+				if (next == std::string::npos) next = line.size();
+				fields.push_back(line.substr(pos, next - pos));
+				pos = next + 1;
+			}
+			if (fields.size() != 6) {
+				entry = nullptr;
+				continue;
+			}
+			entry = &g_sigCache[fields[1]];
+			entry->size = std::strtoull(fields[2].c_str(), nullptr, 10);
+			entry->mtime = std::strtoll(fields[3].c_str(), nullptr, 10);
+			entry->hash = std::strtoul(fields[4].c_str(), nullptr, 16);
+			entry->scanUs = std::strtoll(fields[5].c_str(), nullptr, 10);
+			entry->offsets.clear();
+			entry->wanted.clear();
+		} else if (entry) {
+			// pattern<TAB>offset[<TAB>w], w if the pattern is looked up in this module
+			char *end;
+			auto pattern = line.substr(0, tab);
+			entry->offsets.push_back({pattern, std::strtoll(line.c_str() + tab + 1, &end, 10)});
+			if (!strcmp(end, "\tw")) entry->wanted.insert(pattern);
+		}
+	}
+}
+
+static void saveSignatureCache() {
+	g_sigCacheDirty = false;
+	std::ofstream file(SIGNATURE_CACHE_FILE, std::ios::out | std::ios::trunc);
+	if (!file.good()) return;
+
+	for (auto &kv : g_sigCache) {
+		char hash[16];
+		snprintf(hash, sizeof hash, "%08X", kv.second.hash);
+		file << "module\t" << kv.first << '\t' << kv.second.size << '\t' << kv.second.mtime << '\t' << hash << '\t' << kv.second.scanUs << '\n';
+		for (auto &offset : kv.second.offsets) {
+			file << offset.first << '\t' << offset.second;
+			if (kv.second.wanted.count(offset.first)) file << "\tw";
+			file << '\n';
+		}
+	}
+}
+
+// Fills the batch from the cache if the module is unchanged and every cached
+// signature still matches at its cached offset. Signatures the entry doesn't
+// cover leave the batch incomplete and are scanned for when asked for.
+static bool loadCachedBatch(const Memory::ModuleInfo &info, uint64_t size, int64_t mtime, uint32_t hash, SignatureBatch *batch) {
+	auto it = g_sigCache.find(info.path);
+	if (it == g_sigCache.end()) return false;
+	auto &entry = it->second;
+	if (entry.size != size || entry.mtime != mtime || entry.hash != hash) return false;
+
+	std::unordered_set<const Memory::Signature *> covered;
+	for (auto &offset : entry.offsets) {
+		auto sig = Memory::CompileSignature(offset.first.c_str());
+		if (!sig || !g_registeredSigs.count(sig)) continue;
+		covered.insert(sig);
+		if (offset.second < 0) {
+			batch->results[sig] = 0;
+			continue;
+		}
+
+		if ((uint64_t)offset.second + sig->bytes.size() > info.size || !Memory::MatchSignature(info.base + offset.second, sig)) {
+			++Memory::sigCacheStats.invalidated;
+			batch->results.clear();
+			return false;
+		}
+		batch->results[sig] = info.base + offset.second;
+	}
+
+	batch->complete = covered.size() == g_registeredSigs.size();
+	return true;
+}
+
+static std::unordered_set<const Memory::Signature *> wantedSignatures(const Memory::ModuleInfo &info) {
+	std::unordered_set<const Memory::Signature *> wanted;
+	auto it = g_sigCache.find(info.path);
+	if (it == g_sigCache.end()) return wanted;
+	for (auto &pattern : it->second.wanted) {
+		auto sig = Memory::CompileSignature(pattern.c_str());
+		if (sig && g_registeredSigs.count(sig)) wanted.insert(sig);
+	}
+	return wanted;
+}
+
+static void resolveBatch(const Memory::ModuleInfo &info, SignatureBatch *batch) {
+	auto start = std::chrono::high_resolution_clock::now();
+
+	if (!g_sigCacheLoaded) loadSignatureCache();
+
+	uint64_t size = 0;
+	int64_t mtime = 0;
+	bool cacheable = getModuleFileInfo(info, &size, &mtime);
+	uint32_t hash = cacheable ? moduleFingerprint(info) : 0;
+
+	if (cacheable && loadCachedBatch(info, size, mtime, hash, batch)) {
+		auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start).count();
+		++Memory::sigCacheStats.hits;
+		Memory::sigCacheStats.signatures += batch->results.size();
+		Memory::sigCacheStats.savedUs += std::max<int64_t>(0, g_sigCache[info.path].scanUs - elapsed);
+		return;
+	}
+
+	scanBatch(info, g_registeredSigs, wantedSignatures(info), batch);
+	++Memory::sigCacheStats.misses;
+	if (!cacheable) return;
+
+	auto &entry = g_sigCache[info.path];
+	entry.size = size;
+	entry.mtime = mtime;
+	entry.hash = hash;
+	entry.scanUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start).count();
+	entry.offsets.clear();
+	for (auto &kv : g_compiledSigs) {
+		auto sig = kv.second.get();
+		if (!sig || !g_registeredSigs.count(sig)) continue;
+		auto result = batch->results.find(sig);
+		if (result == batch->results.end()) continue;
+		entry.offsets.push_back({kv.first, result->second ? (int64_t)(result->second - info.base) : -1});
+	}
+	g_sigCacheDirty = true;
+}
+
+// Records that a signature is looked up in this module, and where it was found
+// if the batch hadn't covered it
+static void noteLookup(const Memory::ModuleInfo &info, const char *pattern, bool resolved, uintptr_t addr) {
+	auto it = g_sigCache.find(info.path);
+	if (it == g_sigCache.end()) return;
+	auto &entry = it->second;
+	if (entry.wanted.insert(pattern).second) g_sigCacheDirty = true;
+	if (resolved) {
+		entry.offsets.push_back({pattern, addr ? (int64_t)(addr - info.base) : -1});
+		g_sigCacheDirty = true;
+	}
+}
+
+void Memory::FlushSignatureCache() {
+	if (g_sigCacheDirty) saveSignatureCache();
+}
+
+// The matcher FindAddress used before signatures were compiled, kept only as
+// a reference for ScanSelfTest. On a mismatch it restarts the pattern at the
+// next byte instead of one past where the partial match began, so a match
+// overlapping a failed partial one is skipped.
+#define INRANGE(x, a, b) ((x) >= (a) && (x) <= (b))
+#define getBits(x) (INRANGE(((x) & (~0x20)), 'A', 'F') ? (((x) & (~0x20)) - 'A' + 0xA) : (INRANGE(x, '0', '9') ? x - '0' : 0))
+#define getByte(x) (getBits(x[0]) << 4 | getBits(x[1]))
+static uintptr_t legacyFindAddress(const uintptr_t start, const uintptr_t end, const char *target) {
 	const char *pattern = target;
 	uintptr_t result = 0;
 
@@ -134,6 +595,98 @@ uintptr_t Memory::FindAddress(const uintptr_t start, const uintptr_t end, const
 	}
 	return 0;
 }
+
+Memory::ScanSelfTestResult Memory::ScanSelfTest(const uint8_t *data, size_t size, const std::vector<const char *> &patterns) {
+	Memory::ScanSelfTestResult res{};
+	auto start = (uintptr_t)data;
+	auto end = start + size;
+
+	std::unordered_set<const Memory::Signature *> sigs;
+	for (auto pattern : patterns) {
+		auto sig = Memory::CompileSignature(pattern);
+		if (sig) sigs.insert(sig);
+	}
+
+	Memory::ModuleInfo info{};
+	strncpy(info.name, "selftest", sizeof info.name - 1);
+	info.base = start;
+	info.size = size;
+
+	auto now = []() { return std::chrono::high_resolution_clock::now(); };
+	auto usSince = [&](auto t) { return (int64_t)std::chrono::duration_cast<std::chrono::microseconds>(now() - t).count(); };
+
+	auto t = now();
+	SignatureBatch batch;
+	scanBatch(info, sigs, {}, &batch);
+	res.batchUs = usSince(t);
+
+	std::unordered_map<const Memory::Signature *, uintptr_t> single;
+	t = now();
+	for (auto sig : sigs) {
+		single[sig] = Memory::FindSignature(start, end, sig);
+	}
+	res.singleUs = usSince(t);
+
+	std::vector<uintptr_t> legacy(patterns.size());
+	t = now();
+	for (size_t i = 0; i < patterns.size(); ++i) {
+		legacy[i] = legacyFindAddress(start, end, patterns[i]);
+	}
+	res.legacyUs = usSince(t);
+
+	// Both compiled scanners must agree on a real match, and can't be later
+	// than a real match the old matcher found. Being earlier is the overlap
+	// bug the old matcher had.
+	std::unordered_set<const Memory::Signature *> seen;
+	for (size_t i = 0; i < patterns.size(); ++i) {
+		auto sig = Memory::CompileSignature(patterns[i]);
+		if (!sig || !seen.insert(sig).second) continue;
+		++res.signatures;
+
+		auto found = batch.results[sig];
+		bool ok = found == single[sig] && (!found || matchAt((const uint8_t *)found, sig));
+		if (legacy[i] && matchAt((const uint8_t *)legacy[i], sig)) ok &= found && found <= legacy[i];
+
+		if (!ok) {
+			++res.mismatches;
+		} else if (found) {
+			++res.found;
+			if (found != legacy[i]) ++res.legacyMissed;
+		}
+	}
+	return res;
+}
+
+uintptr_t Memory::FindAddress(const uintptr_t start, const uintptr_t end, const char *target) {
+	return Memory::FindSignature(start, end, Memory::CompileSignature(target));
+}
+uintptr_t Memory::FindAddress(const Memory::ModuleInfo &info, const char *target) {
+	auto sig = Memory::CompileSignature(target);
+	if (!sig) return 0;
+
+	if (g_registeredSigs.count(sig)) {
+		auto it = g_sigBatches.find(info.name);
+		if (it == g_sigBatches.end()) {
+			it = g_sigBatches.insert({info.name, SignatureBatch()}).first;
+			resolveBatch(info, &it->second);
+		}
+		auto &batch = it->second;
+
+		auto result = batch.results.find(sig);
+		if (result != batch.results.end()) {
+			noteLookup(info, target, false, 0);
+			return result->second;
+		}
+		if (batch.complete) return 0;
+
+		auto addr = Memory::FindSignature(info.base, info.base + info.size, sig);
+		batch.results[sig] = addr;
+		noteLookup(info, target, true, addr);
+		return addr;
+	}
+
+	return Memory::FindSignature(info.base, info.base + info.size, sig);
+}
 uintptr_t Memory::Scan(const char *moduleName, const char *pattern, int offset) {
 	uintptr_t result = 0;
 	if (strlen(pattern) == 0) {
@@ -143,9 +696,7 @@ uintptr_t Memory::Scan(const char *moduleName, const char *pattern, int offset)
 
 	auto info = Memory::ModuleInfo();
 	if (Memory::TryGetModule(moduleName, &info)) {
-		auto start = uintptr_t(info.base);
-		auto end = start + info.size;
-		result = Memory::FindAddress(start, end, pattern);
+		result = Memory::FindAddress(info, pattern);
 		if (result) {
 			result += offset;
 		}
@@ -166,17 +717,18 @@ uintptr_t Memory::Scan(const char *moduleName, const char *pattern, int offset)
 }
 std::vector<uintptr_t> Memory::MultiScan(const char *moduleName, const char *pattern, int offset) {
 	std::vector<uintptr_t> result;
-	auto length = std::strlen(pattern);
+	auto sig = Memory::CompileSignature(pattern);
+	if (!sig) return result;
 
 	auto info = Memory::ModuleInfo();
 	if (Memory::TryGetModule(moduleName, &info)) {
 		auto start = uintptr_t(info.base);
 		auto end = start + info.size;
 		while (true) {
-			auto addr = Memory::FindAddress(start, end, pattern);
+			auto addr = Memory::FindSignature(start, end, sig);
 			if (addr) {
 				result.push_back(addr + offset);
-				start = addr + length;
+				start = addr + sig->bytes.size();
 			} else {
 				break;
 			}
@@ -190,9 +742,7 @@ std::vector<uintptr_t> Memory::Scan(const char *moduleName, const Memory::Patter
 
 	auto info = Memory::ModuleInfo();
 	if (Memory::TryGetModule(moduleName, &info)) {
-		auto start = uintptr_t(info.base);
-		auto end = start + info.size;
-		auto addr = Memory::FindAddress(start, end, pattern->signature);
+		auto addr = Memory::FindAddress(info, pattern->signature);
 		if (addr) {
 			for (auto const &offset : pattern->offsets) {
 				result.push_back(addr + offset);
@@ -210,18 +760,19 @@ std::vector<std::vector<uintptr_t>> Memory::MultiScan(const char *moduleName, co
 		auto moduleEnd = moduleStart + info.size;
 
 		for (const auto &pattern : *patterns) {
-			auto length = std::strlen(pattern->signature);
+			auto sig = Memory::CompileSignature(pattern->signature);
+			if (!sig) continue;
 			auto start = moduleStart;
 
 			while (true) {
-				auto addr = Memory::FindAddress(start, moduleEnd, pattern->signature);
+				auto addr = Memory::FindSignature(start, moduleEnd, sig);
 				if (addr) {
 					auto result = std::vector<uintptr_t>();
 					for (const auto &offset : pattern->offsets) {
 						result.push_back(addr + offset);
 					}
 					results.push_back(result);
-					start = addr + length;
+					start = addr + sig->bytes.size();
 				} else {
 					break;
 				}
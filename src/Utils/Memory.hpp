@@ -30,7 +30,53 @@ namespace Memory {
 	void *GetModuleHandleByName(const char *moduleName);
 	void CloseModuleHandle(void *moduleHandle);
 
+	// Pre-parsed form of a "AA BB ? CC" signature string
+	struct Signature {
+		std::vector<uint8_t> bytes;  // pattern bytes, 0 where wildcarded
+		std::vector<uint8_t> mask;   // 0xFF for fixed bytes, 0x00 for wildcards
+		size_t anchor;               // offset of the rarest fixed byte run, used to prefilter candidates
+		size_t anchorLen;            // 0 (all wildcards), 1 or 2
+	};
+
+	const Signature *CompileSignature(const char *pattern);
+	bool MatchSignature(uintptr_t address, const Signature *sig);
+	uintptr_t FindSignature(uintptr_t start, uintptr_t end, const Signature *sig);
+	// Signatures registered here are resolved together in a single pass the
+	// first time any of them is scanned for in a given module
+	void RegisterSignatures(const std::vector<const char *> &patterns);
+
+#define SIGNATURE_CACHE_FILE "sar_sigcache.txt"
+
+	// Batch results are persisted to SIGNATURE_CACHE_FILE keyed by module path,
+	// size, mtime and a fingerprint of the build (a hash of the executable
+	// segment on Linux, the PE timestamp and checksum on Windows)
+	struct SignatureCacheStats {
+		int hits;         // modules resolved from the cache
+		int misses;       // modules that needed a full scan
+		int invalidated;  // cached modules rejected because a signature no longer matched
+		int signatures;   // signatures resolved from the cache
+		int64_t savedUs;  // scan time avoided through hits
+	};
+	extern SignatureCacheStats sigCacheStats;
+	// Writes the cache file if any module was rescanned since the last write
+	void FlushSignatureCache();
+
+	// Scans a buffer for the given signatures with the batch and single
+	// scanners, and checks them against the matcher used before signatures
+	// were compiled
+	struct ScanSelfTestResult {
+		int signatures;
+		int found;
+		int mismatches;    // compiled results that disagree, aren't a match, or come after the old matcher's
+		int legacyMissed;  // matches the old matcher skipped over
+		int64_t batchUs;
+		int64_t singleUs;
+		int64_t legacyUs;
+	};
+	ScanSelfTestResult ScanSelfTest(const uint8_t *data, size_t size, const std::vector<const char *> &patterns);
+
 	uintptr_t FindAddress(const uintptr_t start, const uintptr_t end, const char *target);
+	uintptr_t FindAddress(const ModuleInfo &info, const char *target);
 	uintptr_t Scan(const char *moduleName, const char *pattern, int offset = 0);
 	std::vector<uintptr_t> MultiScan(const char *moduleName, const char *pattern, int offset = 0);
 
@@ -118,9 +164,7 @@ namespace Memory {
 
 		auto info = Memory::ModuleInfo();
 		if (Memory::TryGetModule(moduleName, &info)) {
-			auto start = uintptr_t(info.base);
-			auto end = start + info.size;
-			result = Memory::FindAddress(start, end, pattern);
+			result = Memory::FindAddress(info, pattern);
 			if (result) {
 				result += offset;
 			}